@@ -128,6 +128,12 @@ public class AudioCore {
 
     public native boolean isSending();
 
+    /**
+     * Time between starting to stream and the playback of the first sample in milliseconds,
+     * -1 if not sending or not chosen yet
+     */
+    public native long getPlayoutLatency();
+
     public void pauseStreaming() {
         mPool.submit(new Runnable() {
             @Override
@@ -21,6 +21,8 @@
 #include "SenderSession.h"
 #include "ReceiverSession.h"
 #include "decoder.h"
+#include "backend/OpenSLSink.h"
+#include "backend/NdkMedia.h"
 
 #include "jrtplib/rtpsourcedata.h"
 
@@ -38,11 +40,18 @@ void thread_exit_handler(int sig) {
 
 // Global audiostream manager
 AudioStreamSession *audioSession;
+OpenSLSink *audioSink;
+AudioPlayer *audioPlayer;
+
+// Used until the sender announces its format
+#define DEFAULT_FORMAT "mime: string(audio/mpeg), sample-rate: int32(44100), channel-count: int32(2), " \
+                       "encoder-delay: int32(576), encoder-padding: int32(1579)"
 
 void Java_de_rwth_1aachen_comsys_audiosync_AudioCore_initAudio(JNIEnv *env, jobject thiz,
                                                                jint samplesPerSec,
                                                                jint framesPerBuffer) {
-    audioplayer_initGlobal((uint32_t) samplesPerSec, (uint32_t) framesPerBuffer);
+    audioSink = new OpenSLSink((uint32_t) samplesPerSec, (uint32_t) framesPerBuffer);
+    audioPlayer = new AudioPlayer(audioSink);
 
 #ifdef RTP_SUPPORT_THREAD
     // Workaround to kill threads since pthread_cancel is not supported
@@ -59,7 +68,11 @@ void Java_de_rwth_1aachen_comsys_audiosync_AudioCore_initAudio(JNIEnv *env, jobj
 void Java_de_rwth_1aachen_comsys_audiosync_AudioCore_deinitAudio(JNIEnv *env, jobject thiz) {
     if (audioSession) audioSession->Stop();
     if (audioSession) delete audioSession;
-    audioplayer_cleanup();
+    audioSession = NULL;
+    if (audioPlayer) delete audioPlayer;
+    audioPlayer = NULL;
+    if (audioSink) delete audioSink;
+    audioSink = NULL;
 }
 
 
@@ -84,7 +97,7 @@ void Java_de_rwth_1aachen_comsys_audiosync_AudioCore_startStreamingAsset (JNIEnv
 
     debugLog("Audio file offset: %ld, size: %ld", outStart, fileSize);
     AMediaExtractor *extr = decoder_createExtractorFromFd(fd, outStart, fileSize);
-    audioSession = SenderSession::StartStreaming((uint16_t) portbase, extr);
+    audioSession = SenderSession::StartStreaming((uint16_t) portbase, new ExtractorSource(extr));
 
     AAsset_close(asset);
 }
@@ -95,7 +108,7 @@ void Java_de_rwth_1aachen_comsys_audiosync_AudioCore_startStreamingUri
     const char *path = env->GetStringUTFChars(jPath, 0);
     AMediaExtractor *extr = decoder_createExtractorFromUri(path);
     env->ReleaseStringUTFChars(jPath, path);
-    audioSession = SenderSession::StartStreaming((uint16_t) portbase, extr);
+    audioSession = SenderSession::StartStreaming((uint16_t) portbase, new ExtractorSource(extr));
 }
 
 /*
@@ -106,7 +119,9 @@ void Java_de_rwth_1aachen_comsys_audiosync_AudioCore_startStreamingUri
 void Java_de_rwth_1aachen_comsys_audiosync_AudioCore_startReceiving(JNIEnv *env, jobject thiz,
                                                                     jstring jHost, jint portbase) {
     const char *host = env->GetStringUTFChars(jHost, 0);
-    audioSession = ReceiverSession::StartReceiving(host, (uint16_t) portbase);
+    audioSession = ReceiverSession::StartReceiving(host, (uint16_t) portbase,
+                                                   &MediaCodecDecoder::Create, audioPlayer,
+                                                   DEFAULT_FORMAT);
     env->ReleaseStringUTFChars(jHost, host);
 }
 
@@ -117,12 +132,12 @@ void Java_de_rwth_1aachen_comsys_audiosync_AudioCore_startReceiving(JNIEnv *env,
  */
 void Java_de_rwth_1aachen_comsys_audiosync_AudioCore_stopServices(JNIEnv *env, jobject thiz) {
     if (audioSession) audioSession->Stop();
-    audioplayer_stopPlayback();
+    if (audioPlayer) audioPlayer->StopPlayback();
 }
 
 void Java_de_rwth_1aachen_comsys_audiosync_AudioCore_setDeviceLatency(JNIEnv *env, jobject thiz,  jlong latencyMs) {
-    if (latencyMs >= 0)
-        audioplayer_setDeviceLatency((int64_t)latencyMs * 1000);
+    if (latencyMs >= 0 && audioPlayer)
+        audioPlayer->SetDeviceLatency((int64_t)latencyMs * 1000);
 }
 
 /*
@@ -163,7 +178,7 @@ jobjectArray Java_de_rwth_1aachen_comsys_audiosync_AudioCore_getAudioDestination
 
                 jobject dest = env->NewObject(clzz, init);
                 env->SetObjectField(dest, nameID, env->NewStringUTF(chars));
-                env->SetIntField(dest, jitterID, (jint) sourceData->INF_GetJitter());
+                env->SetIntField(dest, jitterID, (jint) AudioStreamSession::SourceJitterUs(sourceData));
                 env->SetIntField(dest, timeOffsetID, (jint)sourceData->GetClockOffsetUSeconds());
                 env->SetIntField(dest, packetsLostID, (jint) sourceData->RR_GetPacketsLost());
                 env->SetObjectArrayElement(ret, i, dest);
@@ -206,3 +221,11 @@ void Java_de_rwth_1aachen_comsys_audiosync_AudioCore_pauseSending
         // TODO
     }
 }
+
+jlong Java_de_rwth_1aachen_comsys_audiosync_AudioCore_getPlayoutLatency(JNIEnv *, jobject) {
+    if (audioSession != NULL && audioSession->IsSender()) {
+        SenderSession *sender = (SenderSession *)audioSession;
+        if (sender->PlayoutLeadUs() > 0) return (jlong)(sender->PlayoutLeadUs() / 1000);
+    }
+    return -1;
+}
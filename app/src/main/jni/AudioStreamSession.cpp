@@ -16,9 +16,11 @@
 #include <stdint.h>
 #include <string>
 #include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
 #include <android/log.h>
 
-#include "libmsntp/libmsntp.h"
 #include "jrtplib/rtpsession.h"
 #include "jrtplib/rtppacket.h"
 #include "jrtplib/rtpsourcedata.h"
@@ -31,12 +33,14 @@
 #include "AudioStreamSession.h"
 #include "audioplayer.h"
 #include "apppacket.h"
-#include "decoder.h"
 
 #define debugLog(...) __android_log_print(ANDROID_LOG_DEBUG, "AudioSync", __VA_ARGS__)
 
 using namespace jrtplib;
 
+static RTPImpairmentParams _impairment;
+static uint32_t _impairedSessions = 0;
+
 static void _checkerror(int rtperr) {
     if (rtperr < 0) {
         debugLog("RTP Error: %s", RTPGetErrorString(rtperr).c_str());
@@ -47,10 +51,104 @@ static void _checkerror(int rtperr) {
 void AudioStreamSession::log(const char *logStr, ...) {
     va_list ap;
     va_start(ap, logStr);
-#ifdef __ANDROID__
     __android_log_vprint(ANDROID_LOG_DEBUG, "AudioStreamSession", logStr, ap);
-#else
-    vprintf(logStr, ap);
-#endif
     va_end(ap);
-}
\ No newline at end of file
+}
+
+int64_t AudioStreamSession::SourceJitterUs(const RTPSourceData *source) {
+    return (int64_t) (source->INF_GetJitter() * AUDIOSYNC_TIMESTAMP_UNITS * SECOND_MICRO);
+}
+
+int64_t AudioStreamSession::SystemTimeUs(const RTPTime &receivetime) {
+    RTPTime age = RTPTime::CurrentTime();
+    age -= receivetime;
+    return audiosync_systemTimeUs() - (age.GetSeconds() * SECOND_MICRO + age.GetMicroSeconds());
+}
+
+void AudioStreamSession::RunNetwork() {
+    while (isRunning) {
+        int64_t wakeUs = RunNetworkStep();
+        if (wakeUs < 0) break;
+
+        int64_t waitUs = wakeUs - audiosync_monotonicTimeUs();
+        if (pollsNetwork && IsActive()) {
+            // Poll sends the RTCP packets as well
+            int64_t rtcpUs = (int64_t) (GetRTCPDelay().GetDouble() * SECOND_MICRO);
+            if (rtcpUs < waitUs) waitUs = rtcpUs;
+            if (waitUs > 0) {
+                bool dataAvailable;
+                WaitForIncomingData(RTPTime((uint32_t) (waitUs / SECOND_MICRO),
+                                            (uint32_t) (waitUs % SECOND_MICRO)), &dataAvailable);
+            }
+            Poll();
+        } else if (waitUs > 0) {
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            wakeCondition.wait_for(lock, std::chrono::microseconds(waitUs),
+                                   [this] { return wakeRequested || !isRunning; });
+            wakeRequested = false;
+        }
+    }
+}
+
+void AudioStreamSession::Wake() {
+    std::lock_guard<std::mutex> lock(wakeMutex);
+    wakeRequested = true;
+    wakeCondition.notify_one();
+}
+
+bool AudioStreamSession::WakeRequested() {
+    std::lock_guard<std::mutex> lock(wakeMutex);
+    bool requested = wakeRequested;
+    wakeRequested = false;
+    return requested;
+}
+
+void AudioStreamSession::Leave(const RTPTime &maxWaitTime) {
+    BYEDestroy(drivenExternally ? RTPTime(0, 0) : maxWaitTime, 0, 0);
+}
+
+void *AudioStreamSession::RunNetworkThread(void *ctx) {
+    ((AudioStreamSession *) ctx)->RunNetwork();
+    return NULL;
+}
+
+void AudioStreamSession::SetNetworkImpairment(const RTPImpairmentParams &params) {
+    _impairment = params;
+    _impairedSessions = 0;
+}
+
+static RTPTime _millis(double ms) {
+    return RTPTime(ms / 1000.0);
+}
+
+bool AudioStreamSession::ParseNetworkImpairment(const char *profile,
+                                                RTPImpairmentParams *params) {
+    std::string str(profile);
+    char *saveptr = NULL;
+    for (char *tok = strtok_r(&str[0], ",", &saveptr); tok != NULL;
+         tok = strtok_r(NULL, ",", &saveptr)) {
+        char key[16];
+        double a = 0, b = 0;
+        int n = sscanf(tok, "%15[a-z]=%lf/%lf", key, &a, &b);
+        if (n < 2) return false;
+
+        if (strcmp(key, "loss") == 0) params->SetLossProbability(a);
+        else if (strcmp(key, "burst") == 0 && n == 3) params->SetBurstLoss(a, b);
+        else if (strcmp(key, "delay") == 0) params->SetDelay(_millis(a), params->GetJitter());
+        else if (strcmp(key, "jitter") == 0) params->SetDelay(params->GetBaseDelay(), _millis(a));
+        else if (strcmp(key, "reorder") == 0 && n == 3) params->SetReorder(a, _millis(b));
+        else if (strcmp(key, "dup") == 0) params->SetDuplicateProbability(a);
+        else if (strcmp(key, "seed") == 0) params->SetSeed((uint32_t) a);
+        else return false;
+    }
+    return true;
+}
+
+void AudioStreamSession::ApplyNetworkImpairment(RTPSessionParams &sessparams) {
+    if (!_impairment.IsEnabled()) return;
+
+    RTPImpairmentParams params = _impairment;
+    params.SetSeed(_impairment.GetSeed() + _impairedSessions++);
+    sessparams.SetImpairmentParams(params);
+    debugLog("Impairing network with seed %u", params.GetSeed());
+}
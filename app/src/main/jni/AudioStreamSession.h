@@ -13,29 +13,34 @@
 #ifndef AUDIOSYNC_STREAM
 #define AUDIOSYNC_STREAM
 
-#include <media/NdkMediaFormat.h>
 #include <pthread.h>
+#include <condition_variable>
+#include <mutex>
 #include "jrtplib/rtpsession.h"
+#include "jrtplib/rtpsessionparams.h"
+#include "mempool.h"
 
 class AudioStreamSession : public jrtplib::RTPSession {
 public:
+    /**
+     * @param mgr  used for all allocations of the session and must be used by its transmitter
+     */
+    AudioStreamSession(jrtplib::RTPMemoryManager *mgr = MemoryManager())
+            : RTPSession(NULL, mgr) { }
+
     virtual ~AudioStreamSession() {
         log("Deallocating AudioStream");
-        if (format) AMediaFormat_delete(format);
     }
 
     virtual void Stop() {
         if (isRunning) {
             isRunning = false;// Should kill them all
+            Wake();
 
             if (networkThread && pthread_join(networkThread, NULL)) {
                 //perror("Error joining thread");
             }
             networkThread = 0;
-            if (ntpThread && pthread_join(ntpThread, NULL)) {
-                //perror("Error joining thread");
-            }
-            ntpThread = 0;
         }
     };
 
@@ -50,12 +55,87 @@ public:
 
     virtual int64_t CurrentPlaybackTimeUs() = 0;
 
+    /**
+     * Does whatever work is due in the network loop. Sessions without their own threads
+     * (see CreateWithTransmitter) are driven by calling Poll() and this method repeatedly.
+     * @return monotonic time in microseconds when this wants to be called again, -1 when done
+     */
+    virtual int64_t RunNetworkStep() = 0;
+
+    /**
+     * Asks for RunNetworkStep to be called right away, e.g. from a callback of the jrtplib
+     * poll thread. Wakes up the network thread, if it is sleeping rather than polling.
+     */
+    void Wake();
+
+    /**
+     * Whether Wake was called since the last time this was asked. For owners which call
+     * RunNetworkStep themselves.
+     */
+    bool WakeRequested();
+
+    /**
+     * Degrades the packets received by all sessions created afterwards, to test them on a bad
+     * network. Every session uses its own seed, counting up from the one in params.
+     */
+    static void SetNetworkImpairment(const jrtplib::RTPImpairmentParams &params);
+
+    /**
+     * Parses a profile like "loss=0.02,burst=0.01/0.25,delay=5,jitter=30,reorder=0.01/20,dup=0.01,seed=7",
+     * all times in milliseconds. Returns false if the profile is malformed.
+     */
+    static bool ParseNetworkImpairment(const char *profile, jrtplib::RTPImpairmentParams *params);
+
+    /**
+     * RFC 3550 interarrival jitter of the source's RTP packets, jrtplib keeps it in timestamp
+     * units. 0 until the source sent any.
+     */
+    static int64_t SourceJitterUs(const jrtplib::RTPSourceData *source);
+
+    /**
+     * Memory manager the sender and receivers share, all their packets and the objects around
+     * them are reused from its pool
+     */
+    static PoolMemoryManager *MemoryManager() {
+        return PoolMemoryManager::Shared();
+    }
+
 protected:
-    pthread_t networkThread = 0, ntpThread = 0;
+    pthread_t networkThread = 0;
     bool isRunning = true;
-    AMediaFormat *format;
+    // Set if the owner calls RunNetworkStep instead of the network thread
+    bool drivenExternally = false;
+    // Set if the network thread polls the session instead of a jrtplib poll thread
+    bool pollsNetwork = false;
+    std::mutex wakeMutex;
+    std::condition_variable wakeCondition;
+    bool wakeRequested = false;
 
     void log(const char *logStr, ...);
+
+    /**
+     * Calls RunNetworkStep and sleeps until it wants to be called again. With pollsNetwork
+     * incoming packets and RTCP which is due wake it up early, otherwise Wake() does.
+     */
+    virtual void RunNetwork();
+
+    /**
+     * Sends the BYE packet and destroys the session, waits at most maxWaitTime for it
+     * to be sent. Externally driven sessions must not block, they don't wait at all.
+     */
+    void Leave(const jrtplib::RTPTime &maxWaitTime);
+
+    /**
+     * Call on the session params before creating the session, enables the network impairment
+     */
+    static void ApplyNetworkImpairment(jrtplib::RTPSessionParams &sessparams);
+
+    /**
+     * The system time at which a packet was received, from its receivetime
+     */
+    static int64_t SystemTimeUs(const jrtplib::RTPTime &receivetime);
+
+    static void *RunNetworkThread(void *ctx);
 };
 
 // Initializer functions
@@ -65,14 +145,22 @@ protected:
 // TODO An error callback would be nice
 
 
-#define AUDIOSYNC_SNTP_PORT_OFFSET 3
 // IMPORTANT: The local timestamp unit MUST be set, otherwise
 //            RTCP Sender Report info will be calculated wrong
-//            In this case, we'll be sending 1000 samples each second, so we'll
-//            put the timestamp unit to (1.0/1000.0)
-// AMediaExtractor uses microseconds too, so we can transport the correct playback time
-#define AUDIOSYNC_TIMESTAMP_UNITS (1.0 / 48000.0)
+// The RTP timestamps count microseconds of media time, like the sample times of
+// AMediaExtractor. The receivers set it for the sender, jrtplib's jitter is in this unit.
+#define AUDIOSYNC_TIMESTAMP_UNITS (1.0 / 1000000.0)
 // Random extension id
 #define AUDIOSYNC_EXTENSION_HEADER_ID 7
+// The extension carries the playback time (int64), fragments of a frame that did not fit
+// into one packet append a word with these flags and the fragment index in the lower bits.
+// All fragments of a frame share the RTP timestamp. Everything in network byte order.
+#define AUDIOSYNC_EXTENSION_FRAGMENT_SIZE (sizeof(int64_t) + sizeof(uint32_t))
+#define AUDIOSYNC_FRAGMENT_START 0x80000000u
+#define AUDIOSYNC_FRAGMENT_END 0x40000000u
+#define AUDIOSYNC_FRAGMENT_INDEX_MASK 0x0000FFFFu
+// Default path MTU, the worst case IPv6 + UDP headers are subtracted from it
+#define AUDIOSYNC_DEFAULT_MTU 1500
+#define AUDIOSYNC_IP_UDP_OVERHEAD (40 + 8)
 
 #endif
\ No newline at end of file
@@ -8,7 +8,6 @@
 
 #define debugLog(...) __android_log_print(ANDROID_LOG_DEBUG, "ReceiverSession", __VA_ARGS__)
 
-#include "libmsntp/libmsntp.h"
 #include "jrtplib/rtppacket.h"
 #include "jrtplib/rtpsourcedata.h"
 #include "jrtplib/rtpudpv4transmitter.h"
@@ -17,10 +16,14 @@
 
 #include "apppacket.h"
 #include "audioplayer.h"
-#include "decoder.h"
+#include "backend/ThreadedDecoder.h"
+#include <algorithm>
 #include <cinttypes>
+#include <string.h>
 
-#define NTP_PACKET_INTERVAL_SEC 5
+#define STATUS_INTERVAL_SEC 1
+// The player corrects its rate and position from here, it is fed on every packet as well
+#define MONITOR_INTERVAL_US 20000
 
 using namespace jrtplib;
 
@@ -31,146 +34,268 @@ static void _checkerror(int rtperr) {
     }
 }
 
+static int _stageCPUs[3] = {-1, -1, -1};
+
+void ReceiverSession::SetStageCPUs(int networkCPU, int decodeCPU, int outputCPU) {
+    _stageCPUs[0] = networkCPU;
+    _stageCPUs[1] = decodeCPU;
+    _stageCPUs[2] = outputCPU;
+}
+
 void ReceiverSession::RunNetwork() {
-    log("Sending Hi package");
-    const char *hi = "HI";
-    int status = SendPacket(hi, sizeof(hi), 0, false,
-                            sizeof(hi));// Say Hi, should cause the server to send data
-    _checkerror(status);
+    if (audiosync_setThreadCPU(networkCPU) != 0) log("Could not pin the network thread");
+    AudioStreamSession::RunNetwork();
+    if (state != Joining && state != WaitingForFormat) player->StopPlayback();
+}
 
-    while (codec == NULL && isRunning) {
-        log("Waiting for codec RTCP package...");
-        RTPTime::Wait(RTPTime(1, 0));// Wait 1s
-    }
-    if (!isRunning) return;
-
-    // Start decoder
-    status = AMediaCodec_start(codec);
-    if (status != AMEDIA_OK) return;
-    log("Started decoder");
-
-    // Extracting format data
-    int32_t samples = 44100, channels = 1;
-    AMediaFormat_getInt32(format, AMEDIAFORMAT_KEY_SAMPLE_RATE, &samples);
-    AMediaFormat_getInt32(format, AMEDIAFORMAT_KEY_CHANNEL_COUNT, &channels);
-    audioplayer_initPlayback((uint32_t) samples, (uint32_t) channels);
-
-    bool hasInput = true, hasOutput = true;
-    int32_t beginTimestamp = -1, lastTimestamp = 0;
-    uint16_t lastSeqNum = 0;
-    while (hasInput && isRunning) {
-        BeginDataAccess();
-        if (GotoFirstSourceWithData()) {
-            do {
-                RTPPacket *pack;
-                while ((pack = GetNextPacket()) != NULL) {
-                    // We repurposed the marker flag as end of file
-                    hasInput = !pack->HasMarker();
-
-                    // Calculate playback time and do some lost package corrections
-                    uint32_t timestamp = pack->GetTimestamp();
-                    if (beginTimestamp == -1) {// record first timestamp and use differences
-                        beginTimestamp = timestamp;
-                        lastSeqNum = pack->GetSequenceNumber() - (uint16_t) 1;
-                    }
-                    timestamp -= beginTimestamp;
-                    if (pack->HasExtension()
-                        && pack->GetExtensionID() == AUDIOSYNC_EXTENSION_HEADER_ID
-                        && pack->GetExtensionLength() == sizeof(int64_t)) {
-                        int64_t *usec = (int64_t*) pack->GetExtensionData();
-                        audioplayer_syncPlayback(ntohq(*usec), timestamp);
-                    }
-
-                    /*if (pack->HasExtension()) {
-                        debugLog("Ext: %" PRIu16 " %lld", pack->GetExtensionID(), (long long)pack->GetExtensionLength());
-                    }*/
-
-                    // Handle lost packets, TODO How does this work with multiple senders?
-                    if (pack->GetSequenceNumber() != lastSeqNum + 1) {
-                        // TODO handle mutliple packages with same timestamp. (Decode together?)
-                        /*if (timestamp == lastTimestamp)*/
-                        log("Packets jumped %u => %u | %.2f => %.2fs.", lastSeqNum,
-                            pack->GetSequenceNumber(), lastTimestamp / 1E6,
-                            timestamp / 1E6);
-                        // TODO evaluate the impact of this time gap parameter
-                        if (timestamp - lastTimestamp > SECOND_MICRO/20) {//50 ms
-                            // According to the docs we need to flushIf data is not adjacent.
-                            // It is unclear how big these gaps can be and still be tolerable.
-                            // During testing this call did cause the codec
-                            // to throw errors. most likely in combination with splitted packages,
-                            // where one of a a set of packages with the same timestamp got lost
-                            log("Flushing codec");
-                            AMediaCodec_flush(codec);
-                        }
-                    }
-                    lastSeqNum = pack->GetSequenceNumber();
-                    lastTimestamp = timestamp;
-
-                    if (hasInput) {
-                        //log("Received %.2f", timestamp / 1000000.0);
-                        uint8_t *payload = pack->GetPayloadData();
-                        size_t length = pack->GetPayloadLength();
-                        status = decoder_enqueueBuffer(codec, payload, length, (int64_t) timestamp);
-                        if (status != AMEDIA_OK) hasInput = false;
-                    } else {
-                        log("Receiver: End of file");
-                        // Tell the codec we are done
-                        decoder_enqueueBuffer(codec, NULL, -1, (int64_t) timestamp);
-                    }
-                    hasOutput = decoder_dequeueBuffer(codec, &audioplayer_enqueuePCMFrames);
-
-                    DeletePacket(pack);
+int64_t ReceiverSession::RunNetworkStep() {
+    int64_t nowUs = audiosync_monotonicTimeUs();
+    switch (state) {
+        case Joining: {
+            log("Sending Hi package");
+            const char hi[] = "HI";
+            int status = SendPacket(hi, sizeof(hi), 0, false,
+                                    sizeof(hi));// Say Hi, should cause the server to send data
+            _checkerror(status);
+            state = WaitingForFormat;
+            ProbeClock(nowUs);// Starts the clock sync while we wait for the format
+            return nowUs;
+        }
+
+        case WaitingForFormat:
+            if (decoder == NULL) {
+                log("Waiting for codec RTCP package...");
+                // The sender waits for us, keep this short
+                return std::min(nowUs + SECOND_MICRO / 10, ProbeClock(nowUs));
+            }
+
+            // Start decoder, externally driven sessions decode synchronously
+            concealer.Init(player, decoder->SampleRate(), decoder->NumChannels());
+            if (!drivenExternally) {
+                decoder = new ThreadedDecoder(decoder, &concealer, decodeCPU, outputCPU);
+            }
+            if (decoder->Start() != 0) return -1;
+            log("Started decoder");
+
+            player->InitPlayback(decoder->SampleRate(), decoder->NumChannels());
+            startupUs += audiosync_monotonicTimeUs() - nowUs;
+            state = Receiving;
+            return nowUs;
+
+        case Receiving: {
+            // Called whenever packets arrived or a timer is due
+            ProcessPackets();
+            if (!timers.IsScheduled(MonitorTimer)) timers.Schedule(MonitorTimer, nowUs);
+            if (clockSyncEnabled && !timers.IsScheduled(ClockTimer)) {
+                timers.Schedule(ClockTimer, nextProbeUs);
+            }
+            // Only ready once our clock is in sync, the sender can't play us earlier
+            if ((!clockSyncEnabled || clock.IsReady()) && !timers.IsScheduled(StatusTimer)) {
+                timers.Schedule(StatusTimer, nowUs);
+            }
+
+            int timer;
+            while ((timer = timers.Expire(nowUs)) >= 0) {
+                switch (timer) {
+                    case MonitorTimer:
+                        player->MonitorPlayback();
+                        timers.Schedule(MonitorTimer, nowUs + MONITOR_INTERVAL_US);
+                        break;
+                    case StatusTimer:
+                        SendReceiverStatus();
+                        timers.Schedule(StatusTimer, nowUs + STATUS_INTERVAL_SEC * SECOND_MICRO);
+                        break;
+                    case NackTimer:
+                        SendNACK(nowUs);
+                        break;
+                    case ReleaseTimer:// ProcessPackets passed the held packets on already
+                        break;
+                    case ClockTimer:
+                        timers.Schedule(ClockTimer, ProbeClock(nowUs));
+                        break;
                 }
-            } while (GotoNextSourceWithData());
+            }
+            if (hasInput) {
+                ScheduleDeadlines(nowUs);
+                return timers.NextDueUs();
+            }
+
+            log("Received all data, ending RTP session.");
+            log("FEC recovered %" PRIu64 " packets, %" PRIu64 " were unrecoverable",
+                fec.Recovered(), fec.Unrecoverable());
+            if (nackEnabled) {
+                log("Requested %" PRIu64 " retransmissions, %" PRIu64 " packets arrived",
+                    nack.Requested(), nack.Repaired());
+            }
+            log("Jitter buffer: %" PRIu64 " packets lost, %" PRIu64 " late, reorder depth %u, "
+                "%.1f packets held on average", jitter.Lost(), jitter.LateDrops(),
+                jitter.ReorderDepth(), jitter.MeanOccupancy());
+            PoolStats pool = MemoryManager()->TotalStats();
+            log("Memory pool: %" PRId64 " of %zu buffers used at most, %" PRIu64
+                " allocations went to the heap", pool.highWater, pool.capacity, pool.fallbacks);
+            Leave(RTPTime(1, 0));
+            state = Draining;
+            return nowUs;
         }
-        EndDataAccess();
-
-        struct timespec req;
-        req.tv_sec = 0;
-        req.tv_nsec = 1000*1000;
-        audioplayer_monitorPlayback();
-        // We should give other threads the opportunity to run
-        nanosleep(&req, NULL);// TODO base time on duration of received audio?
-        audioplayer_monitorPlayback();
-    }
-    log("Received all data, ending RTP session.");
-    BYEDestroy(RTPTime(1, 0), 0, 0);
 
-    while (hasOutput && status == AMEDIA_OK && isRunning) {
-        hasOutput = decoder_dequeueBuffer(codec, &audioplayer_enqueuePCMFrames);
-        RTPTime::Wait(RTPTime(0, 5000));
+        case Draining:
+            if (hasOutput && decoderStatus == 0) {
+                hasOutput = decoder->DequeueBuffer(&concealer);
+                return nowUs + 5000;
+            }
+            decoder->Stop();
+            log("Finished decoding, concealed %" PRIu64 " gaps with %.1f ms of audio",
+                concealer.Gaps(), concealer.ConcealedUs() / 1E3);
+            state = Playing;
+            return nowUs;
+
+        case Playing:
+            player->MonitorPlayback();
+            return nowUs + 50000;// 50ms
     }
-    AMediaCodec_stop(codec);
-    log("Finished decoding");
+    return -1;
+}
 
-    while(isRunning) {
-        audioplayer_monitorPlayback();
-        RTPTime::Wait(RTPTime(0, 50000));// 10ms
+void ReceiverSession::ProcessPackets() {
+    RTPPacket *pack;
+    RTPTime now = RTPTime::CurrentTime();
+    BeginDataAccess();
+    if (GotoFirstSourceWithData()) {
+        do {
+            RTPSourceData *source = GetCurrentSourceInfo();
+            while ((pack = GetNextPacket()) != NULL) {
+                if (nackEnabled) nack.Received(pack->GetSequenceNumber(), audiosync_monotonicTimeUs());
+                // Parity packets only serve to rebuild lost packets in the jitter buffer
+                if (pack->GetPayloadType() == AUDIOSYNC_FEC_PAYLOAD_TYPE) fec.Add(pack, now);
+                else jitter.Insert(pack, now);
+            }
+            jitterUs = SourceJitterUs(source);
+            rttUs = (int64_t) (source->INF_GetRoundtripTime().GetDouble() * SECOND_MICRO);
+            jitter.SetJitter(NetworkJitterUs());
+        } while (GotoNextSourceWithData());
     }
-    audioplayer_stopPlayback();
+
+    // Packets come out in order, once the ones before them arrived or were given up
+    fec.Resolve(jitter, now);
+    uint32_t lost;
+    while ((pack = jitter.Next(now, &lost)) != NULL) ProcessPacket(pack, lost);
+    EndDataAccess();
 }
 
-void ReceiverSession::SetFormat(AMediaFormat *newFormat) {
+void ReceiverSession::ProcessPacket(RTPPacket *pack, uint32_t lost) {
+    // We repurposed the marker flag as end of file
+    hasInput = !pack->HasMarker();
 
-    const char *mime;
-    if (AMediaFormat_getString(newFormat, AMEDIAFORMAT_KEY_MIME, &mime)) {
-        log("New format %s and creating codec", mime);
+    // Calculate playback time and do some lost package corrections
+    uint32_t timestamp = pack->GetTimestamp();
+    if (beginTimestamp == -1) {// record first timestamp and use differences
+        beginTimestamp = timestamp;
+        lastSeqNum = pack->GetSequenceNumber() - (uint16_t) 1;
+    }
+    timestamp -= beginTimestamp;
+    bool isFragment = false;
+    uint32_t fragment = 0;
+    if (pack->HasExtension()
+        && pack->GetExtensionID() == AUDIOSYNC_EXTENSION_HEADER_ID
+        && pack->GetExtensionLength() >= sizeof(int64_t)) {
+        int64_t usec;
+        memcpy(&usec, pack->GetExtensionData(), sizeof(int64_t));
+        player->SyncPlayback(ntohq(usec), timestamp);
+
+        if (pack->GetExtensionLength() == AUDIOSYNC_EXTENSION_FRAGMENT_SIZE) {
+            memcpy(&fragment, pack->GetExtensionData() + sizeof(int64_t),
+                   sizeof(uint32_t));
+            fragment = ntohl(fragment);
+            isFragment = true;
+        }
+    }
 
-        AMediaCodec *newCodec = AMediaCodec_createDecoderByType(mime);
-        if (newCodec) {
-            int status = AMediaCodec_configure(newCodec, newFormat, NULL, NULL, 0);
-            if (status != AMEDIA_OK) return;
+    /*if (pack->HasExtension()) {
+        debugLog("Ext: %" PRIu16 " %lld", pack->GetExtensionID(), (long long)pack->GetExtensionLength());
+    }*/
 
-            if (this->format != NULL) AMediaFormat_delete(this->format);
-            this->format = newFormat;
-            this->codec = newCodec;
+    // Handle lost packets, TODO How does this work with multiple senders?
+    // Reordered packets were sorted by the jitter buffer, these are gone for good. The codec
+    // is not flushed, that caused it to throw errors, the concealer fills in the missing time.
+    if (lost > 0) {
+        log("Lost %u packets %u => %u | %.2f => %.2fs.", lost, lastSeqNum,
+            pack->GetSequenceNumber(), lastTimestamp / 1E6,
+            timestamp / 1E6);
+    }
+    lastSeqNum = pack->GetSequenceNumber();
+    lastTimestamp = timestamp;
+    if (nackEnabled) nack.Passed(lastSeqNum);
+
+    if (hasInput) {
+        //log("Received %.2f", timestamp / 1000000.0);
+        if (isFragment) {
+            if (ReassembleFragment(pack, fragment, timestamp)) {
+                decoderStatus = decoder->EnqueueBuffer(frameBuffer.data(),
+                                                       (ssize_t) frameBuffer.size(),
+                                                       (int64_t) timestamp);
+            }
+            DeletePacket(pack);
         } else {
-            log("Could not create codec");
+            // The payload is read where it was received, the decoder copies it once
+            decoderStatus = decoder->EnqueueBufferRef(pack->GetPayloadData(),
+                                                      pack->GetPayloadLength(),
+                                                      (int64_t) timestamp, this, pack);
         }
+        if (decoderStatus != 0) hasInput = false;
+    } else {
+        log("Receiver: End of file");
+        // Tell the codec we are done
+        decoder->EnqueueBuffer(NULL, -1, (int64_t) timestamp);
+        DeletePacket(pack);
+    }
+    hasOutput = decoder->DequeueBuffer(&concealer);
+}
+
+void ReceiverSession::ReleaseBuffer(void *ref) {
+    DeletePacket((RTPPacket *) ref);
+}
+
+bool ReceiverSession::ReassembleFragment(RTPPacket *pack, uint32_t fragment, uint32_t timestamp) {
+    uint32_t index = fragment & AUDIOSYNC_FRAGMENT_INDEX_MASK;
+    if (fragment & AUDIOSYNC_FRAGMENT_START) {
+        if (frameValid) log("Dropping incomplete frame at %.2fs", frameTimestamp / 1E6);
+        frameBuffer.clear();
+        frameValid = index == 0;
+        frameTimestamp = timestamp;
+    } else if (frameValid && (pack->GetSequenceNumber() != (uint16_t) (frameSeqNum + 1)
+                              || index != frameIndex + 1 || timestamp != frameTimestamp)) {
+        // Feeding a partial frame would corrupt the codec state
+        log("Dropping frame at %.2fs, fragment %u is missing", frameTimestamp / 1E6,
+            frameIndex + 1);
+        frameValid = false;
+    }
+    if (!frameValid) return false;
+
+    frameSeqNum = pack->GetSequenceNumber();
+    frameIndex = index;
+    frameBuffer.insert(frameBuffer.end(), pack->GetPayloadData(),
+                       pack->GetPayloadData() + pack->GetPayloadLength());
+    if (fragment & AUDIOSYNC_FRAGMENT_END) {
+        frameValid = false;
+        return true;
+    }
+    return false;
+}
 
-        // TODO in case a codec changes mid-stream, we would have to figure out if it
-        // needs to be started
+void ReceiverSession::SetFormat(const char *formatString) {
+    log("New format %s and creating codec", formatString);
+
+    int64_t startUs = audiosync_monotonicTimeUs();
+    AudioDecoder *newDecoder = decoderFactory(formatString);
+    startupUs = audiosync_monotonicTimeUs() - startUs;
+    if (newDecoder) {
+        this->decoder = newDecoder;
+    } else {
+        log("Could not create codec");
     }
+
+    // TODO in case a codec changes mid-stream, we would have to figure out if it
+    // needs to be started
 }
 
 void ReceiverSession::SendClockOffset(int64_t offsetUSecs) {
@@ -180,6 +305,113 @@ void ReceiverSession::SendClockOffset(int64_t offsetUSecs) {
                             sizeof(audiostream_clockOffset));
 }
 
+int64_t ReceiverSession::NetworkJitterUs() {
+    // The round trips of the probes vary at least as much as the media packets' arrival
+    if (!clockSyncEnabled) return jitterUs;
+    return std::max(jitterUs, clock.JitterUs());
+}
+
+void ReceiverSession::OnNewSource(RTPSourceData *dat) {
+    // Otherwise jrtplib estimates the unit from two sender reports, without any jitter until then
+    dat->SetTimestampUnit(AUDIOSYNC_TIMESTAMP_UNITS);
+}
+
+void ReceiverSession::SetClockSync(bool enable) {
+    clockSyncEnabled = enable;
+    if (!enable) timers.Cancel(ClockTimer);
+}
+
+int64_t ReceiverSession::ProbeClock(int64_t nowUs) {
+    if (!clockSyncEnabled) return INT64_MAX;
+    if (nowUs < nextProbeUs) return nextProbeUs;
+
+    audiostream_clockProbe probe = {.ssrc = htonl(GetLocalSSRC()),
+            .originateUs = htonq(audiosync_systemTimeUs()), .receiveUs = 0, .transmitUs = 0};
+    int status = SendRTCPAPPPacket(AUDIOSTREAM_PACKET_CLOCK_PROBE, AUDIOSTREAM_APP, &probe,
+                                   sizeof(audiostream_clockProbe));
+    _checkerror(status);
+    nextProbeUs = clock.NextProbeUs(nowUs);
+    return nextProbeUs;
+}
+
+void ReceiverSession::ProcessClockReply(const audiostream_clockProbe *reply,
+                                        const RTPTime &receivetime) {
+    // Replies to the other receivers may come our way too
+    if (!clockSyncEnabled || ntohl(reply->ssrc) != GetLocalSSRC()) return;
+    if (!clock.AddSample(ntohq(reply->originateUs), ntohq(reply->receiveUs),
+                         ntohq(reply->transmitUs), SystemTimeUs(receivetime))) {
+        return;
+    }
+
+    if (clockSyncedUs == 0) {
+        clockSyncedUs = audiosync_monotonicTimeUs();
+        log("Clock offset %.2f ms after %" PRIu64 " probes, round trip %.2f ms",
+            clock.OffsetUs() / 1E3, clock.Samples(), clock.RttUs() / 1E3);
+    }
+    if (clock.HasSkew() && !skewLogged) {
+        skewLogged = true;
+        log("Clock skew %.1f ppm +- %.1f ppm, offset %.2f ms +- %.2f ms", clock.SkewPpm(),
+            clock.SkewErrorPpm(), clock.OffsetUs() / 1E3, clock.ErrorBoundUs() / 1E3);
+    }
+    player->SetClockModel(clock.ReferenceUs(), clock.OffsetUs(), clock.Skew());
+    SendClockOffset(clock.OffsetUs());
+}
+
+void ReceiverSession::SendReceiverStatus() {
+    int64_t clockErrorUs = clockSyncEnabled ? clock.ErrorBoundUs() : 0;
+    audiostream_receiverStatus status = {.startupUs = htonq(startupUs),
+            .jitterUs = htonq(NetworkJitterUs()), .clockErrorUs = htonq(clockErrorUs)};
+    this->SendRTCPAPPPacket(AUDIOSTREAM_PACKET_RECEIVER_STATUS, AUDIOSTREAM_APP, &status,
+                            sizeof(audiostream_receiverStatus));
+}
+
+static int64_t _nackHoldUs(int64_t delayUs, int64_t retryUs) {
+    int64_t holdUs = delayUs + AUDIOSYNC_NACK_RETRIES * retryUs;
+    return holdUs < AUDIOSYNC_NACK_MAX_HOLD_US ? holdUs : AUDIOSYNC_NACK_MAX_HOLD_US;
+}
+
+void ReceiverSession::SetNACK(bool enable) {
+    nackEnabled = enable;
+    jitter.SetMinimumHold(enable ? _nackHoldUs(AUDIOSYNC_NACK_DELAY_US, AUDIOSYNC_NACK_DEFAULT_RETRY_US) : 0);
+}
+
+void ReceiverSession::NackDelays(int64_t *delayUs, int64_t *retryUs) {
+    // Packets which are only reordered don't need to be sent again
+    *delayUs = AUDIOSYNC_NACK_JITTER_FACTOR * NetworkJitterUs();
+    if (*delayUs < AUDIOSYNC_NACK_DELAY_US) *delayUs = AUDIOSYNC_NACK_DELAY_US;
+    // A request and the retransmission take a round trip, give every retry that long
+    *retryUs = rttUs > 0 ? rttUs + *delayUs : AUDIOSYNC_NACK_DEFAULT_RETRY_US;
+    if (*retryUs < AUDIOSYNC_NACK_MIN_RETRY_US) *retryUs = AUDIOSYNC_NACK_MIN_RETRY_US;
+}
+
+void ReceiverSession::SendNACK(int64_t nowUs) {
+    int64_t delayUs, retryUs;
+    NackDelays(&delayUs, &retryUs);
+    jitter.SetMinimumHold(_nackHoldUs(delayUs, retryUs));
+
+    audiostream_nack entries[AUDIOSYNC_NACK_MAX_ENTRIES];
+    size_t count = nack.Collect(nowUs, delayUs, retryUs, entries, AUDIOSYNC_NACK_MAX_ENTRIES);
+    if (count == 0) return;
+    int status = SendRTCPAPPPacket(AUDIOSTREAM_PACKET_NACK, AUDIOSTREAM_APP, entries,
+                                   count * sizeof(audiostream_nack));
+    _checkerror(status);
+}
+
+void ReceiverSession::ScheduleDeadlines(int64_t nowUs) {
+    int64_t dueUs = -1;
+    if (nackEnabled) {
+        int64_t delayUs, retryUs;
+        NackDelays(&delayUs, &retryUs);
+        dueUs = nack.NextDueUs(delayUs, retryUs);
+    }
+    if (dueUs >= 0) timers.Schedule(NackTimer, dueUs);
+    else timers.Cancel(NackTimer);
+
+    int64_t releaseUs = jitter.NextReleaseUs(RTPTime::CurrentTime());
+    if (releaseUs >= 0) timers.Schedule(ReleaseTimer, nowUs + releaseUs);
+    else timers.Cancel(ReleaseTimer);
+}
+
 void ReceiverSession::OnAPPPacket(RTCPAPPPacket *apppacket, const RTPTime &receivetime,
                                   const RTPAddress *senderaddress) {
     // All RTCP app packages come from the central sender
@@ -187,82 +419,58 @@ void ReceiverSession::OnAPPPacket(RTCPAPPPacket *apppacket, const RTPTime &recei
         char *formatString = (char *) apppacket->GetAPPData();
         if (formatString[apppacket->GetAPPDataLength() - 1] == '\0') {
             log("Received format string %s", formatString);
-            AMediaFormat *newFormat = audiostream_createFormat(formatString);
-
-            if (newFormat != NULL) {
-                log("Parsed format string %s", AMediaFormat_toString(newFormat));
-                // TODO activate this again
-                // TODO figure out how to compare formats and see if it's the same as the old
-                if (format == NULL)// only seet this right now, if there is nothing else
-                    SetFormat(newFormat);
-                else
-                    AMediaFormat_delete(newFormat);
-            }
+            // TODO figure out how to compare formats and see if it's the same as the old
+            if (decoder == NULL)// only set this right now, if there is nothing else
+                SetFormat(formatString);
         }
+    } else if (apppacket->GetSubType() == AUDIOSTREAM_PACKET_CLOCK_REPLY
+               && apppacket->GetAPPDataLength() >= sizeof(audiostream_clockProbe)) {
+        ProcessClockReply((audiostream_clockProbe *) apppacket->GetAPPData(), receivetime);
     } /*else if (apppacket->GetSubType() == AUDIOSTREAM_PACKET_CLOCK_SYNC
                && apppacket->GetAPPDataLength() >= sizeof(audiostream_clockSync)) {
 
         audiostream_clockSync *sync = (audiostream_clockSync *) apppacket->GetAPPData();
         int64_t systemTimeUs = ntohq(sync->systemTimeUs);
         int64_t playbackTimeUs = ntohq(sync->playbackTimeUs);
-        audioplayer_syncPlayback(systemTimeUs, playbackTimeUs);
+        player->SyncPlayback(systemTimeUs, playbackTimeUs);
     }*/
 }
 
 int64_t ReceiverSession::CurrentPlaybackTimeUs() {
-    return audioplayer_currentPlaybackTimeUs();
+    return player->CurrentPlaybackTimeUs();
 }
 
-void *ReceiverSession::RunNetworkThread(void *ctx) {
-    ((ReceiverSession *) ctx)->RunNetwork();
-    return NULL;
+void ReceiverSession::InitSession(AudioDecoderFactory decoderFactory, AudioPlayer *player,
+                                  const char *defaultFormat) {
+    this->decoderFactory = decoderFactory;
+    this->player = player;
+    if (defaultFormat) SetFormat(defaultFormat);
 }
 
-char *_host;
-int _ntpport;
-
-void *ReceiverSession::RunNTPClient(void *ctx) {
-    static int64_t lastOffsetUs = 0;
-
-    ReceiverSession *sess = (ReceiverSession *) ctx;
-    while (sess->IsRunning()) {
-        struct timeval tv;
-        int err = msntp_get_offset(_host, _ntpport, &tv);
-        if (err) debugLog("NTP client error %d", err);
-        else {
-            int64_t offsetUSecs = tv.tv_usec + tv.tv_sec * SECOND_MICRO;
-            if (lastOffsetUs != 0) offsetUSecs = (offsetUSecs + lastOffsetUs) / 2;
-            lastOffsetUs = offsetUSecs;
-
-            // Send it to everyone
-            sess->SendClockOffset(offsetUSecs);
-            audioplayer_setSystemTimeOffset(offsetUSecs);
-            //debugLog("My clock offset is %fs", offsetUSecs/1E6);
-        }
-        RTPTime::Wait(RTPTime(NTP_PACKET_INTERVAL_SEC, 0));
-    }
-    free(_host);
-    return NULL;
-}
-
-AudioStreamSession *ReceiverSession::StartReceiving(const char *host, uint16_t portbase) {
+AudioStreamSession *ReceiverSession::StartReceiving(const char *host, uint16_t portbase,
+                                                    AudioDecoderFactory decoderFactory,
+                                                    AudioPlayer *player,
+                                                    const char *defaultFormat,
+                                                    uint16_t localPortbase,
+                                                    const char *multicastGroup) {
     ReceiverSession *sess = new ReceiverSession();
     RTPUDPv4TransmissionParams transparams;
     RTPSessionParams sessparams;
 
-    AMediaFormat *format = AMediaFormat_new();
-    AMediaFormat_setString(format, AMEDIAFORMAT_KEY_MIME, "audio/mpeg");
-    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_SAMPLE_RATE, 44100);
-    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_CHANNEL_COUNT, 2);
-    AMediaFormat_setInt32(format, "encoder-delay", 576);
-    AMediaFormat_setInt32(format, "encoder-padding", 1579);
-    sess->SetFormat(format);
+    sess->InitSession(decoderFactory, player, defaultFormat);
+    sess->networkCPU = _stageCPUs[0];
+    sess->decodeCPU = _stageCPUs[1];
+    sess->outputCPU = _stageCPUs[2];
 
     sessparams.SetOwnTimestampUnit(AUDIOSYNC_TIMESTAMP_UNITS);
     sessparams.SetAcceptOwnPackets(false);
     sessparams.SetReceiveMode(RTPTransmitter::ReceiveMode::AcceptAll);
+    ApplyNetworkImpairment(sessparams);
+    // The network thread waits for the packets itself
+    sessparams.SetUsePollThread(false);
+    sess->pollsNetwork = true;
     //uint16_t portbase = RTP_PORT;
-    transparams.SetPortbase(portbase);
+    transparams.SetPortbase(localPortbase != 0 ? localPortbase : portbase);
     int status = sess->Create(sessparams, &transparams);
     _checkerror(status);
 
@@ -270,13 +478,48 @@ AudioStreamSession *ReceiverSession::StartReceiving(const char *host, uint16_t p
     RTPIPv4Address addr(ntohl(inet_addr(host)), portbase);
     status = sess->AddDestination(addr);
     _checkerror(status);
+    sess->SetNACK(true);
+    sess->SetClockSync(true);
+
+    if (multicastGroup) {
+        // The sender streams to the group on the port we are listening on
+        RTPIPv4Address group(ntohl(inet_addr(multicastGroup)), transparams.GetPortbase());
+        debugLog("Joining multicast group %s", multicastGroup);
+        status = sess->JoinMulticastGroup(group);
+        _checkerror(status);
+    }
 
-    // TODO kind of ugly, can we pass this in a better way
-    _host = strdup(host);
-    _ntpport = portbase + AUDIOSYNC_SNTP_PORT_OFFSET;
-    pthread_create(&(sess->ntpThread), NULL, &ReceiverSession::RunNTPClient, sess);
     pthread_attr_t attr;
     pthread_attr_init(&attr);
     pthread_create(&(sess->networkThread), &attr, &ReceiverSession::RunNetworkThread, sess);
     return sess;
+}
+
+ReceiverSession *ReceiverSession::CreateWithTransmitter(RTPTransmitter *transmitter,
+                                                        const RTPAddress &sender,
+                                                        AudioDecoderFactory decoderFactory,
+                                                        AudioPlayer *player,
+                                                        const char *defaultFormat,
+                                                        const RTPAddress *multicastGroup) {
+    ReceiverSession *sess = new ReceiverSession();
+    RTPSessionParams sessparams;
+
+    sess->InitSession(decoderFactory, player, defaultFormat);
+
+    sessparams.SetOwnTimestampUnit(AUDIOSYNC_TIMESTAMP_UNITS);
+    sessparams.SetAcceptOwnPackets(false);
+    sessparams.SetReceiveMode(RTPTransmitter::ReceiveMode::AcceptAll);
+    ApplyNetworkImpairment(sessparams);
+    sessparams.SetUsePollThread(false);
+    int status = sess->Create(sessparams, transmitter);
+    if (status >= 0) status = sess->AddDestination(sender);
+    if (status >= 0 && multicastGroup) status = sess->JoinMulticastGroup(*multicastGroup);
+    if (status < 0) {
+        _checkerror(status);
+        delete sess;
+        return NULL;
+    }
+
+    sess->drivenExternally = true;
+    return sess;
 }
\ No newline at end of file
@@ -5,36 +5,306 @@
 #ifndef AUDIOSYNC_RECEIVERSESSION_H
 #define AUDIOSYNC_RECEIVERSESSION_H
 
-#include <media/NdkMediaCodec.h>
+#include <vector>
 #include "AudioStreamSession.h"
 #include "jrtplib/rtpaddress.h"
 #include "jrtplib/rtcpapppacket.h"
+#include "audioplayer.h"
+#include "clocksync.h"
+#include "concealment.h"
+#include "fec.h"
+#include "jitterbuffer.h"
+#include "nack.h"
+#include "timerwheel.h"
+#include "backend/AudioDecoder.h"
 
-class ReceiverSession : public AudioStreamSession {
+class ReceiverSession : public AudioStreamSession, private AudioBufferReleaser {
 public:
     ~ReceiverSession() {
-        if (codec) AMediaCodec_delete(codec);
+        if (decoder) delete decoder;
     }
 
-    static AudioStreamSession *StartReceiving(const char *host, uint16_t portbase);
+    /**
+     * @param decoderFactory  used to create a decoder once the sender announced its format
+     * @param player          plays the decoded audio, not owned by the session
+     * @param defaultFormat   format to assume until the sender announces one, may be NULL
+     * @param localPortbase   port to listen on, 0 uses the same as the sender
+     * @param multicastGroup  IPv4 group the sender streams to, may be NULL
+     */
+    static AudioStreamSession *StartReceiving(const char *host, uint16_t portbase,
+                                              AudioDecoderFactory decoderFactory,
+                                              AudioPlayer *player,
+                                              const char *defaultFormat = NULL,
+                                              uint16_t localPortbase = 0,
+                                              const char *multicastGroup = NULL);
+
+    /**
+     * Creates a session without a network thread on top of any transmitter, e.g. the
+     * RTPFakeTransmitter. The caller drives it with Poll() and RunNetworkStep().
+     * Clock sync is off, sender and receiver must share a clock unless it is enabled.
+     * The transmitter has to use MemoryManager().
+     * @param multicastGroup  joined if not NULL, reports still go to the sender directly
+     * @return NULL if the session could not be created
+     */
+    static ReceiverSession *CreateWithTransmitter(jrtplib::RTPTransmitter *transmitter,
+                                                  const jrtplib::RTPAddress &sender,
+                                                  AudioDecoderFactory decoderFactory,
+                                                  AudioPlayer *player,
+                                                  const char *defaultFormat = NULL,
+                                                  const jrtplib::RTPAddress *multicastGroup = NULL);
 
     int64_t CurrentPlaybackTimeUs();
 
+    int64_t RunNetworkStep();
+
+    /**
+     * Pins the threads of all receivers started afterwards, a negative CPU leaves that stage to
+     * the scheduler. Receivers from StartReceiving decode on a thread of their own and hand the
+     * PCM data to the player on a third one.
+     */
+    static void SetStageCPUs(int networkCPU, int decodeCPU, int outputCPU);
+
+    /**
+     * Asks the sender to repeat lost packets, and holds the packets after a gap until the
+     * retransmission had its chance. The sender needs a history, see SenderSession::SetRetransmission
+     */
+    void SetNACK(bool enable);
+
+    /**
+     * Estimates the offset of the sender's clock by probes in the RTCP stream, and adjusts the
+     * player with it. On joining a burst of probes is sent, the receiver only reports it is
+     * ready once the estimate is good enough.
+     * On by default for receivers from StartReceiving.
+     */
+    void SetClockSync(bool enable);
+
+    /**
+     * Sender clock minus ours right now, following the skew. 0 until estimated
+     */
+    int64_t ClockOffsetUs() {
+        return clock.HasOffset() ? clock.OffsetUs(audiosync_systemTimeUs()) : 0;
+    }
+
+    /**
+     * How much faster the sender's clock runs, 0 until fitted
+     */
+    double ClockSkewPpm() {
+        return clock.SkewPpm();
+    }
+
+    /**
+     * Two standard errors of the skew
+     */
+    double ClockSkewErrorPpm() {
+        return clock.SkewErrorPpm();
+    }
+
+    /**
+     * The offset is off by at most about this much
+     */
+    int64_t ClockErrorBoundUs() {
+        return clock.ErrorBoundUs();
+    }
+
+    /**
+     * Round trip of the probe the offset came from
+     */
+    int64_t ClockRttUs() {
+        return clock.RttUs();
+    }
+
+    /**
+     * Monotonic time when the first offset was estimated, 0 until then
+     */
+    int64_t ClockSyncedUs() {
+        return clockSyncedUs;
+    }
+
+    /**
+     * Retransmissions asked for, every retry counts
+     */
+    uint64_t NackRequested() {
+        return nack.Requested();
+    }
+
+    /**
+     * Requested packets which arrived after all
+     */
+    uint64_t NackRepaired() {
+        return nack.Repaired();
+    }
+
+    /**
+     * Packets rebuilt from FEC parity packets
+     */
+    uint64_t FecRecovered() {
+        return fec.Recovered();
+    }
+
+    /**
+     * Lost packets which FEC could not rebuild, because more than one of their group was lost
+     */
+    uint64_t FecUnrecoverable() {
+        return fec.Unrecoverable();
+    }
+
+    /**
+     * Packets which arrived behind a newer one
+     */
+    uint64_t ReorderedPackets() {
+        return jitter.Reordered();
+    }
+
+    /**
+     * Most packets a packet arrived behind the newest one
+     */
+    uint32_t ReorderDepth() {
+        return jitter.ReorderDepth();
+    }
+
+    /**
+     * Packets which arrived after the jitter buffer gave up on them
+     */
+    uint64_t LateDrops() {
+        return jitter.LateDrops();
+    }
+
+    /**
+     * Media packets which never made it to the decoder
+     */
+    uint64_t LostPackets() {
+        return jitter.Lost();
+    }
+
+    /**
+     * Gaps in the decoded audio which were filled in, valid once decoding finished
+     */
+    uint64_t ConcealedGaps() {
+        return concealer.Gaps();
+    }
+
+    int64_t ConcealedUs() {
+        return concealer.ConcealedUs();
+    }
+
+    double MeanBufferOccupancy() {
+        return jitter.MeanOccupancy();
+    }
+
+    size_t MaxBufferOccupancy() {
+        return jitter.MaxOccupancy();
+    }
+
+    /**
+     * How long the jitter buffer waits for a missing packet
+     */
+    int64_t HoldWindowUs() {
+        return jitter.HoldWindowUs();
+    }
+
+    /**
+     * Jitter of the packets from the sender, as reported to it. Before media arrived it is
+     * known from the clock probes, without clock sync it is 0 until then.
+     */
+    int64_t NetworkJitterUs();
+
 protected:
     void RunNetwork();
 
-    AMediaCodec *codec;
+    void OnNewSource(jrtplib::RTPSourceData *dat);
+
+    AudioDecoder *decoder = NULL;
+    AudioDecoderFactory decoderFactory = NULL;
+    AudioPlayer *player = NULL;
+    LossConcealer concealer;// Between the decoder and the player
+    int networkCPU = -1, decodeCPU = -1, outputCPU = -1;
+
+    // Used by the network loop
+    enum {
+        Joining, WaitingForFormat, Receiving, Draining, Playing
+    } state = Joining;
+    bool hasInput = true, hasOutput = true;
+    int decoderStatus = 0;
+    int32_t beginTimestamp = -1, lastTimestamp = 0;
+    uint16_t lastSeqNum = 0;
+
+    FecDecoder fec{GetMemoryManager()};
+    JitterBuffer jitter{GetMemoryManager(), &fec};
+    NackTracker nack{GetMemoryManager()};
+    bool nackEnabled = false;
+    int64_t rttUs = 0;// To the sender, 0 until known
+
+    // Work which is due without any packets arriving
+    enum {
+        MonitorTimer, StatusTimer, NackTimer, ReleaseTimer, ClockTimer, TimerCount
+    };
+    TimerWheel timers{TimerCount};
 
-    void SetFormat(AMediaFormat *newFormat);
+    // Reassembly of fragmented frames
+    std::vector<uint8_t> frameBuffer;
+    bool frameValid = false;
+    uint32_t frameTimestamp = 0;
+    uint16_t frameSeqNum = 0;
+    uint32_t frameIndex = 0;
+
+    // Offset of the sender's clock, the replies arrive on the network thread as well
+    ClockSync clock;
+    bool clockSyncEnabled = false;
+    int64_t nextProbeUs = 0, clockSyncedUs = 0;
+    bool skewLogged = false;
+
+    // Reported to the sender, which picks the playout lead from it
+    int64_t startupUs = 0;
+    int64_t jitterUs = 0;// Of the media packets
+
+    void InitSession(AudioDecoderFactory decoderFactory, AudioPlayer *player,
+                     const char *defaultFormat);
+
+    void ProcessPackets();
+
+    /**
+     * @param lost  packets the jitter buffer gave up on right before this one
+     */
+    void ProcessPacket(jrtplib::RTPPacket *pack, uint32_t lost);
+
+    /**
+     * Appends a fragment to the frame buffer, a frame with missing fragments is discarded
+     * @return true if the frame in frameBuffer is complete
+     */
+    bool ReassembleFragment(jrtplib::RTPPacket *pack, uint32_t fragment, uint32_t timestamp);
+
+    void SetFormat(const char *formatString);
+
+    // The decoder is done with a packet it got by EnqueueBufferRef
+    void ReleaseBuffer(void *ref);
 
     void SendClockOffset(int64_t offsetUSecs);
 
-    void OnAPPPacket(jrtplib::RTCPAPPPacket *apppacket, const jrtplib::RTPTime &receivetime,
-                     const jrtplib::RTPAddress *senderaddress);
+    /**
+     * Sends a probe if one is due
+     * @return when the next one is due
+     */
+    int64_t ProbeClock(int64_t nowUs);
+
+    void ProcessClockReply(const audiostream_clockProbe *reply,
+                           const jrtplib::RTPTime &receivetime);
+
+    void SendReceiverStatus();
 
-    static void *RunNetworkThread(void *ctx);
+    void SendNACK(int64_t nowUs);
 
-    static void *RunNTPClient(void *ctx);
+    /**
+     * How long a packet has to be missing before it is requested, and again after that
+     */
+    void NackDelays(int64_t *delayUs, int64_t *retryUs);
+
+    /**
+     * Schedules the timers for the lost packets and the ones held in the jitter buffer
+     */
+    void ScheduleDeadlines(int64_t nowUs);
+
+    void OnAPPPacket(jrtplib::RTCPAPPPacket *apppacket, const jrtplib::RTPTime &receivetime,
+                     const jrtplib::RTPAddress *senderaddress);
 
 };
 
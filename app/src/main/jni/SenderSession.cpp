@@ -8,21 +8,25 @@
 
 #define debugLog(...) __android_log_print(ANDROID_LOG_DEBUG, "AudioSync", __VA_ARGS__)
 
-#include "libmsntp/libmsntp.h"
 #include "jrtplib/rtppacket.h"
 #include "jrtplib/rtpsourcedata.h"
 #include "jrtplib/rtpudpv4transmitter.h"
 #include "jrtplib/rtpipv4address.h"
 #include "jrtplib/rtpipv6address.h"
 #include "jrtplib/rtpsessionparams.h"
+#include "jrtplib/rtpstructs.h"
 
+#include <algorithm>
 #include <cinttypes>
+#include <new>
+#include <string>
+#include <string.h>
+#include <stddef.h>
 
-#include "decoder.h"
 #include "apppacket.h"
 
 
-#define PACKET_GAP_MICRO 2000
+#define FORMAT_INTERVAL_SEC 1
 using namespace jrtplib;
 
 static void _checkerror(int rtperr) {
@@ -33,89 +37,222 @@ static void _checkerror(int rtperr) {
 }
 
 void SenderSession::RunNetwork() {
-    // Waiting for connections and sending them data
-    if (!extractor) {
-        log("No datasource");
-        return;
+    AudioStreamSession::RunNetwork();
+    if (state == Streaming) {
+        debugLog("Sender was canceled before finishing streaming");
+        log("I'm done sending");
+        Leave(RTPTime(2, 0));
+    }
+}
+
+int64_t SenderSession::RunNetworkStep() {
+    int64_t nowUs = audiosync_monotonicTimeUs();
+    switch (state) {
+        case WaitingForClients:
+            // Waiting for connections and sending them data
+            if (!source) {
+                log("No datasource");
+                return -1;
+            }
+            if (connectedSources == 0) {
+                if (!waitingLogged) log("Waiting for clients....");
+                waitingLogged = true;
+                return nowUs + SECOND_MICRO;// OnNewSource wakes us up
+            }
+            log("Client connected, starting to send once all clients are ready");
+            state = WaitingForSync;
+            syncDeadlineUs = nowUs + AUDIOSYNC_SYNC_TIMEOUT_US;// Let the receivers sync their clocks
+            return nowUs;
+
+        case WaitingForSync:
+            // Every receiver status wakes us up
+            if (nowUs < syncDeadlineUs && !receiversReady()) return syncDeadlineUs;
+            this->playoutLeadUs = transmissionLatency();
+            log("Playout lead %.0f ms", playoutLeadUs / 1E3);
+            this->playbackStartUs = audiosync_systemTimeUs() + playoutLeadUs;
+            this->playbackStartMonoUs = nowUs + playoutLeadUs;
+            this->lastRefillUs = nowUs;
+            this->tokens = burstBytes;
+            state = Streaming;
+            return nowUs;
+
+        case Streaming:
+            break;
+
+        case Done:
+            return -1;
+    }
+
+    // Read one sample ahead, we need its timestamp and size to know when it may be sent
+    if (!hasSample) {
+        sampleSize = source->ReadSample(sample, sizeof(sample), &sampleTimeUs);
+        if (sampleSize == AUDIOSOURCE_AGAIN) return nowUs + AUDIOSYNC_SOURCE_RETRY_US;
+        hasSample = true;
     }
+    ssize_t written = sampleSize;
+    int64_t timeUs = sampleTimeUs;
+    if (written >= 0) {
+        // Scheduled against its playback time, so stalls and late wakeups don't accumulate.
+        // Samples that are overdue are sent as fast as the rate cap allows.
+        int64_t dueUs = playbackStartMonoUs + timeUs - leadUs;
+        if (dueUs > nowUs) return dueUs;
+        int64_t waitUs = ConsumeTokens(nowUs, (size_t) written);
+        if (waitUs > 0) return nowUs + waitUs;
+    }
+    hasSample = false;
 
     int status = 0;
-    while (connectedSources == 0 && isRunning) {
-        RTPTime::Wait(RTPTime(2, 0));// Wait 2s
-        log("Waiting for clients....");
+    if (lastTimeUs == -1) lastTimeUs = timeUs;// We need to calc
+    uint32_t timestampinc = (uint32_t) (timeUs - lastTimeUs);// Assuming it will fit
+    lastTimeUs = timeUs;
+
+    sendingPlaybackTimeUs = this->playbackStartUs + timeUs;
+    if (written >= 0) {
+        status = SendFrame(sample, (size_t) written, timestampinc, sendingPlaybackTimeUs);
+    } else {
+        sample[0] = '\0';
+        status = SendMediaPacket(sample, 1, true, timestampinc, NULL, 0);// Use marker as end of data mark
+        if (status >= 0) status = SendParity(true);
+        log("Sender: End of stream.");
+    }
+    _checkerror(status);
+
+    // Repeat the format, receivers can't start without it and RTCP packets get lost as well
+    if (nowUs - lastFormatUs >= FORMAT_INTERVAL_SEC * SECOND_MICRO) {
+        SendMediaFormat();
+        lastFormatUs = nowUs;
     }
-    if (!isRunning) return;
-
-    log("Client connected, starting to send in 2 seconds");
-    RTPTime::Wait(RTPTime(3, 0));// Let's wait for some NTP sync's
-    this->playbackStartUs = audiosync_systemTimeUs() + transmissionLatency();
-
-    ssize_t written = 0;
-    int64_t lastTimeUs = -1, lastClockSyncUs = 0;
-    while (written >= 0 && isRunning) {
-        int64_t timeUs = 0;
-        uint8_t buffer[8192];// TODO figure out optimum size
-        written = decoder_extractData(extractor, buffer, sizeof(buffer), &timeUs);
-        if (lastTimeUs == -1) lastTimeUs = timeUs;// We need to calc
-        uint32_t timestampinc = (uint32_t) (timeUs - lastTimeUs);// Assuming it will fit
-        lastTimeUs = timeUs;
-
-        if (written >= 0) {
-            if (written > 1200) {
-                log("Package is too large: %ld, split it up. (%.2fs)", (long) written, timeUs/1E6);
-                // TODO these UDP packages are definitely too large and result in IP fragmentation
-                // most MTU's will be 1500, RTP header is 12 bytes we should
-                // split the packets up at some point(1024 seems reasonable)
-                //SendPacketRecursive(buffer, (size_t) written, 0, false, timestampinc);
+
+    // Not really necessary, we are not using this
+    BeginDataAccess();
+    // check incoming packets
+    if (GotoFirstSourceWithData()) {
+        do {
+            RTPPacket *pack;
+            while ((pack = GetNextPacket()) != NULL) {
+                log("The sender should not get packets !\n");
+                DeletePacket(pack);
             }
-            // Periodically send out clock syncs
-            //if (timeUs - lastClockSyncUs > SECOND_MICRO) {
-                int64_t usecs = htonq(this->playbackStartUs + timeUs);
-                status = SendPacketEx(buffer, (size_t) written, 0, false, timestampinc,
-                                      AUDIOSYNC_EXTENSION_HEADER_ID,
-                                      &usecs,
-                                      sizeof(int64_t) / sizeof(uint32_t));
-                lastClockSyncUs = timeUs;
-            //} else {
-            //    status = SendPacket(buffer, (size_t) written, 0, false, timestampinc);
-           // }
-        } else {
-            buffer[0] = '\0';
-            status = SendPacket(buffer, 1, 0, true, timestampinc);// Use marker as end of data mark
-            log("Sender: End of stream.");
-        }
-        _checkerror(status);
+        } while (GotoNextSourceWithData());
+    }
+    EndDataAccess();
 
-        // Don't decrease the waiting time too much, sending a great number of packets very fast,
-        // will cause the network (or the client) to drop a high number of these packets.
-        // TODO auto-adjust this value based on lost packets, figure out how to utilize throughput
-        //uint32_t waitUs = timestampinc > 10000 ? timestampinc - 10000 : 2000;
-        RTPTime::Wait(RTPTime(0, timestampinc/2));
-
-        // Not really necessary, we are not using this
-        BeginDataAccess();
-        // check incoming packets
-        if (GotoFirstSourceWithData()) {
-            do {
-                RTPPacket *pack;
-                while ((pack = GetNextPacket()) != NULL) {
-                    log("The sender should not get packets !\n");
-                    DeletePacket(pack);
-                }
-            } while (GotoNextSourceWithData());
+    if (written < 0) {
+        if (readAhead) {
+            log("Source queue underruns: %" PRIu64, readAhead->Underruns());
+        }
+        if (historySize > 0) {
+            log("Retransmitted %" PRIu64 " packets, missed %" PRIu64, retransmissions.load(),
+                retransmissionsMissed.load());
         }
-        EndDataAccess();
+        log("I'm done sending");
+        state = Done;
+        Leave(RTPTime(2, 0));
+        return -1;
     }
-    if (written >= 0 && !isRunning) {
-        debugLog("Sender was canceled before finishing streaming");
+
+    return nowUs;// Next sample
+}
+
+int64_t SenderSession::ConsumeTokens(int64_t nowUs, size_t bytes) {
+    if (rateCap == 0) return 0;
+
+    // A sample larger than the bucket still has to go out at some point
+    double capacity = std::max((double) burstBytes, (double) bytes);
+    tokens = std::min(capacity, tokens + (nowUs - lastRefillUs) * (double) rateCap / SECOND_MICRO);
+    lastRefillUs = nowUs;
+    if (tokens < bytes) {
+        return (int64_t) ((bytes - tokens) * SECOND_MICRO / rateCap) + 1;
     }
+    tokens -= bytes;
+    return 0;
+}
+
+void SenderSession::SetPacing(int64_t leadUs, uint32_t rateCap, uint32_t burstBytes) {
+    this->leadUs = leadUs;
+    this->rateCap = rateCap;
+    this->burstBytes = burstBytes;
+}
 
-    log("I'm done sending");
-    BYEDestroy(RTPTime(2, 0), 0, 0);
+void SenderSession::SetPlayoutMargin(int64_t marginUs) {
+    this->playoutMarginUs = marginUs;
+}
+
+int64_t SenderSession::PlayoutLeadUs() {
+    return playoutLeadUs;
+}
+
+// Called by the poll thread once requests arrived, it is the only one using the server
+static void _serveSNTP(int, void *data) {
+    msntp_ctx *server = (msntp_ctx *) data;
+    int status = msntp_ctx_serve(server, 0);
+    if (status != 0 && status != -1) debugLog("SNTP error: %s", msntp_ctx_strerror(server));
+}
+
+int SenderSession::StartSNTPServer(uint16_t port) {
+    if (!udpTransmitter || sntpServer) return -1;
+
+    msntp_ctx *server = msntp_ctx_new();
+    if (!server) return -1;
+    if (msntp_ctx_start_server(server, port) != 0) {
+        debugLog("Could not start the SNTP server: %s", msntp_ctx_strerror(server));
+        msntp_ctx_free(server);
+        return -1;
+    }
+    int status = udpTransmitter->AddWaitDescriptor(msntp_ctx_server_fd(server), &_serveSNTP,
+                                                   server);
+    if (status < 0) {
+        _checkerror(status);
+        msntp_ctx_free(server);
+        return status;
+    }
+    sntpServer = server;
+    debugLog("Serving SNTP on port %u", port);
+    return 0;
+}
+
+bool SenderSession::receiversReady() {
+    bool ready = true;
+    BeginDataAccess();
+    if (GotoFirstSource()) {
+        do {
+            RTPSourceData *dat = GetCurrentSourceInfo();
+            if (!dat->IsOwnSSRC() && !dat->ReceivedBYE() && dat->GetStartupUSeconds() < 0) {
+                ready = false;
+            }
+        } while (ready && GotoNextSource());
+    }
+    EndDataAccess();
+    return ready;
 }
 
 int64_t SenderSession::transmissionLatency() {
-    return 10 * SECOND_MICRO;;
+    // Every receiver has to get the first packet, and be able to play it, in time
+    int64_t neededUs = 0;
+    BeginDataAccess();
+    if (GotoFirstSource()) {
+        do {
+            RTPSourceData *dat = GetCurrentSourceInfo();
+            if (dat->IsOwnSSRC() || dat->ReceivedBYE()) continue;
+
+            int64_t rttUs = (int64_t) (dat->INF_GetRoundtripTime().GetDouble() * SECOND_MICRO);
+            if (rttUs <= 0) rttUs = AUDIOSYNC_DEFAULT_RTT_US;
+            int64_t startupUs = dat->GetStartupUSeconds();
+            if (startupUs < 0) startupUs = AUDIOSYNC_DEFAULT_STARTUP_US;
+            // The receiver's clock might be off by its error bound in either direction
+            int64_t clockUs = std::max(dat->GetClockOffsetChangeUSeconds(),
+                                       dat->GetReportedClockErrorUSeconds());
+            // Late packets are as good as lost, cover most of the jitter
+            int64_t us = rttUs / 2 + startupUs + 4 * dat->GetReportedJitterUSeconds() + clockUs;
+            // Time for a lost packet to be requested and sent again
+            if (historySize > 0) us += AUDIOSYNC_NACK_DELAY_US + rttUs;
+            neededUs = std::max(neededUs, us);
+        } while (GotoNextSource());
+    }
+    EndDataAccess();
+
+    return std::min(AUDIOSYNC_MAX_PLAYOUT_LEAD_US,
+                    std::max(AUDIOSYNC_MIN_PLAYOUT_LEAD_US, neededUs + playoutMarginUs));
 }
 
 /*void SenderSession::sendClockSync(int64_t playbackUSeconds) {
@@ -143,7 +280,23 @@ int64_t SenderSession::transmissionLatency() {
 
 void SenderSession::OnAPPPacket(RTCPAPPPacket *apppacket, const RTPTime &receivetime,
                                 const RTPAddress *senderaddress) {
-    if (apppacket->GetSubType() == AUDIOSTREAM_PACKET_CLOCK_OFFSET
+    if (apppacket->GetSubType() == AUDIOSTREAM_PACKET_CLOCK_PROBE
+        && apppacket->GetAPPDataLength() >= sizeof(audiostream_clockProbe)) {
+        // Answered right away, the time until the reply goes out is part of the round trip
+        audiostream_clockProbe reply;
+        memcpy(&reply, apppacket->GetAPPData(), sizeof(audiostream_clockProbe));
+        reply.receiveUs = htonq(SystemTimeUs(receivetime));
+        reply.transmitUs = htonq(audiosync_systemTimeUs());
+        int status;
+        if (senderaddress) {
+            status = SendRTCPAPPPacketTo(AUDIOSTREAM_PACKET_CLOCK_REPLY, AUDIOSTREAM_APP, &reply,
+                                         sizeof(audiostream_clockProbe), *senderaddress);
+        } else {
+            status = SendRTCPAPPPacket(AUDIOSTREAM_PACKET_CLOCK_REPLY, AUDIOSTREAM_APP, &reply,
+                                       sizeof(audiostream_clockProbe));
+        }
+        _checkerror(status);
+    } else if (apppacket->GetSubType() == AUDIOSTREAM_PACKET_CLOCK_OFFSET
         && apppacket->GetAPPDataLength() >= sizeof(audiostream_clockOffset)) {
         audiostream_clockOffset *clock = (audiostream_clockOffset *) apppacket->GetAPPData();
         RTPSourceData *source = GetSourceInfo(apppacket->GetSSRC());
@@ -155,25 +308,190 @@ void SenderSession::OnAPPPacket(RTCPAPPPacket *apppacket, const RTPTime &receive
             //offsetUs += audiosync_systemTimeUs() - ntohq(clock->systemTimeUs);
             source->SetClockOffsetUSeconds(offsetUs);
         }
+    } else if (apppacket->GetSubType() == AUDIOSTREAM_PACKET_RECEIVER_STATUS
+               && apppacket->GetAPPDataLength()
+                  >= offsetof(audiostream_receiverStatus, clockErrorUs)) {
+        audiostream_receiverStatus *status = (audiostream_receiverStatus *) apppacket->GetAPPData();
+        RTPSourceData *source = GetSourceInfo(apppacket->GetSSRC());
+        if (source) {
+            source->SetStartupUSeconds(ntohq(status->startupUs));
+            source->SetReportedJitterUSeconds(ntohq(status->jitterUs));
+            // Older receivers don't send it
+            if (apppacket->GetAPPDataLength() >= sizeof(audiostream_receiverStatus)) {
+                source->SetReportedClockErrorUSeconds(ntohq(status->clockErrorUs));
+            }
+            Wake();
+        }
+    } else if (apppacket->GetSubType() == AUDIOSTREAM_PACKET_NACK) {
+        audiostream_nack *nacks = (audiostream_nack *) apppacket->GetAPPData();
+        size_t count = apppacket->GetAPPDataLength() / sizeof(audiostream_nack);
+        RTPSourceData *source = GetSourceInfo(apppacket->GetSSRC());
+        if (source) {
+            for (size_t i = 0; i < count; i++) Retransmit(nacks[i], source);
+        }
     }
 }
 
+void SenderSession::Retransmit(const audiostream_nack &nack, RTPSourceData *dat) {
+    RTPAddress *dest = addressFromData(dat);
+    if (dest == NULL) return;
+
+    // Pointless unless it arrives before it is played
+    int64_t rttUs = (int64_t) (dat->INF_GetRoundtripTime().GetDouble() * SECOND_MICRO);
+    if (rttUs <= 0) rttUs = AUDIOSYNC_DEFAULT_RTT_US;
+    int64_t arrivalUs = audiosync_systemTimeUs() + rttUs / 2;
+
+    uint16_t seqNum = ntohs(nack.seqNum);
+    uint16_t bitmask = ntohs(nack.bitmask);
+    std::lock_guard<std::mutex> lock(historyMutex);
+    for (int i = 0; i <= 16; i++) {
+        if (i > 0 && (bitmask & (1 << (i - 1))) == 0) continue;
+        uint16_t s = (uint16_t) (seqNum + i);
+        HistoryEntry *entry = historySize > 0 ? &history[s % historySize] : NULL;
+        if (entry == NULL || entry->length == 0 || entry->seqNum != s
+            || entry->playbackTimeUs < arrivalUs) {
+            retransmissionsMissed++;
+            continue;
+        }
+        // Only to the one who asked, everyone else has it. The UDP and fake transmitters can
+        // address it, others (e.g. IPv6) fall back to sending to every destination, where the
+        // duplicates are dropped by sequence number.
+        int status = SendRawRTPData(historyData.data() + (s % historySize) * historySlotSize,
+                                    entry->length, *dest);
+        _checkerror(status);
+        if (status >= 0) retransmissions++;
+        else retransmissionsMissed++;
+    }
+    RTPDelete(dest, GetMemoryManager());
+}
+
+void SenderSession::OnSentRTPPacket(const void *header, size_t headerLen, const void *payload,
+                                    size_t payloadLen) {
+    std::lock_guard<std::mutex> lock(historyMutex);
+    size_t len = headerLen + payloadLen;
+    if (historySize == 0 || len > historySlotSize || headerLen < sizeof(RTPHeader)) return;
+
+    const uint8_t *h = (const uint8_t *) header;
+    uint16_t seqNum = (uint16_t) ((h[2] << 8) | h[3]);
+    size_t slot = seqNum % historySize;
+    // The only copy of the payload, the packet was sent straight from the sample
+    uint8_t *entry = historyData.data() + slot * historySlotSize;
+    memcpy(entry, header, headerLen);
+    memcpy(entry + headerLen, payload, payloadLen);
+    history[slot].seqNum = seqNum;
+    history[slot].length = len;
+    history[slot].playbackTimeUs = sendingPlaybackTimeUs;
+}
+
+int SenderSession::SetRetransmission(size_t historySize) {
+    std::lock_guard<std::mutex> lock(historyMutex);
+    this->historySize = historySize;
+    return AllocateHistory();
+}
+
+int SenderSession::AllocateHistory() {
+    // Every slot fits the largest packet, nothing is allocated while streaming
+    historySlotSize = mtu > AUDIOSYNC_IP_UDP_OVERHEAD ? mtu - AUDIOSYNC_IP_UDP_OVERHEAD : 0;
+    HistoryEntry unused = {0, 0, 0};
+    try {
+        historyData.assign(historySize * historySlotSize, 0);
+        history.assign(historySize, unused);
+    } catch (const std::bad_alloc &e) {
+        historySize = 0;
+        historyData.clear();
+        history.clear();
+        return ERR_RTP_OUTOFMEM;
+    }
+    return 0;
+}
+
 int64_t SenderSession::CurrentPlaybackTimeUs() {
+    if (this->playbackStartUs == 0) return 0;// Not streaming yet
     int64_t pUs = audiosync_systemTimeUs() - this->playbackStartUs;
     return pUs > 0 ? pUs : 0;// Can be negative initially
 }
 
-/*void SenderSession::SendPacketRecursive(const void *data, size_t len, uint8_t pt, bool mark,
-                                        uint32_t timestampinc) {
-    const size_t maxSize = 1024;
-    if (len > maxSize) {
-        SendPacket(data, maxSize, pt, mark, timestampinc);
-        RTPTime::Wait(RTPTime(0, PACKET_GAP_MICRO));
-        SendPacketRecursive(data+maxSize, len - maxSize, pt, mark, 0);
-    } else {
-        SendPacket(data, len, pt, mark, timestampinc);
+int SenderSession::SendFrame(const uint8_t *data, size_t len, uint32_t timestampinc,
+                             int64_t playbackTimeUs) {
+    // Every packet carries the playback time, to sync the clocks
+    uint32_t ext[AUDIOSYNC_EXTENSION_FRAGMENT_SIZE / sizeof(uint32_t)];
+    int64_t usecs = htonq(playbackTimeUs);
+    memcpy(ext, &usecs, sizeof(int64_t));
+    if (len <= maxPayloadSize) {
+        int status = SendMediaPacket(data, len, false, timestampinc, ext,
+                                     sizeof(int64_t) / sizeof(uint32_t));
+        if (status < 0) return status;
+        return SendParity(false);
     }
-}*/
+
+    // Split it up ourselves, a lost IP fragment would lose the whole datagram.
+    // The fragments are handed to the kernel together
+    int status = BeginSendBatch();
+    if (status < 0) return status;
+    // Parity packets go between frames, the receiver expects the fragments back to back
+    size_t fragments = (len + maxPayloadSize - 1) / maxPayloadSize;
+    if (fec.Count() + fragments > AUDIOSYNC_FEC_MAX_GROUP) status = SendParity(true);
+    uint32_t index = 0;
+    for (size_t offset = 0; status >= 0 && offset < len; offset += maxPayloadSize, index++) {
+        size_t size = std::min(maxPayloadSize, len - offset);
+        uint32_t flags = index & AUDIOSYNC_FRAGMENT_INDEX_MASK;
+        if (offset == 0) flags |= AUDIOSYNC_FRAGMENT_START;
+        if (offset + size == len) flags |= AUDIOSYNC_FRAGMENT_END;
+        ext[sizeof(int64_t) / sizeof(uint32_t)] = htonl(flags);
+
+        // jrtplib increments the timestamp after the packet, fragments have to share it
+        bool last = (flags & AUDIOSYNC_FRAGMENT_END) != 0;
+        status = SendMediaPacket(data + offset, size, false, last ? timestampinc : 0, ext,
+                                 AUDIOSYNC_EXTENSION_FRAGMENT_SIZE / sizeof(uint32_t));
+    }
+    if (status >= 0) status = SendParity(false);
+    int endStatus = EndSendBatch();
+    return status < 0 ? status : endStatus;
+}
+
+int SenderSession::SendMediaPacket(const uint8_t *data, size_t len, bool mark,
+                                   uint32_t timestampinc, const uint32_t *ext, size_t extWords) {
+    if (fecGroupSize > 0) {
+        uint16_t seqNum;
+        uint32_t timestamp;
+        int status = GetNextPacketInfo(&seqNum, &timestamp);
+        if (status < 0) return status;
+        fec.Add(seqNum, timestamp, mark, ext, extWords, data, len);
+    }
+    if (extWords == 0) return SendPacket(data, len, 0, mark, timestampinc);
+    return SendPacketEx(data, len, 0, mark, timestampinc, AUDIOSYNC_EXTENSION_HEADER_ID, ext,
+                        extWords);
+}
+
+int SenderSession::SendParity(bool flush) {
+    if (fec.Count() == 0 || (!flush && fec.Count() < fecGroupSize)) return 0;
+    const std::vector<uint8_t> &parity = fec.Finish();
+    return SendPacket(parity.data(), parity.size(), AUDIOSYNC_FEC_PAYLOAD_TYPE, false, 0);
+}
+
+int SenderSession::SetFEC(size_t groupSize) {
+    size_t oldGroupSize = fecGroupSize;
+    fecGroupSize = std::min(groupSize, (size_t) AUDIOSYNC_FEC_MAX_GROUP);
+    // Parity packets have a larger header than the media packets they protect
+    int status = SetMTU(mtu);
+    if (status < 0) fecGroupSize = oldGroupSize;
+    return status;
+}
+
+int SenderSession::SetMTU(size_t mtu) {
+    // RTP header with one CSRC-less header and our extension, or the FEC header
+    size_t headerSize = 12 + 4 + AUDIOSYNC_EXTENSION_FRAGMENT_SIZE;
+    if (fecGroupSize > 0) headerSize = std::max(headerSize, 12 + sizeof(audiosync_fecHeader));
+    if (mtu < AUDIOSYNC_IP_UDP_OVERHEAD + RTP_MINPACKETSIZE) return ERR_RTP_SESSION_MAXPACKETSIZETOOSMALL;
+
+    size_t maxPacketSize = mtu - AUDIOSYNC_IP_UDP_OVERHEAD;
+    int status = SetMaximumPacketSize(maxPacketSize);
+    if (status < 0) return status;
+    this->mtu = mtu;
+    maxPayloadSize = maxPacketSize - headerSize;
+    std::lock_guard<std::mutex> lock(historyMutex);
+    return historySize > 0 ? AllocateHistory() : 0;
+}
 
 RTPAddress *SenderSession::addressFromData(RTPSourceData *dat) {
     short port = 0;
@@ -186,41 +504,69 @@ RTPAddress *SenderSession::addressFromData(RTPSourceData *dat) {
     if (addr) {
         if (addr->GetAddressType() == RTPAddress::IPv4Address) {
             const RTPIPv4Address *v4addr = (const RTPIPv4Address *) (addr);
-            return new RTPIPv4Address(v4addr->GetIP(), v4addr->GetPort() + port);
+            return RTPNew(GetMemoryManager(), RTPMEM_TYPE_CLASS_RTPADDRESS)
+                    RTPIPv4Address(v4addr->GetIP(), v4addr->GetPort() + port);
         } else if (addr->GetAddressType() == RTPAddress::IPv6Address) {
             const RTPIPv6Address *v6addr = (const RTPIPv6Address *) (addr);
-            return new RTPIPv6Address(v6addr->GetIP(), v6addr->GetPort() + port);
+            return RTPNew(GetMemoryManager(), RTPMEM_TYPE_CLASS_RTPADDRESS)
+                    RTPIPv6Address(v6addr->GetIP(), v6addr->GetPort() + port);
         }
     }
     return NULL;
 }
 
+size_t SenderSession::SourceQueueDepth() {
+    return readAhead ? readAhead->QueueDepth() : 0;
+}
+
+uint64_t SenderSession::SourceUnderruns() {
+    return readAhead ? readAhead->Underruns() : 0;
+}
+
+int SenderSession::SetMulticastGroup(const RTPAddress &group) {
+    if (!SupportsMulticasting()) return ERR_RTP_UDPV4TRANS_NOMULTICASTSUPPORT;
+    ClearDestinations();
+    int status = AddDestination(group);
+    if (status < 0) return status;
+    multicast = true;
+    return 0;
+}
+
 void SenderSession::OnNewSource(jrtplib::RTPSourceData *dat) {
     if (dat->IsOwnSSRC()) return;
 
     log("Added new source");
     RTPAddress *dest = addressFromData(dat);
     if (dest) {
-        AddDestination(*dest);
-        delete(dest);
+        // Multicast receivers already get everything sent to the group
+        if (!multicast) AddDestination(*dest);
+        RTPDelete(dest, GetMemoryManager());
         connectedSources++;
-
-        if (this->format) {
-            const char *formatString = AMediaFormat_toString(format);
-            SendRTCPAPPPacket(AUDIOSTREAM_PACKET_MEDIAFORMAT, AUDIOSTREAM_APP,
-                              (const uint8_t *) formatString, strlen(formatString));
-        }
+        SendMediaFormat();
+        Wake();
     }
 }
 
+void SenderSession::SendMediaFormat() {
+    if (this->source == NULL) return;
+
+    // APP data must be a multiple of 32 bit, the receiver expects a terminating NUL
+    const char *formatString = source->FormatString();
+    size_t len = strlen(formatString) + 1;
+    std::string padded(formatString, len);
+    padded.resize((len + 3) & ~(size_t) 3, '\0');
+    SendRTCPAPPPacket(AUDIOSTREAM_PACKET_MEDIAFORMAT, AUDIOSTREAM_APP,
+                      (const uint8_t *) padded.data(), padded.size());
+}
+
 void SenderSession::OnBYEPacket(jrtplib::RTPSourceData *dat) {
     if (dat->IsOwnSSRC()) return;
 
     log("Received bye package");
     RTPAddress *dest = addressFromData(dat);
     if (dest != NULL) {
-        DeleteDestination(*dest);
-        delete(dest);
+        if (!multicast) DeleteDestination(*dest);
+        RTPDelete(dest, GetMemoryManager());
         connectedSources--;
     }
 }
@@ -232,39 +578,23 @@ void SenderSession::OnRemoveSource(jrtplib::RTPSourceData *dat) {
     log("Removing source");
     RTPAddress *dest = addressFromData(dat);
     if (dest != NULL) {
-        DeleteDestination(*dest);
-        delete(dest);
+        if (!multicast) DeleteDestination(*dest);
+        RTPDelete(dest, GetMemoryManager());
         connectedSources--;
     }
 }
 
-void * SenderSession::RunNetworkThread(void *ctx) {
-    ((SenderSession *) ctx)->RunNetwork();
-    return NULL;
+void SenderSession::InitSession(AudioSource *source) {
+    SetDefaultMark(false);
+    SetLocalName("Sender", 6);
+    this->source = source;
+    SetMTU(AUDIOSYNC_DEFAULT_MTU);
 }
 
-RTPUDPv4TransmissionParams transparams;
-void * SenderSession::RunNTPServer(void *ctx) {
-    SenderSession *sess = (SenderSession *) ctx;
-    int port = transparams.GetPortbase() + AUDIOSYNC_SNTP_PORT_OFFSET;
-    if (msntp_start_server(port) != 0) {
-        debugLog("Listening for SNTP clients on port %d...", port);
-        return NULL;
-    }
-
-
-    debugLog("Listening for SNTP clients on port %d...", port);
-    while (sess->IsRunning()) {
-        int ret = msntp_serve();
-        if (ret > 0 || ret < -1) return NULL;
-    }
-
-    msntp_stop_server();
-    return NULL;
-}
-
-SenderSession * SenderSession::StartStreaming(uint16_t portbase, AMediaExtractor *extractor) {
+SenderSession * SenderSession::StartStreaming(uint16_t portbase, AudioSource *source,
+                                              const char *multicastGroup) {
     SenderSession *sess = new SenderSession();
+    RTPUDPv4TransmissionParams transparams;
     RTPSessionParams sessparams;
 
     // IMPORTANT: The local timestamp unit MUST be set, otherwise
@@ -273,17 +603,52 @@ SenderSession * SenderSession::StartStreaming(uint16_t portbase, AMediaExtractor
     // put the timestamp unit to (1.0/10.0)
     sessparams.SetOwnTimestampUnit(AUDIOSYNC_TIMESTAMP_UNITS);
     sessparams.SetReceiveMode(RTPTransmitter::ReceiveMode::AcceptAll);
+    ApplyNetworkImpairment(sessparams);
     //sessparams.SetAcceptOwnPackets(false);
     transparams.SetPortbase(portbase);
-    int status = sess->Create(sessparams, &transparams);
+    // Created here rather than by the session, which may wrap it, to wait for the SNTP server
+    sess->udpTransmitter = new RTPUDPv4Transmitter(sess->GetMemoryManager());
+    int status = sess->udpTransmitter->Init(sessparams.IsUsingPollThread());
+    if (status >= 0) {
+        status = sess->udpTransmitter->Create(sessparams.GetMaximumPacketSize(), &transparams);
+    }
+    if (status >= 0) status = sess->Create(sessparams, sess->udpTransmitter);
     _checkerror(status);
 
-    sess->SetDefaultMark(false);
-    sess->SetLocalName("Sender", 6);
-    sess->extractor = extractor;
+    // Storage may be slow, demux on another thread so packets go out on time
+    sess->readAhead = new ReadAheadSource(source);
+    sess->InitSession(sess->readAhead);
+    status = sess->SetRetransmission(AUDIOSYNC_NACK_HISTORY);
+    _checkerror(status);
+    if (multicastGroup) {
+        RTPIPv4Address group(ntohl(inet_addr(multicastGroup)), portbase);
+        status = sess->SetMulticastGroup(group);
+        _checkerror(status);
+        if (status >= 0) debugLog("Streaming to multicast group %s:%u", multicastGroup, portbase);
+    }
     pthread_create(&(sess->networkThread), NULL, &(SenderSession::RunNetworkThread), sess);
-    pthread_create(&sess->ntpThread, NULL, &SenderSession::RunNTPServer, sess);
 
     debugLog("Started RTP server on port %u, now waiting for clients", portbase);
     return sess;
-}
\ No newline at end of file
+}
+
+SenderSession *SenderSession::CreateWithTransmitter(RTPTransmitter *transmitter,
+                                                    AudioSource *source) {
+    SenderSession *sess = new SenderSession();
+    RTPSessionParams sessparams;
+
+    sessparams.SetOwnTimestampUnit(AUDIOSYNC_TIMESTAMP_UNITS);
+    sessparams.SetReceiveMode(RTPTransmitter::ReceiveMode::AcceptAll);
+    ApplyNetworkImpairment(sessparams);
+    sessparams.SetUsePollThread(false);
+    int status = sess->Create(sessparams, transmitter);
+    if (status < 0) {
+        _checkerror(status);
+        delete sess;
+        return NULL;
+    }
+
+    sess->drivenExternally = true;
+    sess->InitSession(source);
+    return sess;
+}
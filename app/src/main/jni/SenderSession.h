@@ -6,18 +6,64 @@
 #define AUDIOSYNC_SENDERSESSION_H
 
 #include <atomic>
-#include <media/NdkMediaExtractor.h>
+#include <mutex>
+#include <vector>
 #include "AudioStreamSession.h"
 #include "jrtplib/rtpaddress.h"
 #include "jrtplib/rtcpapppacket.h"
+#include "jrtplib/rtpudpv4transmitter.h"
+#include "backend/AudioSource.h"
+#include "backend/ReadAheadSource.h"
+#include "fec.h"
+#include "nack.h"
+#include "libmsntp/libmsntp.h"
+
+// Samples are sent this far ahead of their playback time
+#define AUDIOSYNC_DEFAULT_LEAD_US (10 * 1000000LL)
+// Wait this long when the source has no sample ready
+#define AUDIOSYNC_SOURCE_RETRY_US 2000
+// Overdue samples are sent with at most 1 MB/s, in bursts of 8 KB. A burst has to fit into the
+// receivers' socket buffers (RTPUDPV4TRANS_RTPRECEIVEBUFFER, 32 KB) with room to spare, every
+// datagram takes up about twice its size in there.
+#define AUDIOSYNC_DEFAULT_RATE_CAP (1024 * 1024)
+#define AUDIOSYNC_DEFAULT_BURST (8 * 1024)
+// The playout lead, from the start of streaming until the first sample is played, is chosen
+// from what the receivers report, plus a safety margin, within these bounds
+#define AUDIOSYNC_MIN_PLAYOUT_LEAD_US ((int64_t) 200 * 1000)
+#define AUDIOSYNC_MAX_PLAYOUT_LEAD_US ((int64_t) 10 * 1000000)
+#define AUDIOSYNC_DEFAULT_PLAYOUT_MARGIN_US ((int64_t) 250 * 1000)
+// Assumed for receivers which did not report yet
+#define AUDIOSYNC_DEFAULT_RTT_US ((int64_t) 100 * 1000)
+#define AUDIOSYNC_DEFAULT_STARTUP_US ((int64_t) 500 * 1000)
+// Longest wait for all receivers to report they are ready, their clocks sync in a burst
+#define AUDIOSYNC_SYNC_TIMEOUT_US ((int64_t) 1 * 1000000)
 
 class SenderSession : public AudioStreamSession {
 public:
     ~SenderSession() {
-        if (extractor) AMediaExtractor_delete(extractor);
+        if (udpTransmitter) {
+            Destroy();// The poll thread uses both until then
+            if (sntpServer) msntp_ctx_free(sntpServer);
+            delete udpTransmitter;
+        }
+        if (source) delete source;
     }
 
-    static SenderSession *StartStreaming(uint16_t portbase, AMediaExtractor *extractor);
+    /**
+     * @param multicastGroup  IPv4 group to send to instead of every receiver, may be NULL.
+     *                        The receivers have to join it on the same portbase.
+     */
+    static SenderSession *StartStreaming(uint16_t portbase, AudioSource *source,
+                                         const char *multicastGroup = NULL);
+
+    /**
+     * Creates a session without a network thread on top of any transmitter, e.g. the
+     * RTPFakeTransmitter. The caller drives it with Poll() and RunNetworkStep().
+     * The transmitter has to use MemoryManager().
+     * @return NULL if the session could not be created
+     */
+    static SenderSession *CreateWithTransmitter(jrtplib::RTPTransmitter *transmitter,
+                                                AudioSource *source);
 
     bool IsSender() {
         return true;
@@ -25,6 +71,87 @@ public:
 
     int64_t CurrentPlaybackTimeUs();
 
+    int64_t RunNetworkStep();
+
+    /**
+     * Frames which don't fit into a single packet for this path MTU are sent in fragments
+     * @return < 0 if the MTU is too small
+     */
+    int SetMTU(size_t mtu);
+
+    /**
+     * Every sample is sent leadUs before it is played back. Samples which are overdue,
+     * e.g. at the start or after the source stalled, are sent with at most rateCap bytes/s
+     * (0 disables the cap), in bursts of up to burstBytes.
+     */
+    void SetPacing(int64_t leadUs, uint32_t rateCap, uint32_t burstBytes);
+
+    /**
+     * Sends every packet once to the group instead of to each receiver. The receivers still
+     * report to the sender directly, so it knows every one of them. Call before any receiver
+     * connected, the address type has to match the transmitter.
+     * @return < 0 if the transmitter can't send to the group
+     */
+    int SetMulticastGroup(const jrtplib::RTPAddress &group);
+
+    /**
+     * Sends a parity packet after every groupSize media packets, so the receivers can rebuild
+     * one lost packet per group. Groups end with a frame, so they may be a little longer.
+     * 0 disables FEC, at most AUDIOSYNC_FEC_MAX_GROUP. Call before any receiver connected.
+     * @return < 0 if the MTU is too small for the parity packets
+     */
+    int SetFEC(size_t groupSize);
+
+    /**
+     * Keeps the last historySize packets, to repeat them when a receiver reports them lost and
+     * they can still be played in time. 0 disables it. The playout lead grows by a round trip.
+     * @return < 0 if the history could not be allocated
+     */
+    int SetRetransmission(size_t historySize);
+
+    /**
+     * Packets repeated on request of a receiver
+     */
+    uint64_t Retransmissions() {
+        return retransmissions;
+    }
+
+    /**
+     * Requested packets which were too late or no longer in the history
+     */
+    uint64_t RetransmissionsMissed() {
+        return retransmissionsMissed;
+    }
+
+    /**
+     * Added on top of the playout lead the receivers need, to absorb what they didn't report
+     */
+    void SetPlayoutMargin(int64_t marginUs);
+
+    /**
+     * Answers SNTP requests on the port, so clients without the clock probes can sync with
+     * this device as well. The poll thread waits for them along with the RTP and RTCP sockets.
+     * Only sessions of StartStreaming have a UDP transmitter to wait with.
+     * @return < 0 if the server could not be started
+     */
+    int StartSNTPServer(uint16_t port);
+
+    /**
+     * Time between the start of streaming and the playback of the first sample,
+     * 0 before it was chosen
+     */
+    int64_t PlayoutLeadUs();
+
+    /**
+     * Samples demuxed ahead of the network thread, 0 without read ahead (see StartStreaming)
+     */
+    size_t SourceQueueDepth();
+
+    /**
+     * How often the network thread had to wait for the demuxer
+     */
+    uint64_t SourceUnderruns();
+
 protected:
 
     void OnNewSource(jrtplib::RTPSourceData *dat);
@@ -36,20 +163,74 @@ protected:
     void OnAPPPacket(jrtplib::RTCPAPPPacket *apppacket, const jrtplib::RTPTime &receivetime,
                      const jrtplib::RTPAddress *senderaddress);
 
+    void OnSentRTPPacket(const void *header, size_t headerLen, const void *payload,
+                         size_t payloadLen);
+
 private:
+    enum {
+        WaitingForClients, WaitingForSync, Streaming, Done
+    } state = WaitingForClients;
     int64_t playbackStartUs = 0;
-    std::atomic_int connectedSources;
-    AMediaExtractor *extractor;
+    bool waitingLogged = false;
+    int64_t syncDeadlineUs = 0;
+    int64_t playoutMarginUs = AUDIOSYNC_DEFAULT_PLAYOUT_MARGIN_US;
+    int64_t playoutLeadUs = 0;
+    int64_t lastTimeUs = -1;
+    int64_t lastFormatUs = 0;
+    size_t mtu = 0, maxPayloadSize = 0;
+    FecEncoder fec;
+    size_t fecGroupSize = 0;
+    bool multicast = false;
+
+    // Sent packets, slot seqNum % historySize. Written by the network thread, read by the poll thread
+    struct HistoryEntry {
+        uint16_t seqNum;
+        size_t length;// 0 if unused
+        int64_t playbackTimeUs;// The deadline of the packet
+    };
+    std::mutex historyMutex;
+    std::vector<uint8_t> historyData;
+    std::vector<HistoryEntry> history;
+    size_t historySize = 0, historySlotSize = 0;
+    int64_t sendingPlaybackTimeUs = 0;// Of the packets being sent
+    std::atomic<uint64_t> retransmissions{0}, retransmissionsMissed{0};
+
+    // Pacing, see SetPacing
+    int64_t leadUs = AUDIOSYNC_DEFAULT_LEAD_US;
+    uint32_t rateCap = AUDIOSYNC_DEFAULT_RATE_CAP, burstBytes = AUDIOSYNC_DEFAULT_BURST;
+    int64_t playbackStartMonoUs = 0, lastRefillUs = 0;
+    double tokens = 0;
+
+    // The next sample, read ahead of sending it
+    uint8_t sample[8192];// TODO figure out optimum size
+    ssize_t sampleSize = 0;
+    int64_t sampleTimeUs = 0;
+    bool hasSample = false;
+    std::atomic_int connectedSources{0};
+    AudioSource *source = NULL;
+    ReadAheadSource *readAhead = NULL;// Same as source if set
+    // Of StartStreaming, the session may use it through the network impairment
+    jrtplib::RTPUDPv4Transmitter *udpTransmitter = NULL;
+    msntp_ctx *sntpServer = NULL;
 
     void RunNetwork();
-    /*void SendPacketRecursive(const void *data, size_t len, uint8_t pt, bool mark,
-                             uint32_t timestampinc);*/
+
+    void InitSession(AudioSource *source);
+    void SendMediaFormat();
+    int SendFrame(const uint8_t *data, size_t len, uint32_t timestampinc, int64_t playbackTimeUs);
+    // Sends one packet of the media stream and adds it to the FEC group
+    int SendMediaPacket(const uint8_t *data, size_t len, bool mark, uint32_t timestampinc,
+                        const uint32_t *ext, size_t extWords);
+    // Sends the parity packet once the group is complete, or right away if flush is set
+    int SendParity(bool flush);
+    int AllocateHistory();
+    // Repeats the packets in the bitmask of a NACK entry to the receiver
+    void Retransmit(const audiostream_nack &nack, jrtplib::RTPSourceData *dat);
+    // Token bucket, returns how long to wait until bytes may be sent
+    int64_t ConsumeTokens(int64_t nowUs, size_t bytes);
+    bool receiversReady();
     int64_t transmissionLatency();
     jrtplib::RTPAddress *addressFromData(jrtplib::RTPSourceData *dat);
-
-    static void *RunNetworkThread(void *ctx);
-
-    static void *RunNTPServer(void *ctx);
 };
 
 
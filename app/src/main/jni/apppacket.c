@@ -1,5 +1,5 @@
 /*
- * apppacket.c: helper function to create and configure a AMediaFormat intance
+ * apppacket.c: helper functions to parse media format strings, to read the clocks and to pin threads
  *
  * (C) Copyright 2015 Simon Grätzer
  * Email: simon@graetzer.org
@@ -10,58 +10,126 @@
  * of the License.
  */
 
+#define _GNU_SOURCE
 #include "apppacket.h"
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
+#include <sched.h>
 
 const uint8_t *audiostream_app_name = (const uint8_t*) "ADST";
 
-AMediaFormat *audiostream_createFormat(char *formatString) {
+typedef struct {
+    const char *key, *type, *value;
+    size_t keyLen, typeLen, valueLen;
+} _formatEntry;
+
+// Split the next "key: type(value)" entry off the string, returns false at the end
+static bool _nextFormatEntry(const char **cursor, _formatEntry *entry) {
+    const char *str = *cursor;
+    while (*str != '\0') {
+        // Skip separators and a leading "{"
+        while (*str == ' ' || *str == ',' || *str == '{') str++;
+        const char *colon = strchr(str, ':');
+        if (colon == NULL) break;
+        const char *valBegin = strchr(colon, '(');
+        const char *end = valBegin != NULL ? strchr(valBegin, ')') : NULL;
+        const char *next = strchr(str, ',');
+        if (end == NULL) break;
+        if (next != NULL && next < valBegin) {// Something without a value, e.g. a ByteBuffer
+            str = next;
+            continue;
+        }
+
+        entry->key = str;
+        entry->keyLen = (size_t) (colon - str);
+        entry->type = colon + 1;
+        while (*entry->type == ' ') entry->type++;
+        entry->typeLen = (size_t) (valBegin - entry->type);
+        entry->value = valBegin + 1;
+        entry->valueLen = (size_t) (end - entry->value);
+        *cursor = end + 1;
+        return true;
+    }
+    *cursor = str + strlen(str);
+    return false;
+}
+
+static bool _findFormatEntry(const char *formatString, const char *key, _formatEntry *entry) {
+    size_t keyLen = strlen(key);
+    while (_nextFormatEntry(&formatString, entry)) {
+        if (entry->keyLen == keyLen && strncmp(entry->key, key, keyLen) == 0) return true;
+    }
+    return false;
+}
+
+bool audiostream_formatInt32(const char *formatString, const char *key, int32_t *value) {
+    _formatEntry entry;
+    if (!_findFormatEntry(formatString, key, &entry)
+        || strncmp(entry.type, "int32", entry.typeLen) != 0) return false;
+
+    char *endptr;
+    long val = strtol(entry.value, &endptr, 10);
+    if (endptr != entry.value + entry.valueLen) return false;
+    *value = (int32_t) val;
+    return true;
+}
+
+bool audiostream_formatString(const char *formatString, const char *key, char *value,
+                              size_t capacity) {
+    _formatEntry entry;
+    if (!_findFormatEntry(formatString, key, &entry)
+        || strncmp(entry.type, "string", entry.typeLen) != 0
+        || entry.valueLen >= capacity) return false;
+
+    memcpy(value, entry.value, entry.valueLen);
+    value[entry.valueLen] = '\0';
+    return true;
+}
+
+#ifdef __ANDROID__
+AMediaFormat *audiostream_createFormat(const char *formatString) {
     // An example should look like this
     // mime: string(audio/mpeg), durationUs: int64(56737959), bit-rate: int32(128000), channel-count: int32(2),
     // sample-rate: int32(44100), encoder-delay: int32(576), encoder-padding: int32(1579)}
 
 
     AMediaFormat *format = AMediaFormat_new();
-    char *attr = strtok(formatString, ", ");
-    do {
-        char *type = strchr(attr, ':');
-        if (type == NULL) continue;
-        char *valBegin = strchr(attr, '(');
-        if (valBegin == NULL) continue;
-        char *end = strchr(valBegin, ')');
-        if (end == NULL) continue;
-
-        type = '\0';
-        valBegin++;
-        type++;
+    _formatEntry entry;
+    while (_nextFormatEntry(&formatString, &entry)) {
+        char attr[128], val[256];
+        if (entry.keyLen >= sizeof(attr) || entry.valueLen >= sizeof(val)) continue;
+        memcpy(attr, entry.key, entry.keyLen);
+        attr[entry.keyLen] = '\0';
+        memcpy(val, entry.value, entry.valueLen);
+        val[entry.valueLen] = '\0';
+
+        const char *type = entry.type;
+        char *end = val + entry.valueLen;
         char *endptr;
         if (strncmp(type, "int32", 5) == 0) {
-            long val = strtol(valBegin, &endptr, 10);
+            long v = strtol(val, &endptr, 10);
             if (endptr == end) {
-                AMediaFormat_setInt32(format, attr, (int32_t)val);
+                AMediaFormat_setInt32(format, attr, (int32_t)v);
             }
         } else if (strncmp(type, "int64", 5) == 0) {
-            long val = strtol(valBegin, &endptr, 10);
+            long long v = strtoll(val, &endptr, 10);
             if (endptr == end) {
-                AMediaFormat_setInt64(format, attr, (int64_t)val);
+                AMediaFormat_setInt64(format, attr, (int64_t)v);
             }
         } else if (strncmp(type, "size_t", 6) == 0) {
             // No set function
-        } else if (strncmp(attr, "float", 5) == 0 || strncmp(type, "double", 6) == 0) {
-            double val = strtod(valBegin, &endptr);
+        } else if (strncmp(type, "float", 5) == 0 || strncmp(type, "double", 6) == 0) {
+            double v = strtod(val, &endptr);
             if (endptr == end) {
-                AMediaFormat_setFloat(format, attr, (float)val);
+                AMediaFormat_setFloat(format, attr, (float)v);
             }
         } else if (strncmp(type, "string", 6) == 0) {
-            *end = '\0';
-            AMediaFormat_setString(format, attr, valBegin);
+            AMediaFormat_setString(format, attr, val);
         } else {
             // probably a ByteBuffer, there is not value given
         }
-
-    } while((attr = strtok(NULL, ", ")) != NULL);
+    }
     return format;
 
     /* TODO for certain codecs we might have to set some  buffer values
@@ -72,8 +140,16 @@ ByteBuffer bb = ByteBuffer.wrap(bytes);
 mf.setByteBuffer("csd-0", bb);
      * */
 }
+#endif
+
+static int64_t (*_clockUs)(void) = NULL;
+
+void audiosync_setClock(int64_t (*clockUs)(void)) {
+    _clockUs = clockUs;
+}
 
 int64_t audiosync_systemTimeUs() {
+    if (_clockUs) return _clockUs();
     struct timespec ts;
     int err = clock_gettime(CLOCK_REALTIME, &ts);
     if (err) return 0;
@@ -82,6 +158,7 @@ int64_t audiosync_systemTimeUs() {
 }
 
 int64_t audiosync_monotonicTimeUs() {
+    if (_clockUs) return _clockUs();
     struct timespec ts;
     int err = clock_gettime(CLOCK_MONOTONIC, &ts);
     if (err) return 0;
@@ -90,6 +167,7 @@ int64_t audiosync_monotonicTimeUs() {
 }
 
 int64_t audiosync_coarseTimeUs() {
+    if (_clockUs) return _clockUs();
     struct timespec ts;
     int err = clock_gettime(CLOCK_REALTIME_COARSE, &ts);
     if (err) return 0;
@@ -102,4 +180,12 @@ int64_t audiosync_coarseAccuracyUs() {
     int err = clock_getres(CLOCK_REALTIME_COARSE, &ts);
     if (err) return 0;
     return (int64_t)ts.tv_sec*SECOND_MICRO + ts.tv_nsec / (int64_t)1000;
-}
\ No newline at end of file
+}
+
+int audiosync_setThreadCPU(int cpu) {
+    if (cpu < 0) return 0;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(cpu_set_t), &set);// 0 is the calling thread
+}
@@ -15,7 +15,12 @@
 
 // c doesn't know the bool type used in NdkMediaFormat.h
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <endian.h>
+#ifdef __ANDROID__
 #include <media/NdkMediaFormat.h>
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -26,8 +31,14 @@ extern "C" {
 
 // A media format packet is just a string, generated from an MediaFormat instance
 #define AUDIOSTREAM_PACKET_MEDIAFORMAT 1
+#ifdef __ANDROID__
 // Try to parse the string returned from AMediaFormat_toString and use all the parameters
-AMediaFormat *audiostream_createFormat(char *formatString);
+AMediaFormat *audiostream_createFormat(const char *formatString);
+#endif
+// Lookup single entries like "sample-rate: int32(44100)" in a format string
+bool audiostream_formatInt32(const char *formatString, const char *key, int32_t *value);
+bool audiostream_formatString(const char *formatString, const char *key, char *value,
+                              size_t capacity);
 
 #define AUDIOSTREAM_PACKET_CLOCK_OFFSET 2
 typedef struct {
@@ -36,13 +47,64 @@ typedef struct {
      */
     int64_t systemTimeUs;
     /**
-     * Clock offset relative to the ntp server, in microseconds.
+     * Clock offset relative to the sender, in microseconds.
      * If positive, the server clock is ahead of the local clock;
      * if negative, the server clock is behind the local clock.
      */
     int64_t offsetUSeconds;
 } __attribute__ ((__packed__)) audiostream_clockOffset;
 
+// Sent by a receiver once it is ready to play, the sender picks the playout lead from these
+#define AUDIOSTREAM_PACKET_RECEIVER_STATUS 3
+typedef struct {
+    /**
+     * Time it took to create and start the decoder and the audio output, in microseconds
+     */
+    int64_t startupUs;
+    /**
+     * Interarrival jitter of the audio packets in microseconds, 0 before any arrived
+     */
+    int64_t jitterUs;
+    /**
+     * How far off the receiver's estimate of the sender clock may be, in microseconds.
+     * 0 if it doesn't estimate it. Missing in the status of older receivers.
+     */
+    int64_t clockErrorUs;
+} __attribute__ ((__packed__)) audiostream_receiverStatus;
+
+// Sent by a receiver for lost packets of the media stream, the sender repeats those which can
+// still be played in time. Like the generic NACK of RFC 4585, every entry names a lost packet and
+// which of the 16 packets after it are lost as well. An APP packet carries several entries.
+#define AUDIOSTREAM_PACKET_NACK 4
+typedef struct {
+    uint16_t seqNum;
+    /**
+     * Bit i is set if seqNum + i + 1 was lost too
+     */
+    uint16_t bitmask;
+} __attribute__ ((__packed__)) audiostream_nack;
+
+// Clock synchronisation like NTP, carried in the RTP session. A receiver sends a probe with the
+// time it was sent, the sender answers with the same struct, filled in with its receive and
+// transmit times. All times are system times in microseconds.
+#define AUDIOSTREAM_PACKET_CLOCK_PROBE 5
+#define AUDIOSTREAM_PACKET_CLOCK_REPLY 6
+typedef struct {
+    /**
+     * SSRC of the receiver which sent the probe, the reply may reach the others as well
+     */
+    uint32_t ssrc;
+    /**
+     * When the receiver sent the probe, on its clock
+     */
+    int64_t originateUs;
+    /**
+     * When the sender received the probe and sent the reply, on its clock. 0 in a probe.
+     */
+    int64_t receiveUs;
+    int64_t transmitUs;
+} __attribute__ ((__packed__)) audiostream_clockProbe;
+
 /*#define AUDIOSTREAM_PACKET_CLOCK_SYNC 2
 // Order clients to align playback at these points
 typedef struct {
@@ -50,12 +112,23 @@ typedef struct {
     int64_t playbackTimeUs;// The media time derived from the RTP packet timestamps
 } __attribute__ ((__packed__)) audiostream_clockSync;*/
 
+// 64 bit byte order conversion, bionic already has these
+#ifndef htonq
+#define htonq(x) htobe64(x)
+#define ntohq(x) be64toh(x)
+#endif
+
 // a million microseconds = one second
 #define SECOND_MICRO ((int64_t)1000000)
 int64_t audiosync_systemTimeUs();
 int64_t audiosync_monotonicTimeUs();
 int64_t audiosync_coarseTimeUs();
 int64_t audiosync_coarseAccuracyUs();
+// Replaces all of the clocks above, e.g. with a simulated one. NULL restores the system clocks
+void audiosync_setClock(int64_t (*clockUs)(void));
+
+// Pins the calling thread to one CPU, a negative cpu leaves it alone. Returns 0 on success
+int audiosync_setThreadCPU(int cpu);
 
 #ifdef __cplusplus
 }
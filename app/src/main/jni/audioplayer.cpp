@@ -1,5 +1,5 @@
 /*
- * audioplayer.c: Encapsulate the OpenSL interface into something simpler to use
+ * audioplayer.cpp: Keeps the playback of an audiostream in sync with the senders clock
  *
  * (C) Copyright 2015 Simon Grätzer
  * Email: simon@graetzer.org
@@ -14,173 +14,45 @@
 #include <time.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 #include <cinttypes>
-#include <SLES/OpenSLES.h>
-#include <SLES/OpenSLES_Android.h>
 #include <android/log.h>
 
 #include "audioplayer.h"
-#include "audioutils/fifo.h"
 #include "apppacket.h"
 
-#include "readerwriterqueue/readerwriterqueue.h"
 //#include "fresample/fresample.h"
 
 
 #define debugLog(...) __android_log_print(ANDROID_LOG_DEBUG, "AudioPlayer", __VA_ARGS__)
 
-// ========= OpenSL ES =========
-// engine interfaces
-static SLObjectItf engineObject = NULL;
-static SLEngineItf engineEngine;
-// output mix interfaces
-static SLObjectItf outputMixObject = NULL;
-// buffer queue player interfaces
-static SLObjectItf playerObject = NULL;
-static SLPlayItf playerPlay;
-static SLAndroidSimpleBufferQueueItf playerBufferQueue;
-static SLPlaybackRateItf playerPlayRate;
-
-//static SLVolumeItf playerVolume;
-
-// ========= Audio Params =========
-// Device parameters for playback
-static uint32_t global_samplesPerSec;
-static uint32_t global_framesPerBuffers;
-// Parameters for current audio stream
-static uint32_t current_samplesPerSec = 44100;
-static uint32_t current_numChannels = 1;
-// Will be adjusted over time
-static int32_t current_ratePermille = 1000;
-
-// ========= Audio Data Queue =========
-// Audio data queue
-static struct audio_utils_fifo fifo;
-static void *fifoBuffer = NULL;
-
-// ======== Sync Variables =========
-static int64_t current_syncSystemTimeUs = 0;
-static size_t current_bufferedFrames = 0;
-
-// ======== Timeing offset vars =======
-static int64_t current_systemTimeOffsetUs = 0;
-static int64_t current_deviceLatency = 0;
-
-// ============ Some info to interact with the callback ==============
-typedef struct {
-    size_t frameCount;
-    int64_t playbackTimeUs;// The media time derived from the RTP packet timestamps
-} _playbackMark;
-static moodycamel::ReaderWriterQueue<_playbackMark> current_playbackMarkQueue(8192);
-// write / read to aligned 32bit integer is atomic
-// Written to by monitoring thread
-static bool current_isPlaying = false;
-static bool current_enableJumps = false;
-
-// Writtten by the callback
-static volatile int64_t current_queuedFrames = 0;// Bytes appended to the audio queue
-static _playbackMark last_mark;// Last sync mark
-static int64_t current_started = 0;
-static int64_t current_drop = 0;
-static int64_t current_diff = 0;
-
-// =================== Helpers ===================
-static const char *_descriptionForResult(SLresult result) {
-    switch (result) {
-        case SL_RESULT_SUCCESS:
-            return "SUCCESS";
-        case SL_RESULT_PRECONDITIONS_VIOLATED:
-            return "PRECONDITIONS_VIOLATED";
-        case SL_RESULT_PARAMETER_INVALID:
-            return "PARAMETER_INVALID";
-        case SL_RESULT_MEMORY_FAILURE:
-            return "MEMORY_FAILURE";
-        case SL_RESULT_RESOURCE_ERROR:
-            return "RESOURCE_ERROR";
-        case SL_RESULT_RESOURCE_LOST:
-            return "RESOURCE_LOST";
-        case SL_RESULT_IO_ERROR:
-            return "IO_ERROR";
-        case SL_RESULT_BUFFER_INSUFFICIENT:
-            return "BUFFER_INSUFFICIENT";
-        case SL_RESULT_CONTENT_CORRUPTED:
-            return "CONTENT_CORRUPTED";
-        case SL_RESULT_CONTENT_UNSUPPORTED:
-            return "CONTENT_UNSUPPORTED";
-        case SL_RESULT_CONTENT_NOT_FOUND:
-            return "CONTENT_NOT_FOUND";
-        case SL_RESULT_PERMISSION_DENIED:
-            return "PERMISSION_DENIED";
-        case SL_RESULT_FEATURE_UNSUPPORTED:
-            return "FEATURE_UNSUPPORTED";
-        case SL_RESULT_INTERNAL_ERROR:
-            return "INTERNAL_ERROR";
-        case SL_RESULT_OPERATION_ABORTED:
-            return "OPERATION_ABORTED";
-        case SL_RESULT_CONTROL_LOST:
-            return "CONTROL_LOST";
-        default:
-            return "Unknown error code";
-    }
-}
-
-#define _checkerror(result) _checkerror_internal(result, __FUNCTION__)
+// Maximum amount of bytes we read from the fifo in one callback
+#define MAX_BUFFER_SIZE AUDIOSINK_MAX_BUFFER_SIZE
 
-static void _checkerror_internal(SLresult result, const char *f) {
-    if (SL_RESULT_SUCCESS != result) {
-        debugLog("%s - OpenSL ES error: %s", f, _descriptionForResult(result));
-        // TODO figure out which errors to treat as fatal
-        if (result != SL_RESULT_BUFFER_INSUFFICIENT) {
-            exit(-1);
-        }
-    }
+AudioPlayer::AudioPlayer(AudioSink *sink) : sink(sink), fifo(), current_playbackMarkQueue(8192) {
+    memset(&last_mark, 0, sizeof(_playbackMark));
 }
 
-// =================== Setup OpenSL objects ===================
-
-// create the engine and output mix objects
-static void _createEngine() {
-    // create engine
-    SLresult result = slCreateEngine(&engineObject, 0, NULL, 0, NULL, NULL);
-    _checkerror(result);
-
-    // realize the engine
-    result = (*engineObject)->Realize(engineObject, SL_BOOLEAN_FALSE);
-    _checkerror(result);
-
-    // get the engine interface, which is needed in order to create other objects
-    result = (*engineObject)->GetInterface(engineObject, SL_IID_ENGINE, &engineEngine);
-    _checkerror(result);
-
-    result = (*engineEngine)->CreateOutputMix(engineEngine, &outputMixObject, 0, NULL, NULL);
-    _checkerror(result);
-    (void) result;
-
-    // realize the output mix
-    result = (*outputMixObject)->Realize(outputMixObject, SL_BOOLEAN_FALSE);
-    _checkerror(result);
+AudioPlayer::~AudioPlayer() {
+    StopPlayback();
+    // free the buffer if it was allocated
+    if (fifoBuffer != NULL) {
+        free(fifoBuffer);
+        fifoBuffer = NULL;
+    }
 }
 
-// Temporary buffer for the audio buffer queue.
-// 8192 equals 2048 frames with 2 channels with 16bit PCM format
-#define N_BUFFERS 3
-#define MAX_BUFFER_SIZE (8192)
-int16_t tempBuffers[MAX_BUFFER_SIZE * N_BUFFERS];
-uint32_t tempBuffers_ix = 0;
-// this callback handler is called every time a buffer finishes playing
-static void _bqPlayerCallback(SLAndroidSimpleBufferQueueItf bq, void *context __unused) {
+// this is called every time a buffer finishes playing
+size_t AudioPlayer::RenderFrames(int16_t *buf_ptr) {
     // Assuming PCM 16
     // Let's try to fill in the ideal amount of frames. Frame size: numChannels * sizeof(int16_t)
-    // global_framesPerBuffers is the max amount of frames we read
+    // framesPerBuffer is the max amount of frames we read
+    const size_t framesPerBuffer = sink->FramesPerBuffer();
     size_t frameSize = current_numChannels * sizeof(int16_t);
-    size_t maxBufferSize = global_framesPerBuffers * frameSize;
-
-    tempBuffers_ix = (tempBuffers_ix + 1) % N_BUFFERS;
-    int16_t *buf_ptr = tempBuffers + maxBufferSize * tempBuffers_ix;
+    size_t maxBufferSize = framesPerBuffer * frameSize;
 
-
-    static int64_t accuracy;
-    int64_t nowUs = audiosync_coarseTimeUs() + current_systemTimeOffsetUs + current_deviceLatency;
+    int64_t localUs = audiosync_coarseTimeUs();
+    int64_t nowUs = localUs + SystemTimeOffsetUs(localUs) + current_deviceLatency;
     if (!current_isPlaying && current_syncSystemTimeUs != 0) {
         if (accuracy == 0) accuracy = audiosync_coarseAccuracyUs();// Usually 10ms
 
@@ -223,169 +95,106 @@ static void _bqPlayerCallback(SLAndroidSimpleBufferQueueItf bq, void *context __
         current_drop = drop;
         current_diff = diff;
 
-        size_t requestFrames = global_framesPerBuffers;
+        // The drift of the server clock, dropped or repeated a frame at a time
+        ClockModel model = LoadClockModel();
+        int skewFrame = 0;
+        current_skewFrames += model.skew * framesPerBuffer;
+        if (current_skewFrames >= 1) skewFrame = 1;
+        else if (current_skewFrames <= -1) skewFrame = -1;
+
+        size_t requestFrames = framesPerBuffer;
         if (current_enableJumps) {
             if (diff >= accuracy/2) {// Speed up playback a bit
                 requestFrames += drop;
                 if (requestFrames * frameSize > MAX_BUFFER_SIZE) {
                     requestFrames = MAX_BUFFER_SIZE / frameSize;
-                    drop = requestFrames - global_framesPerBuffers;
+                    drop = requestFrames - framesPerBuffer;
                 }
             } else if (diff <= -accuracy/2) {// Play silence
                 drop = -drop;
-                if (drop < global_framesPerBuffers) {
+                if (drop < (int64_t) framesPerBuffer) {
                     size_t ss = (size_t) drop * current_numChannels;
                     ssize_t frameCount = audio_utils_fifo_read(&fifo, buf_ptr + ss,
                                                                requestFrames - drop);
                     if (frameCount > 0) {
                         memset(buf_ptr, 0, ss);
-
-                        SLresult result = (*bq)->Enqueue(bq, buf_ptr, (SLuint32) maxBufferSize);
-                        _checkerror(result);
                         current_queuedFrames += frameCount;
-                        return;
+                        return framesPerBuffer;
                     }
                 }
                 memset(buf_ptr, 1, maxBufferSize);// for some reason 0 doesn't work
-                SLresult result = (*bq)->Enqueue(bq, buf_ptr, (SLuint32) maxBufferSize);
-                _checkerror(result);
-                return;
+                return framesPerBuffer;
             }
         }
 
         // Now we can start playing some sound
+        bool jumping = current_enableJumps && diff >= accuracy/2 && drop > 0;
+        if (!jumping && skewFrame != 0 && (requestFrames + 1) * frameSize <= MAX_BUFFER_SIZE) {
+            requestFrames += skewFrame;
+        } else {
+            // The jump catches up with whatever drift built up meanwhile
+            if (current_skewFrames > 1) current_skewFrames = 1;
+            if (current_skewFrames < -1) current_skewFrames = -1;
+            skewFrame = 0;
+        }
         ssize_t frameCount = audio_utils_fifo_read(&fifo, buf_ptr, requestFrames);
         if (frameCount > 0) {
 
+            if (skewFrame != 0 && frameCount == (ssize_t) requestFrames && frameCount > 1) {
+                size_t last = (size_t) (frameCount - 1) * current_numChannels;
+                size_t prev = last - current_numChannels;
+                if (skewFrame > 0) {// Average the last two frames into one
+                    for (uint32_t c = 0; c < current_numChannels; c++)
+                        buf_ptr[prev+c] = (int16_t) ((buf_ptr[prev+c] + buf_ptr[last+c]) / 2);
+                    current_queuedFrames += 1;
+                    frameCount--;
+                } else {// Repeat the last frame
+                    for (uint32_t c = 0; c < current_numChannels; c++)
+                        buf_ptr[last+current_numChannels+c] = buf_ptr[last+c];
+                    current_queuedFrames -= 1;
+                    frameCount++;
+                }
+                current_skewFrames -= skewFrame;
+            }
+
             // Implementing dropping or stretching of frames
-            if (current_enableJumps && diff >= accuracy/2 && frameCount == requestFrames) {
+            if (jumping && frameCount == (ssize_t) requestFrames) {
                 int mod = (int)(frameCount / drop);
                 int nFrame = 0;
                 for (int frame = 0; frame < frameCount; frame++) {
                     int from = frame * current_numChannels;
                     int to = nFrame * current_numChannels;
 
-                    if (drop > 0 && frame % mod == 0) {
+                    if (drop > 0 && frame % mod == 0 && frame + 1 < frameCount) {
                         int next = from + current_numChannels;
-                        for (int c = 0; c < current_numChannels; c++)
+                        for (uint32_t c = 0; c < current_numChannels; c++)
                             buf_ptr[to+c] = (int16_t) ((buf_ptr[from+c] + buf_ptr[next+c]) / 2);
                         drop--;
                         continue;
                     }
 
-                    for (int c = 0; c < current_numChannels; c++) buf_ptr[to+c] = buf_ptr[from+c];
+                    for (uint32_t c = 0; c < current_numChannels; c++) buf_ptr[to+c] = buf_ptr[from+c];
                     nFrame++;
                 }
-                current_queuedFrames += frameCount - global_framesPerBuffers;
-                frameCount = global_framesPerBuffers;
+                current_queuedFrames += frameCount - nFrame;
+                frameCount = nFrame;
             }
 
             current_queuedFrames += frameCount;
-            maxBufferSize = frameCount * current_numChannels * sizeof(int16_t);
-            SLresult result = (*bq)->Enqueue(bq, buf_ptr, (SLuint32) maxBufferSize);
-            _checkerror(result);
-
-            return;
+            return (size_t) frameCount;
         }
         debugLog("FIFO buffer is empty");
+        return 0;
     } else {
         // Don't actually starve the buffer, just keep it running
         memset(buf_ptr, 1, maxBufferSize);// for some reason 0 doesn't work
-        //_generateTone(buf_ptr);
-        SLresult result = (*bq)->Enqueue(bq, buf_ptr, (SLuint32) maxBufferSize);
-        _checkerror(result);
-    }
-}
-
-// create buffer queue audio player
-static void _createBufferQueueAudioPlayer(SLuint32 samplesPerSec, SLuint32 numChannels) {
-    SLresult result;
-    SLuint32 channelMask = SL_SPEAKER_FRONT_CENTER;
-    if (numChannels >= 2) {
-        numChannels = 2;// I don't think devices support more than 2
-        channelMask = SL_SPEAKER_FRONT_LEFT | SL_SPEAKER_FRONT_RIGHT;
-        debugLog("Using stereo audio");
-    }
-
-    // configure audio source
-    SLDataLocator_AndroidSimpleBufferQueue bufferQueue = {SL_DATALOCATOR_ANDROIDSIMPLEBUFFERQUEUE, 1};
-    SLDataFormat_PCM format_pcm = {
-            .formatType = SL_DATAFORMAT_PCM,
-            .numChannels = numChannels,
-            .samplesPerSec = samplesPerSec * 1000,// Milli Hz
-            .bitsPerSample = SL_PCMSAMPLEFORMAT_FIXED_16,
-            .containerSize = SL_PCMSAMPLEFORMAT_FIXED_16,
-            .channelMask = channelMask,
-            .endianness = SL_BYTEORDER_LITTLEENDIAN// TODO: compute real endianness
-    };
-    SLDataSource audioSrc = {&bufferQueue, &format_pcm};
-
-    // configure audio sink
-    SLDataLocator_OutputMix loc_outmix = {SL_DATALOCATOR_OUTPUTMIX, outputMixObject};
-    SLDataSink audioSnk = {&loc_outmix, NULL};
-
-    // create audio player
-    const SLInterfaceID ids[2] = {SL_IID_BUFFERQUEUE, SL_IID_PLAYBACKRATE};//, SL_IID_VOLUME
-    const SLboolean req[2] = {SL_BOOLEAN_TRUE, SL_BOOLEAN_TRUE};
-    result = (*engineEngine)->CreateAudioPlayer(engineEngine, &playerObject, &audioSrc, &audioSnk,
-                                                2, ids, req);// ids length, interfaces, required
-    _checkerror(result);
-
-    // realize the player
-    result = (*playerObject)->Realize(playerObject, SL_BOOLEAN_FALSE);
-    _checkerror(result);
-
-    // get the play interface
-    result = (*playerObject)->GetInterface(playerObject, SL_IID_PLAY, &playerPlay);
-    _checkerror(result);
-
-    // get the buffer queue interface
-    result = (*playerObject)->GetInterface(playerObject, SL_IID_BUFFERQUEUE, &playerBufferQueue);
-    _checkerror(result);
-
-    // get playback rate interface
-    result = (*playerObject)->GetInterface(playerObject, SL_IID_PLAYBACKRATE, &playerPlayRate);
-    _checkerror(result);
-
-    // register callback on the buffer queue
-    result = (*playerBufferQueue)->RegisterCallback(playerBufferQueue, _bqPlayerCallback, NULL);
-    _checkerror(result);
-
-    // get the volume interface
-    //result = (*playerObject)->GetInterface(playerObject, SL_IID_VOLUME, &playerVolume);
-    //_checkerror(result);
-}
-
-void _cleanupBufferQueueAudioPlayer() {
-    // destroy buffer queue audio player object, and invalidate all associated interfaces
-    if (playerObject != NULL) {
-        (*playerObject)->Destroy(playerObject);
-        playerObject = NULL;
-        playerPlay = NULL;
-        playerBufferQueue = NULL;
-        //playerPlayRate = NULL;
-        //playerVolume = NULL;
+        return framesPerBuffer;
     }
 }
 
 // =================== Public API calls ===================
 
-void audioplayer_initGlobal(uint32_t samplesPerSec, uint32_t framesPerBuffer) {
-    debugLog("Device Buffer Size: %d ;  Sample Rate: %d", framesPerBuffer, samplesPerSec);
-    global_samplesPerSec = samplesPerSec;
-    global_framesPerBuffers = framesPerBuffer;
-
-    if (framesPerBuffer > MAX_BUFFER_SIZE) {
-        debugLog("ATTENTION: Global buffersize is bigger than MAX_BUFFER_SIZE");
-    }
-}
-
-void audioplayer_initPlayback(uint32_t samplesPerSec, uint32_t numChannels) {
-    if (engineObject == NULL) {
-        _createEngine();
-        debugLog("Initialized AudioPlayer");
-    }
-
+void AudioPlayer::InitPlayback(uint32_t samplesPerSec, uint32_t numChannels) {
     debugLog("Audio Sample Rate: %u; Channels: %u", samplesPerSec, numChannels);
     // Reset our entire state
     current_samplesPerSec = samplesPerSec;
@@ -400,6 +209,8 @@ void audioplayer_initPlayback(uint32_t samplesPerSec, uint32_t numChannels) {
     current_started = 0;
     current_drop = 0;
     current_diff = 0;
+    current_skewFrames = 0;
+    monitor_lastPrint = 0;
 
     // Empty queues
     if (current_playbackMarkQueue.size_approx() > 0) {
@@ -409,28 +220,23 @@ void audioplayer_initPlayback(uint32_t samplesPerSec, uint32_t numChannels) {
         }
     }
 
-    _createBufferQueueAudioPlayer(current_samplesPerSec, current_numChannels);
-    // Always use optimal rate, resample by slowing down playback
-    if (global_samplesPerSec != samplesPerSec) {
-        // Will probably result in "AUDIO_OUTPUT_FLAG_FAST denied by client"
-        debugLog("Global:%d != Current: %d", global_samplesPerSec, samplesPerSec);
-        (*playerPlayRate)->SetRate(playerPlayRate, (SLpermille) 1000);
-    }
-
     // Initialize the audio buffer queue
     size_t frameCount = current_samplesPerSec * 60 * 5;// 5 minutes buffer
     size_t frameSize = current_numChannels * sizeof(uint16_t);
     fifoBuffer = realloc(fifoBuffer, frameCount * frameSize);// Is as good as malloc
     audio_utils_fifo_init(&fifo, frameCount, frameSize, fifoBuffer);
 
+    // Always use optimal rate, resample by slowing down playback
+    if (sink->SampleRate() != samplesPerSec) {
+        // Will probably result in "AUDIO_OUTPUT_FLAG_FAST denied by client"
+        debugLog("Global:%d != Current: %d", sink->SampleRate(), samplesPerSec);
+    }
     // This call has latency, we need to keep the audio system starving to perform start / pause
-    SLresult result = (*playerPlay)->SetPlayState(playerPlay, SL_PLAYSTATE_PLAYING);
-    _checkerror(result);
-    _bqPlayerCallback(playerBufferQueue, NULL);
+    sink->Open(current_samplesPerSec, current_numChannels, this);
     debugLog("Initialized playback");
 }
 
-void audioplayer_enqueuePCMFrames(const uint8_t *pcmBuffer, size_t pcmSize, int64_t playbackTimeUs) {
+void AudioPlayer::EnqueuePCMFrames(const uint8_t *pcmBuffer, size_t pcmSize, int64_t playbackTimeUs) {
 
 
     size_t frameSize = current_numChannels * sizeof(uint16_t);
@@ -449,18 +255,18 @@ void audioplayer_enqueuePCMFrames(const uint8_t *pcmBuffer, size_t pcmSize, int6
     //debugLog("Enqueued: %" PRId64 ", pl: %" PRId64, mark.systemTimeUs, playbackTimeUs);
 
     if (written == 0 && pcmSize > 0 && current_isPlaying) {
-        audioplayer_monitorPlayback();
+        MonitorPlayback();
         debugLog("FiFo queue seems to be full, slowing down");
         struct timespec req;
         req.tv_sec = (time_t) 3;// Let's sleep for a while
         req.tv_nsec = 0;
         nanosleep(&req, NULL);
-        audioplayer_enqueuePCMFrames(pcmBuffer, pcmSize, playbackTimeUs);
+        EnqueuePCMFrames(pcmBuffer, pcmSize, playbackTimeUs);
     }
-    audioplayer_monitorPlayback();
+    MonitorPlayback();
 }
 
-void audioplayer_syncPlayback(int64_t systemTimeUs, int64_t playbackTimeUs) {
+void AudioPlayer::SyncPlayback(int64_t systemTimeUs, int64_t playbackTimeUs) {
     if (current_syncSystemTimeUs == 0) {
         /*_playbackMark mark;
         mark.playbackTimeUs = 0;
@@ -468,61 +274,87 @@ void audioplayer_syncPlayback(int64_t systemTimeUs, int64_t playbackTimeUs) {
         current_playbackMarkQueue.enqueue(mark);*/
         current_syncSystemTimeUs = systemTimeUs - playbackTimeUs;
 
-        int64_t nowUs = audiosync_systemTimeUs() + current_systemTimeOffsetUs;
-        int64_t diff = systemTimeUs - nowUs;
+        int64_t localUs = audiosync_systemTimeUs();
+        int64_t diff = systemTimeUs - (localUs + SystemTimeOffsetUs(localUs));
         debugLog("Start determined to: %" PRId64, current_syncSystemTimeUs);
         debugLog("Starting playback in %fs", diff / 1E6);
     }
 
     //debugLog("Adding Sync: System time %"PRId64". PlaybackTime: %"PRId64, systemTimeUs, playbackTimeUs);
-    audioplayer_monitorPlayback();
+    MonitorPlayback();
+}
+
+void AudioPlayer::SetSystemTimeOffset(int64_t offsetUs) {
+    SetClockModel(0, offsetUs, 0);
+    debugLog("Clock offset %" PRId64, offsetUs);
+}
+
+void AudioPlayer::SetClockModel(int64_t referenceUs, int64_t offsetUs, double skew) {
+    std::lock_guard<std::mutex> lock(clock_mutex);
+    uint32_t seq = current_clockSeq.load(std::memory_order_relaxed);
+    current_clockSeq.store(seq + 1, std::memory_order_relaxed);// Odd while writing
+    std::atomic_thread_fence(std::memory_order_release);
+    current_clockReferenceUs.store(referenceUs, std::memory_order_relaxed);
+    current_clockOffsetUs.store(offsetUs, std::memory_order_relaxed);
+    current_clockSkew.store(skew, std::memory_order_relaxed);
+    current_clockSeq.store(seq + 2, std::memory_order_release);
 }
 
-void audioplayer_setSystemTimeOffset(int64_t offsetUs) {
-    current_systemTimeOffsetUs = offsetUs;
-    debugLog("NTP offset %" PRId64, offsetUs);
+AudioPlayer::ClockModel AudioPlayer::LoadClockModel() {
+    ClockModel model;
+    uint32_t before, after;
+    do {
+        before = current_clockSeq.load(std::memory_order_acquire);
+        model.referenceUs = current_clockReferenceUs.load(std::memory_order_relaxed);
+        model.offsetUs = current_clockOffsetUs.load(std::memory_order_relaxed);
+        model.skew = current_clockSkew.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = current_clockSeq.load(std::memory_order_relaxed);
+    } while ((before & 1) != 0 || before != after);
+    return model;
 }
 
-void audioplayer_setDeviceLatency(int64_t latencyUs) {
+int64_t AudioPlayer::SystemTimeOffsetUs(int64_t nowUs) {
+    ClockModel model = LoadClockModel();
+    return model.offsetUs + (int64_t) (model.skew * (nowUs - model.referenceUs));
+}
+
+void AudioPlayer::SetDeviceLatency(int64_t latencyUs) {
     current_deviceLatency = latencyUs;
-    debugLog("Set device latency to" PRId64, latencyUs);
+    debugLog("Set device latency to %" PRId64, latencyUs);
 }
 
-void audioplayer_monitorPlayback() {
+void AudioPlayer::MonitorPlayback() {
+    std::lock_guard<std::mutex> lock(monitor_mutex);
 
     //debugLog("Mark: Sample %lu Presentation Time: %"PRId64, last_mark.frameCount, last_mark.playbackTimeUs);
     //debugLog("Sync: System time %"PRId64". Presentation Time: %"PRId64, last_sync.systemTimeUs, last_sync.playbackTimeUs);
 
-    static int64_t lastPrint;
-    static int64_t lastDiff;
-    static int64_t lastAdjustment;
-    static int64_t listenTime;
-
     if (current_isPlaying) {
         int64_t nowUs = audiosync_monotonicTimeUs();
-        if (lastPrint == 0) {
+        if (monitor_lastPrint == 0) {
             int64_t diff = current_syncSystemTimeUs - current_started;
             debugLog("Started late / early %fs. Diff in callback %fs", diff/1E6, current_diff/1E6);
             debugLog("Clock accuracy %" PRId64, audiosync_coarseAccuracyUs());
-            lastPrint = nowUs;
-            lastDiff = current_diff;
-            lastAdjustment = nowUs;// don't wait full 2 seconds
-            listenTime = 2*SECOND_MICRO;
+            monitor_lastPrint = nowUs;
+            monitor_lastDiff = current_diff;
+            monitor_lastAdjustment = nowUs;// don't wait full 2 seconds
+            monitor_listenTime = 2*SECOND_MICRO;
             return;
         }
 
-        int64_t wait = nowUs - lastPrint;
+        int64_t wait = nowUs - monitor_lastPrint;
         const int64_t diff = current_diff;
         if (wait > 5*SECOND_MICRO) {
             // Is positive if we are late, negative if we are too fast
             debugLog("Accumulated diff: %fs", diff/1E6);
-            lastPrint = nowUs;
+            monitor_lastPrint = nowUs;
         }
-        wait = nowUs - lastAdjustment;
-        if (!current_enableJumps && wait > listenTime) {
-            listenTime = 5*SECOND_MICRO;// Don't reset so often
+        wait = nowUs - monitor_lastAdjustment;
+        if (!current_enableJumps && wait > monitor_listenTime) {
+            monitor_listenTime = 5*SECOND_MICRO;// Don't reset so often
 
-            double vDelta = (double)(lastDiff-diff) / wait;
+            double vDelta = (double)(monitor_lastDiff-diff) / wait;
 
             int32_t offset = (int32_t)(vDelta * 1000);
             debugLog("Speed: %f. Drop %" PRId64 ". Rate offset %" PRId32, vDelta + 1.0,
@@ -533,60 +365,33 @@ void audioplayer_monitorPlayback() {
             if (newRate > 2000) newRate = 2000;
             if (2 <= labs((long)offset)) {
                 current_ratePermille = newRate;
-                (*playerPlayRate)->SetRate(playerPlayRate, (SLpermille) current_ratePermille);
+                sink->SetPlaybackRate(current_ratePermille);
                 debugLog("Adjusted Rate");
             }
             current_enableJumps = true;
-            lastDiff = diff;
-            lastAdjustment = nowUs;
+            monitor_lastDiff = diff;
+            monitor_lastAdjustment = nowUs;
             debugLog("Enabled Jumps");
         } else if (current_enableJumps
-                   && wait > llabs((long long)lastDiff) && lastDiff != diff) {// Use lastDiff as the jumping allowed time
+                   && wait > llabs((long long)monitor_lastDiff) && monitor_lastDiff != diff) {// Use lastDiff as the jumping allowed time
             current_enableJumps = false;
-            lastDiff = diff;
-            lastAdjustment = nowUs;
+            monitor_lastDiff = diff;
+            monitor_lastAdjustment = nowUs;
             debugLog("Disabled Jumps");
         }
     } else  {
-        lastPrint = 0;
+        monitor_lastPrint = 0;
     }
 }
 
-int64_t audioplayer_currentPlaybackTimeUs() {
+int64_t AudioPlayer::CurrentPlaybackTimeUs() {
     return last_mark.playbackTimeUs;
 }
 
-void audioplayer_stopPlayback() {
+void AudioPlayer::StopPlayback() {
     debugLog("Stopping playback");
-    if (playerPlay) {
-        SLresult result = (*playerPlay)->SetPlayState(playerPlay, SL_PLAYSTATE_STOPPED);
-        _checkerror(result);
-        debugLog("Stopped playback");
-    }
-
     // Cleanup audio-player so we can use different parameters
-    _cleanupBufferQueueAudioPlayer();
+    sink->Close();
+    current_isPlaying = false;
     audio_utils_fifo_deinit(&fifo);// noop
 }
-
-// shut down the native audio system
-void audioplayer_cleanup() {
-    audioplayer_stopPlayback();
-
-    // destroy output mix object, and invalidate all associated interfaces
-    if (outputMixObject != NULL) {
-        (*outputMixObject)->Destroy(outputMixObject);
-        outputMixObject = NULL;
-    }
-    // destroy engine object, and invalidate all associated interfaces
-    if (engineObject != NULL) {
-        (*engineObject)->Destroy(engineObject);
-        engineObject = NULL;
-        engineEngine = NULL;
-    }
-    // free the buffer if it was allocated
-    if (fifoBuffer != NULL) {
-        free(fifoBuffer);
-        fifoBuffer = NULL;
-    }
-}
@@ -1,5 +1,5 @@
 /*
- * audioplayer.h: Encapsulate the OpenSL interface into something simpler to use
+ * audioplayer.h: Keeps the playback of an audiostream in sync with the senders clock
  *
  * (C) Copyright 2015 Simon Grätzer
  * Email: simon@graetzer.org
@@ -12,52 +12,147 @@
 
 #ifndef AUDIOSYNC_AUDIOPLAYER_H
 #define AUDIOSYNC_AUDIOPLAYER_H
-#ifdef __cplusplus
-extern "C" {
-#endif
 
 #include <stdint.h>
+#include <sys/types.h>
+#include <atomic>
+#include <mutex>
 
-// Initialize the OpenSL audio interface
-void audioplayer_initGlobal(uint32_t samplesPerSec, uint32_t framesPerBuffer);
-/**
- * Init player with samples and channels for the current audiostream. Buffer can fit 5 minutes
- */
-void audioplayer_initPlayback(uint32_t samplesPerSec, uint32_t numChannels);
-/**
- * Enqueue 16 bit PCM audio frames, channels interleaved
- */
-void audioplayer_enqueuePCMFrames(const uint8_t *pcmBuffer, size_t pcmSize, int64_t playbackTimeUs);
-/**
- * Synchronize Playback to an External Source
- * @param playbackTimeUs  The precise time at which to match playback of the audio-stream.
- * @param hostTimeUs      The host time at which to synchronize playback.
- */
-void audioplayer_syncPlayback(int64_t systemTimeUs, int64_t playbackTimeUs);
-/**
- * If positive, the server clock is ahead of the local clock;
- * if negative, the server clock is behind the local clock.
- */
-void audioplayer_setSystemTimeOffset(int64_t offsetUs);
-/**
- * The latency from the moment the audio data is written to the systems
- */
-void audioplayer_setDeviceLatency(int64_t latencyUs);
-// Call this regulary if you don't call any other methods here regulary instead
-void audioplayer_monitorPlayback();
-int64_t audioplayer_currentPlaybackTimeUs();
-/**
- * Stop playback
- */
-void audioplayer_stopPlayback();
-/**
- * Cleanup resources
+#include "audioutils/fifo.h"
+#include "readerwriterqueue/readerwriterqueue.h"
+#include "backend/AudioSink.h"
+#include "backend/AudioDecoder.h"
+
+/*
+ * The player buffers the decoded PCM data and renders it into an AudioSink (OpenSL ES on android)
+ * so that the playback matches the playback time announced by the sender.
  */
-void audioplayer_cleanup();
+class AudioPlayer : public AudioRenderer, public AudioDecoderOutput {
+public:
+    AudioPlayer(AudioSink *sink);
+
+    ~AudioPlayer();
+
+    /**
+     * Init player with samples and channels for the current audiostream. Buffer can fit 5 minutes
+     */
+    void InitPlayback(uint32_t samplesPerSec, uint32_t numChannels);
+
+    /**
+     * Enqueue 16 bit PCM audio frames, channels interleaved
+     */
+    void EnqueuePCMFrames(const uint8_t *pcmBuffer, size_t pcmSize, int64_t playbackTimeUs);
+
+    /**
+     * Synchronize Playback to an External Source
+     * @param playbackTimeUs  The precise time at which to match playback of the audio-stream.
+     * @param hostTimeUs      The host time at which to synchronize playback.
+     */
+    void SyncPlayback(int64_t systemTimeUs, int64_t playbackTimeUs);
+
+    /**
+     * If positive, the server clock is ahead of the local clock;
+     * if negative, the server clock is behind the local clock.
+     */
+    void SetSystemTimeOffset(int64_t offsetUs);
+
+    /**
+     * Like SetSystemTimeOffset, but the offset follows the drift of the server clock. At the
+     * local system time t it is offsetUs + skew * (t - referenceUs). The playback is sped up or
+     * slowed down by the skew a frame at a time, before the drift adds up.
+     */
+    void SetClockModel(int64_t referenceUs, int64_t offsetUs, double skew);
+
+    /**
+     * The latency from the moment the audio data is written to the systems
+     */
+    void SetDeviceLatency(int64_t latencyUs);
+
+    // Call this regulary if you don't call any other methods here regulary instead
+    void MonitorPlayback();
+
+    int64_t CurrentPlaybackTimeUs();
+
+    /**
+     * Stop playback
+     */
+    void StopPlayback();
+
+    // Called by the sink every time a buffer finishes playing
+    size_t RenderFrames(int16_t *buffer);
+
+    AudioSink *Sink() {
+        return sink;
+    }
+
+private:
+    AudioSink *sink;
+
+    // ========= Audio Params =========
+    // Parameters for current audio stream
+    uint32_t current_samplesPerSec = 44100;
+    uint32_t current_numChannels = 1;
+    // Will be adjusted over time
+    int32_t current_ratePermille = 1000;
+
+    // ========= Audio Data Queue =========
+    // Audio data queue
+    struct audio_utils_fifo fifo;
+    void *fifoBuffer = NULL;
+
+    // ======== Sync Variables =========
+    int64_t current_syncSystemTimeUs = 0;
+    size_t current_bufferedFrames = 0;
+
+    // ======== Timeing offset vars =======
+    struct ClockModel {
+        int64_t referenceUs, offsetUs;
+        double skew;
+    };
+    // A seqlock, the callback retries its copy if the count was odd or changed meanwhile. It never
+    // waits for the writers, which are serialized by the mutex.
+    std::atomic<uint32_t> current_clockSeq{0};
+    std::atomic<int64_t> current_clockReferenceUs{0}, current_clockOffsetUs{0};
+    std::atomic<double> current_clockSkew{0};
+    std::mutex clock_mutex;
+    int64_t current_deviceLatency = 0;
+    double current_skewFrames = 0;// Drift compensation which is still due, in frames
+
+    // ============ Some info to interact with the callback ==============
+    typedef struct {
+        size_t frameCount;
+        int64_t playbackTimeUs;// The media time derived from the RTP packet timestamps
+    } _playbackMark;
+    moodycamel::ReaderWriterQueue<_playbackMark> current_playbackMarkQueue;
+    // write / read to aligned 32bit integer is atomic
+    // Written to by monitoring thread
+    bool current_isPlaying = false;
+    bool current_enableJumps = false;
+
+    // Writtten by the callback
+    volatile int64_t current_queuedFrames = 0;// Bytes appended to the audio queue
+    _playbackMark last_mark;// Last sync mark
+    int64_t current_started = 0;
+    int64_t current_drop = 0;
+    int64_t current_diff = 0;
+    int64_t accuracy = 0;
+
+    // Only used by MonitorPlayback, the network and the decoder output may call it at once
+    std::mutex monitor_mutex;
+    int64_t monitor_lastPrint = 0;
+    int64_t monitor_lastDiff = 0;
+    int64_t monitor_lastAdjustment = 0;
+    int64_t monitor_listenTime = 0;
+
+    /**
+     * A consistent copy of the model SetClockModel set last
+     */
+    ClockModel LoadClockModel();
 
-// TODO register an error callback or at least return false
+    /**
+     * Server clock minus the local clock at the local system time nowUs
+     */
+    int64_t SystemTimeOffsetUs(int64_t nowUs);
+};
 
-#ifdef __cplusplus
-}
 #endif
-#endif
\ No newline at end of file
@@ -0,0 +1,93 @@
+/*
+ * AudioDecoder.h: Turns the received samples back into 16 bit PCM
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#ifndef AUDIOSYNC_AUDIODECODER_H
+#define AUDIOSYNC_AUDIODECODER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Receives the decoded PCM data, 16 bit frames with interleaved channels
+ */
+class AudioDecoderOutput {
+public:
+    virtual ~AudioDecoderOutput() { }
+
+    virtual void EnqueuePCMFrames(const uint8_t *pcmBuffer, size_t pcmSize,
+                                  int64_t playbackTimeUs) = 0;
+};
+
+/*
+ * Gets back the buffers a decoder was allowed to read from later, see AudioDecoder::EnqueueBufferRef
+ */
+class AudioBufferReleaser {
+public:
+    virtual ~AudioBufferReleaser() { }
+
+    virtual void ReleaseBuffer(void *ref) = 0;
+};
+
+class AudioDecoder {
+public:
+    virtual ~AudioDecoder() { }
+
+    virtual uint32_t SampleRate() = 0;
+
+    virtual uint32_t NumChannels() = 0;
+
+    /**
+     * @return 0 on success
+     */
+    virtual int Start() = 0;
+
+    /**
+     * Queue a compressed sample, a negative inSize signals the end of the stream
+     * @return 0 on success
+     */
+    virtual int EnqueueBuffer(const uint8_t *inBuffer, ssize_t inSize, int64_t timeUs) = 0;
+
+    /**
+     * Like EnqueueBuffer, but inBuffer stays valid until the decoder passes ref to the releaser,
+     * so a decoder which reads it later does not need a copy of its own. The releaser is only
+     * called from the methods here. By default the buffer is copied and released right away.
+     * @return 0 on success, the buffer is released either way
+     */
+    virtual int EnqueueBufferRef(const uint8_t *inBuffer, size_t inSize, int64_t timeUs,
+                                 AudioBufferReleaser *releaser, void *ref) {
+        int err = EnqueueBuffer(inBuffer, (ssize_t) inSize, timeUs);
+        releaser->ReleaseBuffer(ref);
+        return err;
+    }
+
+    /*
+     * Dequeue a buffer from the codec
+     * @param  output  the pcm data will be passed to this
+     * @return  true if there is still data coming, false if there is no more
+     */
+    virtual bool DequeueBuffer(AudioDecoderOutput *output) = 0;
+
+    /**
+     * Discard all queued input, needed if data is not adjacent
+     */
+    virtual void Flush() = 0;
+
+    virtual void Stop() = 0;
+};
+
+/*
+ * Creates a decoder for a format string announced by the sender (see AudioSource::FormatString)
+ * @return NULL if the format is not supported
+ */
+typedef AudioDecoder *(*AudioDecoderFactory)(const char *formatString);
+
+#endif //AUDIOSYNC_AUDIODECODER_H
@@ -0,0 +1,63 @@
+/*
+ * AudioSink.h: The audio output device the player renders into
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#ifndef AUDIOSYNC_AUDIOSINK_H
+#define AUDIOSYNC_AUDIOSINK_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+// Size of the buffers handed to AudioRenderer::RenderFrames in bytes.
+// 8192 equals 2048 frames with 2 channels with 16bit PCM format
+#define AUDIOSINK_MAX_BUFFER_SIZE (8192)
+
+/*
+ * Called by the sink whenever the device needs more audio, usually on a realtime thread
+ */
+class AudioRenderer {
+public:
+    virtual ~AudioRenderer() { }
+
+    /**
+     * Fill buffer with at most AUDIOSINK_MAX_BUFFER_SIZE bytes
+     * @return the number of frames to play, 0 if there is nothing to play right now
+     */
+    virtual size_t RenderFrames(int16_t *buffer) = 0;
+};
+
+class AudioSink {
+public:
+    virtual ~AudioSink() { }
+
+    /** Native sample rate of the device */
+    virtual uint32_t SampleRate() = 0;
+
+    /** The amount of frames the device consumes with each callback */
+    virtual uint32_t FramesPerBuffer() = 0;
+
+    /**
+     * Start playing 16 bit PCM with interleaved channels, pulled from renderer
+     */
+    virtual void Open(uint32_t samplesPerSec, uint32_t numChannels, AudioRenderer *renderer) = 0;
+
+    /**
+     * Play faster or slower, 1000 permille is the normal rate
+     */
+    virtual void SetPlaybackRate(int32_t ratePermille) = 0;
+
+    /**
+     * Stop playing, the renderer will not be called after this returns
+     */
+    virtual void Close() = 0;
+};
+
+#endif //AUDIOSYNC_AUDIOSINK_H
@@ -0,0 +1,43 @@
+/*
+ * AudioSource.h: Delivers the (compressed) audio samples the sender streams
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#ifndef AUDIOSYNC_AUDIOSOURCE_H
+#define AUDIOSYNC_AUDIOSOURCE_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// ReadSample has no sample ready yet, the caller should try again a little later
+#define AUDIOSOURCE_AGAIN (-EAGAIN)
+
+class AudioSource {
+public:
+    virtual ~AudioSource() { }
+
+    /**
+     * Format of the stream, in the same notation AMediaFormat_toString uses,
+     * e.g. "mime: string(audio/raw), sample-rate: int32(44100), channel-count: int32(2)".
+     * The string is sent to every receiver, which will pick a decoder based on it.
+     */
+    virtual const char *FormatString() = 0;
+
+    /**
+     * Read the next sample (access unit) into buffer and advance
+     * @param timeUSec  set to the presentation time of the sample
+     * @return bytes written, AUDIOSOURCE_AGAIN if a sample is not available yet or
+     *         another negative value at the end of the stream
+     */
+    virtual ssize_t ReadSample(uint8_t *buffer, size_t capacity, int64_t *timeUSec) = 0;
+};
+
+#endif //AUDIOSYNC_AUDIOSOURCE_H
@@ -0,0 +1,102 @@
+/*
+ * NdkMedia.cpp: Source and decoder backed by AMediaExtractor and AMediaCodec
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#include <android/log.h>
+#include "NdkMedia.h"
+#include "../decoder.h"
+#include "../apppacket.h"
+
+#define debugLog(...) __android_log_print(ANDROID_LOG_DEBUG, "NdkMedia", __VA_ARGS__)
+
+ExtractorSource::ExtractorSource(AMediaExtractor *extractor) : extractor(extractor) {
+    AMediaFormat *format = extractor ? decoder_getAudioFormat(extractor) : NULL;
+    if (format) {
+        formatString = AMediaFormat_toString(format);
+        AMediaFormat_delete(format);
+    }
+}
+
+ExtractorSource::~ExtractorSource() {
+    if (extractor) AMediaExtractor_delete(extractor);
+}
+
+ssize_t ExtractorSource::ReadSample(uint8_t *buffer, size_t capacity, int64_t *timeUSec) {
+    if (extractor == NULL) return -1;
+    return decoder_extractData(extractor, buffer, capacity, timeUSec);
+}
+
+AudioDecoder *MediaCodecDecoder::Create(const char *formatString) {
+    AMediaFormat *format = audiostream_createFormat(formatString);
+    if (format == NULL) return NULL;
+    const char *mime;
+    if (!AMediaFormat_getString(format, AMEDIAFORMAT_KEY_MIME, &mime)) {
+        AMediaFormat_delete(format);
+        return NULL;
+    }
+    debugLog("New format %s and creating codec", mime);
+
+    AMediaCodec *codec = AMediaCodec_createDecoderByType(mime);
+    if (codec == NULL) {
+        debugLog("Could not create codec");
+        AMediaFormat_delete(format);
+        return NULL;
+    }
+    int status = AMediaCodec_configure(codec, format, NULL, NULL, 0);
+    if (status != AMEDIA_OK) {
+        AMediaCodec_delete(codec);
+        AMediaFormat_delete(format);
+        return NULL;
+    }
+    return new MediaCodecDecoder(codec, format);
+}
+
+MediaCodecDecoder::~MediaCodecDecoder() {
+    if (codec) AMediaCodec_delete(codec);
+    if (format) AMediaFormat_delete(format);
+}
+
+uint32_t MediaCodecDecoder::SampleRate() {
+    int32_t samples = 44100;
+    AMediaFormat_getInt32(format, AMEDIAFORMAT_KEY_SAMPLE_RATE, &samples);
+    return (uint32_t) samples;
+}
+
+uint32_t MediaCodecDecoder::NumChannels() {
+    int32_t channels = 1;
+    AMediaFormat_getInt32(format, AMEDIAFORMAT_KEY_CHANNEL_COUNT, &channels);
+    return (uint32_t) channels;
+}
+
+int MediaCodecDecoder::Start() {
+    return AMediaCodec_start(codec);
+}
+
+int MediaCodecDecoder::EnqueueBuffer(const uint8_t *inBuffer, ssize_t inSize, int64_t timeUs) {
+    return decoder_enqueueBuffer(codec, inBuffer, inSize, timeUs);
+}
+
+static void _enqueuePCMFrames(void *ctx, const uint8_t *pcmBuffer, size_t pcmSize,
+                              int64_t playbackTime) {
+    ((AudioDecoderOutput *) ctx)->EnqueuePCMFrames(pcmBuffer, pcmSize, playbackTime);
+}
+
+bool MediaCodecDecoder::DequeueBuffer(AudioDecoderOutput *output) {
+    return decoder_dequeueBuffer(codec, &_enqueuePCMFrames, output);
+}
+
+void MediaCodecDecoder::Flush() {
+    AMediaCodec_flush(codec);
+}
+
+void MediaCodecDecoder::Stop() {
+    AMediaCodec_stop(codec);
+}
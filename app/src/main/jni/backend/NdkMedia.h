@@ -0,0 +1,70 @@
+/*
+ * NdkMedia.h: Source and decoder backed by AMediaExtractor and AMediaCodec
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#ifndef AUDIOSYNC_NDKMEDIA_H
+#define AUDIOSYNC_NDKMEDIA_H
+
+#include <string>
+#include <media/NdkMediaExtractor.h>
+#include <media/NdkMediaCodec.h>
+#include "AudioSource.h"
+#include "AudioDecoder.h"
+
+class ExtractorSource : public AudioSource {
+public:
+    /**
+     * Takes ownership of the extractor, the audio track must be selected already
+     */
+    ExtractorSource(AMediaExtractor *extractor);
+
+    ~ExtractorSource();
+
+    const char *FormatString() {
+        return formatString.c_str();
+    }
+
+    ssize_t ReadSample(uint8_t *buffer, size_t capacity, int64_t *timeUSec);
+
+private:
+    AMediaExtractor *extractor;
+    std::string formatString;
+};
+
+class MediaCodecDecoder : public AudioDecoder {
+public:
+    ~MediaCodecDecoder();
+
+    // AudioDecoderFactory
+    static AudioDecoder *Create(const char *formatString);
+
+    uint32_t SampleRate();
+
+    uint32_t NumChannels();
+
+    int Start();
+
+    int EnqueueBuffer(const uint8_t *inBuffer, ssize_t inSize, int64_t timeUs);
+
+    bool DequeueBuffer(AudioDecoderOutput *output);
+
+    void Flush();
+
+    void Stop();
+
+private:
+    MediaCodecDecoder(AMediaCodec *codec, AMediaFormat *format) : codec(codec), format(format) { }
+
+    AMediaCodec *codec;
+    AMediaFormat *format;
+};
+
+#endif //AUDIOSYNC_NDKMEDIA_H
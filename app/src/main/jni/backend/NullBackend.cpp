@@ -0,0 +1,45 @@
+/*
+ * NullBackend.cpp: Source producing silence and a sink discarding everything
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "NullBackend.h"
+#include "PcmDecoder.h"
+#include "../apppacket.h"
+
+NullSource::NullSource(int64_t durationUs, uint32_t samplesPerSec, uint32_t numChannels,
+                       uint32_t framesPerPacket)
+        : samplesPerSec(samplesPerSec), numChannels(numChannels),
+          framesPerPacket(framesPerPacket) {
+    framesLeft = (uint64_t) (durationUs * samplesPerSec / SECOND_MICRO);
+
+    char buffer[128];
+    snprintf(buffer, sizeof(buffer),
+             "mime: string(" AUDIOSYNC_MIME_RAW "), sample-rate: int32(%u), channel-count: int32(%u)",
+             samplesPerSec, numChannels);
+    formatString = buffer;
+}
+
+ssize_t NullSource::ReadSample(uint8_t *buffer, size_t capacity, int64_t *timeUSec) {
+    size_t frameSize = numChannels * sizeof(int16_t);
+    size_t frames = capacity / frameSize;
+    if (frames > framesPerPacket) frames = framesPerPacket;
+    if (frames > framesLeft) frames = (size_t) framesLeft;
+
+    *timeUSec = (int64_t) (framesRead * SECOND_MICRO / samplesPerSec);
+    if (frames == 0) return -1;
+
+    memset(buffer, 0, frames * frameSize);
+    framesLeft -= frames;
+    framesRead += frames;
+    return (ssize_t) (frames * frameSize);
+}
@@ -0,0 +1,54 @@
+/*
+ * NullBackend.h: Source producing silence and a sink discarding everything
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#ifndef AUDIOSYNC_NULLBACKEND_H
+#define AUDIOSYNC_NULLBACKEND_H
+
+#include <string>
+#include "AudioSource.h"
+#include "PacedSink.h"
+#include "RawPcmBackend.h"
+
+/*
+ * Streams durationUs of silence as "audio/raw"
+ */
+class NullSource : public AudioSource {
+public:
+    NullSource(int64_t durationUs, uint32_t samplesPerSec = 44100, uint32_t numChannels = 2,
+               uint32_t framesPerPacket = AUDIOSYNC_PCM_FRAMES_PER_PACKET);
+
+    const char *FormatString() {
+        return formatString.c_str();
+    }
+
+    ssize_t ReadSample(uint8_t *buffer, size_t capacity, int64_t *timeUSec);
+
+private:
+    uint32_t samplesPerSec, numChannels, framesPerPacket;
+    uint64_t framesLeft, framesRead = 0;
+    std::string formatString;
+};
+
+class NullSink : public PacedSink {
+public:
+    NullSink(uint32_t samplesPerSec = 48000, uint32_t framesPerBuffer = 256)
+            : PacedSink(samplesPerSec, framesPerBuffer) { }
+
+    ~NullSink() {
+        Close();
+    }
+
+protected:
+    void WriteFrames(const int16_t *, size_t) { }
+};
+
+#endif //AUDIOSYNC_NULLBACKEND_H
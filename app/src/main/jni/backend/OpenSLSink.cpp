@@ -0,0 +1,232 @@
+/*
+ * OpenSLSink.cpp: Plays PCM audio through the OpenSL ES buffer queue player
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#include <stdlib.h>
+#include <android/log.h>
+#include "OpenSLSink.h"
+
+#define debugLog(...) __android_log_print(ANDROID_LOG_DEBUG, "OpenSLSink", __VA_ARGS__)
+
+// =================== Helpers ===================
+static const char *_descriptionForResult(SLresult result) {
+    switch (result) {
+        case SL_RESULT_SUCCESS:
+            return "SUCCESS";
+        case SL_RESULT_PRECONDITIONS_VIOLATED:
+            return "PRECONDITIONS_VIOLATED";
+        case SL_RESULT_PARAMETER_INVALID:
+            return "PARAMETER_INVALID";
+        case SL_RESULT_MEMORY_FAILURE:
+            return "MEMORY_FAILURE";
+        case SL_RESULT_RESOURCE_ERROR:
+            return "RESOURCE_ERROR";
+        case SL_RESULT_RESOURCE_LOST:
+            return "RESOURCE_LOST";
+        case SL_RESULT_IO_ERROR:
+            return "IO_ERROR";
+        case SL_RESULT_BUFFER_INSUFFICIENT:
+            return "BUFFER_INSUFFICIENT";
+        case SL_RESULT_CONTENT_CORRUPTED:
+            return "CONTENT_CORRUPTED";
+        case SL_RESULT_CONTENT_UNSUPPORTED:
+            return "CONTENT_UNSUPPORTED";
+        case SL_RESULT_CONTENT_NOT_FOUND:
+            return "CONTENT_NOT_FOUND";
+        case SL_RESULT_PERMISSION_DENIED:
+            return "PERMISSION_DENIED";
+        case SL_RESULT_FEATURE_UNSUPPORTED:
+            return "FEATURE_UNSUPPORTED";
+        case SL_RESULT_INTERNAL_ERROR:
+            return "INTERNAL_ERROR";
+        case SL_RESULT_OPERATION_ABORTED:
+            return "OPERATION_ABORTED";
+        case SL_RESULT_CONTROL_LOST:
+            return "CONTROL_LOST";
+        default:
+            return "Unknown error code";
+    }
+}
+
+#define _checkerror(result) _checkerror_internal(result, __FUNCTION__)
+
+static void _checkerror_internal(SLresult result, const char *f) {
+    if (SL_RESULT_SUCCESS != result) {
+        debugLog("%s - OpenSL ES error: %s", f, _descriptionForResult(result));
+        // TODO figure out which errors to treat as fatal
+        if (result != SL_RESULT_BUFFER_INSUFFICIENT) {
+            exit(-1);
+        }
+    }
+}
+
+OpenSLSink::OpenSLSink(uint32_t samplesPerSec, uint32_t framesPerBuffer)
+        : global_samplesPerSec(samplesPerSec), global_framesPerBuffers(framesPerBuffer) {
+    debugLog("Device Buffer Size: %d ;  Sample Rate: %d", framesPerBuffer, samplesPerSec);
+    if (framesPerBuffer * 2 * sizeof(int16_t) > AUDIOSINK_MAX_BUFFER_SIZE) {
+        debugLog("ATTENTION: Global buffersize is bigger than AUDIOSINK_MAX_BUFFER_SIZE");
+    }
+}
+
+// shut down the native audio system
+OpenSLSink::~OpenSLSink() {
+    Close();
+
+    // destroy output mix object, and invalidate all associated interfaces
+    if (outputMixObject != NULL) {
+        (*outputMixObject)->Destroy(outputMixObject);
+        outputMixObject = NULL;
+    }
+    // destroy engine object, and invalidate all associated interfaces
+    if (engineObject != NULL) {
+        (*engineObject)->Destroy(engineObject);
+        engineObject = NULL;
+        engineEngine = NULL;
+    }
+}
+
+// =================== Setup OpenSL objects ===================
+
+// create the engine and output mix objects
+void OpenSLSink::CreateEngine() {
+    // create engine
+    SLresult result = slCreateEngine(&engineObject, 0, NULL, 0, NULL, NULL);
+    _checkerror(result);
+
+    // realize the engine
+    result = (*engineObject)->Realize(engineObject, SL_BOOLEAN_FALSE);
+    _checkerror(result);
+
+    // get the engine interface, which is needed in order to create other objects
+    result = (*engineObject)->GetInterface(engineObject, SL_IID_ENGINE, &engineEngine);
+    _checkerror(result);
+
+    result = (*engineEngine)->CreateOutputMix(engineEngine, &outputMixObject, 0, NULL, NULL);
+    _checkerror(result);
+    (void) result;
+
+    // realize the output mix
+    result = (*outputMixObject)->Realize(outputMixObject, SL_BOOLEAN_FALSE);
+    _checkerror(result);
+}
+
+// this callback handler is called every time a buffer finishes playing
+void OpenSLSink::BufferQueueCallback(SLAndroidSimpleBufferQueueItf bq, void *context) {
+    OpenSLSink *sink = (OpenSLSink *) context;
+
+    sink->tempBuffers_ix = (sink->tempBuffers_ix + 1) % N_BUFFERS;
+    int16_t *buf_ptr = sink->tempBuffers + AUDIOSINK_MAX_BUFFER_SIZE * sink->tempBuffers_ix;
+
+    size_t frameCount = sink->renderer->RenderFrames(buf_ptr);
+    if (frameCount > 0) {
+        size_t size = frameCount * sink->current_numChannels * sizeof(int16_t);
+        SLresult result = (*bq)->Enqueue(bq, buf_ptr, (SLuint32) size);
+        _checkerror(result);
+    }
+}
+
+// create buffer queue audio player
+void OpenSLSink::CreateBufferQueueAudioPlayer(SLuint32 samplesPerSec, SLuint32 numChannels) {
+    SLresult result;
+    SLuint32 channelMask = SL_SPEAKER_FRONT_CENTER;
+    if (numChannels >= 2) {
+        numChannels = 2;// I don't think devices support more than 2
+        channelMask = SL_SPEAKER_FRONT_LEFT | SL_SPEAKER_FRONT_RIGHT;
+        debugLog("Using stereo audio");
+    }
+
+    // configure audio source
+    SLDataLocator_AndroidSimpleBufferQueue bufferQueue = {SL_DATALOCATOR_ANDROIDSIMPLEBUFFERQUEUE, 1};
+    SLDataFormat_PCM format_pcm = {
+            .formatType = SL_DATAFORMAT_PCM,
+            .numChannels = numChannels,
+            .samplesPerSec = samplesPerSec * 1000,// Milli Hz
+            .bitsPerSample = SL_PCMSAMPLEFORMAT_FIXED_16,
+            .containerSize = SL_PCMSAMPLEFORMAT_FIXED_16,
+            .channelMask = channelMask,
+            .endianness = SL_BYTEORDER_LITTLEENDIAN// TODO: compute real endianness
+    };
+    SLDataSource audioSrc = {&bufferQueue, &format_pcm};
+
+    // configure audio sink
+    SLDataLocator_OutputMix loc_outmix = {SL_DATALOCATOR_OUTPUTMIX, outputMixObject};
+    SLDataSink audioSnk = {&loc_outmix, NULL};
+
+    // create audio player
+    const SLInterfaceID ids[2] = {SL_IID_BUFFERQUEUE, SL_IID_PLAYBACKRATE};//, SL_IID_VOLUME
+    const SLboolean req[2] = {SL_BOOLEAN_TRUE, SL_BOOLEAN_TRUE};
+    result = (*engineEngine)->CreateAudioPlayer(engineEngine, &playerObject, &audioSrc, &audioSnk,
+                                                2, ids, req);// ids length, interfaces, required
+    _checkerror(result);
+
+    // realize the player
+    result = (*playerObject)->Realize(playerObject, SL_BOOLEAN_FALSE);
+    _checkerror(result);
+
+    // get the play interface
+    result = (*playerObject)->GetInterface(playerObject, SL_IID_PLAY, &playerPlay);
+    _checkerror(result);
+
+    // get the buffer queue interface
+    result = (*playerObject)->GetInterface(playerObject, SL_IID_BUFFERQUEUE, &playerBufferQueue);
+    _checkerror(result);
+
+    // get playback rate interface
+    result = (*playerObject)->GetInterface(playerObject, SL_IID_PLAYBACKRATE, &playerPlayRate);
+    _checkerror(result);
+
+    // register callback on the buffer queue
+    result = (*playerBufferQueue)->RegisterCallback(playerBufferQueue, BufferQueueCallback, this);
+    _checkerror(result);
+}
+
+void OpenSLSink::Open(uint32_t samplesPerSec, uint32_t numChannels, AudioRenderer *renderer) {
+    if (engineObject == NULL) {
+        CreateEngine();
+        debugLog("Initialized AudioPlayer");
+    }
+
+    this->renderer = renderer;
+    this->current_numChannels = numChannels;
+    CreateBufferQueueAudioPlayer(samplesPerSec, numChannels);
+    // Always use optimal rate, resample by slowing down playback
+    if (global_samplesPerSec != samplesPerSec) {
+        (*playerPlayRate)->SetRate(playerPlayRate, (SLpermille) 1000);
+    }
+
+    // This call has latency, we need to keep the audio system starving to perform start / pause
+    SLresult result = (*playerPlay)->SetPlayState(playerPlay, SL_PLAYSTATE_PLAYING);
+    _checkerror(result);
+    BufferQueueCallback(playerBufferQueue, this);
+}
+
+void OpenSLSink::SetPlaybackRate(int32_t ratePermille) {
+    if (playerPlayRate) {
+        (*playerPlayRate)->SetRate(playerPlayRate, (SLpermille) ratePermille);
+    }
+}
+
+void OpenSLSink::Close() {
+    if (playerPlay) {
+        SLresult result = (*playerPlay)->SetPlayState(playerPlay, SL_PLAYSTATE_STOPPED);
+        _checkerror(result);
+        debugLog("Stopped playback");
+    }
+
+    // destroy buffer queue audio player object, and invalidate all associated interfaces
+    if (playerObject != NULL) {
+        (*playerObject)->Destroy(playerObject);
+        playerObject = NULL;
+        playerPlay = NULL;
+        playerBufferQueue = NULL;
+        playerPlayRate = NULL;
+    }
+}
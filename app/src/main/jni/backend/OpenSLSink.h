@@ -0,0 +1,74 @@
+/*
+ * OpenSLSink.h: Plays PCM audio through the OpenSL ES buffer queue player
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#ifndef AUDIOSYNC_OPENSLSINK_H
+#define AUDIOSYNC_OPENSLSINK_H
+
+#include <SLES/OpenSLES.h>
+#include <SLES/OpenSLES_Android.h>
+#include "AudioSink.h"
+
+class OpenSLSink : public AudioSink {
+public:
+    /**
+     * Device parameters for playback, as reported by the AudioManager
+     */
+    OpenSLSink(uint32_t samplesPerSec, uint32_t framesPerBuffer);
+
+    ~OpenSLSink();
+
+    uint32_t SampleRate() {
+        return global_samplesPerSec;
+    }
+
+    uint32_t FramesPerBuffer() {
+        return global_framesPerBuffers;
+    }
+
+    void Open(uint32_t samplesPerSec, uint32_t numChannels, AudioRenderer *renderer);
+
+    void SetPlaybackRate(int32_t ratePermille);
+
+    void Close();
+
+private:
+    // engine interfaces
+    SLObjectItf engineObject = NULL;
+    SLEngineItf engineEngine;
+    // output mix interfaces
+    SLObjectItf outputMixObject = NULL;
+    // buffer queue player interfaces
+    SLObjectItf playerObject = NULL;
+    SLPlayItf playerPlay = NULL;
+    SLAndroidSimpleBufferQueueItf playerBufferQueue = NULL;
+    SLPlaybackRateItf playerPlayRate = NULL;
+
+    // Device parameters for playback
+    uint32_t global_samplesPerSec;
+    uint32_t global_framesPerBuffers;
+    uint32_t current_numChannels = 1;
+
+    AudioRenderer *renderer = NULL;
+
+    // Temporary buffer for the audio buffer queue.
+    static const int N_BUFFERS = 3;
+    int16_t tempBuffers[AUDIOSINK_MAX_BUFFER_SIZE * N_BUFFERS];
+    uint32_t tempBuffers_ix = 0;
+
+    void CreateEngine();
+
+    void CreateBufferQueueAudioPlayer(SLuint32 samplesPerSec, SLuint32 numChannels);
+
+    static void BufferQueueCallback(SLAndroidSimpleBufferQueueItf bq, void *context);
+};
+
+#endif //AUDIOSYNC_OPENSLSINK_H
@@ -0,0 +1,76 @@
+/*
+ * PacedSink.cpp: Base class for sinks without an audio device, pulls audio in realtime
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#include <time.h>
+#include "PacedSink.h"
+
+#define NANOS_PER_SEC 1000000000LL
+
+PacedSink::PacedSink(uint32_t samplesPerSec, uint32_t framesPerBuffer)
+        : device_samplesPerSec(samplesPerSec), device_framesPerBuffer(framesPerBuffer),
+          running(false), ratePermille(1000) {
+}
+
+PacedSink::~PacedSink() {
+    Close();
+}
+
+void PacedSink::Open(uint32_t samplesPerSec, uint32_t numChannels, AudioRenderer *renderer) {
+    Close();
+    this->current_samplesPerSec = samplesPerSec;
+    this->current_numChannels = numChannels;
+    this->renderer = renderer;
+    this->ratePermille = 1000;
+    OnOpen();
+
+    running = true;
+    pthread_create(&thread, NULL, &PacedSink::RunThread, this);
+}
+
+void PacedSink::SetPlaybackRate(int32_t ratePermille) {
+    this->ratePermille = ratePermille;
+}
+
+void PacedSink::Close() {
+    if (running) {
+        running = false;
+        pthread_join(thread, NULL);
+        thread = 0;
+        OnClose();
+    }
+}
+
+void PacedSink::Run() {
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+    while (running) {
+        size_t frameCount = renderer->RenderFrames(buffer);
+        if (frameCount > 0) WriteFrames(buffer, frameCount);
+        else frameCount = device_framesPerBuffer;// Nothing to play, the device would keep running
+
+        // Duration of the buffer at the current playback rate
+        int64_t nanos = ((int64_t) frameCount * NANOS_PER_SEC * 1000)
+                        / ((int64_t) current_samplesPerSec * ratePermille);
+        deadline.tv_nsec += nanos;
+        while (deadline.tv_nsec >= NANOS_PER_SEC) {
+            deadline.tv_nsec -= NANOS_PER_SEC;
+            deadline.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+    }
+}
+
+void *PacedSink::RunThread(void *ctx) {
+    ((PacedSink *) ctx)->Run();
+    return NULL;
+}
@@ -0,0 +1,78 @@
+/*
+ * PacedSink.h: Base class for sinks without an audio device, pulls audio in realtime
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#ifndef AUDIOSYNC_PACEDSINK_H
+#define AUDIOSYNC_PACEDSINK_H
+
+#include <atomic>
+#include <pthread.h>
+#include "AudioSink.h"
+
+/*
+ * Emulates the callback of a sound card: A thread requests FramesPerBuffer() frames from the
+ * renderer whenever the previous buffer would have finished playing.
+ */
+class PacedSink : public AudioSink {
+public:
+    PacedSink(uint32_t samplesPerSec = 48000, uint32_t framesPerBuffer = 256);
+
+    virtual ~PacedSink();
+
+    uint32_t SampleRate() {
+        return device_samplesPerSec;
+    }
+
+    uint32_t FramesPerBuffer() {
+        return device_framesPerBuffer;
+    }
+
+    void Open(uint32_t samplesPerSec, uint32_t numChannels, AudioRenderer *renderer);
+
+    void SetPlaybackRate(int32_t ratePermille);
+
+    void Close();
+
+protected:
+    uint32_t current_samplesPerSec = 0;
+    uint32_t current_numChannels = 0;
+
+    /**
+     * Called with every rendered buffer, frames are 16 bit PCM with interleaved channels
+     */
+    virtual void WriteFrames(const int16_t *frames, size_t frameCount) = 0;
+
+    /**
+     * Called from Open before the first buffer is written
+     */
+    virtual void OnOpen() { }
+
+    /**
+     * Called from Close after the last buffer was written
+     */
+    virtual void OnClose() { }
+
+private:
+    uint32_t device_samplesPerSec;
+    uint32_t device_framesPerBuffer;
+
+    AudioRenderer *renderer = NULL;
+    pthread_t thread = 0;
+    std::atomic<bool> running;
+    std::atomic<int32_t> ratePermille;
+    int16_t buffer[AUDIOSINK_MAX_BUFFER_SIZE / sizeof(int16_t)];
+
+    void Run();
+
+    static void *RunThread(void *ctx);
+};
+
+#endif //AUDIOSYNC_PACEDSINK_H
@@ -0,0 +1,97 @@
+/*
+ * PcmDecoder.cpp: Decoder for uncompressed "audio/raw" streams, passes the samples through
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#include <string.h>
+#include <algorithm>
+#include "PcmDecoder.h"
+#include "../apppacket.h"
+
+AudioDecoder *PcmDecoder::Create(const char *formatString) {
+    char mime[64];
+    int32_t samples = 44100, channels = 1;
+    if (!audiostream_formatString(formatString, "mime", mime, sizeof(mime))
+        || strcmp(mime, AUDIOSYNC_MIME_RAW) != 0) {
+        return NULL;
+    }
+    audiostream_formatInt32(formatString, "sample-rate", &samples);
+    audiostream_formatInt32(formatString, "channel-count", &channels);
+    if (samples <= 0 || channels <= 0) return NULL;
+    return new PcmDecoder((uint32_t) samples, (uint32_t) channels);
+}
+
+int PcmDecoder::Start() {
+    inputEOS = false;
+    return 0;
+}
+
+PcmDecoder::Buffer &PcmDecoder::Push() {
+    if (count == queue.size()) {
+        // Unroll the ring, so the new slots come after the last buffer
+        std::rotate(queue.begin(), queue.begin() + head, queue.end());
+        head = 0;
+        queue.resize(std::max((size_t) 8, 2 * queue.size()));
+    }
+    Buffer &buffer = queue[(head + count) % queue.size()];
+    count++;
+    return buffer;
+}
+
+void PcmDecoder::Pop() {
+    Buffer &buffer = queue[head];
+    if (buffer.releaser) buffer.releaser->ReleaseBuffer(buffer.ref);
+    buffer.releaser = NULL;
+    head = (head + 1) % queue.size();
+    count--;
+}
+
+int PcmDecoder::EnqueueBuffer(const uint8_t *inBuffer, ssize_t inSize, int64_t timeUs) {
+    if (inSize < 0) {
+        inputEOS = true;
+        return 0;
+    }
+    Buffer &buffer = Push();
+    buffer.copy.assign(inBuffer, inBuffer + inSize);
+    buffer.pcm = NULL;
+    buffer.size = (size_t) inSize;
+    buffer.timeUs = timeUs;
+    buffer.releaser = NULL;
+    return 0;
+}
+
+int PcmDecoder::EnqueueBufferRef(const uint8_t *inBuffer, size_t inSize, int64_t timeUs,
+                                 AudioBufferReleaser *releaser, void *ref) {
+    Buffer &buffer = Push();
+    buffer.pcm = inBuffer;
+    buffer.size = inSize;
+    buffer.timeUs = timeUs;
+    buffer.releaser = releaser;
+    buffer.ref = ref;
+    return 0;
+}
+
+bool PcmDecoder::DequeueBuffer(AudioDecoderOutput *output) {
+    if (count > 0) {
+        Buffer &buffer = queue[head];
+        output->EnqueuePCMFrames(buffer.pcm ? buffer.pcm : buffer.copy.data(), buffer.size,
+                                 buffer.timeUs);
+        Pop();
+    }
+    return !(inputEOS && count == 0);
+}
+
+void PcmDecoder::Flush() {
+    while (count > 0) Pop();
+}
+
+void PcmDecoder::Stop() {
+    Flush();
+}
@@ -0,0 +1,78 @@
+/*
+ * PcmDecoder.h: Decoder for uncompressed "audio/raw" streams, passes the samples through
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#ifndef AUDIOSYNC_PCMDECODER_H
+#define AUDIOSYNC_PCMDECODER_H
+
+#include <vector>
+#include "AudioDecoder.h"
+
+#define AUDIOSYNC_MIME_RAW "audio/raw"
+
+class PcmDecoder : public AudioDecoder {
+public:
+    PcmDecoder(uint32_t samplesPerSec, uint32_t numChannels)
+            : samplesPerSec(samplesPerSec), numChannels(numChannels) { }
+
+    ~PcmDecoder() {
+        Flush();
+    }
+
+    // AudioDecoderFactory
+    static AudioDecoder *Create(const char *formatString);
+
+    uint32_t SampleRate() {
+        return samplesPerSec;
+    }
+
+    uint32_t NumChannels() {
+        return numChannels;
+    }
+
+    int Start();
+
+    int EnqueueBuffer(const uint8_t *inBuffer, ssize_t inSize, int64_t timeUs);
+
+    /**
+     * Keeps the buffer until its frames were passed on, instead of copying them
+     */
+    int EnqueueBufferRef(const uint8_t *inBuffer, size_t inSize, int64_t timeUs,
+                         AudioBufferReleaser *releaser, void *ref);
+
+    bool DequeueBuffer(AudioDecoderOutput *output);
+
+    void Flush();
+
+    void Stop();
+
+private:
+    struct Buffer {
+        std::vector<uint8_t> copy;// Keeps its memory for the next copied buffer in this slot
+        const uint8_t *pcm;// From EnqueueBufferRef, NULL if copied
+        size_t size;
+        int64_t timeUs;
+        AudioBufferReleaser *releaser;
+        void *ref;
+    };
+
+    uint32_t samplesPerSec, numChannels;
+    // Ring of queued buffers, it only grows if it is full
+    std::vector<Buffer> queue;
+    size_t head = 0, count = 0;
+    bool inputEOS = false;
+
+    Buffer &Push();
+
+    void Pop();
+};
+
+#endif //AUDIOSYNC_PCMDECODER_H
@@ -0,0 +1,89 @@
+/*
+ * RawPcmBackend.cpp: Stream from and play into files with headerless 16 bit PCM
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#include <android/log.h>
+#include "RawPcmBackend.h"
+#include "PcmDecoder.h"
+#include "../apppacket.h"
+
+#define debugLog(...) __android_log_print(ANDROID_LOG_DEBUG, "RawPcm", __VA_ARGS__)
+
+RawPcmSource::RawPcmSource(const char *path, uint32_t framesPerPacket)
+        : framesPerPacket(framesPerPacket) {
+    file = fopen(path, "rb");
+    if (file == NULL) debugLog("Could not open %s", path);
+}
+
+RawPcmSource::RawPcmSource(const char *path, uint32_t samplesPerSec, uint32_t numChannels,
+                           uint32_t framesPerPacket) : RawPcmSource(path, framesPerPacket) {
+    SetFormat(samplesPerSec, numChannels);
+}
+
+RawPcmSource::~RawPcmSource() {
+    if (file) fclose(file);
+}
+
+void RawPcmSource::SetFormat(uint32_t samplesPerSec, uint32_t numChannels) {
+    this->samplesPerSec = samplesPerSec;
+    this->numChannels = numChannels;
+
+    char buffer[128];
+    snprintf(buffer, sizeof(buffer),
+             "mime: string(" AUDIOSYNC_MIME_RAW "), sample-rate: int32(%u), channel-count: int32(%u)",
+             samplesPerSec, numChannels);
+    formatString = buffer;
+}
+
+ssize_t RawPcmSource::ReadSample(uint8_t *buffer, size_t capacity, int64_t *timeUSec) {
+    if (file == NULL || samplesPerSec == 0) return -1;
+
+    size_t frameSize = numChannels * sizeof(int16_t);
+    size_t frames = capacity / frameSize;
+    if (frames > framesPerPacket) frames = framesPerPacket;
+    size_t size = frames * frameSize;
+    if (remaining >= 0 && (int64_t) size > remaining) size = (size_t) remaining;
+
+    *timeUSec = (int64_t) (framesRead * SECOND_MICRO / samplesPerSec);
+    size_t read = fread(buffer, 1, size, file);
+    read -= read % frameSize;
+    if (read == 0) return -1;
+
+    if (remaining >= 0) remaining -= read;
+    framesRead += read / frameSize;
+    return (ssize_t) read;
+}
+
+RawPcmSink::RawPcmSink(const char *path) : path(path) {
+}
+
+RawPcmSink::~RawPcmSink() {
+    Close();
+}
+
+void RawPcmSink::OnOpen() {
+    file = fopen(path.c_str(), "wb");
+    if (file == NULL) debugLog("Could not open %s", path.c_str());
+    bytesWritten = 0;
+}
+
+void RawPcmSink::OnClose() {
+    if (file) {
+        fclose(file);
+        file = NULL;
+    }
+}
+
+void RawPcmSink::WriteFrames(const int16_t *frames, size_t frameCount) {
+    if (file == NULL) return;
+    bytesWritten += fwrite(frames, current_numChannels * sizeof(int16_t), frameCount, file)
+                    * current_numChannels * sizeof(int16_t);
+}
@@ -0,0 +1,78 @@
+/*
+ * RawPcmBackend.h: Stream from and play into files with headerless 16 bit PCM
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#ifndef AUDIOSYNC_RAWPCMBACKEND_H
+#define AUDIOSYNC_RAWPCMBACKEND_H
+
+#include <stdio.h>
+#include <string>
+#include "AudioSource.h"
+#include "PacedSink.h"
+
+// 256 stereo frames fit into one packet without IP fragmentation
+#define AUDIOSYNC_PCM_FRAMES_PER_PACKET 256
+
+/*
+ * Reads interleaved signed 16 bit little endian samples
+ */
+class RawPcmSource : public AudioSource {
+public:
+    RawPcmSource(const char *path, uint32_t samplesPerSec, uint32_t numChannels,
+                 uint32_t framesPerPacket = AUDIOSYNC_PCM_FRAMES_PER_PACKET);
+
+    virtual ~RawPcmSource();
+
+    bool IsOpen() {
+        return file != NULL;
+    }
+
+    const char *FormatString() {
+        return formatString.c_str();
+    }
+
+    ssize_t ReadSample(uint8_t *buffer, size_t capacity, int64_t *timeUSec);
+
+protected:
+    FILE *file = NULL;
+    uint32_t samplesPerSec = 0, numChannels = 0, framesPerPacket;
+    // Bytes left to read, negative if unknown
+    int64_t remaining = -1;
+    uint64_t framesRead = 0;
+    std::string formatString;
+
+    RawPcmSource(const char *path, uint32_t framesPerPacket);
+
+    void SetFormat(uint32_t samplesPerSec, uint32_t numChannels);
+};
+
+/*
+ * Writes everything the player renders, as interleaved signed 16 bit little endian samples
+ */
+class RawPcmSink : public PacedSink {
+public:
+    RawPcmSink(const char *path);
+
+    virtual ~RawPcmSink();
+
+protected:
+    std::string path;
+    FILE *file = NULL;
+    uint64_t bytesWritten = 0;
+
+    void OnOpen();
+
+    void OnClose();
+
+    void WriteFrames(const int16_t *frames, size_t frameCount);
+};
+
+#endif //AUDIOSYNC_RAWPCMBACKEND_H
@@ -0,0 +1,81 @@
+/*
+ * ReadAheadSource.cpp: Demuxes the samples of another source ahead of time on its own thread
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include "ReadAheadSource.h"
+
+ReadAheadSource::ReadAheadSource(AudioSource *source, size_t depth, size_t maxSampleSize)
+        : source(source), maxSampleSize(maxSampleSize), filled(depth), empty(depth + 1),
+          running(true), underruns(0) {
+    buffers = new uint8_t[depth * maxSampleSize];
+    for (size_t i = 0; i < depth; i++) {
+        AccessUnit unit = {buffers + i * maxSampleSize, 0, 0};
+        empty.try_enqueue(unit);
+    }
+    pthread_create(&thread, NULL, &ReadAheadSource::RunThread, this);
+}
+
+ReadAheadSource::~ReadAheadSource() {
+    running = false;
+    AccessUnit stop = {NULL, 0, 0};
+    empty.try_enqueue(stop);// There is one slot more than units
+    pthread_join(thread, NULL);
+    delete[] buffers;
+    delete source;
+}
+
+ssize_t ReadAheadSource::ReadSample(uint8_t *buffer, size_t capacity, int64_t *timeUSec) {
+    if (ended) return endStatus;
+
+    AccessUnit unit;
+    if (!filled.try_dequeue(unit)) {
+        underruns++;
+        return AUDIOSOURCE_AGAIN;
+    }
+
+    *timeUSec = unit.timeUs;
+    ssize_t size = unit.size;
+    if (size < 0) {
+        ended = true;
+        endStatus = size;
+    } else {
+        if ((size_t) size > capacity) size = (ssize_t) capacity;
+        memcpy(buffer, unit.data, (size_t) size);
+    }
+    empty.try_enqueue(unit);
+    return size;
+}
+
+void ReadAheadSource::Run() {
+    while (running) {
+        AccessUnit unit;
+        empty.wait_dequeue(unit);
+        if (unit.data == NULL) break;
+
+        unit.size = source->ReadSample(unit.data, maxSampleSize, &unit.timeUs);
+        // Not the end of the stream, the source has to be asked again with the same unit
+        while (unit.size == AUDIOSOURCE_AGAIN && running) {
+            usleep(AUDIOSYNC_READAHEAD_RETRY_US);
+            unit.size = source->ReadSample(unit.data, maxSampleSize, &unit.timeUs);
+        }
+        if (unit.size == AUDIOSOURCE_AGAIN) break;// Destroyed meanwhile
+
+        filled.try_enqueue(unit);
+        if (unit.size < 0) break;// End of stream, nothing more to read
+    }
+}
+
+void *ReadAheadSource::RunThread(void *ctx) {
+    ((ReadAheadSource *) ctx)->Run();
+    return NULL;
+}
@@ -0,0 +1,87 @@
+/*
+ * ReadAheadSource.h: Demuxes the samples of another source ahead of time on its own thread
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#ifndef AUDIOSYNC_READAHEADSOURCE_H
+#define AUDIOSYNC_READAHEADSOURCE_H
+
+#include <atomic>
+#include <pthread.h>
+#include "AudioSource.h"
+#include "readerwriterqueue/readerwriterqueue.h"
+
+// Access units buffered ahead of the network thread, about 6s of AAC
+#define AUDIOSYNC_READAHEAD_DEPTH 256
+#define AUDIOSYNC_READAHEAD_SAMPLE_SIZE 8192
+// Wait this long before asking the wrapped source again when it had no sample ready
+#define AUDIOSYNC_READAHEAD_RETRY_US 2000
+
+/*
+ * Reads the wrapped source on a separate thread into a bounded queue, so slow storage
+ * doesn't hold up the network thread. ReadSample never blocks, it returns AUDIOSOURCE_AGAIN
+ * if the next sample was not read yet. All buffers are allocated up front.
+ */
+class ReadAheadSource : public AudioSource {
+public:
+    /**
+     * Takes ownership of source and starts reading right away
+     */
+    ReadAheadSource(AudioSource *source, size_t depth = AUDIOSYNC_READAHEAD_DEPTH,
+                    size_t maxSampleSize = AUDIOSYNC_READAHEAD_SAMPLE_SIZE);
+
+    ~ReadAheadSource();
+
+    const char *FormatString() {
+        return source->FormatString();
+    }
+
+    ssize_t ReadSample(uint8_t *buffer, size_t capacity, int64_t *timeUSec);
+
+    /**
+     * Samples read ahead and not yet consumed
+     */
+    size_t QueueDepth() const {
+        return filled.size_approx();
+    }
+
+    /**
+     * How often ReadSample found the queue empty before the end of the stream
+     */
+    uint64_t Underruns() const {
+        return underruns;
+    }
+
+private:
+    struct AccessUnit {
+        uint8_t *data;// NULL tells the thread to stop
+        ssize_t size;
+        int64_t timeUs;
+    };
+
+    AudioSource *source;
+    size_t maxSampleSize;
+    uint8_t *buffers;
+    // Units cycle between these two, neither ever has to grow
+    moodycamel::BlockingReaderWriterQueue<AccessUnit> filled, empty;
+    pthread_t thread = 0;
+    std::atomic<bool> running;
+
+    // Written by the consumer
+    std::atomic<uint64_t> underruns;
+    bool ended = false;
+    ssize_t endStatus = -1;
+
+    void Run();
+
+    static void *RunThread(void *ctx);
+};
+
+#endif //AUDIOSYNC_READAHEADSOURCE_H
@@ -0,0 +1,252 @@
+/*
+ * ThreadedDecoder.cpp: Decodes the samples of another decoder on its own thread
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <android/log.h>
+#include "ThreadedDecoder.h"
+#include "../apppacket.h"
+
+#define debugLog(...) __android_log_print(ANDROID_LOG_DEBUG, "ThreadedDecoder", __VA_ARGS__)
+
+// A codec which got more samples than it returned is asked for the rest this often,
+// the first few times it has nothing new the thread waits for samples again
+#define DECODE_POLL_US 5000
+#define DECODE_IDLE_POLLS 4
+
+ThreadedDecoder::ThreadedDecoder(AudioDecoder *decoder, AudioDecoderOutput *output,
+                                 int decodeCPU, int outputCPU)
+        : decoder(decoder), output(output), decodeCPU(decodeCPU), outputCPU(outputCPU),
+          inputFilled(AUDIOSYNC_DECODE_DEPTH + 1), inputEmpty(AUDIOSYNC_DECODE_DEPTH),
+          pcmFilled(AUDIOSYNC_DECODE_PCM_DEPTH + 2), pcmEmpty(AUDIOSYNC_DECODE_PCM_DEPTH),
+          running(false), status(0), inputStalls(0), outputStalls(0), finished(false) {
+    inputBuffers = new uint8_t[AUDIOSYNC_DECODE_DEPTH * AUDIOSYNC_DECODE_SAMPLE_SIZE];
+    for (size_t i = 0; i < AUDIOSYNC_DECODE_DEPTH; i++) {
+        Unit unit = {Data, inputBuffers + i * AUDIOSYNC_DECODE_SAMPLE_SIZE, 0, 0, NULL, NULL, NULL};
+        inputEmpty.try_enqueue(unit);
+    }
+    pcmBuffers = new uint8_t[AUDIOSYNC_DECODE_PCM_DEPTH * AUDIOSYNC_DECODE_PCM_SIZE];
+    for (size_t i = 0; i < AUDIOSYNC_DECODE_PCM_DEPTH; i++) {
+        Unit unit = {Data, pcmBuffers + i * AUDIOSYNC_DECODE_PCM_SIZE, 0, 0, NULL, NULL, NULL};
+        pcmEmpty.try_enqueue(unit);
+    }
+}
+
+ThreadedDecoder::~ThreadedDecoder() {
+    StopThreads();
+    delete decoder;
+    delete[] inputBuffers;
+    delete[] pcmBuffers;
+}
+
+int ThreadedDecoder::Start() {
+    int err = decoder->Start();
+    if (err != 0) return err;
+
+    running = true;
+    pthread_create(&decodeThread, NULL, &ThreadedDecoder::RunDecoderThread, this);
+    pthread_create(&outputThread, NULL, &ThreadedDecoder::RunOutputThread, this);
+    return 0;
+}
+
+int ThreadedDecoder::EnqueueBuffer(const uint8_t *inBuffer, ssize_t inSize, int64_t timeUs) {
+    if (status != 0) return status;
+    if (inSize > AUDIOSYNC_DECODE_SAMPLE_SIZE) {
+        debugLog("Dropping sample of %zd bytes", inSize);
+        return 0;
+    }
+
+    Unit unit = TakeInputUnit();
+    if (inSize < 0) {
+        unit.type = EndOfStream;
+        unit.size = 0;
+    } else {
+        unit.type = Data;
+        unit.size = (size_t) inSize;
+        memcpy(unit.data, inBuffer, unit.size);
+    }
+    unit.timeUs = timeUs;
+    inputFilled.try_enqueue(unit);
+    return 0;
+}
+
+int ThreadedDecoder::EnqueueBufferRef(const uint8_t *inBuffer, size_t inSize, int64_t timeUs,
+                                      AudioBufferReleaser *releaser, void *ref) {
+    if (status != 0) {
+        releaser->ReleaseBuffer(ref);
+        return status;
+    }
+
+    Unit unit = TakeInputUnit();
+    unit.type = Data;
+    unit.input = inBuffer;
+    unit.size = inSize;
+    unit.timeUs = timeUs;
+    unit.releaser = releaser;
+    unit.ref = ref;
+    inputFilled.try_enqueue(unit);
+    return 0;
+}
+
+ThreadedDecoder::Unit ThreadedDecoder::TakeInputUnit() {
+    Unit unit;
+    if (!inputEmpty.try_dequeue(unit)) {
+        inputStalls++;
+        inputEmpty.wait_dequeue(unit);
+    }
+    // The decoder thread is done with it
+    if (unit.ref != NULL) unit.releaser->ReleaseBuffer(unit.ref);
+    unit.input = unit.data;
+    unit.releaser = NULL;
+    unit.ref = NULL;
+    return unit;
+}
+
+bool ThreadedDecoder::DequeueBuffer(AudioDecoderOutput *) {
+    return !finished;
+}
+
+void ThreadedDecoder::Flush() {
+    // Goes through the queue, the samples before it are gone once it reaches the decoder
+    Unit unit = TakeInputUnit();
+    unit.type = FlushCodec;
+    inputFilled.try_enqueue(unit);
+}
+
+void ThreadedDecoder::Stop() {
+    StopThreads();
+    decoder->Stop();
+    debugLog("Waited %llu times for the decoder, the decoder %llu times for the output",
+             (unsigned long long) inputStalls, (unsigned long long) outputStalls);
+}
+
+void ThreadedDecoder::StopThreads() {
+    if (!running) return;
+    running = false;
+    Unit stop = {StopThread, NULL, 0, 0, NULL, NULL, NULL};
+    inputFilled.try_enqueue(stop);// The decoder thread passes it on
+    pthread_join(decodeThread, NULL);
+    pthread_join(outputThread, NULL);
+
+    // All units are back, release what they still carry
+    for (size_t i = 0; i < AUDIOSYNC_DECODE_DEPTH; i++) {
+        Unit unit;
+        if (!inputEmpty.try_dequeue(unit)) break;
+        if (unit.ref != NULL) unit.releaser->ReleaseBuffer(unit.ref);
+        unit.releaser = NULL;
+        unit.ref = NULL;
+        inputEmpty.try_enqueue(unit);
+    }
+}
+
+void ThreadedDecoder::EnqueuePCMFrames(const uint8_t *pcmBuffer, size_t pcmSize,
+                                       int64_t playbackTimeUs) {
+    decoded++;
+    size_t frameSize = decoder->NumChannels() * sizeof(int16_t);
+    uint32_t samplesPerSec = decoder->SampleRate();
+    size_t chunkSize = AUDIOSYNC_DECODE_PCM_SIZE - AUDIOSYNC_DECODE_PCM_SIZE % frameSize;
+
+    size_t offset = 0;
+    while (offset < pcmSize) {
+        Unit unit;
+        // The output thread hands every unit back, it only quits after the decoder thread
+        if (!pcmEmpty.try_dequeue(unit)) {
+            outputStalls++;
+            pcmEmpty.wait_dequeue(unit);
+        }
+        unit.type = Data;
+        unit.size = pcmSize - offset < chunkSize ? pcmSize - offset : chunkSize;
+        memcpy(unit.data, pcmBuffer + offset, unit.size);
+        offset += unit.size;
+        // The time belongs to the end of the buffer, the parts before it end earlier
+        unit.timeUs = playbackTimeUs;
+        if (samplesPerSec > 0) {
+            unit.timeUs -= (int64_t) ((pcmSize - offset) / frameSize) * SECOND_MICRO / samplesPerSec;
+        }
+        pcmFilled.try_enqueue(unit);
+    }
+}
+
+void ThreadedDecoder::RunDecoder() {
+    audiosync_setThreadCPU(decodeCPU);
+    uint64_t samples = 0;
+    int idlePolls = 0;
+    bool ended = false;
+    while (true) {
+        Unit unit;
+        // The codec may still have the output of a sample
+        if (!ended && samples > decoded && idlePolls < DECODE_IDLE_POLLS) {
+            if (!inputFilled.try_dequeue(unit)) {
+                usleep(DECODE_POLL_US);
+                idlePolls++;
+                decoder->DequeueBuffer(this);
+                continue;
+            }
+        } else {
+            inputFilled.wait_dequeue(unit);
+        }
+        if (unit.type == StopThread) break;
+
+        if (unit.type == FlushCodec) {
+            decoder->Flush();
+            samples = decoded = 0;
+        } else if (status == 0) {
+            int err = decoder->EnqueueBuffer(unit.type == Data ? unit.input : NULL,
+                                             unit.type == Data ? (ssize_t) unit.size : -1,
+                                             unit.timeUs);
+            if (err != 0) status = err;
+        }
+        UnitType type = unit.type;
+        int64_t timeUs = unit.timeUs;
+        inputEmpty.try_enqueue(unit);
+
+        if (type == Data) {
+            // Like the network thread did, one buffer out for every sample in
+            samples++;
+            idlePolls = 0;
+            decoder->DequeueBuffer(this);
+        } else if (type == EndOfStream) {
+            while (running && status == 0 && decoder->DequeueBuffer(this)) {}
+            ended = true;
+            Unit end = {EndOfStream, NULL, 0, timeUs, NULL, NULL, NULL};
+            pcmFilled.try_enqueue(end);
+        }
+    }
+
+    Unit stop = {StopThread, NULL, 0, 0, NULL, NULL, NULL};
+    pcmFilled.try_enqueue(stop);
+}
+
+void ThreadedDecoder::RunOutput() {
+    audiosync_setThreadCPU(outputCPU);
+    while (true) {
+        Unit unit;
+        pcmFilled.wait_dequeue(unit);
+        if (unit.type == StopThread) break;
+        if (unit.type == EndOfStream) {
+            finished = true;
+            continue;
+        }
+        output->EnqueuePCMFrames(unit.data, unit.size, unit.timeUs);
+        pcmEmpty.try_enqueue(unit);
+    }
+}
+
+void *ThreadedDecoder::RunDecoderThread(void *ctx) {
+    ((ThreadedDecoder *) ctx)->RunDecoder();
+    return NULL;
+}
+
+void *ThreadedDecoder::RunOutputThread(void *ctx) {
+    ((ThreadedDecoder *) ctx)->RunOutput();
+    return NULL;
+}
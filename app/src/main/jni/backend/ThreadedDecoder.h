@@ -0,0 +1,136 @@
+/*
+ * ThreadedDecoder.h: Decodes the samples of another decoder on its own thread
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#ifndef AUDIOSYNC_THREADEDDECODER_H
+#define AUDIOSYNC_THREADEDDECODER_H
+
+#include <atomic>
+#include <pthread.h>
+#include "AudioDecoder.h"
+#include "readerwriterqueue/readerwriterqueue.h"
+
+// Compressed samples waiting for the decoder, the sender never reads larger ones
+// (see AUDIOSYNC_READAHEAD_SAMPLE_SIZE)
+#define AUDIOSYNC_DECODE_DEPTH 64
+#define AUDIOSYNC_DECODE_SAMPLE_SIZE 8192
+// Decoded buffers waiting for the output, larger ones are split
+#define AUDIOSYNC_DECODE_PCM_DEPTH 32
+#define AUDIOSYNC_DECODE_PCM_SIZE 16384
+
+/*
+ * Runs the wrapped decoder on a thread of its own and hands the PCM data to the output on a
+ * third one, so neither a slow codec nor a full output holds up the network thread.
+ * The stages are connected by single producer, single consumer queues of buffers which are all
+ * allocated up front. EnqueueBuffer only blocks if the decoder is that far behind.
+ *
+ * Buffers passed by EnqueueBufferRef are read by the decoder thread without a copy, they are
+ * released once the unit which carried them is reused or the decoder is stopped.
+ *
+ * All methods must be called from the same thread. The PCM data goes to the output given here,
+ * DequeueBuffer only reports whether there is more to come.
+ */
+class ThreadedDecoder : public AudioDecoder, private AudioDecoderOutput {
+public:
+    /**
+     * Takes ownership of decoder. The stages are pinned to the given CPUs, unless negative.
+     */
+    ThreadedDecoder(AudioDecoder *decoder, AudioDecoderOutput *output, int decodeCPU = -1,
+                    int outputCPU = -1);
+
+    ~ThreadedDecoder();
+
+    uint32_t SampleRate() {
+        return decoder->SampleRate();
+    }
+
+    uint32_t NumChannels() {
+        return decoder->NumChannels();
+    }
+
+    int Start();
+
+    int EnqueueBuffer(const uint8_t *inBuffer, ssize_t inSize, int64_t timeUs);
+
+    int EnqueueBufferRef(const uint8_t *inBuffer, size_t inSize, int64_t timeUs,
+                         AudioBufferReleaser *releaser, void *ref);
+
+    bool DequeueBuffer(AudioDecoderOutput *output);
+
+    void Flush();
+
+    void Stop();
+
+    /**
+     * How often EnqueueBuffer had to wait for the decoder
+     */
+    uint64_t InputStalls() const {
+        return inputStalls;
+    }
+
+    /**
+     * How often the decoder had to wait for the output
+     */
+    uint64_t OutputStalls() const {
+        return outputStalls;
+    }
+
+private:
+    enum UnitType {
+        Data, FlushCodec, EndOfStream, StopThread
+    };
+
+    struct Unit {
+        UnitType type;
+        uint8_t *data;// Owned by the unit
+        size_t size;
+        int64_t timeUs;
+        const uint8_t *input;// Either data or a buffer from EnqueueBufferRef
+        AudioBufferReleaser *releaser;
+        void *ref;
+    };
+
+    AudioDecoder *decoder;
+    AudioDecoderOutput *output;
+    int decodeCPU, outputCPU;
+    uint8_t *inputBuffers, *pcmBuffers;
+    // Units cycle between the empty and filled queues of each stage, neither ever has to grow.
+    // The filled ones have room for one more unit, to stop the thread.
+    moodycamel::BlockingReaderWriterQueue<Unit> inputFilled, inputEmpty, pcmFilled, pcmEmpty;
+    pthread_t decodeThread = 0, outputThread = 0;
+    std::atomic<bool> running;
+
+    // Written by the decoder thread
+    std::atomic<int> status;
+    std::atomic<uint64_t> inputStalls, outputStalls;
+    uint64_t decoded = 0;// Buffers the codec returned
+    // Written by the output thread
+    std::atomic<bool> finished;
+
+    void EnqueuePCMFrames(const uint8_t *pcmBuffer, size_t pcmSize, int64_t playbackTimeUs);
+
+    /**
+     * Takes an empty unit for the decoder thread, releases the buffer it carried before
+     */
+    Unit TakeInputUnit();
+
+    void RunDecoder();
+
+    void RunOutput();
+
+    void StopThreads();
+
+    static void *RunDecoderThread(void *ctx);
+
+    static void *RunOutputThread(void *ctx);
+};
+
+#endif //AUDIOSYNC_THREADEDDECODER_H
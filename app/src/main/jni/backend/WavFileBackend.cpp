@@ -0,0 +1,108 @@
+/*
+ * WavFileBackend.cpp: Stream from and play into RIFF WAVE files with 16 bit PCM
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#include <string.h>
+#include <android/log.h>
+#include "WavFileBackend.h"
+
+#define debugLog(...) __android_log_print(ANDROID_LOG_DEBUG, "WavFile", __VA_ARGS__)
+
+#define WAVE_FORMAT_PCM 1
+
+// All fields are little endian
+typedef struct {
+    uint16_t audioFormat;
+    uint16_t numChannels;
+    uint32_t sampleRate;
+    uint32_t byteRate;
+    uint16_t blockAlign;
+    uint16_t bitsPerSample;
+} __attribute__ ((__packed__)) _wavFmt;
+
+typedef struct {
+    char riff[4];
+    uint32_t riffSize;
+    char wave[4];
+    char fmtId[4];
+    uint32_t fmtSize;
+    _wavFmt fmt;
+    char dataId[4];
+    uint32_t dataSize;
+} __attribute__ ((__packed__)) _wavHeader;
+
+WavFileSource::WavFileSource(const char *path, uint32_t framesPerPacket)
+        : RawPcmSource(path, framesPerPacket) {
+    if (file && !ReadHeader()) {
+        debugLog("%s is not a 16 bit PCM wave file", path);
+        fclose(file);
+        file = NULL;
+    }
+}
+
+bool WavFileSource::ReadHeader() {
+    char riff[12];
+    if (fread(riff, 1, sizeof(riff), file) != sizeof(riff)
+        || memcmp(riff, "RIFF", 4) != 0 || memcmp(riff + 8, "WAVE", 4) != 0) return false;
+
+    bool hasFormat = false;
+    char chunkId[4];
+    uint32_t chunkSize;
+    while (fread(chunkId, 1, 4, file) == 4 && fread(&chunkSize, 4, 1, file) == 1) {
+        if (memcmp(chunkId, "fmt ", 4) == 0 && chunkSize >= sizeof(_wavFmt)) {
+            _wavFmt fmt;
+            if (fread(&fmt, sizeof(fmt), 1, file) != 1) return false;
+            if (fmt.audioFormat != WAVE_FORMAT_PCM || fmt.bitsPerSample != 16) return false;
+            SetFormat(fmt.sampleRate, fmt.numChannels);
+            hasFormat = true;
+            chunkSize -= sizeof(fmt);
+        } else if (memcmp(chunkId, "data", 4) == 0) {
+            remaining = chunkSize;
+            return hasFormat;
+        }
+        // Chunks are padded to an even size
+        if (fseek(file, chunkSize + (chunkSize & 1), SEEK_CUR) != 0) return false;
+    }
+    return false;
+}
+
+WavFileSink::~WavFileSink() {
+    Close();
+}
+
+void WavFileSink::WriteHeader() {
+    _wavHeader header;
+    memcpy(header.riff, "RIFF", 4);
+    header.riffSize = (uint32_t) (sizeof(_wavHeader) - 8 + bytesWritten);
+    memcpy(header.wave, "WAVE", 4);
+    memcpy(header.fmtId, "fmt ", 4);
+    header.fmtSize = sizeof(_wavFmt);
+    header.fmt.audioFormat = WAVE_FORMAT_PCM;
+    header.fmt.numChannels = (uint16_t) current_numChannels;
+    header.fmt.sampleRate = current_samplesPerSec;
+    header.fmt.blockAlign = (uint16_t) (current_numChannels * sizeof(int16_t));
+    header.fmt.byteRate = current_samplesPerSec * header.fmt.blockAlign;
+    header.fmt.bitsPerSample = 16;
+    memcpy(header.dataId, "data", 4);
+    header.dataSize = (uint32_t) bytesWritten;
+    fwrite(&header, sizeof(header), 1, file);
+}
+
+void WavFileSink::OnOpen() {
+    RawPcmSink::OnOpen();
+    // Sizes are unknown for now, will be fixed in OnClose
+    if (file) WriteHeader();
+}
+
+void WavFileSink::OnClose() {
+    if (file && fseek(file, 0, SEEK_SET) == 0) WriteHeader();
+    RawPcmSink::OnClose();
+}
@@ -0,0 +1,41 @@
+/*
+ * WavFileBackend.h: Stream from and play into RIFF WAVE files with 16 bit PCM
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#ifndef AUDIOSYNC_WAVFILEBACKEND_H
+#define AUDIOSYNC_WAVFILEBACKEND_H
+
+#include "RawPcmBackend.h"
+
+class WavFileSource : public RawPcmSource {
+public:
+    WavFileSource(const char *path, uint32_t framesPerPacket = AUDIOSYNC_PCM_FRAMES_PER_PACKET);
+
+private:
+    bool ReadHeader();
+};
+
+class WavFileSink : public RawPcmSink {
+public:
+    WavFileSink(const char *path) : RawPcmSink(path) { }
+
+    ~WavFileSink();
+
+protected:
+    void OnOpen();
+
+    void OnClose();
+
+private:
+    void WriteHeader();
+};
+
+#endif //AUDIOSYNC_WAVFILEBACKEND_H
@@ -0,0 +1,125 @@
+/*
+ * clocksync.cpp: Estimates the offset of the sender's clock from probes in the RTP session
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#include "clocksync.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+
+bool ClockSync::AddSample(int64_t t1, int64_t t2, int64_t t3, int64_t t4) {
+    // Time on the wire, without the time the sender took to answer
+    int64_t rtt = (t4 - t1) - (t3 - t2);
+    if (rtt < 0 || rtt > AUDIOSYNC_CLOCK_MAX_RTT_US) return false;
+
+    Sample s = {t1 + (t4 - t1) / 2, ((t2 - t1) + (t3 - t4)) / 2, rtt};
+    window[next] = s;
+    next = (next + 1) % AUDIOSYNC_CLOCK_MODEL_WINDOW;
+    if (count < AUDIOSYNC_CLOCK_MODEL_WINDOW) count++;
+    samples++;
+
+    // A single lucky sample must not reject all the others, the better half is always kept
+    int64_t rtts[AUDIOSYNC_CLOCK_MODEL_WINDOW];
+    for (size_t i = 0; i < count; i++) rtts[i] = window[i].rttUs;
+    std::nth_element(rtts, rtts + count / 2, rtts + count);
+    int64_t medianUs = rtts[count / 2];
+    rttUs = *std::min_element(rtts, rtts + count / 2 + 1);
+    referenceUs = s.localUs;
+    fitted = Fit(std::max(AUDIOSYNC_CLOCK_OUTLIER_FACTOR * rttUs + AUDIOSYNC_CLOCK_OUTLIER_SLACK_US,
+                          medianUs));
+    if (!fitted) {
+        // The sample least delayed by queues, the delay may differ a lot between directions
+        size_t best = 0, recent = count < AUDIOSYNC_CLOCK_WINDOW ? count : AUDIOSYNC_CLOCK_WINDOW;
+        for (size_t i = 1; i < recent; i++) {
+            if (Latest(i).rttUs < Latest(best).rttUs) best = i;
+        }
+        offsetUs = Latest(best).offsetUs;
+        skew = 0;
+        skewErrorPpm = 0;
+        errorBoundUs = Latest(best).rttUs / 2;
+    }
+    return true;
+}
+
+bool ClockSync::Fit(int64_t maxRttUs) {
+    // Relative to the latest sample, the absolute times don't fit into a double's precision
+    const Sample &ref = Latest(0);
+    double n = 0, sumX = 0, sumY = 0;
+    int64_t first = ref.localUs;
+    for (size_t i = 0; i < count; i++) {
+        const Sample &s = window[i];
+        if (s.rttUs > maxRttUs) continue;
+        n++;
+        sumX += s.localUs - ref.localUs;
+        sumY += s.offsetUs - ref.offsetUs;
+        if (s.localUs < first) first = s.localUs;
+    }
+    if (n < AUDIOSYNC_CLOCK_MIN_FIT_SAMPLES
+        || ref.localUs - first < AUDIOSYNC_CLOCK_MIN_FIT_SPAN_US) {
+        return false;
+    }
+
+    double meanX = sumX / n, meanY = sumY / n;
+    double sxx = 0, sxy = 0;
+    for (size_t i = 0; i < count; i++) {
+        const Sample &s = window[i];
+        if (s.rttUs > maxRttUs) continue;
+        double dx = (s.localUs - ref.localUs) - meanX;
+        sxx += dx * dx;
+        sxy += dx * ((s.offsetUs - ref.offsetUs) - meanY);
+    }
+    double slope = sxy / sxx;
+    const double maxSkew = AUDIOSYNC_CLOCK_MAX_SKEW_PPM / 1E6;
+    if (slope > maxSkew) slope = maxSkew;
+    if (slope < -maxSkew) slope = -maxSkew;
+    double intercept = meanY - slope * meanX;// At the latest sample
+
+    double ssr = 0;
+    for (size_t i = 0; i < count; i++) {
+        const Sample &s = window[i];
+        if (s.rttUs > maxRttUs) continue;
+        double r = (s.offsetUs - ref.offsetUs) - (intercept + slope * (s.localUs - ref.localUs));
+        ssr += r * r;
+    }
+    double sigma = n > 2 ? sqrt(ssr / (n - 2)) : 0;
+    double offsetError = sigma * sqrt(1 / n + meanX * meanX / sxx);
+
+    offsetUs = ref.offsetUs + (int64_t) llround(intercept);
+    skew = slope;
+    skewErrorPpm = 2 * sigma / sqrt(sxx) * 1E6;
+    errorBoundUs = rttUs / 2 + (int64_t) (2 * offsetError);
+    return true;
+}
+
+void ClockSync::Reset() {
+    next = count = 0;
+    samples = probes = 0;
+    fitted = false;
+    offsetUs = referenceUs = rttUs = errorBoundUs = 0;
+    skew = skewErrorPpm = 0;
+}
+
+int64_t ClockSync::JitterUs() {
+    if (count < 2) return 0;
+    // The median, a single probe which got stuck in a queue doesn't count
+    int64_t changes[AUDIOSYNC_CLOCK_MODEL_WINDOW];
+    size_t n = count - 1;
+    for (size_t i = 0; i < n; i++) changes[i] = llabs(Latest(i).rttUs - Latest(i + 1).rttUs);
+    std::nth_element(changes, changes + n / 2, changes + n);
+    return changes[n / 2];
+}
+
+int64_t ClockSync::NextProbeUs(int64_t lastProbeUs) {
+    probes++;
+    return lastProbeUs + (probes < AUDIOSYNC_CLOCK_WINDOW ? AUDIOSYNC_CLOCK_BURST_INTERVAL_US
+                                                          : AUDIOSYNC_CLOCK_PROBE_INTERVAL_US);
+}
@@ -0,0 +1,186 @@
+/*
+ * clocksync.h: Estimates the offset of the sender's clock from probes in the RTP session
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#ifndef AUDIOSYNC_CLOCKSYNC_H
+#define AUDIOSYNC_CLOCKSYNC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Until the drift can be fitted, the estimate comes from the best of the latest samples
+#define AUDIOSYNC_CLOCK_WINDOW 8
+// Samples the drift is fitted over, about a minute at the slow interval
+#define AUDIOSYNC_CLOCK_MODEL_WINDOW 64
+// On joining a burst of AUDIOSYNC_CLOCK_WINDOW probes this far apart is sent, then they are
+// sent at the slower interval. The burst counts the probes, lost ones don't prolong it.
+#define AUDIOSYNC_CLOCK_BURST_INTERVAL_US 5000
+#define AUDIOSYNC_CLOCK_PROBE_INTERVAL_US 1000000
+// Good enough to start playing, without waiting for the rest of the burst
+#define AUDIOSYNC_CLOCK_READY_ERROR_US 2000
+// Replies which took longer are useless, the error of a sample is up to half its round trip
+#define AUDIOSYNC_CLOCK_MAX_RTT_US 1000000
+// Samples with a round trip above factor * the shortest one + slack were held up in a queue,
+// unless they are among the better half
+#define AUDIOSYNC_CLOCK_OUTLIER_FACTOR 2
+#define AUDIOSYNC_CLOCK_OUTLIER_SLACK_US 500
+// The drift is only fitted to this many samples over at least this long
+#define AUDIOSYNC_CLOCK_MIN_FIT_SAMPLES 4
+#define AUDIOSYNC_CLOCK_MIN_FIT_SPAN_US (4 * 1000000LL)
+// Crystals are a lot better than this, a larger skew is noise
+#define AUDIOSYNC_CLOCK_MAX_SKEW_PPM 500
+
+/*
+ * Models the sender's clock as offset + skew * t on the local clock. Every exchange of a probe
+ * and its reply yields four timestamps, t1 and t4 on the local clock when the probe was sent
+ * and the reply arrived, t2 and t3 on the sender's clock when it received the probe and sent
+ * the reply. Like in NTP they give an offset sample with an error of up to half the round trip,
+ * samples delayed by queues are rejected by their round trip.
+ *
+ * At first the offset is that of the best of the last AUDIOSYNC_CLOCK_WINDOW samples, without
+ * a skew. Once the samples span long enough, offset and skew are a least squares fit to the
+ * samples of the last AUDIOSYNC_CLOCK_MODEL_WINDOW which weren't rejected.
+ */
+class ClockSync {
+public:
+    /**
+     * Adds the sample of an exchange, samples with an impossible or too long round trip are
+     * ignored
+     * @return true if the model changed
+     */
+    bool AddSample(int64_t t1, int64_t t2, int64_t t3, int64_t t4);
+
+    /**
+     * Forgets all samples
+     */
+    void Reset();
+
+    /**
+     * Counts the probe which was sent at lastProbeUs, and returns when the next is due
+     */
+    int64_t NextProbeUs(int64_t lastProbeUs);
+
+    bool HasOffset() {
+        return count > 0;
+    }
+
+    /**
+     * Whether the offset is good enough to start playing. Either its error bound is below
+     * AUDIOSYNC_CLOCK_READY_ERROR_US or the replies to the whole burst arrived.
+     */
+    bool IsReady() {
+        return count > 0 && (errorBoundUs <= AUDIOSYNC_CLOCK_READY_ERROR_US
+                             || samples >= AUDIOSYNC_CLOCK_WINDOW);
+    }
+
+    /**
+     * Whether the skew was fitted yet, it is 0 before
+     */
+    bool HasSkew() {
+        return fitted;
+    }
+
+    /**
+     * Sender clock minus the local clock at the time of the latest sample, in microseconds.
+     * Only valid if HasOffset()
+     */
+    int64_t OffsetUs() {
+        return offsetUs;
+    }
+
+    /**
+     * Sender clock minus the local clock at localUs, following the skew
+     */
+    int64_t OffsetUs(int64_t localUs) {
+        return offsetUs + (int64_t) (skew * (localUs - referenceUs));
+    }
+
+    /**
+     * Local time OffsetUs() belongs to
+     */
+    int64_t ReferenceUs() {
+        return referenceUs;
+    }
+
+    /**
+     * How much faster the sender's clock runs, as a fraction
+     */
+    double Skew() {
+        return skew;
+    }
+
+    double SkewPpm() {
+        return skew * 1E6;
+    }
+
+    /**
+     * Two standard errors of the fitted skew, 0 before it was fitted
+     */
+    double SkewErrorPpm() {
+        return skewErrorPpm;
+    }
+
+    /**
+     * OffsetUs() is off by at most about this much. Half the shortest round trip, which might
+     * be spent in one direction only, plus two standard errors of the fit.
+     */
+    int64_t ErrorBoundUs() {
+        return errorBoundUs;
+    }
+
+    /**
+     * Shortest round trip of the samples in the window
+     */
+    int64_t RttUs() {
+        return rttUs;
+    }
+
+    /**
+     * Median change of the round trip between consecutive samples in the window. It bounds the
+     * jitter of either direction, without media packets to measure it. 0 before two samples.
+     */
+    int64_t JitterUs();
+
+    /**
+     * Samples which were accepted
+     */
+    uint64_t Samples() {
+        return samples;
+    }
+
+private:
+    struct Sample {
+        int64_t localUs;// Halfway between sending the probe and the reply arriving
+        int64_t offsetUs, rttUs;
+    };
+
+    Sample window[AUDIOSYNC_CLOCK_MODEL_WINDOW];
+    size_t next = 0, count = 0;
+    uint64_t samples = 0, probes = 0;
+    bool fitted = false;
+    int64_t offsetUs = 0, referenceUs = 0, rttUs = 0, errorBoundUs = 0;
+    double skew = 0, skewErrorPpm = 0;
+
+    /**
+     * i = 0 is the latest sample
+     */
+    const Sample &Latest(size_t i) {
+        return window[(next + AUDIOSYNC_CLOCK_MODEL_WINDOW - 1 - i) % AUDIOSYNC_CLOCK_MODEL_WINDOW];
+    }
+
+    /**
+     * Fits offset and skew to the samples within maxRttUs
+     * @return false if they are too few or too close together
+     */
+    bool Fit(int64_t maxRttUs);
+};
+
+#endif //AUDIOSYNC_CLOCKSYNC_H
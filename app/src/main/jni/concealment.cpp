@@ -0,0 +1,259 @@
+/*
+ * concealment.cpp: Fills the gaps lost packets leave in the decoded audio
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#include "concealment.h"
+
+#include <string.h>
+#include <algorithm>
+#include <android/log.h>
+
+#include "apppacket.h"
+
+#define debugLog(...) __android_log_print(ANDROID_LOG_DEBUG, "LossConcealer", __VA_ARGS__)
+
+#if defined(__GNUC__) || defined(__clang__)
+// Compiles to SSE on x86 and NEON on ARM
+typedef float _float4 __attribute__((vector_size(16)));
+
+static float _dot(const float *a, const float *b, size_t n) {
+    _float4 acc0 = {0, 0, 0, 0}, acc1 = {0, 0, 0, 0};
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _float4 a0, a1, b0, b1;
+        memcpy(&a0, a + i, sizeof(_float4));
+        memcpy(&a1, a + i + 4, sizeof(_float4));
+        memcpy(&b0, b + i, sizeof(_float4));
+        memcpy(&b1, b + i + 4, sizeof(_float4));
+        acc0 += a0 * b0;
+        acc1 += a1 * b1;
+    }
+    acc0 += acc1;
+    float sum = acc0[0] + acc0[1] + acc0[2] + acc0[3];
+    for (; i < n; i++) sum += a[i] * b[i];
+    return sum;
+}
+#else
+static float _dot(const float *a, const float *b, size_t n) {
+    float sum = 0;
+    for (size_t i = 0; i < n; i++) sum += a[i] * b[i];
+    return sum;
+}
+#endif
+
+static inline int16_t _clamp(float sample) {
+    if (sample > INT16_MAX) return INT16_MAX;
+    if (sample < INT16_MIN) return INT16_MIN;
+    return (int16_t) sample;
+}
+
+void LossConcealer::Init(AudioDecoderOutput *output, uint32_t samplesPerSec,
+                         uint32_t numChannels) {
+    this->output = output;
+    this->samplesPerSec = samplesPerSec;
+    this->numChannels = numChannels;
+    minPitch = (size_t) ((int64_t) AUDIOSYNC_CONCEAL_MIN_PITCH_US * samplesPerSec / SECOND_MICRO);
+    maxPitch = (size_t) ((int64_t) AUDIOSYNC_CONCEAL_MAX_PITCH_US * samplesPerSec / SECOND_MICRO);
+    match = (size_t) ((int64_t) AUDIOSYNC_CONCEAL_MATCH_US * samplesPerSec / SECOND_MICRO);
+    fullFrames = (size_t) ((int64_t) AUDIOSYNC_CONCEAL_FULL_US * samplesPerSec / SECOND_MICRO);
+    fadeFrames = (size_t) ((int64_t) AUDIOSYNC_CONCEAL_FADE_US * samplesPerSec / SECOND_MICRO);
+    if (minPitch < 4) minPitch = 4;
+    if (maxPitch < minPitch) maxPitch = minPitch;
+    if (fadeFrames == 0) fadeFrames = 1;
+    decimation = std::max((uint32_t) 1, samplesPerSec / AUDIOSYNC_CONCEAL_SEARCH_RATE);
+
+    // Enough for the search and for the loop, which blends in the period before the last
+    historyFrames = maxPitch + match;
+    history.assign(historyFrames * numChannels, 0);
+    historyFill = 0;
+    mono.assign(historyFrames, 0);
+    coarse.assign(historyFrames / decimation + 1, 0);
+    loop.assign(maxPitch * numChannels, 0);
+    chunk.assign(AUDIOSYNC_CONCEAL_CHUNK_FRAMES * numChannels, 0);
+    frame.assign(numChannels, 0);
+    period = overlap = 0;
+
+    hasLast = false;
+    lastTimeUs = lastDurationUs = 0;
+    gaps = concealedFrames = 0;
+}
+
+int64_t LossConcealer::ConcealedUs() {
+    return samplesPerSec > 0 ? (int64_t) concealedFrames * SECOND_MICRO / samplesPerSec : 0;
+}
+
+void LossConcealer::EnqueuePCMFrames(const uint8_t *pcmBuffer, size_t pcmSize,
+                                     int64_t playbackTimeUs) {
+    size_t frameSize = numChannels * sizeof(int16_t);
+    if (output == NULL || frameSize == 0) return;
+    size_t frames = pcmSize / frameSize;
+    const int16_t *pcm = (const int16_t *) pcmBuffer;
+
+    // The time should belong to the end of the buffer, the sender's timestamps rather belong to
+    // the start of the previous one. It makes a difference when the length changes, a gap has
+    // to show up either way.
+    int64_t durationUs = (int64_t) frames * SECOND_MICRO / samplesPerSec;
+    int64_t gapUs = std::min(playbackTimeUs - durationUs, playbackTimeUs - lastDurationUs)
+                    - lastTimeUs;
+    if (hasLast && gapUs >= AUDIOSYNC_CONCEAL_MIN_GAP_US
+        && gapUs <= AUDIOSYNC_CONCEAL_MAX_GAP_US) {
+        size_t missing = (size_t) (gapUs * samplesPerSec / SECOND_MICRO);
+        gaps++;
+        concealedFrames += missing;
+        Conceal(missing);
+        FadeIn(pcm, frames, missing, playbackTimeUs);
+    } else {
+        if (hasLast && gapUs > AUDIOSYNC_CONCEAL_MAX_GAP_US) {
+            debugLog("Not concealing a gap of %.2fs", gapUs / 1E6);
+        }
+        output->EnqueuePCMFrames(pcmBuffer, pcmSize, playbackTimeUs);
+        Remember(pcm, frames);
+    }
+    hasLast = true;
+    lastTimeUs = playbackTimeUs;
+    lastDurationUs = durationUs;
+}
+
+void LossConcealer::Remember(const int16_t *pcm, size_t frames) {
+    if (frames >= historyFrames) {
+        memcpy(history.data(), pcm + (frames - historyFrames) * numChannels,
+               history.size() * sizeof(int16_t));
+    } else if (frames > 0) {
+        size_t keep = (historyFrames - frames) * numChannels;
+        memmove(history.data(), history.data() + frames * numChannels, keep * sizeof(int16_t));
+        memcpy(history.data() + keep, pcm, frames * numChannels * sizeof(int16_t));
+    }
+    historyFill = std::min(historyFrames, historyFill + frames);
+}
+
+size_t LossConcealer::FindPeriod() {
+    const int16_t *h = history.data();
+    float scale = 1.0f / numChannels;
+    for (size_t f = 0; f < historyFrames; f++) {
+        float sum = 0;
+        for (uint32_t c = 0; c < numChannels; c++) sum += h[f * numChannels + c];
+        mono[f] = sum * scale;
+    }
+
+    // Coarse search on the averaged audio, the end of both windows lines up with the gap
+    size_t d = decimation, m = historyFrames / d, first = historyFrames - m * d;
+    for (size_t j = 0; j < m; j++) {
+        float sum = 0;
+        for (size_t k = 0; k < d; k++) sum += mono[first + j * d + k];
+        coarse[j] = sum / d;
+    }
+    size_t w = match / d, lo = std::max((size_t) 1, minPitch / d), hi = maxPitch / d;
+    const float *target = coarse.data() + m - w;
+    float energy = _dot(target - lo, target - lo, w);
+    size_t best = lo;
+    float bestScore = -1;
+    for (size_t lag = lo; lag <= hi; lag++) {
+        const float *candidate = target - lag;
+        if (lag > lo) energy = std::max(0.0f, energy + candidate[0] * candidate[0]
+                                              - candidate[w] * candidate[w]);
+        float c = _dot(target, candidate, w);
+        // Normalized correlation, squared to save the root
+        float score = c > 0 && energy > 0 ? c * c / energy : 0;
+        if (score > bestScore) {
+            bestScore = score;
+            best = lag;
+        }
+    }
+
+    // Refine around it on the full rate
+    size_t from = std::max(minPitch, best * d > d - 1 ? best * d - (d - 1) : 0);
+    size_t to = std::min(maxPitch, best * d + (d - 1));
+    target = mono.data() + historyFrames - match;
+    size_t period = std::min(maxPitch, std::max(minPitch, best * d));
+    bestScore = -1;
+    for (size_t p = from; p <= to; p++) {
+        const float *candidate = target - p;
+        float c = _dot(target, candidate, match);
+        float e = _dot(candidate, candidate, match);
+        float score = c > 0 && e > 0 ? c * c / e : 0;
+        if (score > bestScore) {
+            bestScore = score;
+            period = p;
+        }
+    }
+    return period;
+}
+
+void LossConcealer::BuildLoop() {
+    period = 0;
+    overlap = std::max((size_t) 1, minPitch / 4);
+    // Right after the start we rather play silence
+    if (historyFill < historyFrames) return;
+
+    size_t p = FindPeriod(), l = p / 4;
+    const int16_t *last = history.data() + (historyFrames - p) * numChannels;
+    const int16_t *before = last - p * numChannels;
+    memcpy(loop.data(), last, p * numChannels * sizeof(int16_t));
+    // The end blends into the period before, whose successor is the start of the loop
+    for (size_t j = 0; j < l; j++) {
+        size_t k = (p - l + j) * numChannels;
+        float weight = (j + 1.0f) / (l + 1.0f);
+        for (uint32_t c = 0; c < numChannels; c++) {
+            loop[k + c] = _clamp((1 - weight) * last[k + c] + weight * before[k + c]);
+        }
+    }
+    period = p;
+    overlap = std::max((size_t) 1, l);
+}
+
+void LossConcealer::Synthesize(size_t i, int16_t *out) {
+    float gain = 1;
+    if (i >= fullFrames) gain = 1 - (float) (i - fullFrames) / fadeFrames;
+    if (period == 0 || gain <= 0) {
+        memset(out, 0, numChannels * sizeof(int16_t));
+        return;
+    }
+    const int16_t *in = loop.data() + (i % period) * numChannels;
+    for (uint32_t c = 0; c < numChannels; c++) out[c] = (int16_t) (in[c] * gain);
+}
+
+void LossConcealer::Conceal(size_t missing) {
+    BuildLoop();
+    size_t frameSize = numChannels * sizeof(int16_t);
+    size_t done = 0;
+    while (done < missing) {
+        size_t n = std::min((size_t) AUDIOSYNC_CONCEAL_CHUNK_FRAMES, missing - done);
+        for (size_t i = 0; i < n; i++) Synthesize(done + i, chunk.data() + i * numChannels);
+        done += n;
+        output->EnqueuePCMFrames((const uint8_t *) chunk.data(), n * frameSize,
+                                 lastTimeUs + (int64_t) done * SECOND_MICRO / samplesPerSec);
+        Remember(chunk.data(), n);
+    }
+}
+
+void LossConcealer::FadeIn(const int16_t *pcm, size_t frames, size_t missing,
+                           int64_t playbackTimeUs) {
+    size_t frameSize = numChannels * sizeof(int16_t);
+    size_t n = std::min(std::min(overlap, frames), (size_t) AUDIOSYNC_CONCEAL_CHUNK_FRAMES);
+    for (size_t i = 0; i < n; i++) {
+        Synthesize(missing + i, frame.data());
+        float weight = (i + 1.0f) / (n + 1.0f);
+        for (uint32_t c = 0; c < numChannels; c++) {
+            size_t s = i * numChannels + c;
+            chunk[s] = _clamp(weight * pcm[s] + (1 - weight) * frame[c]);
+        }
+    }
+    if (n > 0) {
+        int64_t endUs = playbackTimeUs - (int64_t) (frames - n) * SECOND_MICRO / samplesPerSec;
+        output->EnqueuePCMFrames((const uint8_t *) chunk.data(), n * frameSize, endUs);
+        Remember(chunk.data(), n);
+    }
+    if (frames > n) {
+        output->EnqueuePCMFrames((const uint8_t *) (pcm + n * numChannels),
+                                 (frames - n) * frameSize, playbackTimeUs);
+        Remember(pcm + n * numChannels, frames - n);
+    }
+}
@@ -0,0 +1,113 @@
+/*
+ * concealment.h: Fills the gaps lost packets leave in the decoded audio
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#ifndef AUDIOSYNC_CONCEALMENT_H
+#define AUDIOSYNC_CONCEALMENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "backend/AudioDecoder.h"
+
+// Range of the pitch periods we look for, about 67 to 400 Hz
+#define AUDIOSYNC_CONCEAL_MIN_PITCH_US 2500
+#define AUDIOSYNC_CONCEAL_MAX_PITCH_US 15000
+// The end of the audio before a gap is compared with this much audio one period earlier
+#define AUDIOSYNC_CONCEAL_MATCH_US 10000
+// The coarse pitch search runs on audio averaged down to about this rate
+#define AUDIOSYNC_CONCEAL_SEARCH_RATE 8000
+// Repeated audio keeps its level this long, then it fades to silence
+#define AUDIOSYNC_CONCEAL_FULL_US 10000
+#define AUDIOSYNC_CONCEAL_FADE_US 50000
+// Smaller differences are rounding of the timestamps, larger ones are not packet loss
+#define AUDIOSYNC_CONCEAL_MIN_GAP_US 1000
+#define AUDIOSYNC_CONCEAL_MAX_GAP_US 1000000
+// Frames of concealment passed on at once
+#define AUDIOSYNC_CONCEAL_CHUNK_FRAMES 1024
+
+/*
+ * Sits between the decoder and the player. If a buffer starts later than the previous one
+ * ended, the missing time is filled in, so the audio stays on the sender's timeline. The last
+ * pitch period before the gap is repeated, fading out after a while, and the audio after the
+ * gap fades in over the continued repetition.
+ *
+ * The pitch search compares a fixed number of averaged samples per gap, independent of the
+ * sample rate, filling in the gap costs a multiplication per sample. Buffers are only
+ * allocated by Init.
+ */
+class LossConcealer : public AudioDecoderOutput {
+public:
+    /**
+     * Call before the first buffer, forgets everything about the previous stream
+     * @param output  receives the audio, with the gaps filled in
+     */
+    void Init(AudioDecoderOutput *output, uint32_t samplesPerSec, uint32_t numChannels);
+
+    /**
+     * playbackTimeUs belongs to the end of the buffer, like for the player
+     */
+    void EnqueuePCMFrames(const uint8_t *pcmBuffer, size_t pcmSize, int64_t playbackTimeUs);
+
+    /**
+     * Gaps which were filled in
+     */
+    uint64_t Gaps() {
+        return gaps;
+    }
+
+    /**
+     * Length of the audio which was made up
+     */
+    int64_t ConcealedUs();
+
+private:
+    AudioDecoderOutput *output = NULL;
+    uint32_t samplesPerSec = 0, numChannels = 0;
+    size_t minPitch = 0, maxPitch = 0, match = 0, decimation = 1;
+    size_t fullFrames = 0, fadeFrames = 1;
+    bool hasLast = false;
+    int64_t lastTimeUs = 0, lastDurationUs = 0;// Of the previous buffer
+
+    // The latest frames passed on, interleaved
+    std::vector<int16_t> history;
+    size_t historyFrames = 0, historyFill = 0;
+
+    // Scratch space of the pitch search and the synthesis
+    std::vector<float> mono, coarse;
+    std::vector<int16_t> loop, chunk, frame;
+    size_t period = 0, overlap = 0;
+
+    uint64_t gaps = 0, concealedFrames = 0;
+
+    void Remember(const int16_t *pcm, size_t frames);
+
+    size_t FindPeriod();
+
+    /**
+     * Prepares the waveform to repeat, sets period to 0 if there is not enough audio
+     */
+    void BuildLoop();
+
+    /**
+     * Frame i after the start of the gap, written to out
+     */
+    void Synthesize(size_t i, int16_t *out);
+
+    void Conceal(size_t missing);
+
+    /**
+     * Passes the buffer after a gap on, its start fades in over the continued repetition
+     */
+    void FadeIn(const int16_t *pcm, size_t frames, size_t missing, int64_t playbackTimeUs);
+};
+
+#endif //AUDIOSYNC_CONCEALMENT_H
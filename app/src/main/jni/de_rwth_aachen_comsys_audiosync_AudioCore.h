@@ -83,6 +83,9 @@ JNIEXPORT jboolean JNICALL Java_de_rwth_1aachen_comsys_audiosync_AudioCore_isSen
 JNIEXPORT void JNICALL Java_de_rwth_1aachen_comsys_audiosync_AudioCore_pauseSending
         (JNIEnv *, jobject);
 
+JNIEXPORT jlong JNICALL Java_de_rwth_1aachen_comsys_audiosync_AudioCore_getPlayoutLatency
+        (JNIEnv *, jobject);
+
 #ifdef __cplusplus
 }
 #endif
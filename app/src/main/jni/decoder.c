@@ -204,11 +204,23 @@ ssize_t decoder_extractData(AMediaExtractor *extractor, uint8_t *buffer, size_t
     return written;
 }
 
+AMediaFormat *decoder_getAudioFormat(AMediaExtractor *extractor) {
+    size_t tracks = AMediaExtractor_getTrackCount(extractor);
+    for (size_t idx = 0; idx < tracks; idx++) {
+        AMediaFormat *format = AMediaExtractor_getTrackFormat(extractor, idx);
+        const char *mime_type;
+        bool success = AMediaFormat_getString(format, AMEDIAFORMAT_KEY_MIME, &mime_type);
+        if (success && startsWith("audio/", mime_type)) return format;
+        AMediaFormat_delete(format);
+    }
+    return NULL;
+}
+
 
 
 // ============================ Helper functions for streaming data ============================
 
-int decoder_enqueueBuffer(AMediaCodec *codec, uint8_t *inBuffer, ssize_t inSize, int64_t timestamp) {
+int decoder_enqueueBuffer(AMediaCodec *codec, const uint8_t *inBuffer, ssize_t inSize, int64_t timestamp) {
     ssize_t bufIdx = AMediaCodec_dequeueInputBuffer(codec, 5000);// 5ms decoding time
     if (bufIdx >= 0) {
         size_t capacity;
@@ -226,7 +238,7 @@ int decoder_enqueueBuffer(AMediaCodec *codec, uint8_t *inBuffer, ssize_t inSize,
                                                       capacity, (uint64_t) timestamp, 0);
                 if (status != AMEDIA_OK) return status;
                 // Recursevly call this until we are done
-                status = decoder_enqueueBuffer(codec, buffer + capacity, inSize - capacity, timestamp);
+                status = decoder_enqueueBuffer(codec, inBuffer + capacity, inSize - capacity, timestamp);
             } else {
                 memcpy(buffer, inBuffer, (size_t) inSize);
                 status = AMediaCodec_queueInputBuffer(codec, (size_t) bufIdx, 0,
@@ -241,14 +253,14 @@ int decoder_enqueueBuffer(AMediaCodec *codec, uint8_t *inBuffer, ssize_t inSize,
 }
 
 bool decoder_dequeueBuffer(AMediaCodec *codec,
-                           void (*sinkFunc)(const uint8_t *pcmBuffer, size_t pcmSize,
-                                            int64_t playbackTime)) {
+                           void (*sinkFunc)(void *ctx, const uint8_t *pcmBuffer, size_t pcmSize,
+                                            int64_t playbackTime), void *ctx) {
     AMediaCodecBufferInfo info;
     ssize_t bufIdx = AMediaCodec_dequeueOutputBuffer(codec, &info, 5000);// 5ms decoding time
     if (bufIdx >= 0) {
         if (info.size > 0) {
             uint8_t *pcmBuffer = AMediaCodec_getOutputBuffer(codec, (size_t) bufIdx, NULL);
-            sinkFunc(pcmBuffer + info.offset, (size_t) info.size, info.presentationTimeUs);
+            sinkFunc(ctx, pcmBuffer + info.offset, (size_t) info.size, info.presentationTimeUs);
         }
         if (info.flags & AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM) {
             debugLog("Decoder EOS");
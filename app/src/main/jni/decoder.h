@@ -40,18 +40,22 @@ AMediaExtractor *decoder_createExtractorFromUri(const char *path);
 
 ssize_t decoder_extractData(AMediaExtractor *extractor, uint8_t *buffer, size_t capacity,
                             int64_t *timeUSec);
+/*
+ * Format of the first audio track, the caller has to delete it
+ */
+AMediaFormat *decoder_getAudioFormat(AMediaExtractor *extractor);
 
 // =========================== Helper functions for streaming decoding ===========================
 
-int decoder_enqueueBuffer(AMediaCodec *codec, uint8_t *inBuffer, ssize_t inSize, int64_t time);
+int decoder_enqueueBuffer(AMediaCodec *codec, const uint8_t *inBuffer, ssize_t inSize, int64_t time);
 /*
  * Dequeue a buffer from the codec
- * @param  sinkFunc  the pcm data will be passed to this function pointer
+ * @param  sinkFunc  the pcm data will be passed to this function pointer, together with ctx
  * @return  true if there is still data coming, false if there is no more
  */
 bool decoder_dequeueBuffer(AMediaCodec *codec,
-                           void (*sinkFunc)(const uint8_t *pcmBuffer, size_t pcmSize,
-                                            int64_t playbackTime));
+                           void (*sinkFunc)(void *ctx, const uint8_t *pcmBuffer, size_t pcmSize,
+                                            int64_t playbackTime), void *ctx);
 
 #ifdef __cplusplus
 }
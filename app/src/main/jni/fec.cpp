@@ -0,0 +1,241 @@
+/*
+ * fec.cpp: XOR forward error correction for the RTP audio stream
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#include "fec.h"
+
+#include <arpa/inet.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#include "jrtplib/rtpmemorymanager.h"
+
+using namespace jrtplib;
+
+// NEON and SSE2 both XOR 128 bits at once, the compiler picks whatever the target has
+typedef uint8_t fec_vector __attribute__ ((vector_size(16)));
+
+void audiosync_xor(uint8_t *dst, const uint8_t *src, size_t len) {
+    size_t i = 0;
+    for (; i + sizeof(fec_vector) <= len; i += sizeof(fec_vector)) {
+        fec_vector a, b;
+        memcpy(&a, dst + i, sizeof(fec_vector));
+        memcpy(&b, src + i, sizeof(fec_vector));
+        a ^= b;
+        memcpy(dst + i, &a, sizeof(fec_vector));
+    }
+    for (; i < len; i++) dst[i] ^= src[i];
+}
+
+static inline int16_t _seqDiff(uint16_t a, uint16_t b) {
+    return (int16_t) (a - b);
+}
+
+// ========= Encoder =========
+
+void FecEncoder::Add(uint16_t seqNum, uint32_t timestamp, bool marker, const uint32_t *extension,
+                     size_t extensionWords, const uint8_t *payload, size_t length) {
+    if (count == 0) {
+        parity.assign(sizeof(audiosync_fecHeader), 0);
+        audiosync_fecHeader *header = (audiosync_fecHeader *) parity.data();
+        header->baseSeqNum = htons(seqNum);
+    }
+    if (parity.size() < sizeof(audiosync_fecHeader) + length) {
+        parity.resize(sizeof(audiosync_fecHeader) + length, 0);
+    }
+
+    // Everything is XORed in network byte order, the receiver does the same
+    audiosync_fecHeader *header = (audiosync_fecHeader *) parity.data();
+    header->markerXor ^= marker ? 1 : 0;
+    header->timestampXor ^= htonl(timestamp);
+    header->lengthXor ^= htons((uint16_t) length);
+    header->extensionLengthXor ^= htons((uint16_t) extensionWords);
+    for (size_t i = 0; i < extensionWords && i < AUDIOSYNC_FEC_EXTENSION_WORDS; i++) {
+        header->extensionXor[i] ^= extension[i];
+    }
+    audiosync_xor(parity.data() + sizeof(audiosync_fecHeader), payload, length);
+    count++;
+}
+
+const std::vector<uint8_t> &FecEncoder::Finish() {
+    audiosync_fecHeader *header = (audiosync_fecHeader *) parity.data();
+    header->count = (uint8_t) count;
+    count = 0;
+    return parity;
+}
+
+// ========= Decoder =========
+
+static inline double _elapsedUs(const RTPTime &now, const RTPTime &since) {
+    return (now.GetDouble() - since.GetDouble()) * 1E6;
+}
+
+FecDecoder::~FecDecoder() {
+    for (PendingParity &p : parities) Delete(p.packet);
+}
+
+void FecDecoder::Delete(RTPPacket *pack) {
+    RTPDelete(pack, mgr);
+}
+
+// A slot holds the sequence number with an extra bit, so that empty slots never match
+#define PARITY_MARK 0x10000
+
+bool FecDecoder::IsParity(uint16_t seqNum) {
+    return active && paritySlots[seqNum % AUDIOSYNC_JITTER_HISTORY] == (seqNum | PARITY_MARK);
+}
+
+void FecDecoder::RememberParity(uint16_t seqNum) {
+    paritySlots[seqNum % AUDIOSYNC_JITTER_HISTORY] = seqNum | PARITY_MARK;
+}
+
+void FecDecoder::Add(RTPPacket *pack, const RTPTime &now) {
+    audiosync_fecHeader header;
+    if (pack->GetPayloadLength() < sizeof(audiosync_fecHeader)) {
+        Delete(pack);
+        return;
+    }
+    memcpy(&header, pack->GetPayloadData(), sizeof(audiosync_fecHeader));
+    if (header.count == 0) {
+        Delete(pack);
+        return;
+    }
+    uint16_t base = ntohs(header.baseSeqNum);
+    if (!active) settledEnd = base;
+    active = true;
+    groupSize = header.count;
+    // Every group follows the parity packet of the one before, even if that got lost
+    RememberParity(pack->GetSequenceNumber());
+    RememberParity((uint16_t) (base - 1));
+
+    PendingParity p = {pack, now};
+    parities.push_back(p);
+}
+
+void FecDecoder::Resolve(JitterBuffer &buffer, const RTPTime &now) {
+    PendingParities::iterator it = parities.begin();
+    while (it != parities.end()) {
+        size_t missing = Recover(buffer, it->packet, now);
+        // Late packets may still come, lost ones are given up after a while
+        if (missing > 0 && _elapsedUs(now, it->arrival) < AUDIOSYNC_FEC_WAIT_US) {
+            ++it;
+            continue;
+        }
+        unrecoverable += missing;
+
+        audiosync_fecHeader header;
+        memcpy(&header, it->packet->GetPayloadData(), sizeof(audiosync_fecHeader));
+        uint16_t end = (uint16_t) (ntohs(header.baseSeqNum) + header.count);
+        if (_seqDiff(end, settledEnd) > 0) settledEnd = end;
+        Delete(it->packet);
+        it = parities.erase(it);
+    }
+}
+
+size_t FecDecoder::Recover(JitterBuffer &buffer, RTPPacket *parity, const RTPTime &now) {
+    audiosync_fecHeader header;
+    memcpy(&header, parity->GetPayloadData(), sizeof(audiosync_fecHeader));
+    uint16_t base = ntohs(header.baseSeqNum);
+    size_t count = header.count;
+
+    size_t found = 0;
+    uint32_t missingSeqNum = 0;
+    RTPPacket *sample = NULL;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t seqNum = buffer.ExtendSequenceNumber((uint16_t) (base + i));
+        // Some of the group was passed on already, we can't rebuild anything
+        if (buffer.IsReleased(seqNum)) return 0;
+        RTPPacket *pack = buffer.Find(seqNum);
+        if (pack) {
+            found++;
+            sample = pack;
+        } else {
+            missingSeqNum = seqNum;
+        }
+    }
+    if (found + 1 != count) return count - found;
+
+    // The XOR of the parity and everything we have leaves the lost packet
+    const uint8_t *parityPayload = parity->GetPayloadData() + sizeof(audiosync_fecHeader);
+    size_t parityLength = parity->GetPayloadLength() - sizeof(audiosync_fecHeader);
+    payload.assign(parityPayload, parityPayload + parityLength);
+    for (size_t i = 0; i < count; i++) {
+        RTPPacket *pack = buffer.Find(buffer.ExtendSequenceNumber((uint16_t) (base + i)));
+        if (pack == NULL) continue;
+        if (pack->GetPayloadLength() > payload.size()) return 1;// Not from this group
+
+        size_t extensionWords = pack->HasExtension() ? pack->GetExtensionLength() / 4 : 0;
+        uint32_t extension[AUDIOSYNC_FEC_EXTENSION_WORDS] = {0};
+        if (extensionWords > 0) {
+            memcpy(extension, pack->GetExtensionData(),
+                   std::min(extensionWords, (size_t) AUDIOSYNC_FEC_EXTENSION_WORDS) * 4);
+        }
+        header.markerXor ^= pack->HasMarker() ? 1 : 0;
+        header.timestampXor ^= htonl(pack->GetTimestamp());
+        header.lengthXor ^= htons((uint16_t) pack->GetPayloadLength());
+        header.extensionLengthXor ^= htons((uint16_t) extensionWords);
+        for (size_t w = 0; w < AUDIOSYNC_FEC_EXTENSION_WORDS; w++) {
+            header.extensionXor[w] ^= extension[w];
+        }
+        audiosync_xor(payload.data(), pack->GetPayloadData(), pack->GetPayloadLength());
+    }
+
+    // The payload type and extension id are the same for the whole stream
+    size_t length = ntohs(header.lengthXor);
+    size_t extensionWords = ntohs(header.extensionLengthXor);
+    if (length > payload.size() || extensionWords > AUDIOSYNC_FEC_EXTENSION_WORDS) return 1;
+    uint16_t extensionId = sample->HasExtension() ? sample->GetExtensionID() : 0;
+    RTPPacket *pack = RTPNew(mgr, RTPMEM_TYPE_CLASS_RTPPACKET)
+            RTPPacket(sample->GetPayloadType(), payload.data(), length, (uint16_t) missingSeqNum,
+                      ntohl(header.timestampXor), parity->GetSSRC(), header.markerXor != 0, 0,
+                      NULL, extensionWords > 0, extensionId, (uint16_t) extensionWords,
+                      header.extensionXor, 0, mgr);
+    if (pack == NULL) return 1;
+    if (pack->GetCreationError() < 0) {
+        Delete(pack);
+        return 1;
+    }
+    pack->SetExtendedSequenceNumber(missingSeqNum);
+    recovered++;
+    buffer.InsertRecovered(pack, now);
+    return 0;
+}
+
+FecDecoder::PendingParity *FecDecoder::WaitingFor(uint16_t seqNum) {
+    for (PendingParity &p : parities) {
+        audiosync_fecHeader header;
+        memcpy(&header, p.packet->GetPayloadData(), sizeof(audiosync_fecHeader));
+        uint16_t base = ntohs(header.baseSeqNum);
+        if (_seqDiff(seqNum, base) >= 0 && _seqDiff(seqNum, base) < header.count) return &p;
+    }
+    return NULL;
+}
+
+bool FecDecoder::Holds(uint16_t seqNum, uint16_t newestSeqNum, const RTPTime &arrival,
+                       const RTPTime &now) {
+    if (!active) return false;
+    if (WaitingFor(seqNum)) return true;
+    // Its group was settled, or its parity packet seems to be lost
+    return _seqDiff(seqNum, settledEnd) >= 0
+           && _seqDiff(newestSeqNum, seqNum) < (int16_t) (2 * groupSize)
+           && _elapsedUs(now, arrival) < AUDIOSYNC_FEC_HOLD_US;
+}
+
+int64_t FecDecoder::HoldUs(uint16_t seqNum, uint16_t newestSeqNum, const RTPTime &arrival,
+                           const RTPTime &now) {
+    if (!Holds(seqNum, newestSeqNum, arrival, now)) return 0;
+    // Resolve gives up on the parity packet after a while
+    PendingParity *p = WaitingFor(seqNum);
+    double elapsedUs = p ? _elapsedUs(now, p->arrival) : _elapsedUs(now, arrival);
+    double holdUs = (p ? AUDIOSYNC_FEC_WAIT_US : AUDIOSYNC_FEC_HOLD_US) - elapsedUs;
+    return holdUs > 0 ? (int64_t) ceil(holdUs) : 0;
+}
@@ -0,0 +1,157 @@
+/*
+ * fec.h: XOR forward error correction for the RTP audio stream
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#ifndef AUDIOSYNC_FEC_H
+#define AUDIOSYNC_FEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+#include <vector>
+
+#include "jrtplib/rtppacket.h"
+#include "jrtplib/rtptimeutilities.h"
+#include "jitterbuffer.h"
+
+// Parity packets are part of the media stream, with their own payload type
+#define AUDIOSYNC_FEC_PAYLOAD_TYPE 127
+#define AUDIOSYNC_FEC_MAX_GROUP 255
+// Header extension words which are protected, enough for the playback time and fragment flags
+#define AUDIOSYNC_FEC_EXTENSION_WORDS 3
+// A parity packet waits this long for late packets of its group, before giving up on the lost ones
+#define AUDIOSYNC_FEC_WAIT_US 100000
+// A packet whose parity packet got lost is passed on after this long at the latest
+#define AUDIOSYNC_FEC_HOLD_US 200000
+
+/*
+ * A parity packet protects a group of media packets with consecutive sequence numbers.
+ * Its payload is this header, followed by the XOR of all payloads zero padded to the longest.
+ * Any single lost packet of the group can be rebuilt from the others. Network byte order.
+ */
+typedef struct {
+    uint16_t baseSeqNum;// Of the first protected packet
+    uint8_t count;// Number of protected packets
+    uint8_t markerXor;
+    uint32_t timestampXor;
+    uint16_t lengthXor;// Of the payloads
+    uint16_t extensionLengthXor;// In 32 bit words
+    uint32_t extensionXor[AUDIOSYNC_FEC_EXTENSION_WORDS];
+} __attribute__ ((__packed__)) audiosync_fecHeader;
+
+/**
+ * dst ^= src, 16 bytes at a time
+ */
+void audiosync_xor(uint8_t *dst, const uint8_t *src, size_t len);
+
+/*
+ * Accumulates the parity of the packets sent since the last parity packet
+ */
+class FecEncoder {
+public:
+    /**
+     * Adds a packet which is about to be sent, with the sequence number and timestamp it will get
+     */
+    void Add(uint16_t seqNum, uint32_t timestamp, bool marker, const uint32_t *extension,
+             size_t extensionWords, const uint8_t *payload, size_t length);
+
+    size_t Count() const {
+        return count;
+    }
+
+    /**
+     * Payload of the parity packet for the packets added so far, starts the next group
+     */
+    const std::vector<uint8_t> &Finish();
+
+private:
+    std::vector<uint8_t> parity;
+    size_t count = 0;
+};
+
+/*
+ * Rebuilds lost media packets in the jitter buffer from the parity packets, and keeps the
+ * packets of a group in the buffer until it is known whether they are needed for that.
+ */
+class FecDecoder {
+public:
+    FecDecoder(jrtplib::RTPMemoryManager *mgr = NULL)
+            : mgr(mgr),
+              parities(jrtplib::RTPSTLAllocator<PendingParity>(mgr, RTPMEM_TYPE_CLASS_LISTNODE)),
+              paritySlots(AUDIOSYNC_JITTER_HISTORY, 0) {}
+
+    ~FecDecoder();
+
+    /**
+     * Takes ownership of a received parity packet
+     */
+    void Add(jrtplib::RTPPacket *pack, const jrtplib::RTPTime &now);
+
+    /**
+     * Inserts the packets which can be rebuilt into the buffer, and settles the groups which are
+     * complete, rebuilt or waited long enough
+     */
+    void Resolve(JitterBuffer &buffer, const jrtplib::RTPTime &now);
+
+    /**
+     * True if the packet has to stay in the buffer, because its group is not settled yet
+     * @param newestSeqNum  of the newest packet in the buffer
+     * @param arrival       of the packet
+     */
+    bool Holds(uint16_t seqNum, uint16_t newestSeqNum, const jrtplib::RTPTime &arrival,
+               const jrtplib::RTPTime &now);
+
+    /**
+     * Microseconds until Holds lets the packet go at the latest, 0 if it doesn't hold it
+     */
+    int64_t HoldUs(uint16_t seqNum, uint16_t newestSeqNum, const jrtplib::RTPTime &arrival,
+                   const jrtplib::RTPTime &now);
+
+    /**
+     * True if a parity packet had this sequence number, the media stream skips these
+     */
+    bool IsParity(uint16_t seqNum);
+
+    uint64_t Recovered() {
+        return recovered;
+    }
+
+    uint64_t Unrecoverable() {
+        return unrecoverable;
+    }
+
+private:
+    struct PendingParity {
+        jrtplib::RTPPacket *packet;
+        jrtplib::RTPTime arrival;
+    };
+    typedef std::deque<PendingParity, jrtplib::RTPSTLAllocator<PendingParity> > PendingParities;
+
+    jrtplib::RTPMemoryManager *mgr;
+    PendingParities parities;// Waiting for their group, in arrival order
+    bool active = false;// Only hold packets once the sender protects them
+    size_t groupSize = 0;
+    uint16_t settledEnd = 0;// Groups before this are complete or were given up
+    // Sequence numbers of parity packets, as many as the jitter buffer can hold packets
+    std::vector<uint32_t> paritySlots;
+    std::vector<uint8_t> payload;// Of the packet being recovered, kept to reuse its memory
+
+    uint64_t recovered = 0, unrecoverable = 0;
+
+    void RememberParity(uint16_t seqNum);
+    // Returns the number of packets still missing from the group
+    size_t Recover(JitterBuffer &buffer, jrtplib::RTPPacket *parity, const jrtplib::RTPTime &now);
+    // Returns the parity packet protecting the packet, or NULL
+    PendingParity *WaitingFor(uint16_t seqNum);
+    void Delete(jrtplib::RTPPacket *pack);
+};
+
+#endif //AUDIOSYNC_FEC_H
@@ -0,0 +1,76 @@
+/*
+ * android/log.h: Minimal stand-in for the NDK logging API, used by the host build
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#ifndef AUDIOSYNC_HOST_ANDROID_LOG_H
+#define AUDIOSYNC_HOST_ANDROID_LOG_H
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum android_LogPriority {
+    ANDROID_LOG_UNKNOWN = 0,
+    ANDROID_LOG_DEFAULT,
+    ANDROID_LOG_VERBOSE,
+    ANDROID_LOG_DEBUG,
+    ANDROID_LOG_INFO,
+    ANDROID_LOG_WARN,
+    ANDROID_LOG_ERROR,
+    ANDROID_LOG_FATAL,
+    ANDROID_LOG_SILENT
+} android_LogPriority;
+
+/*
+ * Messages below the priority given in the AUDIOSYNC_LOG environment variable are dropped,
+ * e.g. AUDIOSYNC_LOG=6 only prints errors. Everything is printed by default.
+ */
+static inline int __android_log_vprint(int prio, const char *tag, const char *fmt, va_list ap) {
+    static int minPrio = -1;
+    if (minPrio < 0) {
+        const char *env = getenv("AUDIOSYNC_LOG");
+        minPrio = env ? atoi(env) : ANDROID_LOG_UNKNOWN;
+    }
+    if (prio < minPrio) return 0;
+
+    fprintf(stderr, "%s: ", tag);
+    int written = vfprintf(stderr, fmt, ap);
+    fputc('\n', stderr);
+    return written;
+}
+
+static inline int __android_log_print(int prio, const char *tag, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int written = __android_log_vprint(prio, tag, fmt, ap);
+    va_end(ap);
+    return written;
+}
+
+static inline void __android_log_assert(const char *cond, const char *tag, const char *fmt, ...) {
+    fprintf(stderr, "%s: assertion failed: %s (%s)\n", tag, cond, fmt ? fmt : "");
+    abort();
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+// Bionic marks unused parameters with this
+#ifndef __unused
+#define __unused __attribute__((__unused__))
+#endif
+
+#endif //AUDIOSYNC_HOST_ANDROID_LOG_H
@@ -0,0 +1,166 @@
+/*
+ * audiosync.cpp: Command line sender and receiver for linux hosts
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../SenderSession.h"
+#include "../ReceiverSession.h"
+#include "../audioplayer.h"
+#include "../apppacket.h"
+#include "../backend/NullBackend.h"
+#include "../backend/RawPcmBackend.h"
+#include "../backend/WavFileBackend.h"
+#include "../backend/PcmDecoder.h"
+
+// Format of headerless pcm files
+#define RAW_PCM_SAMPLE_RATE 44100
+#define RAW_PCM_CHANNELS 2
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void _handleSignal(int) {
+    stopRequested = 1;
+}
+
+static bool _hasSuffix(const char *str, const char *suffix) {
+    size_t len = strlen(str), slen = strlen(suffix);
+    return len >= slen && strcmp(str + len - slen, suffix) == 0;
+}
+
+/*
+ * "null:<seconds>", *.wav or headerless *.pcm
+ */
+static AudioSource *_createSource(const char *name) {
+    if (strncmp(name, "null:", 5) == 0) {
+        double secs = atof(name + 5);
+        return new NullSource((int64_t) (secs * SECOND_MICRO));
+    } else if (_hasSuffix(name, ".wav")) {
+        WavFileSource *source = new WavFileSource(name);
+        if (source->IsOpen()) return source;
+        delete source;
+    } else {
+        RawPcmSource *source = new RawPcmSource(name, RAW_PCM_SAMPLE_RATE, RAW_PCM_CHANNELS);
+        if (source->IsOpen()) return source;
+        delete source;
+    }
+    return NULL;
+}
+
+/*
+ * No name or "-" plays into the void, otherwise *.wav or headerless *.pcm
+ */
+static AudioSink *_createSink(const char *name) {
+    if (name == NULL) return new NullSink();
+    else if (_hasSuffix(name, ".wav")) return new WavFileSink(name);
+    else return new RawPcmSink(name);
+}
+
+static void _usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s send <portbase> <file.wav|file.pcm|null:seconds>\n"
+            "       %s receive <host> <portbase> [out.wav|out.pcm|-] [localportbase]\n"
+            "PCM files are 16 bit little endian, %d Hz, %d channels\n"
+            "Set AUDIOSYNC_LOG=0 for verbose logging\n"
+            "Set AUDIOSYNC_IMPAIR to degrade received packets, e.g. loss=0.02,jitter=30\n"
+            "(see audiosync-syncbench -h)\n"
+            "Set AUDIOSYNC_MULTICAST to an IPv4 group, e.g. 239.255.42.1, on the sender and\n"
+            "all receivers to stream to the group instead of each receiver\n"
+            "Set AUDIOSYNC_SNTP_PORT on the sender to answer SNTP requests on that port\n"
+            "Set AUDIOSYNC_CPUS to pin the network, decoder and output threads of a receiver,\n"
+            "e.g. 0,1,2 or -1,1,1 where -1 leaves a thread unpinned\n",
+            prog, prog, RAW_PCM_SAMPLE_RATE, RAW_PCM_CHANNELS);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 4) {
+        _usage(argv[0]);
+        return 1;
+    }
+
+    signal(SIGINT, _handleSignal);
+    signal(SIGTERM, _handleSignal);
+    signal(SIGPIPE, SIG_IGN);
+    // jrtplib derives the RTCP CNAME from the login name, which daemons and containers lack
+    setenv("LOGNAME", "audiosync", 0);
+
+    const char *impairment = getenv("AUDIOSYNC_IMPAIR");
+    if (impairment) {
+        jrtplib::RTPImpairmentParams params;
+        if (!AudioStreamSession::ParseNetworkImpairment(impairment, &params)) {
+            fprintf(stderr, "Invalid AUDIOSYNC_IMPAIR profile %s\n", impairment);
+            return 1;
+        }
+        AudioStreamSession::SetNetworkImpairment(params);
+    }
+
+    const char *multicastGroup = getenv("AUDIOSYNC_MULTICAST");
+
+    const char *cpus = getenv("AUDIOSYNC_CPUS");
+    if (cpus) {
+        int networkCPU, decodeCPU, outputCPU;
+        if (sscanf(cpus, "%d,%d,%d", &networkCPU, &decodeCPU, &outputCPU) != 3) {
+            fprintf(stderr, "Invalid AUDIOSYNC_CPUS %s\n", cpus);
+            return 1;
+        }
+        ReceiverSession::SetStageCPUs(networkCPU, decodeCPU, outputCPU);
+    }
+
+    AudioStreamSession *session = NULL;
+    SenderSession *sender = NULL;
+    AudioSink *sink = NULL;
+    AudioPlayer *player = NULL;
+    if (strcmp(argv[1], "send") == 0) {
+        AudioSource *source = _createSource(argv[3]);
+        if (source == NULL) {
+            fprintf(stderr, "Could not open %s\n", argv[3]);
+            return 1;
+        }
+        session = sender = SenderSession::StartStreaming((uint16_t) atoi(argv[2]), source,
+                                                         multicastGroup);
+        const char *sntpPort = getenv("AUDIOSYNC_SNTP_PORT");
+        if (sntpPort && sender->StartSNTPServer((uint16_t) atoi(sntpPort)) < 0) {
+            fprintf(stderr, "Could not answer SNTP requests on port %s\n", sntpPort);
+        }
+    } else if (strcmp(argv[1], "receive") == 0) {
+        sink = _createSink(argc > 4 && strcmp(argv[4], "-") != 0 ? argv[4] : NULL);
+        player = new AudioPlayer(sink);
+        session = ReceiverSession::StartReceiving(argv[2], (uint16_t) atoi(argv[3]),
+                                                  &PcmDecoder::Create, player, NULL,
+                                                  (uint16_t) (argc > 5 ? atoi(argv[5]) : 0),
+                                                  multicastGroup);
+    } else {
+        _usage(argv[0]);
+        return 1;
+    }
+
+    // The sessions never end on their own after the stream is over, the receiver keeps
+    // playing out the buffered audio
+    while (!stopRequested && session->IsRunning()) {
+        usleep(100 * 1000);
+    }
+
+    session->Stop();
+    if (sender) {
+        fprintf(stderr, "Source queue underruns: %llu\n",
+                (unsigned long long) sender->SourceUnderruns());
+        fprintf(stderr, "Playout lead: %.0f ms\n", sender->PlayoutLeadUs() / 1E3);
+    }
+    if (player) player->StopPlayback();
+    delete session;
+    if (player) delete player;
+    if (sink) delete sink;
+    return 0;
+}
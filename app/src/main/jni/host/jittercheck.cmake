@@ -0,0 +1,57 @@
+# Runs audiosync-syncbench with and without network jitter, the playout lead has to grow with it
+# and the jitter buffer has to hold packets long enough for few of them to arrive late.
+# Usage: cmake -DSYNCBENCH=<path> -P jittercheck.cmake
+
+# The minimum hold of the jitter buffer (AUDIOSYNC_JITTER_MIN_HOLD_US)
+set(MIN_HOLD_MS 20)
+# At the minimum hold about 300 packets of the jittered run arrive too late
+set(MAX_LATE 30)
+set(MIN_LEAD_GROWTH_MS 50)
+
+function(run_bench jitter lead_var holds_var lates_var)
+    execute_process(COMMAND ${SYNCBENCH} -n 2 -d 5 -c -i jitter=${jitter},seed=3
+                    OUTPUT_VARIABLE out RESULT_VARIABLE result)
+    if (NOT result EQUAL 0)
+        message(FATAL_ERROR "syncbench failed with jitter=${jitter}:\n${out}")
+    endif ()
+    string(REGEX MATCH "Playout lead ([0-9]+) ms" _ "${out}")
+    set(${lead_var} ${CMAKE_MATCH_1} PARENT_SCOPE)
+
+    # The rows after the header of the jitter buffer table
+    string(REGEX MATCH "receiver +reordered[^\n]*\n[^\n]*\n(( +[0-9][^\n]*\n)+)" _ "${out}")
+    string(REGEX MATCHALL "[^\n]+" rows "${CMAKE_MATCH_1}")
+    set(holds "")
+    set(lates "")
+    foreach (row ${rows})
+        string(REGEX MATCHALL "[0-9.]+" columns "${row}")
+        list(GET columns 3 late)
+        list(GET columns 9 hold)
+        list(APPEND lates ${late})
+        list(APPEND holds ${hold})
+    endforeach ()
+    set(${holds_var} ${holds} PARENT_SCOPE)
+    set(${lates_var} ${lates} PARENT_SCOPE)
+endfunction()
+
+run_bench(0 steady_lead steady_holds steady_lates)
+run_bench(100 jittered_lead jittered_holds jittered_lates)
+message(STATUS "Playout lead ${steady_lead} ms without jitter, ${jittered_lead} ms with")
+message(STATUS "Hold windows ${jittered_holds} ms, late packets ${jittered_lates}")
+
+math(EXPR growth "${jittered_lead} - ${steady_lead}")
+if (growth LESS MIN_LEAD_GROWTH_MS)
+    message(FATAL_ERROR "The playout lead grew by ${growth} ms with jitter")
+endif ()
+if (NOT jittered_holds)
+    message(FATAL_ERROR "No receivers in the output")
+endif ()
+foreach (hold ${jittered_holds})
+    if (NOT hold GREATER MIN_HOLD_MS)
+        message(FATAL_ERROR "A hold window of ${hold} ms did not grow with the jitter")
+    endif ()
+endforeach ()
+foreach (late ${jittered_lates})
+    if (late GREATER MAX_LATE)
+        message(FATAL_ERROR "${late} packets arrived after the jitter buffer gave up on them")
+    endif ()
+endforeach ()
@@ -0,0 +1,106 @@
+/*
+ * msntpstress.cpp: Runs an SNTP server and many clients of libmsntp in one process
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+/*
+ * One thread waits for requests on the server socket and answers them, while every client
+ * thread asks it for the offset with a context of its own. All of them have to succeed, with
+ * an offset close to 0 since they share the clock. A client of a port nobody serves has to
+ * time out, one of a host which doesn't exist has to fail. Exits with 1 on a failure.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <poll.h>
+#include <atomic>
+
+#include "libmsntp/libmsntp.h"
+
+#define STRESS_PORT 17123
+#define STRESS_DEAD_PORT 17124
+#define STRESS_CLIENTS 16
+#define STRESS_REQUESTS 50
+// Loopback and a shared clock, the offset is within the round trip
+#define STRESS_MAX_OFFSET_US 10000
+
+static std::atomic<bool> stopServer{false};
+static std::atomic<int> failures{0};
+
+static void _check(bool ok, const char *what) {
+    printf("%s: %s\n", ok ? "ok" : "FAILED", what);
+    if (!ok) failures++;
+}
+
+static void *_serve(void *data) {
+    msntp_ctx *server = (msntp_ctx *) data;
+    while (!stopServer) {
+        struct pollfd fd = {msntp_ctx_server_fd(server), POLLIN, 0};
+        if (poll(&fd, 1, 50) <= 0) continue;
+        int status = msntp_ctx_serve(server, 0);
+        if (status != 0 && status != -1) {
+            fprintf(stderr, "Serving failed: %s\n", msntp_ctx_strerror(server));
+            failures++;
+        }
+    }
+    return NULL;
+}
+
+static void *_query(void *data) {
+    long id = (long) data;
+    int errors = 0;
+    msntp_ctx *client = msntp_ctx_new();
+    msntp_ctx_set_client_limits(client, 5, 1000, 0.0001);
+    for (int i = 0; i < STRESS_REQUESTS; i++) {
+        struct timeval offset;
+        if (msntp_ctx_get_offset(client, "127.0.0.1", STRESS_PORT, &offset) != 0) {
+            if (errors++ == 0) {
+                fprintf(stderr, "Client %ld: %s\n", id, msntp_ctx_strerror(client));
+            }
+        } else if (llabs(offset.tv_sec * 1000000LL + offset.tv_usec) > STRESS_MAX_OFFSET_US) {
+            if (errors++ == 0) {
+                fprintf(stderr, "Client %ld: offset %ld.%06ld s\n", id, (long) offset.tv_sec,
+                        (long) offset.tv_usec);
+            }
+        }
+    }
+    msntp_ctx_free(client);
+    failures += errors;
+    return NULL;
+}
+
+int main() {
+    msntp_ctx *server = msntp_ctx_new();
+    if (msntp_ctx_start_server(server, STRESS_PORT) != 0) {
+        fprintf(stderr, "Could not start the server: %s\n", msntp_ctx_strerror(server));
+        return 1;
+    }
+    pthread_t serverThread, clientThreads[STRESS_CLIENTS];
+    pthread_create(&serverThread, NULL, &_serve, server);
+    for (long i = 0; i < STRESS_CLIENTS; i++) {
+        pthread_create(&clientThreads[i], NULL, &_query, (void *) i);
+    }
+    for (int i = 0; i < STRESS_CLIENTS; i++) pthread_join(clientThreads[i], NULL);
+    stopServer = true;
+    pthread_join(serverThread, NULL);
+    msntp_ctx_free(server);
+    _check(failures == 0, "offsets of all clients");
+
+    struct timeval offset;
+    msntp_ctx *client = msntp_ctx_new();
+    msntp_ctx_set_client_limits(client, 2, 200, 0.1);
+    _check(msntp_ctx_get_offset(client, "127.0.0.1", STRESS_DEAD_PORT, &offset) != 0,
+           "timeout without a server");
+    _check(msntp_ctx_get_offset(client, "no.such.host.invalid", STRESS_PORT, &offset) != 0,
+           "unknown host");
+    msntp_ctx_free(client);
+    return failures == 0 ? 0 : 1;
+}
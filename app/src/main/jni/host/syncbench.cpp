@@ -0,0 +1,857 @@
+/*
+ * syncbench.cpp: Loopback benchmark running one sender and N receivers in a single process
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+/*
+ * All sessions use the RTPFakeTransmitter and run without threads, driven by a discrete event
+ * loop over a virtual clock. Packets are handed between the sessions with a fixed one-way delay.
+ * Every frame of the streamed audio encodes its own index, so the sinks can tell exactly which
+ * part of the stream they are playing at any (virtual) point in time and compare that with
+ * the senders intended playback position.
+ *
+ * With -k the receivers get clocks of their own, which are off and run at a different rate
+ * than the sender's. Each node's clock is used while the event loop works on it, the sound
+ * card of a receiver runs on its clock as well.
+ *
+ * With -u the sessions use real UDP sockets on the loopback interface instead, still on the
+ * virtual clock. The receivers read their sockets right after the sender sent something, so
+ * the network latency is zero. This mode is there to count the send system calls. The sender
+ * only reads the clock probes of -c when it polls, which looks like an asymmetric delay.
+ *
+ * With -t there is no stream, a UDP transmitter takes in datagrams of an audio packet's size
+ * as fast as it can, to measure how many a core could receive per second.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <queue>
+#include <vector>
+
+#include "jrtplib/rtpdefines.h"
+#include "jrtplib/rtpipv4address.h"
+#include "jrtplib/rtprawpacket.h"
+#include "jrtplib/rtptimeutilities.h"
+#include "jrtplib/rtpudpv4transmitter.h"
+#include "jrtplib/extratransmitters/rtpfaketransmitter.h"
+
+#include "../SenderSession.h"
+#include "../ReceiverSession.h"
+#include "../audioplayer.h"
+#include "../apppacket.h"
+#include "../backend/PcmDecoder.h"
+#include "../backend/RawPcmBackend.h"
+
+using namespace jrtplib;
+
+#define BENCH_SAMPLE_RATE 44100
+#define BENCH_CHANNELS 2
+#define BENCH_LOCALHOST 0x7F000001
+#define BENCH_SENDER_PORTBASE 5000
+#define BENCH_RECEIVER_PORTBASE 6000
+#define BENCH_MULTICAST_GROUP 0xEFFF2A01// 239.255.42.1
+// Sessions without anything to do still process RTCP this often
+#define BENCH_POLL_INTERVAL_US 10000
+// Keep simulating this long after the end of the stream should have been played
+#define BENCH_TAIL_US SECOND_MICRO
+// Give up if the stream did not start after this long
+#define BENCH_TIMEOUT_US (60 * SECOND_MICRO)
+// The frame index is encoded in 24 bit, see _encodeFrame
+#define BENCH_MAX_FRAMES (1 << 24)
+// Room for the senders bursts, the receivers only read their sockets between events
+#define BENCH_UDP_RECEIVE_BUFFER (1024 * 1024)
+// Datagrams queued up for the receiver at a time when measuring its throughput
+#define BENCH_THROUGHPUT_BURST 128
+
+// ========= Virtual Clock =========
+
+static int64_t virtualNowUs = 0;
+
+struct Node;
+// The node whose clock the sessions see right now, the sender's if NULL
+static Node *clockNode = NULL;
+static int64_t _nodeTimeUs(const Node *node, int64_t trueUs);
+
+static int64_t _virtualClockUs() {
+    return clockNode ? _nodeTimeUs(clockNode, virtualNowUs) : virtualNowUs;
+}
+
+static RTPTime _virtualRTPTime() {
+    int64_t nowUs = _virtualClockUs();
+    return RTPTime((uint32_t) (nowUs / SECOND_MICRO), (uint32_t) (nowUs % SECOND_MICRO));
+}
+
+static int64_t _threadCpuTimeUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (int64_t) ts.tv_sec * SECOND_MICRO + ts.tv_nsec / 1000;
+}
+
+static int64_t _realTimeUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * SECOND_MICRO + ts.tv_nsec / 1000;
+}
+
+// ========= Self describing audio =========
+
+/*
+ * Left channel holds the lower 16 bit of the frame index, the right channel the next 8 bit and
+ * their complement as a check. Silence, be it 0x0000 or the 0x0101 the player renders, never
+ * passes the check.
+ */
+static void _encodeFrame(uint32_t index, int16_t *frame) {
+    uint16_t high = (uint16_t) ((index >> 16) & 0xFF);
+    frame[0] = (int16_t) (index & 0xFFFF);
+    frame[1] = (int16_t) (high | ((~high & 0xFF) << 8));
+}
+
+static bool _decodeFrame(const int16_t *frame, uint32_t *index) {
+    uint16_t right = (uint16_t) frame[1];
+    if ((right >> 8) != (~right & 0xFF)) return false;
+    *index = ((uint32_t) (right & 0xFF) << 16) | (uint16_t) frame[0];
+    return true;
+}
+
+class IndexSource : public AudioSource {
+public:
+    IndexSource(uint32_t frameCount) : frameCount(frameCount) { }
+
+    const char *FormatString() {
+        return "mime: string(" AUDIOSYNC_MIME_RAW "), sample-rate: int32(44100), channel-count: int32(2)";
+    }
+
+    ssize_t ReadSample(uint8_t *buffer, size_t capacity, int64_t *timeUSec) {
+        size_t frames = capacity / (BENCH_CHANNELS * sizeof(int16_t));
+        if (frames > AUDIOSYNC_PCM_FRAMES_PER_PACKET) frames = AUDIOSYNC_PCM_FRAMES_PER_PACKET;
+        if (frames > frameCount - framesRead) frames = frameCount - framesRead;
+
+        *timeUSec = (int64_t) framesRead * SECOND_MICRO / BENCH_SAMPLE_RATE;
+        if (frames == 0) return -1;
+
+        int16_t *out = (int16_t *) buffer;
+        for (size_t i = 0; i < frames; i++) {
+            _encodeFrame(framesRead + (uint32_t) i, out + i * BENCH_CHANNELS);
+        }
+        framesRead += frames;
+        return (ssize_t) (frames * BENCH_CHANNELS * sizeof(int16_t));
+    }
+
+private:
+    uint32_t frameCount, framesRead = 0;
+};
+
+/*
+ * Stands in for the sound card, the event loop asks it to render whenever a buffer would
+ * have finished playing. Keeps track of the playout offset against the sender. Buffers
+ * without new audio from the sender count as silent, including the concealment of lost
+ * packets: faded audio fails the check, repeated audio goes back in time.
+ */
+class BenchSink : public AudioSink {
+public:
+    int64_t nextRenderUs = INT64_MAX;
+
+    int64_t firstAudioUs = -1;
+    uint64_t silentBuffers = 0;
+    std::vector<int64_t> offsetsUs;
+
+    BenchSink(uint32_t samplesPerSec, uint32_t framesPerBuffer)
+            : samplesPerSec(samplesPerSec), framesPerBuffer(framesPerBuffer) { }
+
+    uint32_t SampleRate() {
+        return samplesPerSec;
+    }
+
+    uint32_t FramesPerBuffer() {
+        return framesPerBuffer;
+    }
+
+    void Open(uint32_t samplesPerSec, uint32_t numChannels, AudioRenderer *renderer) {
+        this->current_samplesPerSec = samplesPerSec;
+        this->current_numChannels = numChannels;
+        this->renderer = renderer;
+        this->ratePermille = 1000;
+        nextRenderUs = virtualNowUs;
+    }
+
+    /**
+     * How much faster the sound card runs than it should, 1 + the skew of its clock
+     */
+    void SetClockRate(double rate) {
+        clockRate = rate;
+    }
+
+    void SetPlaybackRate(int32_t ratePermille) {
+        this->ratePermille = ratePermille;
+    }
+
+    void Close() {
+        renderer = NULL;
+        nextRenderUs = INT64_MAX;
+    }
+
+    /**
+     * @param senderPositionUs  the position the sender wants to be played right now
+     */
+    void Render(int64_t senderPositionUs) {
+        size_t frameCount = renderer->RenderFrames(buffer);
+        uint32_t index, next;
+        // Mixed samples rarely pass the check by chance, two frames in a row don't
+        if (frameCount > 1 && current_numChannels == BENCH_CHANNELS
+            && _decodeFrame(buffer, &index) && _decodeFrame(buffer + BENCH_CHANNELS, &next)
+            && next == index + 1 && (firstAudioUs < 0 || index > lastIndex)) {
+            if (firstAudioUs < 0) firstAudioUs = virtualNowUs;
+            lastIndex = index;
+            int64_t mediaUs = (int64_t) index * SECOND_MICRO / current_samplesPerSec;
+            offsetsUs.push_back(senderPositionUs - mediaUs);
+        } else if (firstAudioUs >= 0) {
+            silentBuffers++;
+        }
+
+        if (frameCount == 0) frameCount = framesPerBuffer;
+        nextRenderUs += (int64_t) (((int64_t) frameCount * SECOND_MICRO * 1000)
+                                   / ((int64_t) current_samplesPerSec * ratePermille) / clockRate);
+    }
+
+private:
+    uint32_t samplesPerSec, framesPerBuffer;
+    uint32_t current_samplesPerSec = 0, current_numChannels = 0;
+    int32_t ratePermille = 1000;
+    double clockRate = 1;
+    uint32_t lastIndex = 0;
+    AudioRenderer *renderer = NULL;
+    int16_t buffer[AUDIOSINK_MAX_BUFFER_SIZE / sizeof(int16_t)];
+};
+
+// ========= Simulated network =========
+
+struct Delivery {
+    int64_t timeUs;
+    uint64_t seq;// Keeps packets with the same delivery time in order
+    Node *dest;
+    uint16_t srcPort;
+    bool rtp;
+    std::vector<uint8_t> data;
+
+    bool operator>(const Delivery &other) const {
+        return timeUs != other.timeUs ? timeUs > other.timeUs : seq > other.seq;
+    }
+};
+
+struct Node {
+    uint16_t portbase;
+    // Owned by the transmitter once it was created, not used for UDP
+    RTPFakeTransmissionParams *transparams = NULL;
+    RTPTransmitter *transmitter = NULL;
+    AudioStreamSession *session = NULL;
+
+    int64_t joinUs = 0;
+    int64_t nextStepUs = INT64_MAX;
+    int64_t nextPollUs = INT64_MAX;
+    int64_t cpuUs = 0;
+    uint64_t steps = 0;
+    uint64_t datagramsSent = 0;
+
+    // Only for receivers
+    BenchSink *sink = NULL;
+    AudioPlayer *player = NULL;
+    // The local clock is clockOffsetUs ahead of the true time at clockEpochUs, and runs
+    // 1 + clockSkew times as fast
+    int64_t clockOffsetUs = 0;
+    double clockSkew = 0;
+};
+
+static int64_t clockEpochUs = 0;
+
+static int64_t _nodeTimeUs(const Node *node, int64_t trueUs) {
+    return trueUs + node->clockOffsetUs + (int64_t) (node->clockSkew * (trueUs - clockEpochUs));
+}
+
+/**
+ * The first true time at which the node's clock reached nodeUs
+ */
+static int64_t _trueTimeUs(const Node *node, int64_t nodeUs) {
+    int64_t trueUs = clockEpochUs + (int64_t) ((nodeUs - node->clockOffsetUs - clockEpochUs)
+                                               / (1 + node->clockSkew));
+    // Rounding must not wake a session up before it is due, it would never get there
+    while (_nodeTimeUs(node, trueUs) < nodeUs) trueUs++;
+    return trueUs;
+}
+
+static std::vector<Node *> nodes;
+static std::priority_queue<Delivery, std::vector<Delivery>, std::greater<Delivery> > network;
+static uint64_t deliverySeq = 0;
+static int64_t networkDelayUs = 1000;
+static bool useUDP = false, batchSend = true, batchReceive = true;
+
+static void _send(Node *src, Node *dest, uint8_t *data, uint16_t len, int rtp) {
+    Delivery d;
+    d.timeUs = virtualNowUs + networkDelayUs;
+    d.seq = deliverySeq++;
+    d.dest = dest;
+    d.srcPort = (uint16_t) (rtp ? src->portbase : src->portbase + 1);
+    d.rtp = rtp != 0;
+    d.data.assign(data, data + len);
+    network.push(d);
+}
+
+static void _packetReady(void *ctx, uint8_t *data, uint16_t len, uint32_t destip_nbo,
+                         uint16_t destport_nbo, int rtp) {
+    Node *src = (Node *) ctx;
+    src->datagramsSent++;
+    // Everyone but the sender joined the group
+    if (ntohl(destip_nbo) == BENCH_MULTICAST_GROUP) {
+        for (Node *node : nodes) {
+            if (node != src) _send(src, node, data, len, rtp);
+        }
+        return;
+    }
+
+    uint16_t destPort = ntohs(destport_nbo);
+    for (Node *node : nodes) {
+        if (node->portbase == destPort || node->portbase + 1 == destPort) {
+            _send(src, node, data, len, rtp);
+            return;
+        }
+    }
+}
+
+static bool _initUDPNode(Node *node, RTPMemoryManager *mgr) {
+    RTPUDPv4TransmissionParams params;
+    params.SetPortbase(node->portbase);
+    params.SetBindIP(BENCH_LOCALHOST);
+    params.SetRTPReceiveBuffer(BENCH_UDP_RECEIVE_BUFFER);
+    params.SetBatchSend(batchSend);
+    params.SetBatchReceive(batchReceive);
+    std::list<uint32_t> localIPs;
+    localIPs.push_back(BENCH_LOCALHOST);
+    params.SetLocalIPList(localIPs);
+
+    node->transmitter = new RTPUDPv4Transmitter(mgr);
+    if (node->transmitter->Init(false) < 0
+        || node->transmitter->Create(RTP_DEFAULTPACKETSIZE, &params) < 0) {
+        fprintf(stderr, "Could not create UDP transmitter on port %d\n", node->portbase);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @param mgr  memory manager of the session which is going to use the node
+ */
+static bool _initNode(Node *node, uint16_t portbase, RTPMemoryManager *mgr) {
+    node->portbase = portbase;
+    if (useUDP) return _initUDPNode(node, mgr);
+
+    node->transparams = new RTPFakeTransmissionParams();
+    node->transparams->SetPortbase(portbase);
+    node->transparams->SetPacketReadyCB(&_packetReady);
+    node->transparams->SetPacketReadyCBData(node);
+    std::list<uint32_t> localIPs;
+    localIPs.push_back(BENCH_LOCALHOST);
+    node->transparams->SetLocalIPList(localIPs);
+
+    node->transmitter = new RTPFakeTransmitter(mgr);
+    if (node->transmitter->Init(false) < 0
+        || node->transmitter->Create(RTP_DEFAULTPACKETSIZE, node->transparams) < 0) {
+        fprintf(stderr, "Could not create transmitter\n");
+        return false;
+    }
+    return true;
+}
+
+static void _deliver(Delivery &d) {
+    RTPFakeTransmissionParams *params = d.dest->transparams;
+    params->SetCurrentData(d.data.data());
+    params->SetCurrentDataLen((uint16_t) d.data.size());
+    params->SetCurrentDataAddr(BENCH_LOCALHOST);
+    params->SetCurrentDataPort(d.srcPort);
+    params->SetCurrentDataType(d.rtp);
+    clockNode = d.dest;
+    d.dest->session->Poll();
+    clockNode = NULL;
+}
+
+// ========= Receive throughput =========
+
+/**
+ * Sends count datagrams of the given size to a transmitter in bursts, it takes in each burst
+ * at once. Only the CPU time of the receiving side counts.
+ */
+static int _receiveThroughput(uint32_t count, size_t size) {
+    RTPMemoryManager *mgr = AudioStreamSession::MemoryManager();
+    Node sender, receiver;
+    sender.portbase = BENCH_SENDER_PORTBASE;
+    receiver.portbase = BENCH_RECEIVER_PORTBASE;
+    if (!_initUDPNode(&sender, mgr) || !_initUDPNode(&receiver, mgr)) return 1;
+    if (sender.transmitter->SetMaximumPacketSize(size) < 0
+        || sender.transmitter->AddDestination(RTPIPv4Address(BENCH_LOCALHOST,
+                                                             BENCH_RECEIVER_PORTBASE)) < 0) {
+        fprintf(stderr, "Could not send datagrams of %zu B\n", size);
+        return 1;
+    }
+    RTPUDPv4Transmitter *trans = (RTPUDPv4Transmitter *) receiver.transmitter;
+
+    std::vector<uint8_t> data(size, 0);
+    uint32_t sent = 0, received = 0;
+    int64_t cpuUs = 0;
+    while (sent < count) {
+        uint32_t burst = std::min(count - sent, (uint32_t) BENCH_THROUGHPUT_BURST);
+        for (uint32_t i = 0; i < burst; i++) sender.transmitter->SendRTPData(data.data(), size);
+        sent += burst;
+
+        int64_t cpuStart = _threadCpuTimeUs();
+        trans->Poll();
+        RTPRawPacket *packet;
+        while ((packet = trans->GetNextPacket()) != NULL) {
+            RTPDelete(packet, mgr);
+            received++;
+        }
+        cpuUs += _threadCpuTimeUs() - cpuStart;
+    }
+
+    printf("UDP loopback, %s\n", batchReceive ? "batched receives" : "one recvfrom per datagram");
+    printf("Received %u of %u datagrams of %zu B in %.1f ms CPU time\n", received, sent, size,
+           cpuUs / 1E3);
+    printf("%.0f datagrams per second per core, %.3f system calls per datagram\n",
+           received * 1E6 / std::max(cpuUs, (int64_t) 1),
+           trans->GetNumberOfReceiveCalls() / (double) std::max(received, 1u));
+
+    delete sender.transmitter;
+    delete receiver.transmitter;
+    return received == sent ? 0 : 1;
+}
+
+// ========= Reporting =========
+
+static double _percentileAbs(std::vector<int64_t> values, double p) {
+    if (values.empty()) return 0;
+    for (int64_t &v : values) v = llabs(v);
+    std::sort(values.begin(), values.end());
+    size_t i = (size_t) (p * (values.size() - 1));
+    return (double) values[i];
+}
+
+static void _usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-n receivers] [-d seconds] [-l latency_ms] [-j join_interval_ms] [-i profile]\n"
+            "          [-m mtu] [-p lead_ms/rate_kB_s/burst_kB] [-o margin_ms] [-f group] [-r] [-g] [-u] [-s]\n"
+            "          [-c] [-k ppm/offset_ms] [-t datagrams]\n"
+            "  -n  number of receivers (default 4)\n"
+            "  -d  seconds of audio to stream (default 20)\n"
+            "  -l  one-way network latency in ms (default 1)\n"
+            "  -j  receivers join one after another with this interval (default 0)\n"
+            "  -i  impair the network, e.g. loss=0.02,burst=0.01/0.25,delay=5,jitter=30,\n"
+            "      reorder=0.01/20,dup=0.01,seed=7 (probabilities, times in ms)\n"
+            "  -m  path MTU of the sender, smaller values fragment the audio frames\n"
+            "  -p  sender pacing: lead ahead of playback, rate cap for overdue samples\n"
+            "      (0 is unlimited) and burst size (default 10000/1024/8)\n"
+            "  -o  safety margin on top of the playout lead the receivers need (default 250)\n"
+            "  -f  send a FEC parity packet after every group of this many packets\n"
+            "  -r  receivers request lost packets again, the sender keeps a history for that\n"
+            "  -c  receivers estimate the sender's clock offset by probes, instead of relying on\n"
+            "      the shared clock\n"
+            "  -k  clocks of the receivers run this many ppm fast or slow, alternately, and are\n"
+            "      off by as many ms (default 0/0)\n"
+            "  -g  stream to a multicast group which all receivers joined\n"
+            "  -u  send over UDP on 127.0.0.1 instead of the simulated network\n"
+            "  -s  with -u or -t, call sendto and recvfrom for every datagram instead of\n"
+            "      batching with sendmmsg and recvmmsg\n"
+            "  -t  only measure how fast this many UDP datagrams of the -m size are received\n"
+            "All times are simulated, CPU time is measured for real.\n"
+            "Logging is limited to warnings unless AUDIOSYNC_LOG is set.\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    int receiverCount = 4;
+    double durationSec = 20;
+    double latencyMs = 1, joinIntervalMs = 0;
+    const char *impairment = NULL;
+    bool multicast = false;
+    size_t mtu = AUDIOSYNC_DEFAULT_MTU;
+    double leadMs = AUDIOSYNC_DEFAULT_LEAD_US / 1000.0;
+    double marginMs = AUDIOSYNC_DEFAULT_PLAYOUT_MARGIN_US / 1000.0;
+    size_t fecGroup = 0;
+    bool nack = false;
+    bool clockSync = false;
+    double skewPpm = 0, clockOffsetMs = 0;
+    double rateKBs = AUDIOSYNC_DEFAULT_RATE_CAP / 1024.0, burstKB = AUDIOSYNC_DEFAULT_BURST / 1024.0;
+    uint32_t throughputDatagrams = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:d:l:j:i:m:p:o:f:rck:gust:h")) != -1) {
+        switch (opt) {
+            case 'n':
+                receiverCount = atoi(optarg);
+                break;
+            case 'd':
+                durationSec = atof(optarg);
+                break;
+            case 'l':
+                latencyMs = atof(optarg);
+                break;
+            case 'j':
+                joinIntervalMs = atof(optarg);
+                break;
+            case 'i':
+                impairment = optarg;
+                break;
+            case 'm':
+                mtu = (size_t) atoi(optarg);
+                break;
+            case 'p':
+                if (sscanf(optarg, "%lf/%lf/%lf", &leadMs, &rateKBs, &burstKB) < 1) {
+                    _usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'o':
+                marginMs = atof(optarg);
+                break;
+            case 'f':
+                fecGroup = (size_t) atoi(optarg);
+                break;
+            case 'r':
+                nack = true;
+                break;
+            case 'c':
+                clockSync = true;
+                break;
+            case 'k':
+                if (sscanf(optarg, "%lf/%lf", &skewPpm, &clockOffsetMs) < 1) {
+                    _usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'g':
+                multicast = true;
+                break;
+            case 'u':
+                useUDP = true;
+                break;
+            case 's':
+                batchSend = batchReceive = false;
+                break;
+            case 't':
+                throughputDatagrams = (uint32_t) atoi(optarg);
+                break;
+            default:
+                _usage(argv[0]);
+                return 1;
+        }
+    }
+    uint32_t frameCount = (uint32_t) (durationSec * BENCH_SAMPLE_RATE);
+    // Receivers on one host can't share a port, which a multicast group would need
+    if (receiverCount < 1 || durationSec <= 0 || frameCount >= BENCH_MAX_FRAMES
+        || (multicast && useUDP)) {
+        _usage(argv[0]);
+        return 1;
+    }
+    if (throughputDatagrams > 0) {
+        if (mtu <= AUDIOSYNC_IP_UDP_OVERHEAD) {
+            _usage(argv[0]);
+            return 1;
+        }
+        return _receiveThroughput(throughputDatagrams, mtu - AUDIOSYNC_IP_UDP_OVERHEAD);
+    }
+    networkDelayUs = (int64_t) (latencyMs * 1000);
+    int64_t joinIntervalUs = (int64_t) (joinIntervalMs * 1000);
+    if (impairment) {
+        RTPImpairmentParams params;
+        if (!AudioStreamSession::ParseNetworkImpairment(impairment, &params)) {
+            _usage(argv[0]);
+            return 1;
+        }
+        AudioStreamSession::SetNetworkImpairment(params);
+    }
+
+    setenv("AUDIOSYNC_LOG", "5", 0);// ANDROID_LOG_WARN
+    setenv("LOGNAME", "audiosync", 0);// Needed for the RTCP CNAME
+
+    // Start at the current wallclock time, so RTCP reports look reasonable
+    virtualNowUs = audiosync_systemTimeUs();
+    audiosync_setClock(&_virtualClockUs);
+    RTPTime::SetClock(&_virtualRTPTime);
+    const int64_t startUs = virtualNowUs;
+    clockEpochUs = startUs;
+    const int64_t realStartUs = _realTimeUs();
+
+    // ========= Setup =========
+    Node *senderNode = new Node();
+    if (!_initNode(senderNode, BENCH_SENDER_PORTBASE, AudioStreamSession::MemoryManager())) {
+        return 1;
+    }
+    SenderSession *sender = SenderSession::CreateWithTransmitter(senderNode->transmitter,
+                                                                 new IndexSource(frameCount));
+    if (sender == NULL) return 1;
+    if (sender->SetMTU(mtu) < 0) {
+        _usage(argv[0]);
+        return 1;
+    }
+    sender->SetPacing((int64_t) (leadMs * 1000), (uint32_t) (rateKBs * 1024),
+                      (uint32_t) (burstKB * 1024));
+    sender->SetPlayoutMargin((int64_t) (marginMs * 1000));
+    if (sender->SetFEC(fecGroup) < 0) {
+        _usage(argv[0]);
+        return 1;
+    }
+    if (nack && sender->SetRetransmission(AUDIOSYNC_NACK_HISTORY) < 0) return 1;
+    RTPIPv4Address group(BENCH_MULTICAST_GROUP, BENCH_RECEIVER_PORTBASE);
+    if (multicast && sender->SetMulticastGroup(group) < 0) {
+        fprintf(stderr, "Could not send to the multicast group\n");
+        return 1;
+    }
+    senderNode->session = sender;
+    senderNode->nextStepUs = senderNode->nextPollUs = startUs;
+    nodes.push_back(senderNode);
+
+    RTPIPv4Address senderAddr(BENCH_LOCALHOST, BENCH_SENDER_PORTBASE);
+    for (int i = 0; i < receiverCount; i++) {
+        Node *node = new Node();
+        if (!_initNode(node, (uint16_t) (BENCH_RECEIVER_PORTBASE + 2 * i),
+                       AudioStreamSession::MemoryManager())) {
+            return 1;
+        }
+        double sign = i % 2 == 0 ? 1 : -1;
+        node->clockSkew = sign * skewPpm / 1E6;
+        node->clockOffsetUs = (int64_t) (sign * clockOffsetMs * 1000);
+        node->sink = new BenchSink(48000, 256);
+        node->sink->SetClockRate(1 + node->clockSkew);
+        node->player = new AudioPlayer(node->sink);
+        clockNode = node;
+        node->session = ReceiverSession::CreateWithTransmitter(node->transmitter, senderAddr,
+                                                               &PcmDecoder::Create, node->player,
+                                                               NULL, multicast ? &group : NULL);
+        clockNode = NULL;
+        if (node->session == NULL) return 1;
+        ((ReceiverSession *) node->session)->SetNACK(nack);
+        ((ReceiverSession *) node->session)->SetClockSync(clockSync);
+        node->joinUs = node->nextStepUs = node->nextPollUs = startUs + i * joinIntervalUs;
+        nodes.push_back(node);
+    }
+
+    // ========= Event loop =========
+    const int64_t durationUs = (int64_t) frameCount * SECOND_MICRO / BENCH_SAMPLE_RATE;
+    while (true) {
+        int64_t nextUs = network.empty() ? INT64_MAX : network.top().timeUs;
+        for (Node *node : nodes) {
+            nextUs = std::min(nextUs, std::min(node->nextStepUs, node->nextPollUs));
+            if (node->sink) nextUs = std::min(nextUs, node->sink->nextRenderUs);
+        }
+        if (nextUs == INT64_MAX) break;
+        virtualNowUs = std::max(virtualNowUs, nextUs);
+
+        int64_t position = sender->CurrentPlaybackTimeUs();
+        if (position > durationUs + BENCH_TAIL_US) break;
+        if (position == 0 && virtualNowUs - startUs > BENCH_TIMEOUT_US + durationUs) {
+            fprintf(stderr, "Stream did not start\n");
+            break;
+        }
+
+        if (!network.empty() && network.top().timeUs <= virtualNowUs) {
+            Delivery d = network.top();
+            network.pop();
+            if (virtualNowUs < d.dest->joinUs) continue;// Not listening yet
+
+            int64_t cpuStart = _threadCpuTimeUs();
+            _deliver(d);
+            d.dest->cpuUs += _threadCpuTimeUs() - cpuStart;
+            // Receivers wait for incoming data, the sender for packets which wake it up
+            bool wake = d.dest->session->WakeRequested();
+            if (d.dest->sink || wake) {
+                d.dest->nextStepUs = std::min(d.dest->nextStepUs, virtualNowUs);
+            }
+            continue;
+        }
+
+        for (Node *node : nodes) {
+            bool render = node->sink && node->sink->nextRenderUs <= virtualNowUs;
+            bool step = node->nextStepUs <= virtualNowUs;
+            bool poll = step || node->nextPollUs <= virtualNowUs;
+            if (!render && !poll) continue;
+
+            int64_t cpuStart = _threadCpuTimeUs();
+            clockNode = node->sink ? node : NULL;
+            if (render) node->sink->Render(position);
+            if (poll) {
+                node->session->Poll();
+                node->nextPollUs = virtualNowUs + BENCH_POLL_INTERVAL_US;
+                if (node->session->WakeRequested()) step = true;
+            }
+            if (step) {
+                int64_t wakeUs = node->session->RunNetworkStep();
+                node->nextStepUs = wakeUs < 0 ? INT64_MAX : _trueTimeUs(node, wakeUs);
+                node->steps++;
+            }
+            clockNode = NULL;
+            node->cpuUs += _threadCpuTimeUs() - cpuStart;
+
+            // Whatever was sent is in the receivers socket buffers by now
+            if (useUDP && node == senderNode && poll) {
+                for (Node *receiver : nodes) {
+                    if (receiver == senderNode || virtualNowUs < receiver->joinUs) continue;
+                    cpuStart = _threadCpuTimeUs();
+                    clockNode = receiver;
+                    receiver->session->Poll();
+                    clockNode = NULL;
+                    receiver->cpuUs += _threadCpuTimeUs() - cpuStart;
+                    receiver->nextStepUs = std::min(receiver->nextStepUs, virtualNowUs);
+                }
+            }
+        }
+    }
+    const int64_t realUs = _realTimeUs() - realStartUs;
+
+    // ========= Report =========
+    printf("%d receivers, %.1f s audio, %.1f ms latency, %.1f ms join interval\n",
+           receiverCount, durationUs / 1E6, latencyMs, joinIntervalMs);
+    if (impairment) printf("Network impairment %s\n", impairment);
+    if (mtu != AUDIOSYNC_DEFAULT_MTU) printf("Path MTU %zu\n", mtu);
+    if (multicast) printf("Multicast\n");
+    if (fecGroup > 0) printf("FEC parity after every %zu packets\n", fecGroup);
+    if (nack) printf("Retransmission of lost packets\n");
+    if (clockSync) printf("Clock sync by probes\n");
+    if (skewPpm != 0 || clockOffsetMs != 0) {
+        printf("Receiver clocks %.1f ppm and %.1f ms off\n", skewPpm, clockOffsetMs);
+    }
+    if (useUDP) printf("UDP loopback, %s\n", batchSend ? "batched sends and receives"
+                                                 : "one system call per datagram");
+    printf("Pacing %.0f ms lead, %.0f kB/s rate cap, %.0f kB burst\n", leadMs, rateKBs, burstKB);
+    printf("Playout lead %.0f ms with %.0f ms margin\n", sender->PlayoutLeadUs() / 1E3, marginMs);
+    printf("Simulated %.1f s in %.2f s\n\n", (virtualNowUs - startUs) / 1E6, realUs / 1E6);
+    printf("%8s %12s %10s %10s %10s %10s %10s %10s %10s %10s %10s\n", "receiver", "first audio",
+           "mean", "stddev", "p50 |off|", "p95 |off|", "max |off|", "silent", "recovered",
+           "unrecov.", "resent");
+    printf("%8s %12s %10s %10s %10s %10s %10s %10s %10s %10s %10s\n", "", "[s]", "[ms]", "[ms]",
+           "[ms]", "[ms]", "[ms]", "[buffers]", "[packets]", "[packets]", "[packets]");
+
+    int64_t receiverCpuUs = 0;
+    uint64_t receiverSteps = 0;
+    int failed = 0;
+    for (size_t i = 1; i < nodes.size(); i++) {
+        Node *node = nodes[i];
+        BenchSink *sink = node->sink;
+        receiverCpuUs += node->cpuUs;
+        receiverSteps += node->steps;
+        if (sink->firstAudioUs < 0) {
+            printf("%8zu %12s\n", i - 1, "never");
+            failed++;
+            continue;
+        }
+
+        double sum = 0, sumSq = 0;
+        for (int64_t off : sink->offsetsUs) {
+            sum += off;
+            sumSq += (double) off * off;
+        }
+        double n = sink->offsetsUs.size();
+        double mean = sum / n;
+        double stddev = sqrt(std::max(0.0, sumSq / n - mean * mean));
+        ReceiverSession *receiver = (ReceiverSession *) node->session;
+        printf("%8zu %12.3f %10.2f %10.2f %10.2f %10.2f %10.2f %10" PRIu64 " %10" PRIu64
+               " %10" PRIu64 " %10" PRIu64 "\n", i - 1,
+               (sink->firstAudioUs - node->joinUs) / 1E6, mean / 1E3, stddev / 1E3,
+               _percentileAbs(sink->offsetsUs, 0.5) / 1E3,
+               _percentileAbs(sink->offsetsUs, 0.95) / 1E3,
+               _percentileAbs(sink->offsetsUs, 1.0) / 1E3, sink->silentBuffers,
+               receiver->FecRecovered(), receiver->FecUnrecoverable(), receiver->NackRepaired());
+    }
+
+    printf("\n%8s %10s %10s %10s %10s %10s %10s %10s %10s %10s\n", "receiver", "reordered",
+           "max depth", "late", "lost", "mean held", "max held", "concealed", "jitter", "hold");
+    printf("%8s %10s %10s %10s %10s %10s %10s %10s %10s %10s\n", "", "[packets]", "[packets]",
+           "[packets]", "[packets]", "[packets]", "[packets]", "[ms]", "[ms]", "[ms]");
+    for (size_t i = 1; i < nodes.size(); i++) {
+        ReceiverSession *receiver = (ReceiverSession *) nodes[i]->session;
+        printf("%8zu %10" PRIu64 " %10u %10" PRIu64 " %10" PRIu64 " %10.1f %10zu %10.1f %10.1f"
+               " %10.1f\n", i - 1, receiver->ReorderedPackets(), receiver->ReorderDepth(),
+               receiver->LateDrops(), receiver->LostPackets(), receiver->MeanBufferOccupancy(),
+               receiver->MaxBufferOccupancy(), receiver->ConcealedUs() / 1E3,
+               receiver->NetworkJitterUs() / 1E3, receiver->HoldWindowUs() / 1E3);
+    }
+
+    if (clockSync) {
+        printf("\n%8s %10s %10s %10s %10s %10s %10s\n", "receiver", "synced", "offset err",
+               "bound", "skew err", "bound", "rtt");
+        printf("%8s %10s %10s %10s %10s %10s %10s\n", "", "[ms]", "[ms]", "[ms]", "[ppm]",
+               "[ppm]", "[ms]");
+        for (size_t i = 1; i < nodes.size(); i++) {
+            Node *node = nodes[i];
+            ReceiverSession *receiver = (ReceiverSession *) node->session;
+            if (receiver->ClockSyncedUs() == 0) {
+                printf("%8zu %10s\n", i - 1, "never");
+                continue;
+            }
+            // The estimates against the true offset and skew of the sender's clock
+            clockNode = node;
+            int64_t offsetUs = receiver->ClockOffsetUs();
+            int64_t syncedUs = receiver->ClockSyncedUs() - _nodeTimeUs(node, node->joinUs);
+            clockNode = NULL;
+            int64_t trueOffsetUs = virtualNowUs - _nodeTimeUs(node, virtualNowUs);
+            double trueSkewPpm = -node->clockSkew / (1 + node->clockSkew) * 1E6;
+            printf("%8zu %10.1f %10.3f %10.3f %10.2f %10.2f %10.3f\n", i - 1, syncedUs / 1E3,
+                   (offsetUs - trueOffsetUs) / 1E3, receiver->ClockErrorBoundUs() / 1E3,
+                   receiver->ClockSkewPpm() - trueSkewPpm, receiver->ClockSkewErrorPpm(),
+                   receiver->ClockRttUs() / 1E3);
+        }
+    }
+
+    double audioSec = durationUs / 1E6;
+    printf("\nCPU time per second of audio: sender %.3f ms, receivers %.3f ms each "
+                   "(%.3f ms total)\n", senderNode->cpuUs / 1E3 / audioSec,
+           receiverCpuUs / 1E3 / audioSec / receiverCount, receiverCpuUs / 1E3 / audioSec);
+    printf("Receiver wakeups per second of audio: %.1f each\n",
+           receiverSteps / audioSec / receiverCount);
+    if (useUDP) {
+        RTPUDPv4Transmitter *trans = (RTPUDPv4Transmitter *) senderNode->transmitter;
+        printf("Sender system calls per second of audio: %.1f for %.1f datagrams\n",
+               trans->GetNumberOfSendCalls() / audioSec, trans->GetNumberOfSentDatagrams() / audioSec);
+        uint64_t receiveCalls = 0, datagramsReceived = 0;
+        for (size_t i = 1; i < nodes.size(); i++) {
+            trans = (RTPUDPv4Transmitter *) nodes[i]->transmitter;
+            receiveCalls += trans->GetNumberOfReceiveCalls();
+            datagramsReceived += trans->GetNumberOfReceivedDatagrams();
+        }
+        printf("Receiver system calls per second of audio: %.1f for %.1f datagrams each\n",
+               receiveCalls / audioSec / receiverCount, datagramsReceived / audioSec / receiverCount);
+    } else {
+        printf("Sender datagrams per second of audio: %.1f\n", senderNode->datagramsSent / audioSec);
+    }
+    if (nack) {
+        printf("Sender retransmitted %" PRIu64 " packets, %" PRIu64 " requests came too late\n",
+               sender->Retransmissions(), sender->RetransmissionsMissed());
+    }
+    PoolMemoryManager *pool = AudioStreamSession::MemoryManager();
+    printf("Memory pool, most buffers in use:");
+    for (size_t i = 0; i < pool->NumClasses(); i++) {
+        PoolStats stats = pool->Stats(i);
+        printf("%s %" PRId64 "/%zu of %zu B", i > 0 ? "," : "", stats.highWater, stats.capacity,
+               stats.bufferSize);
+    }
+    printf(", %" PRIu64 " allocations went to the heap\n", pool->TotalStats().fallbacks);
+
+    // ========= Teardown =========
+    for (Node *node : nodes) {
+        node->session->Stop();
+        delete node->session;
+        if (node->player) delete node->player;
+        if (node->sink) delete node->sink;
+        delete node->transmitter;
+        delete node;
+    }
+    audiosync_setClock(NULL);
+    RTPTime::SetClock(NULL);
+    return failed == 0 ? 0 : 1;
+}
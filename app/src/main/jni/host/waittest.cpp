@@ -0,0 +1,129 @@
+/*
+ * waittest.cpp: Checks the descriptors RTPUDPv4Transmitter waits for besides its sockets
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+/*
+ * An eventfd and a timerfd are added with AddWaitDescriptor, a wait has to end once they are
+ * readable and call their callbacks. A slot which was freed and reused while the epoll set
+ * still reports the old descriptor must not call the new callback. Exits with 1 on a failure.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include "jrtplib/rtpdefines.h"
+#include "jrtplib/rtpipv4address.h"
+#include "jrtplib/rtptimeutilities.h"
+#include "jrtplib/rtpudpv4transmitter.h"
+
+using namespace jrtplib;
+
+#define WAITTEST_PORTBASE 17000
+#define WAITTEST_LOCALHOST 0x7F000001
+
+struct Calls {
+    int fd = -1;
+    int count = 0;
+};
+
+static int failures = 0;
+
+static void _check(bool ok, const char *what) {
+    printf("%s: %s\n", ok ? "ok" : "FAILED", what);
+    if (!ok) failures++;
+}
+
+static void _callback(int fd, void *data) {
+    Calls *calls = (Calls *) data;
+    calls->fd = fd;
+    calls->count++;
+    uint64_t value;
+    if (read(fd, &value, sizeof(uint64_t)) != sizeof(uint64_t)) {
+        // Read by an earlier callback, the count tells
+    }
+}
+
+static void _wait(RTPUDPv4Transmitter &transmitter, uint32_t ms) {
+    bool dataavailable;
+    transmitter.WaitForIncomingData(RTPTime(ms / 1000, (ms % 1000) * 1000), &dataavailable);
+}
+
+int main() {
+    RTPUDPv4TransmissionParams params;
+    params.SetPortbase(WAITTEST_PORTBASE);
+    params.SetBindIP(WAITTEST_LOCALHOST);
+    std::list<uint32_t> localIPs;
+    localIPs.push_back(WAITTEST_LOCALHOST);
+    params.SetLocalIPList(localIPs);
+
+    RTPUDPv4Transmitter transmitter(0);
+    if (transmitter.Init(false) < 0
+        || transmitter.Create(RTP_DEFAULTPACKETSIZE, &params) < 0) {
+        fprintf(stderr, "Could not create UDP transmitter on port %d\n", WAITTEST_PORTBASE);
+        return 1;
+    }
+
+    // An eventfd written before the wait
+    int event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    Calls eventCalls;
+    _check(transmitter.AddWaitDescriptor(event, &_callback, &eventCalls) == 0, "add eventfd");
+    _check(transmitter.AddWaitDescriptor(event, &_callback, &eventCalls) < 0, "add it twice");
+    _wait(transmitter, 10);
+    _check(eventCalls.count == 0, "no callback while the eventfd is empty");
+    uint64_t one = 1;
+    if (write(event, &one, sizeof(uint64_t)) != sizeof(uint64_t)) return 1;
+    _wait(transmitter, 1000);
+    _check(eventCalls.count == 1 && eventCalls.fd == event, "callback of the written eventfd");
+
+    // A timerfd which expires during the wait
+    int timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    Calls timerCalls;
+    _check(transmitter.AddWaitDescriptor(timer, &_callback, &timerCalls) == 0, "add timerfd");
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_nsec = 5 * 1000 * 1000;
+    timerfd_settime(timer, 0, &spec, NULL);
+    RTPTime start = RTPTime::CurrentTime();
+    _wait(transmitter, 1000);
+    RTPTime elapsed = RTPTime::CurrentTime();
+    elapsed -= start;
+    _check(timerCalls.count == 1 && eventCalls.count == 1, "callback of the expired timerfd");
+    _check(elapsed.GetDouble() < 0.5, "the timerfd ended the wait early");
+    _check(transmitter.DeleteWaitDescriptor(timer) == 0, "delete timerfd");
+    _check(transmitter.DeleteWaitDescriptor(timer) < 0, "delete it twice");
+    close(timer);
+
+    // The slot of the eventfd is reused while the epoll set still has the old registration, as
+    // when another thread deletes and adds a descriptor during the wait. Keeping the eventfd open
+    // through a duplicate, and closing it before the delete, keeps it in the set.
+    int duplicate = dup(event);
+    int reused = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    close(event);
+    transmitter.DeleteWaitDescriptor(event);
+    Calls reusedCalls;
+    _check(transmitter.AddWaitDescriptor(reused, &_callback, &reusedCalls) == 0,
+           "add eventfd to the freed slot");
+    if (write(duplicate, &one, sizeof(uint64_t)) != sizeof(uint64_t)) return 1;
+    _wait(transmitter, 10);
+    _check(reusedCalls.count == 0 && eventCalls.count == 1, "no callback for the stale event");
+    if (write(reused, &one, sizeof(uint64_t)) != sizeof(uint64_t)) return 1;
+    _wait(transmitter, 1000);
+    _check(reusedCalls.count == 1 && reusedCalls.fd == reused, "callback of the new eventfd");
+
+    transmitter.Destroy();
+    close(duplicate);
+    close(reused);
+    return failures == 0 ? 0 : 1;
+}
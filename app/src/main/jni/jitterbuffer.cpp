@@ -0,0 +1,182 @@
+/*
+ * jitterbuffer.cpp: Puts the received RTP packets back in order before they are decoded
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#include "jitterbuffer.h"
+
+#include <math.h>
+#include <algorithm>
+
+#include "jrtplib/rtpmemorymanager.h"
+#include "fec.h"
+
+using namespace jrtplib;
+
+// Extended sequence numbers wrap as well, after a very long time
+static inline int32_t _seqDiff(uint32_t a, uint32_t b) {
+    return (int32_t) (a - b);
+}
+
+static inline double _elapsedUs(const RTPTime &now, const RTPTime &since) {
+    return (now.GetDouble() - since.GetDouble()) * 1E6;
+}
+
+JitterBuffer::~JitterBuffer() {
+    for (HeldPacket &h : held) Delete(h.packet);
+}
+
+void JitterBuffer::Delete(RTPPacket *pack) {
+    RTPDelete(pack, mgr);
+}
+
+uint32_t JitterBuffer::ExtendSequenceNumber(uint16_t seqNum) {
+    return highestSeqNum + (int16_t) (seqNum - (uint16_t) highestSeqNum);
+}
+
+bool JitterBuffer::IsReleased(uint32_t extSeqNum) {
+    return hasReleased && _seqDiff(extSeqNum, releasedSeqNum) <= 0;
+}
+
+RTPPacket *JitterBuffer::Find(uint32_t extSeqNum) {
+    // Searching from the back, missing packets are mostly recent ones
+    for (HeldPackets::reverse_iterator it = held.rbegin(); it != held.rend(); ++it) {
+        int32_t diff = _seqDiff(it->packet->GetExtendedSequenceNumber(), extSeqNum);
+        if (diff == 0) return it->packet;
+        if (diff < 0) break;
+    }
+    return NULL;
+}
+
+bool JitterBuffer::Insert(RTPPacket *pack, const RTPTime &now) {
+    // jrtplib extends late packets with the current cycle count, wrong right after a wrap around
+    uint32_t seqNum = started ? ExtendSequenceNumber(pack->GetSequenceNumber())
+                              : pack->GetExtendedSequenceNumber();
+    pack->SetExtendedSequenceNumber(seqNum);
+    if (!started || _seqDiff(seqNum, highestSeqNum) > 0) {
+        started = true;
+        highestSeqNum = seqNum;
+    } else if (_seqDiff(seqNum, highestSeqNum) < 0) {
+        reordered++;
+        reorderDepth = std::max(reorderDepth, (uint32_t) _seqDiff(highestSeqNum, seqNum));
+    }
+    return Store(pack, now);
+}
+
+bool JitterBuffer::InsertRecovered(RTPPacket *pack, const RTPTime &now) {
+    return Store(pack, now);
+}
+
+bool JitterBuffer::Store(RTPPacket *pack, const RTPTime &now) {
+    uint32_t seqNum = pack->GetExtendedSequenceNumber();
+    if (IsReleased(seqNum)) {
+        // A copy of one we had is no news, but this one was missed. Before the first there are
+        // none we could have missed.
+        if (_seqDiff(seqNum, firstSeqNum) > 0 && !released[seqNum % AUDIOSYNC_JITTER_HISTORY]) {
+            lateDrops++;
+        }
+        Delete(pack);
+        return false;
+    }
+
+    HeldPackets::iterator it = held.end();
+    while (it != held.begin()) {
+        HeldPackets::iterator prev = it - 1;
+        int32_t diff = _seqDiff(seqNum, prev->packet->GetExtendedSequenceNumber());
+        if (diff == 0) {// Duplicate
+            Delete(pack);
+            return false;
+        }
+        if (diff > 0) break;
+        it = prev;
+    }
+    HeldPacket h = {pack, now};
+    held.insert(it, h);
+
+    maxOccupancy = std::max(maxOccupancy, held.size());
+    occupancySum += held.size();
+    inserts++;
+    return true;
+}
+
+void JitterBuffer::SetJitter(int64_t jitterUs) {
+    jitterHoldUs = std::min((int64_t) AUDIOSYNC_JITTER_MAX_HOLD_US,
+                            std::max((int64_t) AUDIOSYNC_JITTER_MIN_HOLD_US,
+                                     AUDIOSYNC_JITTER_HOLD_FACTOR * jitterUs));
+}
+
+int64_t JitterBuffer::HoldWindowUs() {
+    return std::max(jitterHoldUs, minimumHoldUs);
+}
+
+uint32_t JitterBuffer::NextExpected() {
+    uint32_t seqNum = releasedSeqNum + 1;
+    while (fec && fec->IsParity((uint16_t) seqNum)) seqNum++;
+    return seqNum;
+}
+
+RTPPacket *JitterBuffer::Next(const RTPTime &now, uint32_t *lost) {
+    *lost = 0;
+    if (held.empty()) return NULL;
+
+    HeldPacket &front = held.front();
+    uint32_t seqNum = front.packet->GetExtendedSequenceNumber();
+    uint16_t newestSeqNum = (uint16_t) held.back().packet->GetExtendedSequenceNumber();
+    if (fec && fec->Holds((uint16_t) seqNum, newestSeqNum, front.arrival, now)) return NULL;
+
+    if (!hasReleased) {
+        // The stream may start with reordered packets as well
+        if (_elapsedUs(now, front.arrival) < jitterHoldUs
+            && held.size() < AUDIOSYNC_JITTER_CAPACITY) {
+            return NULL;
+        }
+        firstSeqNum = seqNum;
+    } else {
+        uint32_t expected = NextExpected();
+        if (seqNum != expected) {
+            // The missing ones may only be reordered, or retransmitted
+            if (_elapsedUs(now, front.arrival) < HoldWindowUs()
+                && held.size() < AUDIOSYNC_JITTER_CAPACITY) {
+                return NULL;
+            }
+            for (uint32_t s = expected; s != seqNum; s++) {
+                released[s % AUDIOSYNC_JITTER_HISTORY] = false;
+                if (fec == NULL || !fec->IsParity((uint16_t) s)) (*lost)++;
+            }
+            lostTotal += *lost;
+        }
+    }
+
+    RTPPacket *pack = front.packet;
+    held.pop_front();
+    releasedSeqNum = seqNum;
+    hasReleased = true;
+    released[seqNum % AUDIOSYNC_JITTER_HISTORY] = true;
+    return pack;
+}
+
+int64_t JitterBuffer::NextReleaseUs(const RTPTime &now) {
+    if (held.empty()) return -1;
+
+    HeldPacket &front = held.front();
+    uint32_t seqNum = front.packet->GetExtendedSequenceNumber();
+    int64_t fecUs = 0;
+    if (fec) {
+        uint16_t newestSeqNum = (uint16_t) held.back().packet->GetExtendedSequenceNumber();
+        fecUs = fec->HoldUs((uint16_t) seqNum, newestSeqNum, front.arrival, now);
+    }
+
+    double holdUs = 0;
+    if (!hasReleased) holdUs = jitterHoldUs - _elapsedUs(now, front.arrival);
+    else if (seqNum != NextExpected()) holdUs = HoldWindowUs() - _elapsedUs(now, front.arrival);
+    if (held.size() >= AUDIOSYNC_JITTER_CAPACITY || holdUs < 0) holdUs = 0;
+    return std::max(fecUs, (int64_t) ceil(holdUs));
+}
+
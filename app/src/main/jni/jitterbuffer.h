@@ -0,0 +1,177 @@
+/*
+ * jitterbuffer.h: Puts the received RTP packets back in order before they are decoded
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#ifndef AUDIOSYNC_JITTERBUFFER_H
+#define AUDIOSYNC_JITTERBUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+#include <vector>
+
+#include "jrtplib/rtppacket.h"
+#include "jrtplib/rtptimeutilities.h"
+
+class FecDecoder;
+
+// A packet after a gap waits this many times the interarrival jitter for the missing ones,
+// within these bounds
+#define AUDIOSYNC_JITTER_HOLD_FACTOR 4
+#define AUDIOSYNC_JITTER_MIN_HOLD_US 20000
+#define AUDIOSYNC_JITTER_MAX_HOLD_US 500000
+// Packets beyond this are passed on whatever is missing before them
+#define AUDIOSYNC_JITTER_CAPACITY 1024
+// Recently released sequence numbers, to tell duplicates from late packets
+#define AUDIOSYNC_JITTER_HISTORY 1024
+
+/*
+ * Holds the media packets sorted by their extended sequence number and releases them in order.
+ * A packet which follows a gap is held for a time window derived from the jitter, the missing
+ * packets may only be reordered. Packets arriving after their turn are dropped.
+ */
+class JitterBuffer {
+public:
+    /**
+     * @param fec  rebuilds lost packets from the parity packets, may hold packets of its groups
+     *             back and the sequence numbers of its parity packets are not counted as lost
+     */
+    JitterBuffer(jrtplib::RTPMemoryManager *mgr = NULL, FecDecoder *fec = NULL)
+            : mgr(mgr), fec(fec),
+              held(jrtplib::RTPSTLAllocator<HeldPacket>(mgr, RTPMEM_TYPE_CLASS_LISTNODE)),
+              released(AUDIOSYNC_JITTER_HISTORY, false) {}
+
+    ~JitterBuffer();
+
+    /**
+     * Takes ownership of a media packet and extends its sequence number relative to the
+     * packets seen so far
+     * @return false if it was a duplicate or came too late and was deleted
+     */
+    bool Insert(jrtplib::RTPPacket *pack, const jrtplib::RTPTime &now);
+
+    /**
+     * Like Insert, for a packet rebuilt from FEC, which doesn't count as reordered
+     */
+    bool InsertRecovered(jrtplib::RTPPacket *pack, const jrtplib::RTPTime &now);
+
+    /**
+     * The held packet with this extended sequence number or NULL
+     */
+    jrtplib::RTPPacket *Find(uint32_t extSeqNum);
+
+    /**
+     * The extended sequence number closest to the packets seen so far
+     */
+    uint32_t ExtendSequenceNumber(uint16_t seqNum);
+
+    /**
+     * True if the packet was passed on already or given up
+     */
+    bool IsReleased(uint32_t extSeqNum);
+
+    /**
+     * The next packet in sequence order, or NULL while the ones before it may still come.
+     * Delete it with the memory manager.
+     * @param lost  set to the number of media packets given up right before it
+     */
+    jrtplib::RTPPacket *Next(const jrtplib::RTPTime &now, uint32_t *lost);
+
+    /**
+     * Microseconds until Next releases a packet at the latest, unless more packets arrive
+     * @return 0 if it has one right now, -1 if the buffer is empty
+     */
+    int64_t NextReleaseUs(const jrtplib::RTPTime &now);
+
+    /**
+     * Sizes the hold window, from the RFC 3550 interarrival jitter in microseconds
+     */
+    void SetJitter(int64_t jitterUs);
+
+    /**
+     * Holds a packet after a gap at least this long, e.g. until a retransmission can arrive
+     */
+    void SetMinimumHold(int64_t holdUs) {
+        minimumHoldUs = holdUs;
+    }
+
+    int64_t HoldWindowUs();
+
+    /**
+     * Most packets a packet arrived behind the newest one
+     */
+    uint32_t ReorderDepth() {
+        return reorderDepth;
+    }
+
+    /**
+     * Packets which arrived behind a newer one
+     */
+    uint64_t Reordered() {
+        return reordered;
+    }
+
+    /**
+     * Packets which arrived after they were given up
+     */
+    uint64_t LateDrops() {
+        return lateDrops;
+    }
+
+    /**
+     * Media packets given up
+     */
+    uint64_t Lost() {
+        return lostTotal;
+    }
+
+    size_t Occupancy() {
+        return held.size();
+    }
+
+    size_t MaxOccupancy() {
+        return maxOccupancy;
+    }
+
+    /**
+     * Packets held on average, sampled on every insert
+     */
+    double MeanOccupancy() {
+        return inserts > 0 ? occupancySum / (double) inserts : 0;
+    }
+
+private:
+    struct HeldPacket {
+        jrtplib::RTPPacket *packet;
+        jrtplib::RTPTime arrival;
+    };
+    typedef std::deque<HeldPacket, jrtplib::RTPSTLAllocator<HeldPacket> > HeldPackets;
+
+    jrtplib::RTPMemoryManager *mgr;
+    FecDecoder *fec;
+    HeldPackets held;// Sorted by extended sequence number
+    bool started = false, hasReleased = false;
+    uint32_t highestSeqNum = 0, releasedSeqNum = 0, firstSeqNum = 0;
+    std::vector<bool> released;// Slot extSeqNum % AUDIOSYNC_JITTER_HISTORY, false if given up
+    int64_t jitterHoldUs = AUDIOSYNC_JITTER_MIN_HOLD_US, minimumHoldUs = 0;
+
+    uint32_t reorderDepth = 0;
+    uint64_t reordered = 0, lateDrops = 0, lostTotal = 0;
+    size_t maxOccupancy = 0;
+    uint64_t occupancySum = 0, inserts = 0;
+
+    bool Store(jrtplib::RTPPacket *pack, const jrtplib::RTPTime &now);
+    // The sequence number following the last released packet, skipping parity packets
+    uint32_t NextExpected();
+    void Delete(jrtplib::RTPPacket *pack);
+};
+
+#endif //AUDIOSYNC_JITTERBUFFER_H
@@ -72,7 +72,7 @@
 #define RTPFAKETRANS_MAXPACKSIZE							65535
 #define RTPFAKETRANS_IFREQBUFSIZE							8192
 
-//#define RTPFAKETRANS_IS_MCASTADDR(x)							(((x)&0xF0000000) == 0xE0000000)
+#define RTPFAKETRANS_IS_MCASTADDR(x)							(((x)&0xF0000000) == 0xE0000000)
 
 /*#define RTPFAKETRANS_MCASTMEMBERSHIP(socket,type,mcastip,status)	{\
 										struct ip_mreq mreq;\
@@ -96,7 +96,12 @@
 namespace jrtplib
 {
 
-RTPFakeTransmitter::RTPFakeTransmitter(RTPMemoryManager *mgr ) : RTPTransmitter(mgr), destinations(mgr,RTPMEM_TYPE_CLASS_DESTINATIONLISTHASHELEMENT),acceptignoreinfo(mgr,RTPMEM_TYPE_CLASS_ACCEPTIGNOREHASHELEMENT)
+RTPFakeTransmitter::RTPFakeTransmitter(RTPMemoryManager *mgr ) : RTPTransmitter(mgr), destinations(mgr,RTPMEM_TYPE_CLASS_DESTINATIONLISTHASHELEMENT),
+#ifdef RTP_SUPPORT_IPV4MULTICAST
+								  multicastgroups(mgr,RTPMEM_TYPE_CLASS_MULTICASTHASHELEMENT),
+#endif // RTP_SUPPORT_IPV4MULTICAST
+								  rawpacketlist(RTPSTLAllocator<RTPRawPacket*>(mgr,RTPMEM_TYPE_CLASS_LISTNODE)),
+								  acceptignoreinfo(mgr,RTPMEM_TYPE_CLASS_ACCEPTIGNOREHASHELEMENT)
 {
 	created = false;
 	init = false;
@@ -198,14 +203,11 @@ int RTPFakeTransmitter::Create(size_t maximumpacketsize,const RTPTransmissionPar
 #endif // RTPDEBUG
 	}
 
-//#ifdef RTP_SUPPORT_IPV4MULTICAST
-//	if (SetMulticastTTL(params->GetMulticastTTL()))
-//		supportsmulticasting = true;
-//	else
-//		supportsmulticasting = false;
-//#else // no multicast support enabled
+#ifdef RTP_SUPPORT_IPV4MULTICAST
+	supportsmulticasting = true;
+#else // no multicast support enabled
 	supportsmulticasting = false;
-//#endif // RTP_SUPPORT_IPV4MULTICAST
+#endif // RTP_SUPPORT_IPV4MULTICAST
 
 	if (maximumpacketsize > RTPFAKETRANS_MAXPACKSIZE)
 	{
@@ -249,7 +251,7 @@ void RTPFakeTransmitter::Destroy()
 	
 	destinations.Clear();
 #ifdef RTP_SUPPORT_IPV4MULTICAST
-//	multicastgroups.Clear();
+	multicastgroups.Clear();
 #endif // RTP_SUPPORT_IPV4MULTICAST
 	FlushPackets();
 	ClearAcceptIgnoreInfo();
@@ -608,6 +610,71 @@ int RTPFakeTransmitter::SendRTCPData(const void *data,size_t len)
 	return 0;
 }
 
+int RTPFakeTransmitter::SendRTPDataTo(const void *data,size_t len,const RTPAddress &addr)
+{
+	if (!init)
+		return ERR_RTP_FAKETRANS_NOTINIT;
+
+	MAINMUTEX_LOCK
+
+	if (!created)
+	{
+		MAINMUTEX_UNLOCK
+		return ERR_RTP_FAKETRANS_NOTCREATED;
+	}
+	if (len > maxpacksize)
+	{
+		MAINMUTEX_UNLOCK
+		return ERR_RTP_FAKETRANS_SPECIFIEDSIZETOOBIG;
+	}
+	if (addr.GetAddressType() != RTPAddress::IPv4Address)
+	{
+		MAINMUTEX_UNLOCK
+		return ERR_RTP_FAKETRANS_INVALIDADDRESSTYPE;
+	}
+
+	const RTPIPv4Address &address = (const RTPIPv4Address &)addr;
+	RTPIPv4Destination dest(address.GetIP(),address.GetPort());
+	(*params->GetPacketReadyCB())(params->GetPacketReadyCBData(), (uint8_t*)data, len,
+	dest.GetIP_NBO(), dest.GetRTPPort_NBO(), 1);
+
+	MAINMUTEX_UNLOCK
+	return 0;
+}
+
+int RTPFakeTransmitter::SendRTCPDataTo(const void *data,size_t len,const RTPAddress &addr)
+{
+	if (!init)
+		return ERR_RTP_FAKETRANS_NOTINIT;
+
+	MAINMUTEX_LOCK
+
+	if (!created)
+	{
+		MAINMUTEX_UNLOCK
+		return ERR_RTP_FAKETRANS_NOTCREATED;
+	}
+	if (len > maxpacksize)
+	{
+		MAINMUTEX_UNLOCK
+		return ERR_RTP_FAKETRANS_SPECIFIEDSIZETOOBIG;
+	}
+	if (addr.GetAddressType() != RTPAddress::IPv4Address)
+	{
+		MAINMUTEX_UNLOCK
+		return ERR_RTP_FAKETRANS_INVALIDADDRESSTYPE;
+	}
+
+	// Like the UDP transmitter, the port of addr is used as it is
+	const RTPIPv4Address &address = (const RTPIPv4Address &)addr;
+	RTPIPv4Destination dest(address.GetIP(),address.GetPort());
+	(*params->GetPacketReadyCB())(params->GetPacketReadyCBData(), (uint8_t*)data, len,
+	dest.GetIP_NBO(), dest.GetRTPPort_NBO(), 0);
+
+	MAINMUTEX_UNLOCK
+	return 0;
+}
+
 int RTPFakeTransmitter::AddDestination(const RTPAddress &addr)
 {
 	if (!init)
@@ -693,8 +760,8 @@ bool RTPFakeTransmitter::SupportsMulticasting()
 
 int RTPFakeTransmitter::JoinMulticastGroup(const RTPAddress &addr)
 {
-// hrrm wonder how will manage to get multicast info thru to the UDPSINK
-/*	if (!init)
+	// There are no sockets, the packet ready callback has to deliver group packets itself
+	if (!init)
 		return ERR_RTP_FAKETRANS_NOTINIT;
 
 	MAINMUTEX_LOCK
@@ -715,39 +782,19 @@ int RTPFakeTransmitter::JoinMulticastGroup(const RTPAddress &addr)
 	const RTPIPv4Address &address = (const RTPIPv4Address &)addr;
 	uint32_t mcastIP = address.GetIP();
 	
-	if (!RTPFakeTRANS_IS_MCASTADDR(mcastIP))
+	if (!RTPFAKETRANS_IS_MCASTADDR(mcastIP))
 	{
 		MAINMUTEX_UNLOCK
 		return ERR_RTP_FAKETRANS_NOTAMULTICASTADDRESS;
 	}
 	
 	status = multicastgroups.AddElement(mcastIP);
-	if (status >= 0)
-	{
-		RTPFakeTRANS_MCASTMEMBERSHIP(rtpsock,IP_ADD_MEMBERSHIP,mcastIP,status);
-		if (status != 0)
-		{
-			multicastgroups.DeleteElement(mcastIP);
-			MAINMUTEX_UNLOCK
-			return ERR_RTP_FAKETRANS_COULDNTJOINMULTICASTGROUP;
-		}
-		RTPFakeTRANS_MCASTMEMBERSHIP(rtcpsock,IP_ADD_MEMBERSHIP,mcastIP,status);
-		if (status != 0)
-		{
-			RTPFakeTRANS_MCASTMEMBERSHIP(rtpsock,IP_DROP_MEMBERSHIP,mcastIP,status);
-			multicastgroups.DeleteElement(mcastIP);
-			MAINMUTEX_UNLOCK
-			return ERR_RTP_FAKETRANS_COULDNTJOINMULTICASTGROUP;
-		}
-	}
 	MAINMUTEX_UNLOCK	
-	return status;*/
-	return ERR_RTP_FAKETRANS_NOMULTICASTSUPPORT;
+	return status;
 }
 
 int RTPFakeTransmitter::LeaveMulticastGroup(const RTPAddress &addr)
 {
-    /*
 	if (!init)
 		return ERR_RTP_FAKETRANS_NOTINIT;
 
@@ -769,48 +816,26 @@ int RTPFakeTransmitter::LeaveMulticastGroup(const RTPAddress &addr)
 	const RTPIPv4Address &address = (const RTPIPv4Address &)addr;
 	uint32_t mcastIP = address.GetIP();
 	
-	if (!RTPFakeTRANS_IS_MCASTADDR(mcastIP))
+	if (!RTPFAKETRANS_IS_MCASTADDR(mcastIP))
 	{
 		MAINMUTEX_UNLOCK
 		return ERR_RTP_FAKETRANS_NOTAMULTICASTADDRESS;
 	}
 	
 	status = multicastgroups.DeleteElement(mcastIP);
-	if (status >= 0)
-	{	
-		RTPFakeTRANS_MCASTMEMBERSHIP(rtpsock,IP_DROP_MEMBERSHIP,mcastIP,status);
-		RTPFakeTRANS_MCASTMEMBERSHIP(rtcpsock,IP_DROP_MEMBERSHIP,mcastIP,status);
-		status = 0;
-	}
-	
 	MAINMUTEX_UNLOCK
 	return status;
-    */
-	return ERR_RTP_FAKETRANS_NOMULTICASTSUPPORT;
 }
 
 void RTPFakeTransmitter::LeaveAllMulticastGroups()
 {
-/*	if (!init)
+	if (!init)
 		return;
 	
 	MAINMUTEX_LOCK
 	if (created)
-	{
-		multicastgroups.GotoFirstElement();
-		while (multicastgroups.HasCurrentElement())
-		{
-			uint32_t mcastIP;
-			int status = 0;
-
-			mcastIP = multicastgroups.GetCurrentElement();
-			RTPFakeTRANS_MCASTMEMBERSHIP(rtpsock,IP_DROP_MEMBERSHIP,mcastIP,status);
-			RTPFakeTRANS_MCASTMEMBERSHIP(rtcpsock,IP_DROP_MEMBERSHIP,mcastIP,status);
-			multicastgroups.GotoNextElement();
-		}
 		multicastgroups.Clear();
-	}
-	MAINMUTEX_UNLOCK*/
+	MAINMUTEX_UNLOCK
 }
 
 #else // no multicast support
@@ -1093,7 +1118,7 @@ bool RTPFakeTransmitter::SetMulticastTTL(uint8_t ttl)
 
 void RTPFakeTransmitter::FlushPackets()
 {
-	std::list<RTPRawPacket*>::const_iterator it;
+	std::list<RTPRawPacket*,RTPSTLAllocator<RTPRawPacket*> >::const_iterator it;
 
 	for (it = rawpacketlist.begin() ; it != rawpacketlist.end() ; ++it)
 		RTPDelete(*it,GetMemoryManager());
@@ -161,6 +161,8 @@ public:
 	
 	int SendRTPData(const void *data,size_t len);	
 	int SendRTCPData(const void *data,size_t len);
+	int SendRTPDataTo(const void *data,size_t len,const RTPAddress &addr);
+	int SendRTCPDataTo(const void *data,size_t len,const RTPAddress &addr);
 
 	int AddDestination(const RTPAddress &addr);
 	int DeleteDestination(const RTPAddress &addr);
@@ -214,9 +216,10 @@ private:
 	
 	RTPHashTable<const RTPIPv4Destination,RTPFakeTrans_GetHashIndex_IPv4Dest,RTPFAKETRANS_HASHSIZE> destinations;
 #ifdef RTP_SUPPORT_IPV4MULTICAST
-//	RTPHashTable<const uint32_t,RTPFakeTrans_GetHashIndex_uint32_t,RTPFAKETRANS_HASHSIZE> multicastgroups;
+	// Only bookkeeping, the packet ready callback decides who receives a packet
+	RTPHashTable<const uint32_t,RTPFakeTrans_GetHashIndex_uint32_t,RTPFAKETRANS_HASHSIZE> multicastgroups;
 #endif // RTP_SUPPORT_IPV4MULTICAST
-	std::list<RTPRawPacket*> rawpacketlist;
+	std::list<RTPRawPacket*,RTPSTLAllocator<RTPRawPacket*> > rawpacketlist;
 
 	bool supportsmulticasting;
 	size_t maxpacksize;
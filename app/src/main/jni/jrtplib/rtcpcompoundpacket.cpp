@@ -50,7 +50,7 @@
 namespace jrtplib
 {
 
-RTCPCompoundPacket::RTCPCompoundPacket(RTPRawPacket &rawpack, RTPMemoryManager *mgr) : RTPMemoryObject(mgr)
+RTCPCompoundPacket::RTCPCompoundPacket(RTPRawPacket &rawpack, RTPMemoryManager *mgr) : RTPMemoryObject(mgr),rtcppacklist(RTPSTLAllocator<RTCPPacket *>(mgr,RTPMEM_TYPE_CLASS_LISTNODE))
 {
 	compoundpacket = 0;
 	compoundpacketlength = 0;
@@ -78,7 +78,8 @@ RTCPCompoundPacket::RTCPCompoundPacket(RTPRawPacket &rawpack, RTPMemoryManager *
 	rtcppackit = rtcppacklist.begin();
 }
 
-RTCPCompoundPacket::RTCPCompoundPacket(uint8_t *packet, size_t packetlen, bool deletedata, RTPMemoryManager *mgr) : RTPMemoryObject(mgr)
+RTCPCompoundPacket::RTCPCompoundPacket(uint8_t *packet, size_t packetlen, bool deletedata, RTPMemoryManager *mgr) : RTPMemoryObject(mgr),
+	rtcppacklist(RTPSTLAllocator<RTCPPacket *>(mgr,RTPMEM_TYPE_CLASS_LISTNODE))
 {
 	compoundpacket = 0;
 	compoundpacketlength = 0;
@@ -94,7 +95,7 @@ RTCPCompoundPacket::RTCPCompoundPacket(uint8_t *packet, size_t packetlen, bool d
 	rtcppackit = rtcppacklist.begin();
 }
 
-RTCPCompoundPacket::RTCPCompoundPacket(RTPMemoryManager *mgr) : RTPMemoryObject(mgr)
+RTCPCompoundPacket::RTCPCompoundPacket(RTPMemoryManager *mgr) : RTPMemoryObject(mgr),rtcppacklist(RTPSTLAllocator<RTCPPacket *>(mgr,RTPMEM_TYPE_CLASS_LISTNODE))
 {
 	compoundpacket = 0;
 	compoundpacketlength = 0;
@@ -206,7 +207,7 @@ RTCPCompoundPacket::~RTCPCompoundPacket()
 
 void RTCPCompoundPacket::ClearPacketList()
 {
-	std::list<RTCPPacket *>::const_iterator it;
+	std::list<RTCPPacket *,RTPSTLAllocator<RTCPPacket *> >::const_iterator it;
 
 	for (it = rtcppacklist.begin() ; it != rtcppacklist.end() ; it++)
 		RTPDelete(*it,GetMemoryManager());
@@ -217,7 +218,7 @@ void RTCPCompoundPacket::ClearPacketList()
 #ifdef RTPDEBUG
 void RTCPCompoundPacket::Dump()
 {
-	std::list<RTCPPacket *>::const_iterator it;
+	std::list<RTCPPacket *,RTPSTLAllocator<RTCPPacket *> >::const_iterator it;
 	for (it = rtcppacklist.begin() ; it != rtcppacklist.end() ; it++)
 	{
 		RTCPPacket *p = *it;
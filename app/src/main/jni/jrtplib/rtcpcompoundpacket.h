@@ -101,8 +101,8 @@ protected:
 	size_t compoundpacketlength;
 	bool deletepacket;
 	
-	std::list<RTCPPacket *> rtcppacklist;
-	std::list<RTCPPacket *>::const_iterator rtcppackit;
+	std::list<RTCPPacket *,RTPSTLAllocator<RTCPPacket *> > rtcppacklist;
+	std::list<RTCPPacket *,RTPSTLAllocator<RTCPPacket *> >::const_iterator rtcppackit;
 };
 
 } // end namespace
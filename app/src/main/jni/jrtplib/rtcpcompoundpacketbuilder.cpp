@@ -49,7 +49,11 @@
 namespace jrtplib
 {
 
-RTCPCompoundPacketBuilder::RTCPCompoundPacketBuilder(RTPMemoryManager *mgr) : RTCPCompoundPacket(mgr), report(mgr), sdes(mgr)
+RTCPCompoundPacketBuilder::RTCPCompoundPacketBuilder(RTPMemoryManager *mgr) : RTCPCompoundPacket(mgr), report(mgr), sdes(mgr),
+	byepackets(RTPSTLAllocator<Buffer>(mgr,RTPMEM_TYPE_CLASS_LISTNODE)), apppackets(RTPSTLAllocator<Buffer>(mgr,RTPMEM_TYPE_CLASS_LISTNODE))
+#ifdef RTP_SUPPORT_RTCPUNKNOWN
+	, unknownpackets(RTPSTLAllocator<Buffer>(mgr,RTPMEM_TYPE_CLASS_LISTNODE))
+#endif // RTP_SUPPORT_RTCPUNKNOWN
 {
 	byesize = 0;
 	appsize = 0;
@@ -74,7 +78,7 @@ void RTCPCompoundPacketBuilder::ClearBuildBuffers()
 	report.Clear();
 	sdes.Clear();
 
-	std::list<Buffer>::const_iterator it;
+	std::list<Buffer,RTPSTLAllocator<Buffer> >::const_iterator it;
 	for (it = byepackets.begin() ; it != byepackets.end() ; it++)
 	{
 		if ((*it).packetdata)
@@ -597,7 +601,7 @@ int RTCPCompoundPacketBuilder::EndBuild()
 	{
 		bool firstpacket = true;
 		bool done = false;
-		std::list<Buffer>::const_iterator it = report.reportblocks.begin();
+		std::list<Buffer,RTPSTLAllocator<Buffer> >::const_iterator it = report.reportblocks.begin();
 		do
 		{
 			RTCPCommonHeader *hdr = (RTCPCommonHeader *)curbuf;
@@ -660,7 +664,7 @@ int RTCPCompoundPacketBuilder::EndBuild()
 	if (!sdes.sdessources.empty())
 	{
 		bool done = false;
-		std::list<SDESSource *>::const_iterator sourceit = sdes.sdessources.begin();
+		std::list<SDESSource *,RTPSTLAllocator<SDESSource *> >::const_iterator sourceit = sdes.sdessources.begin();
 		
 		do
 		{
@@ -679,7 +683,7 @@ int RTCPCompoundPacketBuilder::EndBuild()
 				*ssrc = htonl((*sourceit)->ssrc);
 				offset += sizeof(uint32_t);
 				
-				std::list<Buffer>::const_iterator itemit,itemend;
+				std::list<Buffer,RTPSTLAllocator<Buffer> >::const_iterator itemit,itemend;
 
 				itemit = (*sourceit)->items.begin();
 				itemend = (*sourceit)->items.end();
@@ -732,7 +736,7 @@ int RTCPCompoundPacketBuilder::EndBuild()
 	// adding the app data
 	
 	{
-		std::list<Buffer>::const_iterator it;
+		std::list<Buffer,RTPSTLAllocator<Buffer> >::const_iterator it;
 
 		for (it = apppackets.begin() ; it != apppackets.end() ; it++)
 		{
@@ -757,7 +761,7 @@ int RTCPCompoundPacketBuilder::EndBuild()
 	// adding the unknown data
 	
 	{
-		std::list<Buffer>::const_iterator it;
+		std::list<Buffer,RTPSTLAllocator<Buffer> >::const_iterator it;
 
 		for (it = unknownpackets.begin() ; it != unknownpackets.end() ; it++)
 		{
@@ -782,7 +786,7 @@ int RTCPCompoundPacketBuilder::EndBuild()
 	// adding bye packets
 	
 	{
-		std::list<Buffer>::const_iterator it;
+		std::list<Buffer,RTPSTLAllocator<Buffer> >::const_iterator it;
 
 		for (it = byepackets.begin() ; it != byepackets.end() ; it++)
 		{
@@ -150,7 +150,7 @@ private:
 	class Report : public RTPMemoryObject
 	{
 	public:
-		Report(RTPMemoryManager *mgr) : RTPMemoryObject(mgr) 
+		Report(RTPMemoryManager *mgr) : RTPMemoryObject(mgr),reportblocks(RTPSTLAllocator<Buffer>(mgr,RTPMEM_TYPE_CLASS_LISTNODE))
 		{ 
 			headerdata = (uint8_t *)headerdata32; 
 			isSR = false; 
@@ -160,7 +160,7 @@ private:
 
 		void Clear()
 		{
-			std::list<Buffer>::const_iterator it; 
+			std::list<Buffer,RTPSTLAllocator<Buffer> >::const_iterator it; 
 			for (it = reportblocks.begin() ; it != reportblocks.end() ; it++) 
 			{
 				if ((*it).packetdata) 
@@ -215,16 +215,16 @@ private:
 		uint8_t *headerdata;
 		uint32_t headerdata32[(sizeof(uint32_t)+sizeof(RTCPSenderReport))/sizeof(uint32_t)]; // either for ssrc and sender info or just ssrc
 		size_t headerlength;
-		std::list<Buffer> reportblocks;
+		std::list<Buffer,RTPSTLAllocator<Buffer> > reportblocks;
 	};
 
 	class SDESSource : public RTPMemoryObject
 	{
 	public:
-		SDESSource(uint32_t s,RTPMemoryManager *mgr) : RTPMemoryObject(mgr),ssrc(s),totalitemsize(0)  { }
+		SDESSource(uint32_t s,RTPMemoryManager *mgr) : RTPMemoryObject(mgr),ssrc(s),items(RTPSTLAllocator<Buffer>(mgr,RTPMEM_TYPE_CLASS_LISTNODE)),totalitemsize(0)  { }
 		~SDESSource()
 		{
-			std::list<Buffer>::const_iterator it;
+			std::list<Buffer,RTPSTLAllocator<Buffer> >::const_iterator it;
 			for (it = items.begin() ; it != items.end() ; it++)
 			{
 				if ((*it).packetdata)
@@ -263,7 +263,7 @@ private:
 		}
 		
 		uint32_t ssrc;
-		std::list<Buffer> items;
+		std::list<Buffer,RTPSTLAllocator<Buffer> > items;
 	private:
 		size_t totalitemsize;
 	};
@@ -271,12 +271,12 @@ private:
 	class SDES : public RTPMemoryObject
 	{
 	public:
-		SDES(RTPMemoryManager *mgr) : RTPMemoryObject(mgr) { sdesit = sdessources.end(); }
+		SDES(RTPMemoryManager *mgr) : RTPMemoryObject(mgr),sdessources(RTPSTLAllocator<SDESSource *>(mgr,RTPMEM_TYPE_CLASS_LISTNODE)) { sdesit = sdessources.end(); }
 		~SDES() { Clear(); }
 
 		void Clear()
 		{
-			std::list<SDESSource *>::const_iterator it;
+			std::list<SDESSource *,RTPSTLAllocator<SDESSource *> >::const_iterator it;
 
 			for (it = sdessources.begin() ; it != sdessources.end() ; it++)
 				RTPDelete(*it,GetMemoryManager());
@@ -304,7 +304,7 @@ private:
 
 		size_t NeededBytes()
 		{
-			std::list<SDESSource *>::const_iterator it;
+			std::list<SDESSource *,RTPSTLAllocator<SDESSource *> >::const_iterator it;
 			size_t x = 0;
 			size_t n,d,r;
 			
@@ -324,7 +324,7 @@ private:
 		
 		size_t NeededBytesWithExtraItem(uint8_t itemdatalength)
 		{
-			std::list<SDESSource *>::const_iterator it;
+			std::list<SDESSource *,RTPSTLAllocator<SDESSource *> >::const_iterator it;
 			size_t x = 0;
 			size_t n,d,r;
 			
@@ -345,7 +345,7 @@ private:
 
 		size_t NeededBytesWithExtraSource()
 		{
-			std::list<SDESSource *>::const_iterator it;
+			std::list<SDESSource *,RTPSTLAllocator<SDESSource *> >::const_iterator it;
 			size_t x = 0;
 			size_t n,d,r;
 			
@@ -367,9 +367,9 @@ private:
 			return x;
 		}
 		
-		std::list<SDESSource *> sdessources;
+		std::list<SDESSource *,RTPSTLAllocator<SDESSource *> > sdessources;
 	private:
-		std::list<SDESSource *>::const_iterator sdesit;
+		std::list<SDESSource *,RTPSTLAllocator<SDESSource *> >::const_iterator sdesit;
 	};
 
 	size_t maximumpacketsize;
@@ -380,14 +380,14 @@ private:
 	Report report;
 	SDES sdes;
 
-	std::list<Buffer> byepackets;
+	std::list<Buffer,RTPSTLAllocator<Buffer> > byepackets;
 	size_t byesize;
 	
-	std::list<Buffer> apppackets;
+	std::list<Buffer,RTPSTLAllocator<Buffer> > apppackets;
 	size_t appsize;
 
 #ifdef RTP_SUPPORT_RTCPUNKNOWN
-	std::list<Buffer> unknownpackets;
+	std::list<Buffer,RTPSTLAllocator<Buffer> > unknownpackets;
 	size_t unknownsize;
 #endif // RTP_SUPPORT_RTCPUNKNOWN 
 	
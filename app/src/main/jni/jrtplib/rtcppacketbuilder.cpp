@@ -146,7 +146,7 @@ int RTCPPacketBuilder::BuildNextPacket(RTCPCompoundPacket **pack)
 		
 		uint32_t tsdiff = (uint32_t)((diff.GetDouble()/timestampunit)+0.5);
 		uint32_t rtptimestamp = rtppacktimestamp+tsdiff;
-		RTPNTPTime ntptimestamp = curtime.GetNTPTime();
+		RTPNTPTime ntptimestamp = RTPTime::WallClockTime().GetNTPTime();
 
 		if ((status = rtcpcomppack->StartSenderReport(ssrc,ntptimestamp,rtptimestamp,packcount,octetcount)) < 0)
 		{
@@ -674,7 +674,7 @@ int RTCPPacketBuilder::BuildBYEPacket(RTCPCompoundPacket **pack,const void *reas
 		
 		uint32_t tsdiff = (uint32_t)((diff.GetDouble()/timestampunit)+0.5);
 		uint32_t rtptimestamp = rtppacktimestamp+tsdiff;
-		RTPNTPTime ntptimestamp = curtime.GetNTPTime();
+		RTPNTPTime ntptimestamp = RTPTime::WallClockTime().GetNTPTime();
 
 		if ((status = rtcpcomppack->StartSenderReport(ssrc,ntptimestamp,rtptimestamp,packcount,octetcount)) < 0)
 		{
@@ -95,6 +95,17 @@
 #define RTP_SUPPORT_SENDAPP
 
 #define RTP_SUPPORT_MEMORYMANAGEMENT
+// sendmmsg(2) to submit a packet to all destinations at once and recvmmsg(2) to take in
+// everything that is queued at once, bionic has both since API 21
+#ifdef __linux__
+#define RTP_SUPPORT_SENDMMSG
+#define RTP_SUPPORT_RECVMMSG
+#endif // __linux__
+
+// epoll(7) to wait for the sockets and other descriptors, an eventfd(2) to abort the wait
+#ifdef __linux__
+#define RTP_SUPPORT_EPOLL
+#endif // __linux__
 
 // No support for sending unknown RTCP packets
 
@@ -228,6 +228,11 @@ static RTPErrorInfo ErrorDescriptions[]=
 	{ ERR_RTP_EXTERNALTRANS_NOTWAITING, "The external transmitter is not currently waiting for incoming data"},
 	{ ERR_RTP_EXTERNALTRANS_SENDERROR, "The external transmitter was unable to actually send the data"},
 	{ ERR_RTP_EXTERNALTRANS_SPECIFIEDSIZETOOBIG, "The specified data size exceeds the maximum amount that has been set"},
+	{ ERR_RTP_IMPAIREDTRANS_CANTINITMUTEX, "Impaired transmitter: couldn't initialize the mutex"},
+	{ ERR_RTP_UDPV4TRANS_CANTCREATEEPOLL, "Couldn't create the epoll instance to wait for incoming data"},
+	{ ERR_RTP_UDPV4TRANS_CANTADDWAITDESCRIPTOR, "Couldn't add the descriptor to the ones to wait for"},
+	{ ERR_RTP_UDPV4TRANS_NOSUCHWAITDESCRIPTOR, "The descriptor is not one of the ones to wait for"},
+	{ ERR_RTP_UDPV4TRANS_TOOMANYWAITDESCRIPTORS, "No room for another descriptor to wait for"},
 	{ 0,0 }
 };
 
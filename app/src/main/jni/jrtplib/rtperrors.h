@@ -231,6 +231,11 @@ std::string JRTPLIB_IMPORTEXPORT RTPGetErrorString(int errcode);
 #define ERR_RTP_EXTERNALTRANS_NOTWAITING			-179
 #define ERR_RTP_EXTERNALTRANS_SENDERROR				-180
 #define ERR_RTP_EXTERNALTRANS_SPECIFIEDSIZETOOBIG		-181
+#define ERR_RTP_IMPAIREDTRANS_CANTINITMUTEX			-182
+#define ERR_RTP_UDPV4TRANS_CANTCREATEEPOLL			-183
+#define ERR_RTP_UDPV4TRANS_CANTADDWAITDESCRIPTOR		-184
+#define ERR_RTP_UDPV4TRANS_NOSUCHWAITDESCRIPTOR			-185
+#define ERR_RTP_UDPV4TRANS_TOOMANYWAITDESCRIPTORS		-186
 
 #endif // RTPERRORS_H
 
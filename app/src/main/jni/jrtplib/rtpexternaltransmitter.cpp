@@ -98,7 +98,8 @@
 namespace jrtplib
 {
 
-RTPExternalTransmitter::RTPExternalTransmitter(RTPMemoryManager *mgr) : RTPTransmitter(mgr), packetinjector((RTPExternalTransmitter *)this)
+RTPExternalTransmitter::RTPExternalTransmitter(RTPMemoryManager *mgr) : RTPTransmitter(mgr), packetinjector((RTPExternalTransmitter *)this),
+								  rawpacketlist(RTPSTLAllocator<RTPRawPacket*>(mgr,RTPMEM_TYPE_CLASS_LISTNODE))
 {
 	created = false;
 	init = false;
@@ -641,7 +642,7 @@ RTPRawPacket *RTPExternalTransmitter::GetNextPacket()
 
 void RTPExternalTransmitter::FlushPackets()
 {
-	std::list<RTPRawPacket*>::const_iterator it;
+	std::list<RTPRawPacket*,RTPSTLAllocator<RTPRawPacket*> >::const_iterator it;
 
 	for (it = rawpacketlist.begin() ; it != rawpacketlist.end() ; ++it)
 		RTPDelete(*it,GetMemoryManager());
@@ -195,7 +195,7 @@ private:
 	RTPExternalSender *sender;
 	RTPExternalPacketInjecter packetinjector;
 
-	std::list<RTPRawPacket*> rawpacketlist;
+	std::list<RTPRawPacket*,RTPSTLAllocator<RTPRawPacket*> > rawpacketlist;
 
 	uint8_t *localhostname;
 	size_t localhostnamelength;
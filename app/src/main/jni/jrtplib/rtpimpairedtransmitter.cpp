@@ -0,0 +1,328 @@
+/*
+
+  This file is a part of JRTPLIB as used by AudioSync
+  Copyright (c) 2015 Simon Grätzer
+
+  Wraps another transmitter and degrades the incoming packet stream with
+  reproducible loss, burst loss, delay jitter, reordering and duplication.
+  Distributed under the same terms as the rest of JRTPLIB (see rtpsession.h).
+
+*/
+
+#include "rtpimpairedtransmitter.h"
+#include "rtprawpacket.h"
+#include "rtpaddress.h"
+#include "rtperrors.h"
+#include <string.h>
+#ifdef RTPDEBUG
+	#include <iostream>
+#endif // RTPDEBUG
+
+#include "rtpdebug.h"
+
+#ifdef RTP_SUPPORT_THREAD
+	#define MAINMUTEX_LOCK 		{ if (threadsafe) mainmutex.Lock(); }
+	#define MAINMUTEX_UNLOCK	{ if (threadsafe) mainmutex.Unlock(); }
+#else
+	#define MAINMUTEX_LOCK
+	#define MAINMUTEX_UNLOCK
+#endif // RTP_SUPPORT_THREAD
+
+namespace jrtplib
+{
+
+RTPImpairmentParams::RTPImpairmentParams() : basedelay(0,0), jitterdelay(0,0), reorderdelay(0,0)
+{
+	seed = 1;
+	lossprob = 0;
+	burstenterprob = 0;
+	burstleaveprob = 1;
+	reorderprob = 0;
+	duplicateprob = 0;
+}
+
+bool RTPImpairmentParams::IsEnabled() const
+{
+	RTPTime zero(0,0);
+	return lossprob > 0 || burstenterprob > 0 || basedelay > zero || jitterdelay > zero
+		|| reorderprob > 0 || duplicateprob > 0;
+}
+
+RTPImpairedTransmitter::RTPImpairedTransmitter(RTPTransmitter *trans, const RTPImpairmentParams &params, bool deletetrans, RTPMemoryManager *mgr)
+	: RTPTransmitter(mgr), params(params), rnd(params.GetSeed()),
+	  delayedpackets(RTPSTLAllocator<DelayedPacket>(mgr,RTPMEM_TYPE_CLASS_LISTNODE)),
+	  readypackets(RTPSTLAllocator<RTPRawPacket*>(mgr,RTPMEM_TYPE_CLASS_LISTNODE))
+{
+	this->trans = trans;
+	this->deletetrans = deletetrans;
+	inburst = false;
+	numlost = 0;
+	numduplicated = 0;
+	numreordered = 0;
+#ifdef RTP_SUPPORT_THREAD
+	threadsafe = false;
+#endif // RTP_SUPPORT_THREAD
+}
+
+RTPImpairedTransmitter::~RTPImpairedTransmitter()
+{
+	ClearPackets();
+	if (deletetrans)
+		RTPDelete(trans,GetMemoryManager());
+}
+
+int RTPImpairedTransmitter::Init(bool tsafe)
+{
+#ifdef RTP_SUPPORT_THREAD
+	threadsafe = tsafe;
+	if (threadsafe && !mainmutex.IsInitialized())
+	{
+		if (mainmutex.Init() < 0)
+			return ERR_RTP_IMPAIREDTRANS_CANTINITMUTEX;
+	}
+#else
+	if (tsafe)
+		return ERR_RTP_NOTHREADSUPPORT;
+#endif // RTP_SUPPORT_THREAD
+
+	if (deletetrans)
+		return trans->Init(tsafe);
+	return 0;
+}
+
+int RTPImpairedTransmitter::Create(size_t maxpacksize,const RTPTransmissionParams *transparams)
+{
+	if (deletetrans)
+		return trans->Create(maxpacksize,transparams);
+	return 0;
+}
+
+void RTPImpairedTransmitter::Destroy()
+{
+	MAINMUTEX_LOCK
+	ClearPackets();
+	MAINMUTEX_UNLOCK
+	if (deletetrans)
+		trans->Destroy();
+}
+
+int RTPImpairedTransmitter::Poll()
+{
+	int status;
+
+	if ((status = trans->Poll()) < 0)
+		return status;
+
+	MAINMUTEX_LOCK
+	ImpairIncomingPackets();
+	ReleaseDuePackets();
+	MAINMUTEX_UNLOCK
+	return 0;
+}
+
+int RTPImpairedTransmitter::WaitForIncomingData(const RTPTime &delay,bool *dataavailable)
+{
+	RTPTime wait = delay;
+	bool ready;
+
+	// Wake up in time to release the next delayed packet
+	MAINMUTEX_LOCK
+	ready = !readypackets.empty();
+	if (!ready && !delayedpackets.empty())
+	{
+		RTPTime now = RTPTime::CurrentTime();
+		RTPTime left = delayedpackets.front().releasetime;
+
+		if (left <= now)
+			wait = RTPTime(0,0);
+		else
+		{
+			left -= now;
+			if (left < wait)
+				wait = left;
+		}
+	}
+	MAINMUTEX_UNLOCK
+
+	if (ready)
+	{
+		if (dataavailable != 0)
+			*dataavailable = true;
+		return 0;
+	}
+	return trans->WaitForIncomingData(wait,dataavailable);
+}
+
+bool RTPImpairedTransmitter::NewDataAvailable()
+{
+	bool v;
+
+	MAINMUTEX_LOCK
+	v = !readypackets.empty();
+	MAINMUTEX_UNLOCK
+	return v;
+}
+
+RTPRawPacket *RTPImpairedTransmitter::GetNextPacket()
+{
+	RTPRawPacket *pack = 0;
+
+	MAINMUTEX_LOCK
+	if (!readypackets.empty())
+	{
+		pack = readypackets.front();
+		readypackets.pop_front();
+	}
+	MAINMUTEX_UNLOCK
+	return pack;
+}
+
+#ifdef RTPDEBUG
+void RTPImpairedTransmitter::Dump()
+{
+	MAINMUTEX_LOCK
+	std::cout << "Impaired transmitter" << std::endl;
+	std::cout << "    Lost packets:           " << numlost << std::endl;
+	std::cout << "    Duplicated packets:     " << numduplicated << std::endl;
+	std::cout << "    Reordered packets:      " << numreordered << std::endl;
+	std::cout << "    Delayed packets:        " << delayedpackets.size() << std::endl;
+	MAINMUTEX_UNLOCK
+	trans->Dump();
+}
+#endif // RTPDEBUG
+
+void RTPImpairedTransmitter::ImpairIncomingPackets()
+{
+	RTPRawPacket *pack;
+
+	while ((pack = trans->GetNextPacket()) != 0)
+	{
+		// Every packet consumes the same amount of random numbers, so the decisions
+		// for a packet don't depend on what happened to the ones before it
+		double lossdraw = rnd.GetRandomDouble();
+		double burstdraw = rnd.GetRandomDouble();
+		double jitterdraw = rnd.GetRandomDouble();
+		double reorderdraw = rnd.GetRandomDouble();
+		double duplicatedraw = rnd.GetRandomDouble();
+		double duplicatejitterdraw = rnd.GetRandomDouble();
+
+		if (inburst)
+			inburst = (burstdraw >= params.GetBurstLeaveProbability());
+		else
+			inburst = (burstdraw < params.GetBurstEnterProbability());
+
+		if (inburst || lossdraw < params.GetLossProbability())
+		{
+			numlost++;
+			RTPDelete(pack,GetMemoryManager());
+			continue;
+		}
+
+		RTPTime releasetime = pack->GetReceiveTime();
+		releasetime += params.GetBaseDelay();
+
+		if (duplicatedraw < params.GetDuplicateProbability())
+		{
+			RTPRawPacket *copy = CopyPacket(pack,pack->GetReceiveTime());
+			if (copy != 0)
+			{
+				RTPTime copytime = releasetime;
+				copytime += RTPTime(params.GetJitter().GetDouble()*duplicatejitterdraw);
+				Delay(copy,copytime);
+				numduplicated++;
+			}
+		}
+
+		releasetime += RTPTime(params.GetJitter().GetDouble()*jitterdraw);
+		if (reorderdraw < params.GetReorderProbability())
+		{
+			releasetime += params.GetReorderDelay();
+			numreordered++;
+		}
+		Delay(pack,releasetime);
+	}
+}
+
+void RTPImpairedTransmitter::Delay(RTPRawPacket *pack, const RTPTime &releasetime)
+{
+	// Keep the list sorted, packets with the same release time stay in arrival order
+	std::list<DelayedPacket,RTPSTLAllocator<DelayedPacket> >::iterator it = delayedpackets.end();
+	while (it != delayedpackets.begin())
+	{
+		std::list<DelayedPacket,RTPSTLAllocator<DelayedPacket> >::iterator prev = it;
+		--prev;
+		if (prev->releasetime <= releasetime)
+			break;
+		it = prev;
+	}
+	delayedpackets.insert(it,DelayedPacket(pack,releasetime));
+}
+
+RTPRawPacket *RTPImpairedTransmitter::CopyPacket(RTPRawPacket *pack, const RTPTime &receivetime)
+{
+	size_t len = pack->GetDataLength();
+	uint8_t *data = RTPNew(GetMemoryManager(),(pack->IsRTP())?RTPMEM_TYPE_BUFFER_RECEIVEDRTPPACKET:RTPMEM_TYPE_BUFFER_RECEIVEDRTCPPACKET) uint8_t[len];
+	if (data == 0)
+		return 0;
+	memcpy(data,pack->GetData(),len);
+
+	RTPAddress *addr = 0;
+	if (pack->GetSenderAddress() != 0)
+	{
+		addr = pack->GetSenderAddress()->CreateCopy(GetMemoryManager());
+		if (addr == 0)
+		{
+			RTPDeleteByteArray(data,GetMemoryManager());
+			return 0;
+		}
+	}
+
+	RTPTime t = receivetime;
+	RTPRawPacket *copy = RTPNew(GetMemoryManager(),RTPMEM_TYPE_CLASS_RTPRAWPACKET) RTPRawPacket(data,len,addr,t,pack->IsRTP(),GetMemoryManager());
+	if (copy == 0)
+	{
+		RTPDeleteByteArray(data,GetMemoryManager());
+		if (addr)
+			RTPDelete(addr,GetMemoryManager());
+	}
+	return copy;
+}
+
+void RTPImpairedTransmitter::ReleaseDuePackets()
+{
+	RTPTime now = RTPTime::CurrentTime();
+
+	while (!delayedpackets.empty() && delayedpackets.front().releasetime <= now)
+	{
+		RTPRawPacket *pack = delayedpackets.front().packet;
+		delayedpackets.pop_front();
+
+		// Like a socket, a delayed packet is received when it is read
+		if (pack->GetReceiveTime() < now)
+		{
+			RTPRawPacket *retimed = CopyPacket(pack,now);
+			if (retimed != 0)
+			{
+				RTPDelete(pack,GetMemoryManager());
+				pack = retimed;
+			}
+		}
+		readypackets.push_back(pack);
+	}
+}
+
+void RTPImpairedTransmitter::ClearPackets()
+{
+	std::list<DelayedPacket,RTPSTLAllocator<DelayedPacket> >::iterator it;
+	std::list<RTPRawPacket*,RTPSTLAllocator<RTPRawPacket*> >::iterator it2;
+
+	for (it = delayedpackets.begin() ; it != delayedpackets.end() ; ++it)
+		RTPDelete(it->packet,GetMemoryManager());
+	delayedpackets.clear();
+	for (it2 = readypackets.begin() ; it2 != readypackets.end() ; ++it2)
+		RTPDelete(*it2,GetMemoryManager());
+	readypackets.clear();
+}
+
+} // end namespace
+
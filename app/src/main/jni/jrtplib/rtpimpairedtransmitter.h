@@ -0,0 +1,214 @@
+/*
+
+  This file is a part of JRTPLIB as used by AudioSync
+  Copyright (c) 2015 Simon Grätzer
+
+  Wraps another transmitter and degrades the incoming packet stream with
+  reproducible loss, burst loss, delay jitter, reordering and duplication.
+  Used to test how a session copes with a bad (wireless) network, without
+  changing the session code itself. Distributed under the same terms as
+  the rest of JRTPLIB (see rtpsession.h).
+
+*/
+
+/**
+ * \file rtpimpairedtransmitter.h
+ */
+
+#ifndef RTPIMPAIREDTRANSMITTER_H
+
+#define RTPIMPAIREDTRANSMITTER_H
+
+#include "rtpconfig.h"
+#include "rtptransmitter.h"
+#include "rtptimeutilities.h"
+#include "rtprandomrand48.h"
+#include <list>
+
+#ifdef RTP_SUPPORT_THREAD
+	#include "../jthread/jmutex.h"
+#endif // RTP_SUPPORT_THREAD
+
+namespace jrtplib
+{
+
+class RTPRawPacket;
+
+/** Describes how an RTPImpairedTransmitter degrades the incoming packets.
+ *  Describes how an RTPImpairedTransmitter degrades the incoming packets. All random decisions are
+ *  taken from a generator seeded with RTPImpairmentParams::SetSeed, so the same seed and the same
+ *  packet sequence always give the same result. By default nothing is impaired.
+ */
+class JRTPLIB_IMPORTEXPORT RTPImpairmentParams
+{
+public:
+	RTPImpairmentParams();
+
+	/** Sets the seed of the random number generator (default is 1). */
+	void SetSeed(uint32_t s)						{ seed = s; }
+
+	/** Returns the seed of the random number generator. */
+	uint32_t GetSeed() const						{ return seed; }
+
+	/** Sets the probability that a single packet is lost, independent of the others. */
+	void SetLossProbability(double p)					{ lossprob = p; }
+
+	/** Returns the probability that a single packet is lost (default is 0). */
+	double GetLossProbability() const					{ return lossprob; }
+
+	/** Sets the burst loss model.
+	 *  Sets the parameters of a two state (Gilbert) loss model: every packet switches to the lossy
+	 *  state with probability \c enterprob, all packets are lost while in it and every packet leaves
+	 *  it again with probability \c leaveprob. The mean burst length is therefore 1/\c leaveprob packets.
+	 */
+	void SetBurstLoss(double enterprob, double leaveprob)			{ burstenterprob = enterprob; burstleaveprob = leaveprob; }
+
+	/** Returns the probability to start a loss burst (default is 0). */
+	double GetBurstEnterProbability() const					{ return burstenterprob; }
+
+	/** Returns the probability to end a loss burst (default is 1). */
+	double GetBurstLeaveProbability() const					{ return burstleaveprob; }
+
+	/** Every packet is delayed by \c base plus a uniformly distributed value between zero and \c jitter. */
+	void SetDelay(const RTPTime &base, const RTPTime &jitter)		{ basedelay = base; jitterdelay = jitter; }
+
+	/** Returns the constant delay (default is 0). */
+	RTPTime GetBaseDelay() const						{ return basedelay; }
+
+	/** Returns the maximum random delay on top of the constant delay (default is 0). */
+	RTPTime GetJitter() const						{ return jitterdelay; }
+
+	/** With probability \c p a packet is held back for an additional \c delay, so that later packets overtake it. */
+	void SetReorder(double p, const RTPTime &delay)				{ reorderprob = p; reorderdelay = delay; }
+
+	/** Returns the probability that a packet is held back (default is 0). */
+	double GetReorderProbability() const					{ return reorderprob; }
+
+	/** Returns how long a packet is held back to reorder it (default is 0). */
+	RTPTime GetReorderDelay() const						{ return reorderdelay; }
+
+	/** Sets the probability that a packet is delivered twice. */
+	void SetDuplicateProbability(double p)					{ duplicateprob = p; }
+
+	/** Returns the probability that a packet is delivered twice (default is 0). */
+	double GetDuplicateProbability() const					{ return duplicateprob; }
+
+	/** Returns \c true if any of the impairments is switched on. */
+	bool IsEnabled() const;
+private:
+	uint32_t seed;
+	double lossprob;
+	double burstenterprob, burstleaveprob;
+	RTPTime basedelay, jitterdelay;
+	double reorderprob;
+	RTPTime reorderdelay;
+	double duplicateprob;
+};
+
+/** A transmitter which impairs the packets received by another transmitter.
+ *  A transmitter which impairs the packets received by another transmitter, as described by an
+ *  RTPImpairmentParams instance. Outgoing packets are passed on unchanged, since every session
+ *  already impairs what it receives. Delayed packets are only handed to the session by a later
+ *  call to RTPImpairedTransmitter::Poll, their receive time is set to that moment. An RTPSession
+ *  creates this automatically when RTPSessionParams::SetImpairmentParams enabled impairments.
+ */
+class JRTPLIB_IMPORTEXPORT RTPImpairedTransmitter : public RTPTransmitter
+{
+public:
+	/** Wraps \c trans, which is deleted together with this instance if \c deletetrans is \c true.
+	 *  Wraps \c trans, which is deleted together with this instance if \c deletetrans is \c true.
+	 *  Only an owned transmitter is initialized, created and destroyed through this instance.
+	 */
+	RTPImpairedTransmitter(RTPTransmitter *trans, const RTPImpairmentParams &params, bool deletetrans, RTPMemoryManager *mgr = 0);
+	~RTPImpairedTransmitter();
+
+	int Init(bool treadsafe);
+	int Create(size_t maxpacksize,const RTPTransmissionParams *transparams);
+	void Destroy();
+	RTPTransmissionInfo *GetTransmissionInfo()				{ return trans->GetTransmissionInfo(); }
+	void DeleteTransmissionInfo(RTPTransmissionInfo *inf)			{ trans->DeleteTransmissionInfo(inf); }
+
+	int GetLocalHostName(uint8_t *buffer,size_t *bufferlength)		{ return trans->GetLocalHostName(buffer,bufferlength); }
+	bool ComesFromThisTransmitter(const RTPAddress *addr)			{ return trans->ComesFromThisTransmitter(addr); }
+	size_t GetHeaderOverhead()						{ return trans->GetHeaderOverhead(); }
+
+	int Poll();
+	int WaitForIncomingData(const RTPTime &delay,bool *dataavailable = 0);
+	int AbortWait()								{ return trans->AbortWait(); }
+
+	int SendRTPData(const void *data,size_t len)				{ return trans->SendRTPData(data,len); }
+	int SendRTPDataGather(const void *header,size_t headerlen,const void *payload,size_t payloadlen)
+										{ return trans->SendRTPDataGather(header,headerlen,payload,payloadlen); }
+	int SendRTCPData(const void *data,size_t len)				{ return trans->SendRTCPData(data,len); }
+	int SendRTPDataTo(const void *data,size_t len,const RTPAddress &addr)	{ return trans->SendRTPDataTo(data,len,addr); }
+	int SendRTCPDataTo(const void *data,size_t len,const RTPAddress &addr)	{ return trans->SendRTCPDataTo(data,len,addr); }
+	int BeginSendBatch()							{ return trans->BeginSendBatch(); }
+	int EndSendBatch()							{ return trans->EndSendBatch(); }
+
+	int AddDestination(const RTPAddress &addr)				{ return trans->AddDestination(addr); }
+	int DeleteDestination(const RTPAddress &addr)				{ return trans->DeleteDestination(addr); }
+	void ClearDestinations()						{ trans->ClearDestinations(); }
+
+	bool SupportsMulticasting()						{ return trans->SupportsMulticasting(); }
+	int JoinMulticastGroup(const RTPAddress &addr)				{ return trans->JoinMulticastGroup(addr); }
+	int LeaveMulticastGroup(const RTPAddress &addr)				{ return trans->LeaveMulticastGroup(addr); }
+	void LeaveAllMulticastGroups()						{ trans->LeaveAllMulticastGroups(); }
+
+	int SetReceiveMode(RTPTransmitter::ReceiveMode m)			{ return trans->SetReceiveMode(m); }
+	int AddToIgnoreList(const RTPAddress &addr)				{ return trans->AddToIgnoreList(addr); }
+	int DeleteFromIgnoreList(const RTPAddress &addr)			{ return trans->DeleteFromIgnoreList(addr); }
+	void ClearIgnoreList()							{ trans->ClearIgnoreList(); }
+	int AddToAcceptList(const RTPAddress &addr)				{ return trans->AddToAcceptList(addr); }
+	int DeleteFromAcceptList(const RTPAddress &addr)			{ return trans->DeleteFromAcceptList(addr); }
+	void ClearAcceptList()							{ trans->ClearAcceptList(); }
+	int SetMaximumPacketSize(size_t s)					{ return trans->SetMaximumPacketSize(s); }
+
+	bool NewDataAvailable();
+	RTPRawPacket *GetNextPacket();
+#ifdef RTPDEBUG
+	void Dump();
+#endif // RTPDEBUG
+
+	/** Returns the number of packets which were dropped so far. */
+	uint32_t GetNumberOfLostPackets() const					{ return numlost; }
+
+	/** Returns the number of extra copies which were delivered so far. */
+	uint32_t GetNumberOfDuplicatedPackets() const				{ return numduplicated; }
+
+	/** Returns the number of packets which were held back to be reordered so far. */
+	uint32_t GetNumberOfReorderedPackets() const				{ return numreordered; }
+private:
+	class DelayedPacket
+	{
+	public:
+		DelayedPacket(RTPRawPacket *p, const RTPTime &t) : packet(p), releasetime(t)	{ }
+		RTPRawPacket *packet;
+		RTPTime releasetime;
+	};
+
+	void ImpairIncomingPackets();
+	void Delay(RTPRawPacket *pack, const RTPTime &releasetime);
+	RTPRawPacket *CopyPacket(RTPRawPacket *pack, const RTPTime &receivetime);
+	void ReleaseDuePackets();
+	void ClearPackets();
+
+	RTPTransmitter *trans;
+	bool deletetrans;
+	RTPImpairmentParams params;
+	RTPRandomRand48 rnd;
+	bool inburst;
+
+	std::list<DelayedPacket,RTPSTLAllocator<DelayedPacket> > delayedpackets;
+	std::list<RTPRawPacket*,RTPSTLAllocator<RTPRawPacket*> > readypackets;
+	uint32_t numlost, numduplicated, numreordered;
+
+#ifdef RTP_SUPPORT_THREAD
+	jthread::JMutex mainmutex;
+	bool threadsafe;
+#endif // RTP_SUPPORT_THREAD
+};
+
+} // end namespace
+
+#endif // RTPIMPAIREDTRANSMITTER_H
+
@@ -132,7 +132,7 @@ int RTPInternalSourceData::ProcessRTPPacket(RTPPacket *rtppack,const RTPTime &re
 
 	// find the right position to insert the packet
 	
-	std::list<RTPPacket*>::iterator it,start;
+	std::list<RTPPacket *,RTPSTLAllocator<RTPPacket *> >::iterator it,start;
 	bool done = false;
 	uint32_t newseqnr = rtppack->GetExtendedSequenceNumber();
 	
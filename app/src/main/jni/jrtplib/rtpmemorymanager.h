@@ -140,6 +140,9 @@
 /** Buffer to store a HashElement instance for the source table. */
 #define RTPMEM_TYPE_CLASS_SOURCETABLEHASHELEMENT				32
 
+/** Buffer to store a node of a std::list, see RTPSTLAllocator. */
+#define RTPMEM_TYPE_CLASS_LISTNODE						33
+
 namespace jrtplib
 {
 
@@ -253,5 +256,78 @@ inline void RTPDelete(ClassName *obj, RTPMemoryManager *mgr)
 
 #endif // RTP_SUPPORT_MEMORYMANAGEMENT
 
+#include <cstddef>
+#include <new>
+#include <utility>
+
+namespace jrtplib
+{
+
+/** An allocator for STL containers which takes its memory from a memory manager.
+ *  An allocator for STL containers which takes its memory from a memory manager, so that e.g.
+ *  the nodes of a list of packets come from the same place as the packets themselves. Like
+ *  RTPNew, it uses the global \c new if the manager is NULL or memory management is disabled.
+ */
+template<class T>
+class RTPSTLAllocator
+{
+public:
+	typedef T value_type;
+	typedef T *pointer;
+	typedef const T *const_pointer;
+	typedef T &reference;
+	typedef const T &const_reference;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+
+	template<class U> struct rebind { typedef RTPSTLAllocator<U> other; };
+
+	RTPSTLAllocator(RTPMemoryManager *mgr, int memtype) : mgr(mgr), memtype(memtype)		{ }
+	template<class U>
+	RTPSTLAllocator(const RTPSTLAllocator<U> &a) : mgr(a.GetMemoryManager()), memtype(a.GetMemoryType())	{ }
+
+	RTPMemoryManager *GetMemoryManager() const						{ return mgr; }
+	int GetMemoryType() const								{ return memtype; }
+
+	T *allocate(size_t n)
+	{
+#ifdef RTP_SUPPORT_MEMORYMANAGEMENT
+		void *p = (mgr == 0) ? ::operator new(n*sizeof(T)) : mgr->AllocateBuffer(n*sizeof(T),memtype);
+		if (p == 0)
+			throw std::bad_alloc();
+		return (T *)p;
+#else
+		return (T *)::operator new(n*sizeof(T));
+#endif // RTP_SUPPORT_MEMORYMANAGEMENT
+	}
+
+	void deallocate(T *p, size_t)
+	{
+#ifdef RTP_SUPPORT_MEMORYMANAGEMENT
+		if (mgr != 0)
+		{
+			mgr->FreeBuffer(p);
+			return;
+		}
+#endif // RTP_SUPPORT_MEMORYMANAGEMENT
+		::operator delete(p);
+	}
+
+	size_t max_size() const									{ return ((size_t)-1)/sizeof(T); }
+
+	template<class U, class... Args>
+	void construct(U *p, Args&&... args)							{ ::new((void *)p) U(std::forward<Args>(args)...); }
+	template<class U>
+	void destroy(U *p)									{ p->~U(); }
+
+	bool operator==(const RTPSTLAllocator &a) const						{ return mgr == a.mgr && memtype == a.memtype; }
+	bool operator!=(const RTPSTLAllocator &a) const						{ return !(*this == a); }
+private:
+	RTPMemoryManager *mgr;
+	int memtype;
+};
+
+} // end namespace
+
 #endif // RTPMEMORYMANAGER_H
 
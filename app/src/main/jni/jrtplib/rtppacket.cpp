@@ -313,10 +313,12 @@ int RTPPacket::BuildPacket(uint8_t payloadtype,const void *payloaddata,size_t pa
 		
 		payload += sizeof(RTPExtensionHeader);
 		memcpy(payload,extensiondata,RTPPacket::extensionlength);
+		RTPPacket::extension = payload;
 		
 		payload += RTPPacket::extensionlength;
 	}
-	memcpy(payload,payloaddata,payloadlen);
+	if (payloaddata) // otherwise the caller sends the payload from where it is
+		memcpy(payload,payloaddata,payloadlen);
 	return 0;
 }
 
@@ -74,7 +74,8 @@ public:
 		  size_t maxpacksize, RTPMemoryManager *mgr = 0);
 	
 	/** This constructor is similar to the other constructor, but here data is stored in an external buffer
-	 *  \c buffer with size \c buffersize. */
+	 *  \c buffer with size \c buffersize. If \c payloaddata is NULL, only the header is written, the
+	 *  total packet size is still checked against \c buffersize. */
 	RTPPacket(uint8_t payloadtype,const void *payloaddata,size_t payloadlen,uint16_t seqnr,
 		  uint32_t timestamp,uint32_t ssrc,bool gotmarker,uint8_t numcsrcs,const uint32_t *csrcs,
 		  bool gotextension,uint16_t extensionid,uint16_t extensionlen_numwords,const void *extensiondata,
@@ -237,6 +237,47 @@ int RTPPacketBuilder::BuildPacketEx(const void *data,size_t len,
 
 }
 
+int RTPPacketBuilder::BuildHeader(size_t len)
+{
+	if (!init)
+		return ERR_RTP_PACKBUILD_NOTINIT;
+	if (!defptset)
+		return ERR_RTP_PACKBUILD_DEFAULTPAYLOADTYPENOTSET;
+	if (!defmarkset)
+		return ERR_RTP_PACKBUILD_DEFAULTMARKNOTSET;
+	if (!deftsset)
+		return ERR_RTP_PACKBUILD_DEFAULTTSINCNOTSET;
+	return PrivateBuildPacket(0,len,defaultpayloadtype,defaultmark,defaulttimestampinc,false);
+}
+
+int RTPPacketBuilder::BuildHeader(size_t len,uint8_t pt,bool mark,uint32_t timestampinc)
+{
+	if (!init)
+		return ERR_RTP_PACKBUILD_NOTINIT;
+	return PrivateBuildPacket(0,len,pt,mark,timestampinc,false);
+}
+
+int RTPPacketBuilder::BuildHeaderEx(size_t len,uint16_t hdrextID,const void *hdrextdata,size_t numhdrextwords)
+{
+	if (!init)
+		return ERR_RTP_PACKBUILD_NOTINIT;
+	if (!defptset)
+		return ERR_RTP_PACKBUILD_DEFAULTPAYLOADTYPENOTSET;
+	if (!defmarkset)
+		return ERR_RTP_PACKBUILD_DEFAULTMARKNOTSET;
+	if (!deftsset)
+		return ERR_RTP_PACKBUILD_DEFAULTTSINCNOTSET;
+	return PrivateBuildPacket(0,len,defaultpayloadtype,defaultmark,defaulttimestampinc,true,hdrextID,hdrextdata,numhdrextwords);
+}
+
+int RTPPacketBuilder::BuildHeaderEx(size_t len,uint8_t pt,bool mark,uint32_t timestampinc,
+		  uint16_t hdrextID,const void *hdrextdata,size_t numhdrextwords)
+{
+	if (!init)
+		return ERR_RTP_PACKBUILD_NOTINIT;
+	return PrivateBuildPacket(0,len,pt,mark,timestampinc,true,hdrextID,hdrextdata,numhdrextwords);
+}
+
 int RTPPacketBuilder::PrivateBuildPacket(const void *data,size_t len,
 	                  uint8_t pt,bool mark,uint32_t timestampinc,bool gotextension,
 	                  uint16_t hdrextID,const void *hdrextdata,size_t numhdrextwords)
@@ -248,6 +289,8 @@ int RTPPacketBuilder::PrivateBuildPacket(const void *data,size_t len,
 	if (status < 0)
 		return status;
 	packetlength = p.GetPacketLength();
+	if (data == 0) // the payload stays with the caller
+		packetlength -= p.GetPayloadLength();
 
 	if (numpackets == 0) // first packet
 	{
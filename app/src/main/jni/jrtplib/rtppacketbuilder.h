@@ -123,6 +123,23 @@ public:
 	                  uint8_t pt,bool mark,uint32_t timestampinc,
 	                  uint16_t hdrextID,const void *hdrextdata,size_t numhdrextwords);
 
+	/** Builds only the header of a packet with payload length \c len.
+	 *  Builds only the header of a packet with payload length \c len, like BuildPacket would, but 
+	 *  without copying the payload. GetPacket and GetPacketLength then describe the header, the 
+	 *  caller sends it followed by its payload, e.g. with RTPTransmitter::SendRTPDataGather.
+	 */
+	int BuildHeader(size_t len);
+
+	/** Builds only the header of a packet with payload length \c len, see BuildPacket and the previous function. */
+	int BuildHeader(size_t len,uint8_t pt,bool mark,uint32_t timestampinc);
+
+	/** Builds only the header of a packet with payload length \c len, see BuildPacketEx and BuildHeader. */
+	int BuildHeaderEx(size_t len,uint16_t hdrextID,const void *hdrextdata,size_t numhdrextwords);
+
+	/** Builds only the header of a packet with payload length \c len, see BuildPacketEx and BuildHeader. */
+	int BuildHeaderEx(size_t len,uint8_t pt,bool mark,uint32_t timestampinc,
+	                  uint16_t hdrextID,const void *hdrextdata,size_t numhdrextwords);
+
 	/** Returns a pointer to the last built RTP packet data. */
 	uint8_t *GetPacket()						{ if (!init) return 0; return buffer; }
 
@@ -192,6 +209,7 @@ public:
 	 */
 	void AdjustSSRC(uint32_t s)					{ ssrc = s; }
 private:
+	// Without data only the header is built
 	int PrivateBuildPacket(const void *data,size_t len,
 	                  uint8_t pt,bool mark,uint32_t timestampinc,bool gotextension,
 	                  uint16_t hdrextID = 0,const void *hdrextdata = 0,size_t numhdrextwords = 0);
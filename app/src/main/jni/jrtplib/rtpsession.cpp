@@ -36,6 +36,7 @@
 #include "rtpudpv4transmitter.h"
 #include "rtpudpv6transmitter.h"
 #include "rtpexternaltransmitter.h"
+#include "rtpimpairedtransmitter.h"
 #include "rtpsessionparams.h"
 #include "rtpdefines.h"
 #include "rtprawpacket.h"
@@ -148,6 +149,16 @@ int RTPSession::Create(const RTPSessionParams &sessparams,const RTPTransmissionP
 	
 	if (rtptrans == 0)
 		return ERR_RTP_OUTOFMEM;
+	if (sessparams.GetImpairmentParams().IsEnabled())
+	{
+		RTPTransmitter *impaired = RTPNew(GetMemoryManager(),RTPMEM_TYPE_CLASS_RTPTRANSMITTER) RTPImpairedTransmitter(rtptrans,sessparams.GetImpairmentParams(),true,GetMemoryManager());
+		if (impaired == 0)
+		{
+			RTPDelete(rtptrans,GetMemoryManager());
+			return ERR_RTP_OUTOFMEM;
+		}
+		rtptrans = impaired;
+	}
 	if ((status = rtptrans->Init(usingpollthread)) < 0)
 	{
 		RTPDelete(rtptrans,GetMemoryManager());
@@ -180,11 +191,28 @@ int RTPSession::Create(const RTPSessionParams &sessparams,RTPTransmitter *transm
 		return ERR_RTP_SESSION_MAXPACKETSIZETOOSMALL;
 		
 	rtptrans = transmitter;
+	deletetransmitter = false;
+	if (sessparams.GetImpairmentParams().IsEnabled())
+	{
+		// Only the wrapper belongs to the session, the transmitter itself stays with the caller
+		rtptrans = RTPNew(GetMemoryManager(),RTPMEM_TYPE_CLASS_RTPTRANSMITTER) RTPImpairedTransmitter(transmitter,sessparams.GetImpairmentParams(),false,GetMemoryManager());
+		if (rtptrans == 0)
+			return ERR_RTP_OUTOFMEM;
+		deletetransmitter = true;
+		if ((status = rtptrans->Init(usingpollthread)) < 0)
+		{
+			RTPDelete(rtptrans,GetMemoryManager());
+			return status;
+		}
+	}
 
 	if ((status = rtptrans->SetMaximumPacketSize(maxpacksize)) < 0)
+	{
+		if (deletetransmitter)
+			RTPDelete(rtptrans,GetMemoryManager());
 		return status;
+	}
 
-	deletetransmitter = false;
 	return InternalCreate(sessparams);
 }
 
@@ -585,16 +613,17 @@ int RTPSession::SendPacket(const void *data,size_t len)
 		return ERR_RTP_SESSION_NOTCREATED;
 
 	BUILDER_LOCK
-	if ((status = packetbuilder.BuildPacket(data,len)) < 0)
+	if ((status = packetbuilder.BuildHeader(len)) < 0)
 	{
 		BUILDER_UNLOCK
 		return status;
 	}
-	if ((status = rtptrans->SendRTPData(packetbuilder.GetPacket(),packetbuilder.GetPacketLength())) < 0)
+	if ((status = rtptrans->SendRTPDataGather(packetbuilder.GetPacket(),packetbuilder.GetPacketLength(),data,len)) < 0)
 	{
 		BUILDER_UNLOCK
 		return status;
 	}
+	OnSentRTPPacket(packetbuilder.GetPacket(),packetbuilder.GetPacketLength(),data,len);
 	BUILDER_UNLOCK
 
 	SOURCES_LOCK
@@ -615,16 +644,17 @@ int RTPSession::SendPacket(const void *data,size_t len,
 		return ERR_RTP_SESSION_NOTCREATED;
 	
 	BUILDER_LOCK
-	if ((status = packetbuilder.BuildPacket(data,len,pt,mark,timestampinc)) < 0)
+	if ((status = packetbuilder.BuildHeader(len,pt,mark,timestampinc)) < 0)
 	{
 		BUILDER_UNLOCK
 		return status;
 	}
-	if ((status = rtptrans->SendRTPData(packetbuilder.GetPacket(),packetbuilder.GetPacketLength())) < 0)
+	if ((status = rtptrans->SendRTPDataGather(packetbuilder.GetPacket(),packetbuilder.GetPacketLength(),data,len)) < 0)
 	{
 		BUILDER_UNLOCK
 		return status;
 	}
+	OnSentRTPPacket(packetbuilder.GetPacket(),packetbuilder.GetPacketLength(),data,len);
 	BUILDER_UNLOCK
 	
 	SOURCES_LOCK
@@ -645,16 +675,17 @@ int RTPSession::SendPacketEx(const void *data,size_t len,
 		return ERR_RTP_SESSION_NOTCREATED;
 
 	BUILDER_LOCK
-	if ((status = packetbuilder.BuildPacketEx(data,len,hdrextID,hdrextdata,numhdrextwords)) < 0)
+	if ((status = packetbuilder.BuildHeaderEx(len,hdrextID,hdrextdata,numhdrextwords)) < 0)
 	{
 		BUILDER_UNLOCK
 		return status;
 	}
-	if ((status = rtptrans->SendRTPData(packetbuilder.GetPacket(),packetbuilder.GetPacketLength())) < 0)
+	if ((status = rtptrans->SendRTPDataGather(packetbuilder.GetPacket(),packetbuilder.GetPacketLength(),data,len)) < 0)
 	{
 		BUILDER_UNLOCK
 		return status;
 	}
+	OnSentRTPPacket(packetbuilder.GetPacket(),packetbuilder.GetPacketLength(),data,len);
 	BUILDER_UNLOCK
 
 	SOURCES_LOCK
@@ -676,16 +707,17 @@ int RTPSession::SendPacketEx(const void *data,size_t len,
 		return ERR_RTP_SESSION_NOTCREATED;
 	
 	BUILDER_LOCK
-	if ((status = packetbuilder.BuildPacketEx(data,len,pt,mark,timestampinc,hdrextID,hdrextdata,numhdrextwords)) < 0)
+	if ((status = packetbuilder.BuildHeaderEx(len,pt,mark,timestampinc,hdrextID,hdrextdata,numhdrextwords)) < 0)
 	{
 		BUILDER_UNLOCK
 		return status;
 	}
-	if ((status = rtptrans->SendRTPData(packetbuilder.GetPacket(),packetbuilder.GetPacketLength())) < 0)
+	if ((status = rtptrans->SendRTPDataGather(packetbuilder.GetPacket(),packetbuilder.GetPacketLength(),data,len)) < 0)
 	{
 		BUILDER_UNLOCK
 		return status;
 	}
+	OnSentRTPPacket(packetbuilder.GetPacket(),packetbuilder.GetPacketLength(),data,len);
 	BUILDER_UNLOCK
 
 	SOURCES_LOCK
@@ -697,9 +729,42 @@ int RTPSession::SendPacketEx(const void *data,size_t len,
 	return 0;
 }
 
+int RTPSession::SendRawRTPData(const void *data,size_t len,const RTPAddress &addr)
+{
+	if (!created)
+		return ERR_RTP_SESSION_NOTCREATED;
+	return rtptrans->SendRTPDataTo(data,len,addr);
+}
+
+int RTPSession::BeginSendBatch()
+{
+	if (!created)
+		return ERR_RTP_SESSION_NOTCREATED;
+	return rtptrans->BeginSendBatch();
+}
+
+int RTPSession::EndSendBatch()
+{
+	if (!created)
+		return ERR_RTP_SESSION_NOTCREATED;
+	return rtptrans->EndSendBatch();
+}
+
 #ifdef RTP_SUPPORT_SENDAPP
 
 int RTPSession::SendRTCPAPPPacket(uint8_t subtype, const uint8_t name[4], const void *appdata, size_t appdatalen)
+{
+	return PrivateSendRTCPAPPPacket(subtype,name,appdata,appdatalen,0);
+}
+
+int RTPSession::SendRTCPAPPPacketTo(uint8_t subtype, const uint8_t name[4], const void *appdata, size_t appdatalen,
+                                    const RTPAddress &addr)
+{
+	return PrivateSendRTCPAPPPacket(subtype,name,appdata,appdatalen,&addr);
+}
+
+int RTPSession::PrivateSendRTCPAPPPacket(uint8_t subtype, const uint8_t name[4], const void *appdata, size_t appdatalen,
+                                         const RTPAddress *addr)
 {
 	int status;
 
@@ -744,7 +809,10 @@ int RTPSession::SendRTCPAPPPacket(uint8_t subtype, const uint8_t name[4], const
 		return status;
 
 	//send packet
-	status = rtptrans->SendRTCPData(pb.GetCompoundPacketData(),pb.GetCompoundPacketLength());
+	if (addr)
+		status = rtptrans->SendRTCPDataTo(pb.GetCompoundPacketData(),pb.GetCompoundPacketLength(),*addr);
+	else
+		status = rtptrans->SendRTCPData(pb.GetCompoundPacketData(),pb.GetCompoundPacketLength());
 	if(status < 0)
 		return status;
 
@@ -800,7 +868,7 @@ int RTPSession::SendUnknownPacket(bool sr, uint8_t payload_type, uint8_t subtype
 
 		uint32_t tsdiff = (uint32_t)((diff.GetDouble()/timestampunit)+0.5);
 		uint32_t rtptimestamp = rtppacktimestamp+tsdiff;
-		RTPNTPTime ntptimestamp = curtime.GetNTPTime();
+		RTPNTPTime ntptimestamp = RTPTime::WallClockTime().GetNTPTime();
 
 		//first packet in an rtcp compound packet should always be SR or RR
 		if((status = rtcpcomppack->StartSenderReport(ssrc,ntptimestamp,rtptimestamp,packcount,octetcount)) < 0)
@@ -914,6 +982,18 @@ int RTPSession::SetDefaultTimestampIncrement(uint32_t timestampinc)
 	return status;
 }
 
+int RTPSession::GetNextPacketInfo(uint16_t *seqnr, uint32_t *timestamp)
+{
+	if (!created)
+		return ERR_RTP_SESSION_NOTCREATED;
+
+	BUILDER_LOCK
+	*seqnr = packetbuilder.GetSequenceNumber();
+	*timestamp = packetbuilder.GetTimestamp();
+	BUILDER_UNLOCK
+	return 0;
+}
+
 int RTPSession::IncrementTimestamp(uint32_t inc)
 {
 	if (!created)
@@ -148,7 +148,8 @@ public:
 	/** Sends the RTP packet with payload \c data which has length \c len.
 	 *  Sends the RTP packet with payload \c data which has length \c len.
 	 *  The used payload type, marker and timestamp increment will be those that have been set 
-	 *  using the \c SetDefault member functions.
+	 *  using the \c SetDefault member functions. Only the header is built, the transmitter sends 
+	 *  it together with the payload straight from \c data. This applies to all SendPacket functions.
 	 */
 	int SendPacket(const void *data,size_t len);
 
@@ -177,6 +178,29 @@ public:
 	int SendPacketEx(const void *data,size_t len,
 	                  uint8_t pt,bool mark,uint32_t timestampinc,
 	                  uint16_t hdrextID,const void *hdrextdata,size_t numhdrextwords);
+
+	/** Collects the RTP packets sent from now on, so the transmitter can hand them to the OS at once.
+	 *  Collects the RTP packets sent from now on, until RTPSession::EndSendBatch is called. Useful
+	 *  when several packets are sent back to back, e.g. the fragments of a frame. Transmitters which
+	 *  don't support this keep sending every packet right away.
+	 */
+	int BeginSendBatch();
+
+	/** Sends the RTP packets collected since RTPSession::BeginSendBatch was called. */
+	int EndSendBatch();
+
+	/** Sends the already built RTP packet \c data with length \c len to \c addr only.
+	 *  Sends the already built RTP packet \c data with length \c len to \c addr only, without
+	 *  changing the sequence number or timestamp. Useful to repeat a packet on request of one
+	 *  receiver, e.g. one which was stored in RTPSession::OnSentRTPPacket.
+	 */
+	int SendRawRTPData(const void *data,size_t len,const RTPAddress &addr);
+
+	/** Stores the sequence number and timestamp the next RTP packet will be sent with.
+	 *  Stores the sequence number and timestamp the next RTP packet will be sent with in \c seqnr
+	 *  and \c timestamp. Useful to describe packets in advance, e.g. to protect them with FEC.
+	 */
+	int GetNextPacketInfo(uint16_t *seqnr, uint32_t *timestamp);
 #ifdef RTP_SUPPORT_SENDAPP
 	/** If sending of RTCP APP packets was enabled at compile time, this function creates a compound packet 
 	 *  containing an RTCP APP packet and sends it immediately. 
@@ -186,6 +210,14 @@ public:
 	 *  specification, so use with care. 
 	 */
 	int SendRTCPAPPPacket(uint8_t subtype, const uint8_t name[4], const void *appdata, size_t appdatalen);
+
+	/** Like SendRTCPAPPPacket, but sends the compound packet to the RTCP address \c addr only.
+	 *  Like SendRTCPAPPPacket, but sends the compound packet to the RTCP address \c addr only, e.g. to
+	 *  answer the participant an RTCP packet came from. Transmitters which can't address a single
+	 *  destination send it to all of them.
+	 */
+	int SendRTCPAPPPacketTo(uint8_t subtype, const uint8_t name[4], const void *appdata, size_t appdatalen,
+	                        const RTPAddress &addr);
 #endif // RTP_SUPPORT_SENDAPP
 
 #ifdef RTP_SUPPORT_RTCPUNKNOWN
@@ -505,6 +537,14 @@ protected:
 	/** Is called when a BYE packet has been processed for source \c srcdat. */
 	virtual void OnBYEPacket(RTPSourceData *srcdat)							{ }
 
+	/** Is called when an RTP packet has just been sent.
+	 *  Is called when an RTP packet has just been sent by one of the SendPacket functions. The packet
+	 *  consists of the \c headerlen bytes in \c header followed by the \c payloadlen bytes in
+	 *  \c payload, which is the caller's buffer, it was never copied into a whole packet. The data is
+	 *  only valid during the call, no other RTP packet can be sent from within it.
+	 */
+	virtual void OnSentRTPPacket(const void *header,size_t headerlen,const void *payload,size_t payloadlen) { }
+
 	/** Is called when an RTCP compound packet has just been sent (useful to inspect outgoing RTCP data). */
 	virtual void OnSendRTCPCompoundPacket(RTCPCompoundPacket *pack)					{ }
 #ifdef RTP_SUPPORT_THREAD
@@ -536,6 +576,10 @@ private:
 	int ProcessPolledData();
 	int ProcessRTCPCompoundPacket(RTCPCompoundPacket &rtcpcomppack,RTPRawPacket *pack);
 	RTPRandom *GetRandomNumberGenerator(RTPRandom *r);
+#ifdef RTP_SUPPORT_SENDAPP
+	int PrivateSendRTCPAPPPacket(uint8_t subtype, const uint8_t name[4], const void *appdata, size_t appdatalen,
+	                             const RTPAddress *addr);
+#endif // RTP_SUPPORT_SENDAPP
 	
 	RTPRandom *rtprnd;
 	bool deletertprnd;
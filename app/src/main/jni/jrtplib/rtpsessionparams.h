@@ -43,6 +43,7 @@
 #include "rtptransmitter.h"
 #include "rtptimeutilities.h"
 #include "rtpsources.h"
+#include "rtpimpairedtransmitter.h"
 
 namespace jrtplib
 {
@@ -211,6 +212,15 @@ public:
 
 	/** Returns the currently set CNAME, is blank when this will be generated automatically (the default). */
 	std::string GetCNAME() const						{ return cname; }
+
+	/** Sets how the incoming packets should be impaired, to simulate a bad network.
+	 *  Sets how the incoming packets should be impaired, to simulate a bad network. If any impairment
+	 *  is enabled, the session wraps its transmitter in an RTPImpairedTransmitter.
+	 */
+	void SetImpairmentParams(const RTPImpairmentParams &p)			{ impairment = p; }
+
+	/** Returns the impairment of the incoming packets (default is none). */
+	const RTPImpairmentParams &GetImpairmentParams() const			{ return impairment; }
 private:
 	bool acceptown;
 	bool usepollthread;
@@ -240,6 +250,8 @@ private:
 	uint32_t predefinedssrc;
 
 	std::string cname;
+
+	RTPImpairmentParams impairment;
 };
 
 } // end namespace
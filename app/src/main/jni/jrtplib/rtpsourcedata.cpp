@@ -258,7 +258,8 @@ jitter = (uint32_t)djitter;
 	}
 }
 
-RTPSourceData::RTPSourceData(uint32_t s, RTPMemoryManager *mgr) : RTPMemoryObject(mgr),SDESinf(mgr),byetime(0,0)
+RTPSourceData::RTPSourceData(uint32_t s, RTPMemoryManager *mgr) : RTPMemoryObject(mgr),
+	packetlist(RTPSTLAllocator<RTPPacket *>(mgr,RTPMEM_TYPE_CLASS_LISTNODE)),SDESinf(mgr),byetime(0,0)
 {
 	ssrc = s;
 	issender = false;
@@ -315,7 +316,8 @@ RTPTime RTPSourceData::INF_GetRoundtripTime() const
 	if (RRinf.GetDelaySinceLastSR() == 0 && RRinf.GetLastSRTimestamp() == 0)
 		return RTPTime(0,0);
 
-	RTPNTPTime recvtime = RRinf.GetReceiveTime().GetNTPTime();
+	// Our sender reports carry the wallclock time, the receive time comes from the monotonic clock
+	RTPNTPTime recvtime = RTPTime::ToWallClockTime(RRinf.GetReceiveTime()).GetNTPTime();
 	uint32_t rtt = ((recvtime.GetMSW()&0xFFFF)<<16)|((recvtime.GetLSW()>>16)&0xFFFF);
 	rtt -= RRinf.GetLastSRTimestamp();
 	rtt -= RRinf.GetDelaySinceLastSR();
@@ -429,14 +429,55 @@ public:
 		}
 
 		void SetClockOffsetUSeconds(int64_t offset) {
+			if (hasClockOffset) {
+				int64_t change = offset - clockOffetUSeconds;
+				clockOffsetChangeUSeconds = change < 0 ? -change : change;
+			}
 			clockOffetUSeconds = offset;
+			hasClockOffset = true;
+		}
+
+		// How much the offset moved between the last two reports, as a measure of its error
+		int64_t GetClockOffsetChangeUSeconds() {
+			return clockOffsetChangeUSeconds;
+		}
+
+		bool HasClockOffset() {
+			return hasClockOffset;
+		}
+
+		// Time the receiver needed to set up decoding and playback, -1 until it reported it
+		int64_t GetStartupUSeconds() {
+			return startupUSeconds;
+		}
+
+		void SetStartupUSeconds(int64_t startup) {
+			startupUSeconds = startup;
+		}
+
+		// Interarrival jitter as measured by the receiver
+		int64_t GetReportedJitterUSeconds() {
+			return reportedJitterUSeconds;
+		}
+
+		void SetReportedJitterUSeconds(int64_t jitter) {
+			reportedJitterUSeconds = jitter;
+		}
+
+		// How far off the receiver's clock offset may be, by its own estimate
+		int64_t GetReportedClockErrorUSeconds() {
+			return reportedClockErrorUSeconds;
+		}
+
+		void SetReportedClockErrorUSeconds(int64_t error) {
+			reportedClockErrorUSeconds = error;
 		}
 
 #ifdef RTPDEBUG
 	virtual void Dump();
 #endif // RTPDEBUG
 protected:
-	std::list<RTPPacket *> packetlist;
+	std::list<RTPPacket *,RTPSTLAllocator<RTPPacket *> > packetlist;
 
 	uint32_t ssrc;
 	bool ownssrc;
@@ -461,6 +502,11 @@ protected:
 
 		// ============ Custom ============
 		int64_t clockOffetUSeconds = 0;
+		int64_t clockOffsetChangeUSeconds = 0;
+		bool hasClockOffset = false;
+		int64_t startupUSeconds = -1;
+		int64_t reportedJitterUSeconds = 0;
+		int64_t reportedClockErrorUSeconds = 0;
 };
 
 inline RTPPacket *RTPSourceData::GetNextPacket()
@@ -479,7 +525,7 @@ inline RTPPacket *RTPSourceData::GetNextPacket()
 
 inline void RTPSourceData::FlushPackets()
 {
-	std::list<RTPPacket *>::const_iterator it;
+	std::list<RTPPacket *,RTPSTLAllocator<RTPPacket *> >::const_iterator it;
 
 	for (it = packetlist.begin() ; it != packetlist.end() ; ++it)
 		RTPDelete(*it,GetMemoryManager());
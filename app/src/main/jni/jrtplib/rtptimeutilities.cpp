@@ -30,9 +30,18 @@
 
 */
 
+#include "rtptimeutilities.h"
+
+namespace jrtplib
+{
+
+RTPTime (*RTPTime::clockfunc)() = 0;
+RTPTime (*RTPTime::wallclockfunc)() = 0;
+
+} // end namespace
+
 #if (defined(WIN32) || defined(_WIN32_WCE))
 
-#include "rtptimeutilities.h"
 #ifdef RTPDEBUG
 	#include <iostream>
 #endif // RTPDEBUG
@@ -50,6 +50,8 @@
 #endif // WIN32
 
 #define RTP_NTPTIMEOFFSET									2208988800UL
+// Added to the monotonic clock, so subtracting a timeout from a time shortly after boot can't wrap
+#define RTP_MONOTONICTIMEOFFSET								86400UL
 
 namespace jrtplib
 {
@@ -80,14 +82,35 @@ private:
 class JRTPLIB_IMPORTEXPORT RTPTime
 {
 public:
+	/** Returns an RTPTime instance representing the current time of a monotonic clock. 
+	 *  Returns an RTPTime instance representing the current time of a monotonic clock. It 
+	 *  advances steadily and doesn't jump when the system time is set, but its origin is
+	 *  unspecified. Use it for intervals, deadlines and receive times, and WallClockTime 
+	 *  where a time has NTP semantics. On Unix it reads CLOCK_MONOTONIC, which the vDSO 
+	 *  answers without a system call.
+	 */
+	static RTPTime CurrentTime();
+
 	/** Returns an RTPTime instance representing the current wallclock time. 
 	 *  Returns an RTPTime instance representing the current wallclock time. This is expressed 
 	 *  as a number of seconds since 00:00:00 UTC, January 1, 1970.
 	 */
-	static RTPTime CurrentTime();
+	static RTPTime WallClockTime();
+
+	/** Returns the wallclock time which corresponds to \c t, a time returned by CurrentTime. 
+	 *  Returns the wallclock time which corresponds to \c t, a time returned by CurrentTime,
+	 *  using the current difference between both clocks.
+	 */
+	static RTPTime ToWallClockTime(const RTPTime &t);
 
 	/** This function waits the amount of time specified in \c delay. */
 	static void Wait(const RTPTime &delay);
+
+	/** Replaces the clocks behind CurrentTime() and WallClockTime(), e.g. to run sessions against a simulated clock.
+	 *  Replaces the clocks behind CurrentTime() and WallClockTime(). If \c wallclocktime is a null pointer,
+	 *  \c currenttime serves as both. Passing null pointers restores the system clocks.
+	 */
+	static void SetClock(RTPTime (*currenttime)(),RTPTime (*wallclocktime)() = 0)	{ clockfunc = currenttime; wallclockfunc = (wallclocktime)?wallclocktime:currenttime; }
 		
 	/** Creates an RTPTime instance representing \c t, which is expressed in units of seconds. */
 	RTPTime(double t);
@@ -126,6 +149,9 @@ private:
 #endif // WIN32 || _WIN32_WCE
 
 	uint32_t sec,microsec;
+
+	static RTPTime (*clockfunc)();
+	static RTPTime (*wallclockfunc)();
 };
 
 inline RTPTime::RTPTime(double t)
@@ -198,6 +224,14 @@ inline RTPTime RTPTime::CurrentTime()
 	return RTPTime((uint32_t)((microseconds + microdiff) / 1000000ui64),((uint32_t)((microseconds + microdiff) % 1000000ui64)));
 }
 
+// Already anchored at the system time when first called
+inline RTPTime RTPTime::WallClockTime()
+{
+	if (wallclockfunc)
+		return wallclockfunc();
+	return CurrentTime();
+}
+
 inline void RTPTime::Wait(const RTPTime &delay)
 {
 	DWORD t;
@@ -221,6 +255,23 @@ extern RTPTimeInitializer timeinit;
 
 inline RTPTime RTPTime::CurrentTime()
 {
+	if (clockfunc)
+		return clockfunc();
+
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+	
+	if (clock_gettime(CLOCK_MONOTONIC,&ts) == 0)
+		return RTPTime((uint32_t)ts.tv_sec+RTP_MONOTONICTIMEOFFSET,(uint32_t)(ts.tv_nsec/1000));
+#endif // CLOCK_MONOTONIC
+	return WallClockTime();
+}
+
+inline RTPTime RTPTime::WallClockTime()
+{
+	if (wallclockfunc)
+		return wallclockfunc();
+
 	struct timeval tv;
 	
 	gettimeofday(&tv,0);
@@ -238,6 +289,18 @@ inline void RTPTime::Wait(const RTPTime &delay)
 
 #endif // WIN32
 
+inline RTPTime RTPTime::ToWallClockTime(const RTPTime &t)
+{
+	RTPTime wallclock = WallClockTime();
+	RTPTime now = CurrentTime();
+	RTPTime result = t;
+
+	// Adding first can't wrap, t + wallclock is never below now
+	result += wallclock;
+	result -= now;
+	return result;
+}
+
 inline RTPTime &RTPTime::operator-=(const RTPTime &t)
 { 
 	sec -= t.sec; 
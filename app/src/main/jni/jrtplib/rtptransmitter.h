@@ -41,6 +41,8 @@
 #include "rtpconfig.h"
 #include "rtptypes.h"
 #include "rtpmemoryobject.h"
+#include "rtperrors.h"
+#include <string.h>
 
 namespace jrtplib
 {
@@ -155,9 +157,30 @@ public:
 	/** Send a packet with length \c len containing \c data	to all RTP addresses of the current destination list. */
 	virtual int SendRTPData(const void *data,size_t len) = 0;	
 
+	/** Sends a packet made of \c header and \c payload to all RTP addresses of the current destination list.
+	 *  Sends a packet made of the \c headerlen bytes in \c header followed by the \c payloadlen bytes
+	 *  in \c payload, like SendRTPData does with the whole packet. Transmitters which can hand
+	 *  both parts to the OS at once avoid copying the payload, the others send a copy.
+	 */
+	virtual int SendRTPDataGather(const void *header,size_t headerlen,const void *payload,size_t payloadlen);
+
 	/** Send a packet with length \c len containing \c data to all RTCP addresses of the current destination list. */
 	virtual int SendRTCPData(const void *data,size_t len) = 0;
 
+	/** Sends a packet with length \c len containing \c data to the RTP address \c addr only.
+	 *  Sends a packet with length \c len containing \c data to the RTP address \c addr only, which
+	 *  does not have to be in the destination list. Transmitters which can't address a single
+	 *  destination send the packet to all RTP addresses of the destination list instead.
+	 */
+	virtual int SendRTPDataTo(const void *data,size_t len,const RTPAddress &)		{ return SendRTPData(data,len); }
+
+	/** Sends a packet with length \c len containing \c data to the RTCP address \c addr only.
+	 *  Sends a packet with length \c len containing \c data to the RTCP address \c addr only, e.g. the
+	 *  one an RTCP packet came from. Transmitters which can't address a single destination send the 
+	 *  packet to all RTCP addresses of the destination list instead.
+	 */
+	virtual int SendRTCPDataTo(const void *data,size_t len,const RTPAddress &)		{ return SendRTCPData(data,len); }
+
 	/** Adds the address specified by \c addr to the list of destinations. */
 	virtual int AddDestination(const RTPAddress &addr) = 0;
 
@@ -213,6 +236,16 @@ public:
 	/** Returns the raw data of a received RTP packet (received during the Poll function) 
 	 *  in an RTPRawPacket instance. */
 	virtual RTPRawPacket *GetNextPacket() = 0;
+
+	/** Starts collecting outgoing RTP packets instead of sending them one by one.
+	 *  Starts collecting outgoing RTP packets instead of sending them one by one, until
+	 *  RTPTransmitter::EndSendBatch is called. Transmitters which can't batch their sends
+	 *  just keep sending right away.
+	 */
+	virtual int BeginSendBatch()										{ return 0; }
+
+	/** Sends the RTP packets collected since RTPTransmitter::BeginSendBatch was called. */
+	virtual int EndSendBatch()										{ return 0; }
 #ifdef RTPDEBUG
 	virtual void Dump() = 0;
 #endif // RTPDEBUG
@@ -255,6 +288,20 @@ private:
 	RTPTransmitter::TransmissionProtocol protocol;
 };
 
+inline int RTPTransmitter::SendRTPDataGather(const void *header,size_t headerlen,const void *payload,size_t payloadlen)
+{
+	uint8_t *packet = RTPNew(GetMemoryManager(),RTPMEM_TYPE_BUFFER_RTPPACKET) uint8_t[headerlen+payloadlen];
+	int status;
+
+	if (packet == 0)
+		return ERR_RTP_OUTOFMEM;
+	memcpy(packet,header,headerlen);
+	memcpy(packet+headerlen,payload,payloadlen);
+	status = SendRTPData(packet,headerlen+payloadlen);
+	RTPDeleteByteArray(packet,GetMemoryManager());
+	return status;
+}
+
 } // end namespace
 
 #endif // RTPTRANSMITTER_H
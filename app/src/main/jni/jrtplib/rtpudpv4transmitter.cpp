@@ -50,6 +50,7 @@
 	#include <string.h>
 	#include <netdb.h>
 	#include <unistd.h>
+	#include <errno.h>
 
 	#ifdef RTP_HAVE_SYS_FILIO
 		#include <sys/filio.h>
@@ -60,6 +61,10 @@
 	#ifdef RTP_SUPPORT_IFADDRS
 		#include <ifaddrs.h>
 	#endif // RTP_SUPPORT_IFADDRS
+	#ifdef RTP_SUPPORT_EPOLL
+		#include <sys/epoll.h>
+		#include <sys/eventfd.h>
+	#endif // RTP_SUPPORT_EPOLL
 
 	#define RTPSOCKERR								-1
 	#define RTPCLOSE(x)								close(x)
@@ -81,8 +86,22 @@
 #include <iostream>
 
 #define RTPUDPV4TRANS_MAXPACKSIZE							65535
+
+// Makes recvfrom return the full length of a datagram which did not fit
+#ifdef MSG_TRUNC
+	#define RTPUDPV4TRANS_RECVFLAGS							MSG_TRUNC
+#else
+	#define RTPUDPV4TRANS_RECVFLAGS							0
+#endif // MSG_TRUNC
 #define RTPUDPV4TRANS_IFREQBUFSIZE							8192
 
+// Tells the events of the epoll set apart, the added descriptors follow. The upper half of their
+// event data holds the descriptor, the slot may have been reused during the wait.
+#define RTPUDPV4TRANS_WAITABORT								0
+#define RTPUDPV4TRANS_WAITRTP								1
+#define RTPUDPV4TRANS_WAITRTCP								2
+#define RTPUDPV4TRANS_WAITEXTRA								3
+
 #define RTPUDPV4TRANS_IS_MCASTADDR(x)							(((x)&0xF0000000) == 0xE0000000)
 
 #define RTPUDPV4TRANS_MCASTMEMBERSHIP(socket,type,mcastip,status)	{\
@@ -111,10 +130,17 @@ RTPUDPv4Transmitter::RTPUDPv4Transmitter(RTPMemoryManager *mgr) : RTPTransmitter
 #ifdef RTP_SUPPORT_IPV4MULTICAST
 								  multicastgroups(mgr,RTPMEM_TYPE_CLASS_MULTICASTHASHELEMENT),
 #endif // RTP_SUPPORT_IPV4MULTICAST
+								  rawpacketlist(RTPSTLAllocator<RTPRawPacket*>(mgr,RTPMEM_TYPE_CLASS_LISTNODE)),
 								  acceptignoreinfo(mgr,RTPMEM_TYPE_CLASS_ACCEPTIGNOREHASHELEMENT)
 {
 	created = false;
 	init = false;
+	batchbuffer = 0;
+	numsendcalls = 0;
+	numsentdatagrams = 0;
+	memset(recvbuffers,0,sizeof(recvbuffers));
+	numrecvcalls = 0;
+	numreceiveddatagrams = 0;
 #if (defined(WIN32) || defined(_WIN32_WCE))
 	timeinit.Dummy();
 #endif // WIN32 || _WIN32_WCE
@@ -325,6 +351,19 @@ int RTPUDPv4Transmitter::Create(size_t maximumpacketsize,const RTPTransmissionPa
 	}
 	
 	maxpacksize = maximumpacketsize;
+#ifdef RTP_SUPPORT_SENDMMSG
+	usesendmmsg = params->GetBatchSend();
+#else
+	usesendmmsg = false;
+#endif // RTP_SUPPORT_SENDMMSG
+	batching = false;
+	batchcount = 0;
+#ifdef RTP_SUPPORT_RECVMMSG
+	userecvmmsg = params->GetBatchReceive();
+#else
+	userecvmmsg = false;
+#endif // RTP_SUPPORT_RECVMMSG
+	recvbuffersize = RTPUDPV4TRANS_BATCHRECVSIZE;
 	portbase = params->GetPortbase();
 	multicastTTL = params->GetMulticastTTL();
 	receivemode = RTPTransmitter::AcceptAll;
@@ -364,6 +403,8 @@ void RTPUDPv4Transmitter::Destroy()
 	multicastgroups.Clear();
 #endif // RTP_SUPPORT_IPV4MULTICAST
 	FlushPackets();
+	ClearSendBatch();
+	ClearReceiveBuffers();
 	ClearAcceptIgnoreInfo();
 	localIPs.clear();
 	created = false;
@@ -609,8 +650,18 @@ int RTPUDPv4Transmitter::WaitForIncomingData(const RTPTime &delay,bool *dataavai
 	
 	MAINMUTEX_LOCK
 	
+#ifdef RTP_SUPPORT_EPOLL
+	struct epoll_event events[RTPUDPV4TRANS_WAITEXTRA+RTPUDPV4TRANS_MAXWAITDESCRIPTORS];
+	RTPUDPv4TransDescriptorCallback callbacks[RTPUDPV4TRANS_MAXWAITDESCRIPTORS];
+	void *callbackdata[RTPUDPV4TRANS_MAXWAITDESCRIPTORS];
+	int callbackfds[RTPUDPV4TRANS_MAXWAITDESCRIPTORS];
+	int numevents,numcallbacks,timeout,i;
+	bool gotdata;
+	int64_t ms;
+#else
 	fd_set fdset;
 	struct timeval tv;
+#endif // RTP_SUPPORT_EPOLL
 	
 	if (!created)
 	{
@@ -623,19 +674,32 @@ int RTPUDPv4Transmitter::WaitForIncomingData(const RTPTime &delay,bool *dataavai
 		return ERR_RTP_UDPV4TRANS_ALREADYWAITING;
 	}
 	
+#ifdef RTP_SUPPORT_EPOLL
+	// Whole milliseconds, rounded up so the wait does not end before the delay passed
+	ms = (int64_t)delay.GetSeconds()*1000+(delay.GetMicroSeconds()+999)/1000;
+	timeout = (ms < 0x7FFFFFFF)?(int)ms:0x7FFFFFFF;
+#else
 	FD_ZERO(&fdset);
 	FD_SET(rtpsock,&fdset);
 	FD_SET(rtcpsock,&fdset);
 	FD_SET(abortdesc[0],&fdset);
 	tv.tv_sec = delay.GetSeconds();
 	tv.tv_usec = delay.GetMicroSeconds();
+#endif // RTP_SUPPORT_EPOLL
 	
 	waitingfordata = true;
 	
 	WAITMUTEX_LOCK
 	MAINMUTEX_UNLOCK
 
+#ifdef RTP_SUPPORT_EPOLL
+	numevents = epoll_wait(epollfd,events,RTPUDPV4TRANS_WAITEXTRA+RTPUDPV4TRANS_MAXWAITDESCRIPTORS,timeout);
+	if (numevents < 0 && errno == EINTR)
+		numevents = 0;
+	if (numevents < 0)
+#else
 	if (select(FD_SETSIZE,&fdset,0,0,&tv) < 0)
+#endif // RTP_SUPPORT_EPOLL
 	{
 		MAINMUTEX_LOCK
 		waitingfordata = false;
@@ -652,7 +716,50 @@ int RTPUDPv4Transmitter::WaitForIncomingData(const RTPTime &delay,bool *dataavai
 		WAITMUTEX_UNLOCK
 		return 0;
 	}
-		
+
+#ifdef RTP_SUPPORT_EPOLL
+	gotdata = false;
+	numcallbacks = 0;
+	for (i = 0 ; i < numevents ; i++)
+	{
+		uint32_t tag = (uint32_t)events[i].data.u64;
+
+		if (tag == RTPUDPV4TRANS_WAITABORT)
+		{
+			uint64_t count;
+
+			// Resets the counter, no matter how often the wait was aborted
+			if (read(abortdesc[0],&count,sizeof(uint64_t)))
+			{
+				// To get rid of __wur related compiler warnings
+			}
+		}
+		else if (tag == RTPUDPV4TRANS_WAITRTP || tag == RTPUDPV4TRANS_WAITRTCP)
+			gotdata = true;
+		else
+		{
+			const WaitDescriptor &desc = waitdescs[tag-RTPUDPV4TRANS_WAITEXTRA];
+
+			if (desc.fd >= 0 && desc.fd == (int)(events[i].data.u64>>32)) // might have been deleted or replaced during the wait
+			{
+				callbacks[numcallbacks] = desc.callback;
+				callbackdata[numcallbacks] = desc.data;
+				callbackfds[numcallbacks] = desc.fd;
+				numcallbacks++;
+			}
+		}
+	}
+
+	if (dataavailable != 0)
+		*dataavailable = gotdata;
+
+	MAINMUTEX_UNLOCK
+	WAITMUTEX_UNLOCK
+
+	for (i = 0 ; i < numcallbacks ; i++)
+		callbacks[i](callbackfds[i],callbackdata[i]);
+	return 0;
+#else
 	// if aborted, read from abort buffer
 	if (FD_ISSET(abortdesc[0],&fdset))
 	{
@@ -681,7 +788,83 @@ int RTPUDPv4Transmitter::WaitForIncomingData(const RTPTime &delay,bool *dataavai
 	MAINMUTEX_UNLOCK
 	WAITMUTEX_UNLOCK
 	return 0;
+#endif // RTP_SUPPORT_EPOLL
+}
+
+#ifdef RTP_SUPPORT_EPOLL
+int RTPUDPv4Transmitter::AddWaitDescriptor(int fd,RTPUDPv4TransDescriptorCallback callback,void *data)
+{
+	struct epoll_event ev;
+	int i,slot = -1;
+
+	if (!init)
+		return ERR_RTP_UDPV4TRANS_NOTINIT;
+
+	MAINMUTEX_LOCK
+	if (!created)
+	{
+		MAINMUTEX_UNLOCK
+		return ERR_RTP_UDPV4TRANS_NOTCREATED;
+	}
+
+	for (i = 0 ; i < RTPUDPV4TRANS_MAXWAITDESCRIPTORS ; i++)
+	{
+		if (waitdescs[i].fd == fd)
+		{
+			MAINMUTEX_UNLOCK
+			return ERR_RTP_UDPV4TRANS_CANTADDWAITDESCRIPTOR;
+		}
+		if (waitdescs[i].fd < 0 && slot < 0)
+			slot = i;
+	}
+	if (slot < 0)
+	{
+		MAINMUTEX_UNLOCK
+		return ERR_RTP_UDPV4TRANS_TOOMANYWAITDESCRIPTORS;
+	}
+
+	memset(&ev,0,sizeof(struct epoll_event));
+	ev.events = EPOLLIN;
+	ev.data.u64 = ((uint64_t)(uint32_t)fd<<32)|(RTPUDPV4TRANS_WAITEXTRA+slot);
+	waitdescs[slot].fd = fd;
+	waitdescs[slot].callback = callback;
+	waitdescs[slot].data = data;
+	if (epoll_ctl(epollfd,EPOLL_CTL_ADD,fd,&ev) < 0)
+	{
+		waitdescs[slot].fd = -1;
+		MAINMUTEX_UNLOCK
+		return ERR_RTP_UDPV4TRANS_CANTADDWAITDESCRIPTOR;
+	}
+	MAINMUTEX_UNLOCK
+	return 0;
+}
+
+int RTPUDPv4Transmitter::DeleteWaitDescriptor(int fd)
+{
+	if (!init)
+		return ERR_RTP_UDPV4TRANS_NOTINIT;
+
+	MAINMUTEX_LOCK
+	if (!created)
+	{
+		MAINMUTEX_UNLOCK
+		return ERR_RTP_UDPV4TRANS_NOTCREATED;
+	}
+
+	for (int i = 0 ; i < RTPUDPV4TRANS_MAXWAITDESCRIPTORS ; i++)
+	{
+		if (waitdescs[i].fd == fd)
+		{
+			epoll_ctl(epollfd,EPOLL_CTL_DEL,fd,0);
+			waitdescs[i].fd = -1;
+			MAINMUTEX_UNLOCK
+			return 0;
+		}
+	}
+	MAINMUTEX_UNLOCK
+	return ERR_RTP_UDPV4TRANS_NOSUCHWAITDESCRIPTOR;
 }
+#endif // RTP_SUPPORT_EPOLL
 
 int RTPUDPv4Transmitter::AbortWait()
 {
@@ -724,11 +907,63 @@ int RTPUDPv4Transmitter::SendRTPData(const void *data,size_t len)
 		return ERR_RTP_UDPV4TRANS_SPECIFIEDSIZETOOBIG;
 	}
 	
-	destinations.GotoFirstElement();
-	while (destinations.HasCurrentElement())
+	if (batching)
 	{
-		sendto(rtpsock,(const char *)data,len,0,(const struct sockaddr *)destinations.GetCurrentElement().GetRTPSockAddr(),sizeof(struct sockaddr_in));
-		destinations.GotoNextElement();
+		memcpy(batchbuffer+batchcount*maxpacksize,data,len);
+		batchlengths[batchcount] = len;
+		batchcount++;
+		if (batchcount == RTPUDPV4TRANS_MAXBATCHPACKETS)
+			FlushSendBatch();
+	}
+	else
+		SendToDestinations(true,&data,&len,1,1);
+	
+	MAINMUTEX_UNLOCK
+	return 0;
+}
+
+int RTPUDPv4Transmitter::SendRTPDataGather(const void *header,size_t headerlen,const void *payload,size_t payloadlen)
+{
+	const void *parts[2] = { header, payload };
+	size_t lengths[2] = { headerlen, payloadlen };
+
+	if (!init)
+		return ERR_RTP_UDPV4TRANS_NOTINIT;
+
+	MAINMUTEX_LOCK
+	
+	if (!created)
+	{
+		MAINMUTEX_UNLOCK
+		return ERR_RTP_UDPV4TRANS_NOTCREATED;
+	}
+	if (headerlen+payloadlen > maxpacksize)
+	{
+		MAINMUTEX_UNLOCK
+		return ERR_RTP_UDPV4TRANS_SPECIFIEDSIZETOOBIG;
+	}
+	
+	if (batching)
+	{
+		// The batch keeps whole packets, that's one copy instead of building the packet first
+		uint8_t *packet = batchbuffer+batchcount*maxpacksize;
+
+		memcpy(packet,header,headerlen);
+		memcpy(packet+headerlen,payload,payloadlen);
+		batchlengths[batchcount] = headerlen+payloadlen;
+		batchcount++;
+		if (batchcount == RTPUDPV4TRANS_MAXBATCHPACKETS)
+			FlushSendBatch();
+	}
+	else
+	{
+#if (defined(WIN32) || defined(_WIN32_WCE))
+		// Without sendmsg the parts are sent as a copy
+		MAINMUTEX_UNLOCK
+		return RTPTransmitter::SendRTPDataGather(header,headerlen,payload,payloadlen);
+#else
+		SendToDestinations(true,parts,lengths,2,1);
+#endif // WIN32
 	}
 	
 	MAINMUTEX_UNLOCK
@@ -753,12 +988,103 @@ int RTPUDPv4Transmitter::SendRTCPData(const void *data,size_t len)
 		return ERR_RTP_UDPV4TRANS_SPECIFIEDSIZETOOBIG;
 	}
 	
-	destinations.GotoFirstElement();
-	while (destinations.HasCurrentElement())
+	SendToDestinations(false,&data,&len,1,1);
+	
+	MAINMUTEX_UNLOCK
+	return 0;
+}
+
+int RTPUDPv4Transmitter::SendRTPDataTo(const void *data,size_t len,const RTPAddress &addr)
+{
+	return SendDataTo(true,data,len,addr);
+}
+
+int RTPUDPv4Transmitter::SendRTCPDataTo(const void *data,size_t len,const RTPAddress &addr)
+{
+	return SendDataTo(false,data,len,addr);
+}
+
+int RTPUDPv4Transmitter::SendDataTo(bool rtp,const void *data,size_t len,const RTPAddress &addr)
+{
+	if (!init)
+		return ERR_RTP_UDPV4TRANS_NOTINIT;
+
+	MAINMUTEX_LOCK
+	
+	if (!created)
+	{
+		MAINMUTEX_UNLOCK
+		return ERR_RTP_UDPV4TRANS_NOTCREATED;
+	}
+	if (len > maxpacksize)
+	{
+		MAINMUTEX_UNLOCK
+		return ERR_RTP_UDPV4TRANS_SPECIFIEDSIZETOOBIG;
+	}
+	if (addr.GetAddressType() != RTPAddress::IPv4Address)
+	{
+		MAINMUTEX_UNLOCK
+		return ERR_RTP_UDPV4TRANS_INVALIDADDRESSTYPE;
+	}
+
+	// Not part of a batch, it doesn't go to all destinations. The port of addr is used as it is,
+	// also for RTCP
+	const RTPIPv4Address &address = (const RTPIPv4Address &)addr;
+	RTPIPv4Destination dest(address.GetIP(),address.GetPort());
+	numsendcalls++;
+	if (sendto((rtp)?rtpsock:rtcpsock,(const char *)data,len,0,(const struct sockaddr *)dest.GetRTPSockAddr(),sizeof(struct sockaddr_in)) >= 0)
+		numsentdatagrams++;
+	
+	MAINMUTEX_UNLOCK
+	return 0;
+}
+
+int RTPUDPv4Transmitter::BeginSendBatch()
+{
+	if (!init)
+		return ERR_RTP_UDPV4TRANS_NOTINIT;
+
+	MAINMUTEX_LOCK
+	
+	if (!created)
+	{
+		MAINMUTEX_UNLOCK
+		return ERR_RTP_UDPV4TRANS_NOTCREATED;
+	}
+	if (!usesendmmsg) // nothing to gain, keep sending right away
+	{
+		MAINMUTEX_UNLOCK
+		return 0;
+	}
+	if (batchbuffer == 0)
+	{
+		batchbuffer = RTPNew(GetMemoryManager(),RTPMEM_TYPE_BUFFER_RTPPACKET) uint8_t[maxpacksize*RTPUDPV4TRANS_MAXBATCHPACKETS];
+		if (batchbuffer == 0)
+		{
+			MAINMUTEX_UNLOCK
+			return ERR_RTP_OUTOFMEM;
+		}
+	}
+	batching = true;
+	
+	MAINMUTEX_UNLOCK
+	return 0;
+}
+
+int RTPUDPv4Transmitter::EndSendBatch()
+{
+	if (!init)
+		return ERR_RTP_UDPV4TRANS_NOTINIT;
+
+	MAINMUTEX_LOCK
+	
+	if (!created)
 	{
-		sendto(rtcpsock,(const char *)data,len,0,(const struct sockaddr *)destinations.GetCurrentElement().GetRTCPSockAddr(),sizeof(struct sockaddr_in));
-		destinations.GotoNextElement();
+		MAINMUTEX_UNLOCK
+		return ERR_RTP_UDPV4TRANS_NOTCREATED;
 	}
+	FlushSendBatch();
+	batching = false;
 	
 	MAINMUTEX_UNLOCK
 	return 0;
@@ -1168,6 +1494,14 @@ int RTPUDPv4Transmitter::SetMaximumPacketSize(size_t s)
 		MAINMUTEX_UNLOCK
 		return ERR_RTP_UDPV4TRANS_SPECIFIEDSIZETOOBIG;
 	}
+	// The batch buffer is laid out for the old size
+	FlushSendBatch();
+	if (batchbuffer)
+	{
+		RTPDeleteByteArray(batchbuffer,GetMemoryManager());
+		batchbuffer = 0;
+	}
+	batching = false;
 	maxpacksize = s;
 	MAINMUTEX_UNLOCK
 	return 0;
@@ -1243,19 +1577,175 @@ bool RTPUDPv4Transmitter::SetMulticastTTL(uint8_t ttl)
 
 void RTPUDPv4Transmitter::FlushPackets()
 {
-	std::list<RTPRawPacket*>::const_iterator it;
+	std::list<RTPRawPacket*,RTPSTLAllocator<RTPRawPacket*> >::const_iterator it;
 
 	for (it = rawpacketlist.begin() ; it != rawpacketlist.end() ; ++it)
 		RTPDelete(*it,GetMemoryManager());
 	rawpacketlist.clear();
 }
 
+void RTPUDPv4Transmitter::SendToDestinations(bool rtp,const void *const *parts,const size_t *lengths,int numparts,int numpackets)
+{
+#if (defined(WIN32) || defined(_WIN32_WCE))
+	SOCKET sock = (rtp)?rtpsock:rtcpsock;
+#else
+	int sock = (rtp)?rtpsock:rtcpsock;
+	struct iovec packetiovs[RTPUDPV4TRANS_MAXSENDPARTS];
+#endif // WIN32
+	int i,j;
+
+#ifdef RTP_SUPPORT_SENDMMSG
+	if (usesendmmsg)
+	{
+		struct mmsghdr msgs[RTPUDPV4TRANS_MAXSENDMESSAGES];
+		struct iovec iovs[RTPUDPV4TRANS_MAXSENDMESSAGES*RTPUDPV4TRANS_MAXSENDPARTS];
+		int num = 0;
+
+		for (i = 0 ; i < numpackets ; i++)
+		{
+			destinations.GotoFirstElement();
+			while (destinations.HasCurrentElement())
+			{
+				const RTPIPv4Destination &dest = destinations.GetCurrentElement();
+				struct iovec *msgiovs = iovs+num*RTPUDPV4TRANS_MAXSENDPARTS;
+
+				// The kernel only reads the parts, every destination can use the same
+				for (j = 0 ; j < numparts ; j++)
+				{
+					msgiovs[j].iov_base = (void *)parts[i*numparts+j];
+					msgiovs[j].iov_len = lengths[i*numparts+j];
+				}
+				memset(&msgs[num],0,sizeof(struct mmsghdr));
+				msgs[num].msg_hdr.msg_name = (void *)((rtp)?dest.GetRTPSockAddr():dest.GetRTCPSockAddr());
+				msgs[num].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+				msgs[num].msg_hdr.msg_iov = msgiovs;
+				msgs[num].msg_hdr.msg_iovlen = numparts;
+				num++;
+				if (num == RTPUDPV4TRANS_MAXSENDMESSAGES)
+				{
+					SendMessages(sock,msgs,num);
+					num = 0;
+				}
+				destinations.GotoNextElement();
+			}
+		}
+		if (num > 0)
+			SendMessages(sock,msgs,num);
+		return;
+	}
+#endif // RTP_SUPPORT_SENDMMSG
+
+	for (i = 0 ; i < numpackets ; i++)
+	{
+#if ! (defined(WIN32) || defined(_WIN32_WCE))
+		for (j = 0 ; j < numparts ; j++)
+		{
+			packetiovs[j].iov_base = (void *)parts[i*numparts+j];
+			packetiovs[j].iov_len = lengths[i*numparts+j];
+		}
+#endif // !WIN32
+		destinations.GotoFirstElement();
+		while (destinations.HasCurrentElement())
+		{
+			const RTPIPv4Destination &dest = destinations.GetCurrentElement();
+			const struct sockaddr_in *addr = (rtp)?dest.GetRTPSockAddr():dest.GetRTCPSockAddr();
+			int status;
+
+			numsendcalls++;
+#if (defined(WIN32) || defined(_WIN32_WCE))
+			status = sendto(sock,(const char *)parts[i],lengths[i],0,(const struct sockaddr *)addr,sizeof(struct sockaddr_in));
+#else
+			if (numparts == 1)
+				status = sendto(sock,(const char *)parts[i],lengths[i],0,(const struct sockaddr *)addr,sizeof(struct sockaddr_in));
+			else
+			{
+				struct msghdr msg;
+
+				memset(&msg,0,sizeof(struct msghdr));
+				msg.msg_name = (void *)addr;
+				msg.msg_namelen = sizeof(struct sockaddr_in);
+				msg.msg_iov = packetiovs;
+				msg.msg_iovlen = numparts;
+				status = sendmsg(sock,&msg,0);
+			}
+#endif // WIN32
+			if (status >= 0)
+				numsentdatagrams++;
+			destinations.GotoNextElement();
+		}
+	}
+}
+
+#ifdef RTP_SUPPORT_SENDMMSG
+void RTPUDPv4Transmitter::SendMessages(int sock,struct mmsghdr *msgs,int num)
+{
+	int done = 0;
+
+	while (done < num)
+	{
+		int status = sendmmsg(sock,msgs+done,num-done,0);
+
+		if (status < 0)
+		{
+			if (errno == ENOSYS)
+			{
+				// The kernel is too old, send the rest and everything after it one by one
+				usesendmmsg = false;
+				batching = false;
+				for ( ; done < num ; done++)
+				{
+					struct msghdr *hdr = &msgs[done].msg_hdr;
+
+					numsendcalls++;
+					if (sendmsg(sock,hdr,0) >= 0)
+						numsentdatagrams++;
+				}
+				return;
+			}
+			// Like with sendto, a datagram which can't be sent is dropped
+			numsendcalls++;
+			done++;
+		}
+		else
+		{
+			numsendcalls++;
+			numsentdatagrams += status;
+			done += status;
+		}
+	}
+}
+#endif // RTP_SUPPORT_SENDMMSG
+
+void RTPUDPv4Transmitter::FlushSendBatch()
+{
+	const void *packets[RTPUDPV4TRANS_MAXBATCHPACKETS];
+	int i;
+
+	if (batchcount == 0)
+		return;
+	for (i = 0 ; i < batchcount ; i++)
+		packets[i] = batchbuffer+i*maxpacksize;
+	SendToDestinations(true,packets,batchlengths,1,batchcount);
+	batchcount = 0;
+}
+
+void RTPUDPv4Transmitter::ClearSendBatch()
+{
+	if (batchbuffer)
+	{
+		RTPDeleteByteArray(batchbuffer,GetMemoryManager());
+		batchbuffer = 0;
+	}
+	batchcount = 0;
+	batching = false;
+}
+
 int RTPUDPv4Transmitter::PollSocket(bool rtp)
 {
 	//RTPSOCKLENTYPE fromlen;
 	socklen_t fromlen;
 	ssize_t recvlen;
-	char packetbuffer[RTPUDPV4TRANS_MAXPACKSIZE];
+	int status;
 #if (defined(WIN32) || defined(_WIN32_WCE))
 	SOCKET sock;
 	unsigned long len;
@@ -1269,59 +1759,172 @@ int RTPUDPv4Transmitter::PollSocket(bool rtp)
 		sock = rtpsock;
 	else
 		sock = rtcpsock;
+
+#ifdef RTP_SUPPORT_RECVMMSG
+	if (userecvmmsg)
+	{
+		status = ReceiveMessages(rtp,sock);
+		if (userecvmmsg)
+			return status;
+		// recvmmsg is not available, take in the rest one by one
+	}
+#endif // RTP_SUPPORT_RECVMMSG
 	
 	len = 0;
 	RTPIOCTL(sock,FIONREAD,&len);
+	numrecvcalls++;
 	if (len <= 0)
 		return 0;
 
 	while (len > 0)
 	{
 		RTPTime curtime = RTPTime::CurrentTime();
+		uint8_t *data;
+		size_t datalen;
+
+		// The datagram is received right into the buffer the packet keeps. On Linux FIONREAD
+		// tells the size of the next datagram, elsewhere it is the size of all of them.
+		datalen = ((size_t)len < RTPUDPV4TRANS_MAXPACKSIZE)?(size_t)len:RTPUDPV4TRANS_MAXPACKSIZE;
+		data = RTPNew(GetMemoryManager(),(rtp)?RTPMEM_TYPE_BUFFER_RECEIVEDRTPPACKET:RTPMEM_TYPE_BUFFER_RECEIVEDRTCPPACKET) uint8_t[datalen];
+		if (data == 0)
+			return ERR_RTP_OUTOFMEM;
+
 		fromlen = (socklen_t) sizeof(struct sockaddr_in);
-		recvlen = recvfrom(sock,packetbuffer,RTPUDPV4TRANS_MAXPACKSIZE,0,(struct sockaddr *)&srcaddr,&fromlen);
-		if (recvlen > 0)
+		recvlen = recvfrom(sock,(char *)data,datalen,RTPUDPV4TRANS_RECVFLAGS,(struct sockaddr *)&srcaddr,&fromlen);
+		numrecvcalls++;
+		status = 0;
+		if (recvlen >= 0)
+			numreceiveddatagrams++;
+		if (recvlen > 0 && (size_t)recvlen <= datalen) // truncated datagrams are dropped
+			status = AddReceivedPacket(rtp,data,(size_t)recvlen,ntohl(srcaddr.sin_addr.s_addr),ntohs(srcaddr.sin_port),curtime);
+		if (status <= 0) // the packet did not take the data
+			RTPDeleteByteArray(data,GetMemoryManager());
+		if (status < 0)
+			return status;
+		len = 0;
+		RTPIOCTL(sock,FIONREAD,&len);
+		numrecvcalls++;
+	}
+	return 0;
+}
+
+#ifdef RTP_SUPPORT_RECVMMSG
+int RTPUDPv4Transmitter::ReceiveMessages(bool rtp,int sock)
+{
+	uint8_t **buffers = recvbuffers[(rtp)?0:1];
+	struct mmsghdr msgs[RTPUDPV4TRANS_MAXRECVMESSAGES];
+	struct iovec iovecs[RTPUDPV4TRANS_MAXRECVMESSAGES];
+	struct sockaddr_in srcaddrs[RTPUDPV4TRANS_MAXRECVMESSAGES];
+	int num,i,status;
+
+	do
+	{
+		// Buffers which were not put into a packet last time are still there
+		for (i = 0 ; i < RTPUDPV4TRANS_MAXRECVMESSAGES ; i++)
 		{
-			bool acceptdata;
+			if (buffers[i] == 0)
+			{
+				buffers[i] = RTPNew(GetMemoryManager(),(rtp)?RTPMEM_TYPE_BUFFER_RECEIVEDRTPPACKET:RTPMEM_TYPE_BUFFER_RECEIVEDRTCPPACKET) uint8_t[recvbuffersize];
+				if (buffers[i] == 0)
+					return ERR_RTP_OUTOFMEM;
+			}
+			iovecs[i].iov_base = buffers[i];
+			iovecs[i].iov_len = recvbuffersize;
+			memset(&msgs[i],0,sizeof(struct mmsghdr));
+			msgs[i].msg_hdr.msg_name = &srcaddrs[i];
+			msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+			msgs[i].msg_hdr.msg_iov = &iovecs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
 
-			// got data, process it
-			if (receivemode == RTPTransmitter::AcceptAll)
-				acceptdata = true;
-			else
-				acceptdata = ShouldAcceptData(ntohl(srcaddr.sin_addr.s_addr),ntohs(srcaddr.sin_port));
-			
-			if (acceptdata)
+		num = recvmmsg(sock,msgs,RTPUDPV4TRANS_MAXRECVMESSAGES,MSG_DONTWAIT|RTPUDPV4TRANS_RECVFLAGS,0);
+		numrecvcalls++;
+		if (num < 0)
+		{
+			if (errno == ENOSYS) // the kernel is too old
 			{
-				RTPRawPacket *pack;
-				RTPIPv4Address *addr;
-				uint8_t *datacopy;
+				userecvmmsg = false;
+				ClearReceiveBuffers();
+			}
+			return 0; // nothing left, other errors are ignored like with recvfrom
+		}
 
-				addr = RTPNew(GetMemoryManager(),RTPMEM_TYPE_CLASS_RTPADDRESS) RTPIPv4Address(ntohl(srcaddr.sin_addr.s_addr),ntohs(srcaddr.sin_port));
-				if (addr == 0)
-					return ERR_RTP_OUTOFMEM;
-				datacopy = RTPNew(GetMemoryManager(),(rtp)?RTPMEM_TYPE_BUFFER_RECEIVEDRTPPACKET:RTPMEM_TYPE_BUFFER_RECEIVEDRTCPPACKET) uint8_t[recvlen];
-				if (datacopy == 0)
-				{
-					RTPDelete(addr,GetMemoryManager());
-					return ERR_RTP_OUTOFMEM;
-				}
-				memcpy(datacopy,packetbuffer,(size_t)recvlen);
-				
-				pack = RTPNew(GetMemoryManager(),RTPMEM_TYPE_CLASS_RTPRAWPACKET) RTPRawPacket(datacopy,(size_t)recvlen,addr,curtime,rtp,GetMemoryManager());
-				if (pack == 0)
-				{
-					RTPDelete(addr,GetMemoryManager());
-					RTPDeleteByteArray(datacopy,GetMemoryManager());
-					return ERR_RTP_OUTOFMEM;
-				}
-				rawpacketlist.push_back(pack);	
+		// All of them were there when the call returned
+		RTPTime curtime = RTPTime::CurrentTime();
+		size_t largest = 0;
+
+		for (i = 0 ; i < num ; i++)
+		{
+			size_t len = msgs[i].msg_len;
+
+			numreceiveddatagrams++;
+			if ((msgs[i].msg_hdr.msg_flags&MSG_TRUNC) || len > recvbuffersize)
+			{
+				if (len > largest)
+					largest = len;
+				continue;
 			}
+			if (len == 0)
+				continue;
+			status = AddReceivedPacket(rtp,buffers[i],len,ntohl(srcaddrs[i].sin_addr.s_addr),ntohs(srcaddrs[i].sin_port),curtime);
+			if (status < 0)
+				return status;
+			if (status > 0)
+				buffers[i] = 0; // the packet owns it now
 		}
-		len = 0;
-		RTPIOCTL(sock,FIONREAD,&len);
-	}
+
+		if (largest > recvbuffersize) // make room for the next ones of that size
+		{
+			ClearReceiveBuffers();
+			recvbuffersize = (largest < RTPUDPV4TRANS_MAXPACKSIZE)?largest:RTPUDPV4TRANS_MAXPACKSIZE;
+		}
+	} while (num == RTPUDPV4TRANS_MAXRECVMESSAGES); // there may be more
 	return 0;
 }
+#endif // RTP_SUPPORT_RECVMMSG
+
+// Returns 1 if the packet took over the data, 0 if the datagram is ignored
+int RTPUDPv4Transmitter::AddReceivedPacket(bool rtp,uint8_t *data,size_t len,uint32_t srcip,uint16_t srcport,RTPTime &curtime)
+{
+	RTPRawPacket *pack;
+	RTPIPv4Address *addr;
+	bool acceptdata;
+
+	if (receivemode == RTPTransmitter::AcceptAll)
+		acceptdata = true;
+	else
+		acceptdata = ShouldAcceptData(srcip,srcport);
+	if (!acceptdata)
+		return 0;
+
+	addr = RTPNew(GetMemoryManager(),RTPMEM_TYPE_CLASS_RTPADDRESS) RTPIPv4Address(srcip,srcport);
+	if (addr == 0)
+		return ERR_RTP_OUTOFMEM;
+
+	pack = RTPNew(GetMemoryManager(),RTPMEM_TYPE_CLASS_RTPRAWPACKET) RTPRawPacket(data,len,addr,curtime,rtp,GetMemoryManager());
+	if (pack == 0)
+	{
+		RTPDelete(addr,GetMemoryManager());
+		return ERR_RTP_OUTOFMEM;
+	}
+	rawpacketlist.push_back(pack);
+	return 1;
+}
+
+void RTPUDPv4Transmitter::ClearReceiveBuffers()
+{
+	for (int i = 0 ; i < 2 ; i++)
+	{
+		for (int j = 0 ; j < RTPUDPV4TRANS_MAXRECVMESSAGES ; j++)
+		{
+			if (recvbuffers[i][j])
+			{
+				RTPDeleteByteArray(recvbuffers[i][j],GetMemoryManager());
+				recvbuffers[i][j] = 0;
+			}
+		}
+	}
+}
 
 int RTPUDPv4Transmitter::ProcessAddAcceptIgnoreEntry(uint32_t ip,uint16_t port)
 {
@@ -1600,6 +2203,58 @@ void RTPUDPv4Transmitter::DestroyAbortDescriptors()
 	RTPCLOSE(abortdesc[1]);
 }
 
+#elif defined(RTP_SUPPORT_EPOLL) // an eventfd serves for both ends, next to the sockets in the epoll set
+
+int RTPUDPv4Transmitter::CreateAbortDescriptors()
+{
+	struct epoll_event ev;
+	int i;
+
+	abortdesc[0] = eventfd(0,EFD_NONBLOCK|EFD_CLOEXEC);
+	if (abortdesc[0] < 0)
+		return ERR_RTP_UDPV4TRANS_CANTCREATEABORTDESCRIPTORS;
+	abortdesc[1] = abortdesc[0];
+
+	epollfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epollfd < 0)
+	{
+		close(abortdesc[0]);
+		return ERR_RTP_UDPV4TRANS_CANTCREATEEPOLL;
+	}
+
+	// The sockets exist by now, they stay in the set until it is closed
+	memset(&ev,0,sizeof(struct epoll_event));
+	ev.events = EPOLLIN;
+	ev.data.u64 = RTPUDPV4TRANS_WAITABORT;
+	if (epoll_ctl(epollfd,EPOLL_CTL_ADD,abortdesc[0],&ev) < 0)
+	{
+		DestroyAbortDescriptors();
+		return ERR_RTP_UDPV4TRANS_CANTCREATEEPOLL;
+	}
+	ev.data.u64 = RTPUDPV4TRANS_WAITRTP;
+	if (epoll_ctl(epollfd,EPOLL_CTL_ADD,rtpsock,&ev) < 0)
+	{
+		DestroyAbortDescriptors();
+		return ERR_RTP_UDPV4TRANS_CANTCREATEEPOLL;
+	}
+	ev.data.u64 = RTPUDPV4TRANS_WAITRTCP;
+	if (epoll_ctl(epollfd,EPOLL_CTL_ADD,rtcpsock,&ev) < 0)
+	{
+		DestroyAbortDescriptors();
+		return ERR_RTP_UDPV4TRANS_CANTCREATEEPOLL;
+	}
+
+	for (i = 0 ; i < RTPUDPV4TRANS_MAXWAITDESCRIPTORS ; i++)
+		waitdescs[i].fd = -1;
+	return 0;
+}
+
+void RTPUDPv4Transmitter::DestroyAbortDescriptors()
+{
+	close(epollfd);
+	close(abortdesc[0]);
+}
+
 #else // in a non winsock environment we can use pipes
 
 int RTPUDPv4Transmitter::CreateAbortDescriptors()
@@ -1795,6 +2450,13 @@ void RTPUDPv4Transmitter::AbortWaitInternal()
 {
 #if (defined(WIN32) || defined(_WIN32_WCE))
 	send(abortdesc[1],"*",1,0);
+#elif defined(RTP_SUPPORT_EPOLL)
+	uint64_t one = 1;
+
+	if (write(abortdesc[1],&one,sizeof(uint64_t)))
+	{
+		// To get rid of __wur related compiler warnings
+	}
 #else
 	if (write(abortdesc[1],"*",1))
 	{
@@ -49,6 +49,10 @@
 	#include "../jthread/jmutex.h"
 #endif // RTP_SUPPORT_THREAD
 
+#ifdef RTP_SUPPORT_SENDMMSG
+	#include <sys/socket.h>
+#endif // RTP_SUPPORT_SENDMMSG
+
 #define RTPUDPV4TRANS_HASHSIZE									8317
 #define RTPUDPV4TRANS_DEFAULTPORTBASE								5000
 
@@ -57,14 +61,24 @@
 #define RTPUDPV4TRANS_RTPTRANSMITBUFFER							32768
 #define RTPUDPV4TRANS_RTCPTRANSMITBUFFER						32768
 
+#define RTPUDPV4TRANS_MAXBATCHPACKETS							16
+#define RTPUDPV4TRANS_MAXSENDMESSAGES							64
+#define RTPUDPV4TRANS_MAXSENDPARTS							2
+#define RTPUDPV4TRANS_MAXRECVMESSAGES							16
+#define RTPUDPV4TRANS_BATCHRECVSIZE								2048
+#define RTPUDPV4TRANS_MAXWAITDESCRIPTORS						8
+
 namespace jrtplib
 {
 
+/** Called by RTPUDPv4Transmitter::WaitForIncomingData for a descriptor which became readable. */
+typedef void (*RTPUDPv4TransDescriptorCallback)(int fd,void *data);
+
 /** Parameters for the UDP over IPv4 transmitter. */
 class JRTPLIB_IMPORTEXPORT RTPUDPv4TransmissionParams : public RTPTransmissionParams
 {
 public:
-	RTPUDPv4TransmissionParams():RTPTransmissionParams(RTPTransmitter::IPv4UDPProto)	{ portbase = RTPUDPV4TRANS_DEFAULTPORTBASE; bindIP = 0; multicastTTL = 1; mcastifaceIP = 0; rtpsendbuf = RTPUDPV4TRANS_RTPTRANSMITBUFFER; rtprecvbuf= RTPUDPV4TRANS_RTPRECEIVEBUFFER; rtcpsendbuf = RTPUDPV4TRANS_RTCPTRANSMITBUFFER; rtcprecvbuf = RTPUDPV4TRANS_RTCPRECEIVEBUFFER; }
+	RTPUDPv4TransmissionParams():RTPTransmissionParams(RTPTransmitter::IPv4UDPProto)	{ portbase = RTPUDPV4TRANS_DEFAULTPORTBASE; bindIP = 0; multicastTTL = 1; mcastifaceIP = 0; rtpsendbuf = RTPUDPV4TRANS_RTPTRANSMITBUFFER; rtprecvbuf= RTPUDPV4TRANS_RTPRECEIVEBUFFER; rtcpsendbuf = RTPUDPV4TRANS_RTCPTRANSMITBUFFER; rtcprecvbuf = RTPUDPV4TRANS_RTCPRECEIVEBUFFER; batchsend = true; batchrecv = true; }
 
 	/** Sets the IP address which is used to bind the sockets to \c ip. */
 	void SetBindIP(uint32_t ip)									{ bindIP = ip; }
@@ -125,6 +139,27 @@ public:
 
 	/** Returns the RTCP socket's receive buffer size. */
 	int GetRTCPReceiveBuffer() const							{ return rtcprecvbuf; }
+
+	/** Sets whether a packet is handed to the kernel once for all destinations.
+	 *  If enabled and sendmmsg is available (see RTP_SUPPORT_SENDMMSG), a packet is sent to all
+	 *  destinations by a single system call and the packets between RTPTransmitter::BeginSendBatch
+	 *  and RTPTransmitter::EndSendBatch are sent together. Otherwise every datagram is passed to sendto.
+	 */
+	void SetBatchSend(bool b)									{ batchsend = b; }
+
+	/** Returns whether packets are sent in batches if possible (default is true). */
+	bool GetBatchSend() const									{ return batchsend; }
+
+	/** Sets whether all queued datagrams are taken from a socket at once.
+	 *  If enabled and recvmmsg is available (see RTP_SUPPORT_RECVMMSG), up to RTPUDPV4TRANS_MAXRECVMESSAGES
+	 *  datagrams are received by a single system call, straight into buffers of RTPUDPV4TRANS_BATCHRECVSIZE
+	 *  bytes which the packets keep. Such a batch gets one timestamp. A larger datagram is lost, the buffers
+	 *  grow to its size for the ones after it. Otherwise every datagram is received by a call to recvfrom.
+	 */
+	void SetBatchReceive(bool b)								{ batchrecv = b; }
+
+	/** Returns whether datagrams are received in batches if possible (default is true). */
+	bool GetBatchReceive() const								{ return batchrecv; }
 private:
 	uint16_t portbase;
 	uint32_t bindIP, mcastifaceIP;
@@ -132,6 +167,7 @@ private:
 	uint8_t multicastTTL;
 	int rtpsendbuf, rtprecvbuf;
 	int rtcpsendbuf, rtcprecvbuf;
+	bool batchsend, batchrecv;
 };
 
 /** Additional information about the UDP over IPv4 transmitter. */
@@ -210,7 +246,12 @@ public:
 	int AbortWait();
 	
 	int SendRTPData(const void *data,size_t len);	
+	int SendRTPDataGather(const void *header,size_t headerlen,const void *payload,size_t payloadlen);
 	int SendRTCPData(const void *data,size_t len);
+	int SendRTPDataTo(const void *data,size_t len,const RTPAddress &addr);
+	int SendRTCPDataTo(const void *data,size_t len,const RTPAddress &addr);
+	int BeginSendBatch();
+	int EndSendBatch();
 
 	int AddDestination(const RTPAddress &addr);
 	int DeleteDestination(const RTPAddress &addr);
@@ -235,13 +276,53 @@ public:
 #ifdef RTPDEBUG
 	void Dump();
 #endif // RTPDEBUG
+
+	/** Returns the number of send system calls made so far. */
+	uint32_t GetNumberOfSendCalls() const						{ return numsendcalls; }
+
+	/** Returns the number of datagrams the kernel accepted so far. */
+	uint32_t GetNumberOfSentDatagrams() const					{ return numsentdatagrams; }
+
+#ifdef RTP_SUPPORT_EPOLL
+	/** Adds a descriptor to the ones WaitForIncomingData waits for besides the RTP and RTCP sockets.
+	 *  Once \c fd is readable the wait ends and \c callback is called with it and \c data, after the
+	 *  transmitter was unlocked. Like the sockets, the descriptor keeps ending waits until it was read.
+	 *  This way a single thread can wait for timers or other sockets as well. Up to
+	 *  RTPUDPV4TRANS_MAXWAITDESCRIPTORS can be added, they are forgotten by Destroy.
+	 */
+	int AddWaitDescriptor(int fd,RTPUDPv4TransDescriptorCallback callback,void *data);
+
+	/** Stops waiting for \c fd, do this before closing it. If another thread is waiting at the time,
+	 *  its callback may still be called once.
+	 */
+	int DeleteWaitDescriptor(int fd);
+#endif // RTP_SUPPORT_EPOLL
+
+	/** Returns the number of receive system calls made so far, including the ones checking for data. */
+	uint32_t GetNumberOfReceiveCalls() const					{ return numrecvcalls; }
+
+	/** Returns the number of datagrams received so far, including the ones which were ignored. */
+	uint32_t GetNumberOfReceivedDatagrams() const				{ return numreceiveddatagrams; }
 private:
 	int CreateLocalIPList();
 	bool GetLocalIPList_Interfaces();
 	void GetLocalIPList_DNS();
 	void AddLoopbackAddress();
 	void FlushPackets();
+	// Every packet consists of numparts consecutive entries of parts and lengths
+	void SendToDestinations(bool rtp,const void *const *parts,const size_t *lengths,int numparts,int numpackets);
+	int SendDataTo(bool rtp,const void *data,size_t len,const RTPAddress &addr);
+#ifdef RTP_SUPPORT_SENDMMSG
+	void SendMessages(int sock,struct mmsghdr *msgs,int num);
+#endif // RTP_SUPPORT_SENDMMSG
+	void FlushSendBatch();
+	void ClearSendBatch();
 	int PollSocket(bool rtp);
+#ifdef RTP_SUPPORT_RECVMMSG
+	int ReceiveMessages(bool rtp,int sock);
+#endif // RTP_SUPPORT_RECVMMSG
+	int AddReceivedPacket(bool rtp,uint8_t *data,size_t len,uint32_t srcip,uint16_t srcport,RTPTime &curtime);
+	void ClearReceiveBuffers();
 	int ProcessAddAcceptIgnoreEntry(uint32_t ip,uint16_t port);
 	int ProcessDeleteAcceptIgnoreEntry(uint32_t ip,uint16_t port);
 #ifdef RTP_SUPPORT_IPV4MULTICAST
@@ -271,11 +352,22 @@ private:
 #ifdef RTP_SUPPORT_IPV4MULTICAST
 	RTPHashTable<const uint32_t,RTPUDPv4Trans_GetHashIndex_uint32_t,RTPUDPV4TRANS_HASHSIZE> multicastgroups;
 #endif // RTP_SUPPORT_IPV4MULTICAST
-	std::list<RTPRawPacket*> rawpacketlist;
+	std::list<RTPRawPacket*,RTPSTLAllocator<RTPRawPacket*> > rawpacketlist;
 
 	bool supportsmulticasting;
 	size_t maxpacksize;
 
+	bool usesendmmsg, batching;
+	uint8_t *batchbuffer;
+	size_t batchlengths[RTPUDPV4TRANS_MAXBATCHPACKETS];
+	int batchcount;
+	uint32_t numsendcalls, numsentdatagrams;
+
+	bool userecvmmsg;
+	size_t recvbuffersize;
+	uint8_t *recvbuffers[2][RTPUDPV4TRANS_MAXRECVMESSAGES]; // for RTP and RTCP, kept until a datagram is put in
+	uint32_t numrecvcalls, numreceiveddatagrams;
+
 	class PortInfo
 	{
 	public:
@@ -293,6 +385,19 @@ private:
 #else
 	int abortdesc[2];
 #endif // WIN32
+#ifdef RTP_SUPPORT_EPOLL
+	// The interest set of the sockets, the abort descriptor and the added descriptors
+	// (unused ones have fd -1), it is created along with the abort descriptor
+	struct WaitDescriptor
+	{
+		int fd;
+		RTPUDPv4TransDescriptorCallback callback;
+		void *data;
+	};
+
+	int epollfd;
+	WaitDescriptor waitdescs[RTPUDPV4TRANS_MAXWAITDESCRIPTORS];
+#endif // RTP_SUPPORT_EPOLL
 	int CreateAbortDescriptors();
 	void DestroyAbortDescriptors();
 	void AbortWaitInternal();
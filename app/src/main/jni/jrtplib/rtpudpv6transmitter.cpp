@@ -53,6 +53,7 @@
 	#include <string.h>
 	#include <netdb.h>
 	#include <unistd.h>
+	#include <errno.h>
 
 	#ifdef RTP_HAVE_SYS_FILIO
 		#include <sys/filio.h>
@@ -80,6 +81,13 @@
 #include "rtpdebug.h"
 
 #define RTPUDPV6TRANS_MAXPACKSIZE							65535
+
+// Makes recvfrom return the full length of a datagram which did not fit
+#ifdef MSG_TRUNC
+	#define RTPUDPV6TRANS_RECVFLAGS							MSG_TRUNC
+#else
+	#define RTPUDPV6TRANS_RECVFLAGS							0
+#endif // MSG_TRUNC
 #define RTPUDPV6TRANS_IFREQBUFSIZE							8192
 
 #define RTPUDPV6TRANS_IS_MCASTADDR(x)							(x.s6_addr[0] == 0xFF)
@@ -116,10 +124,14 @@ namespace jrtplib
 RTPUDPv6Transmitter::RTPUDPv6Transmitter(RTPMemoryManager *mgr) : RTPTransmitter(mgr),
 								  destinations(GetMemoryManager(),RTPMEM_TYPE_CLASS_DESTINATIONLISTHASHELEMENT),
 								  multicastgroups(GetMemoryManager(),RTPMEM_TYPE_CLASS_MULTICASTHASHELEMENT),
+								  rawpacketlist(RTPSTLAllocator<RTPRawPacket*>(GetMemoryManager(),RTPMEM_TYPE_CLASS_LISTNODE)),
 								  acceptignoreinfo(GetMemoryManager(),RTPMEM_TYPE_CLASS_ACCEPTIGNOREHASHELEMENT)
 {
 	created = false;
 	init = false;
+	memset(recvbuffers,0,sizeof(recvbuffers));
+	numrecvcalls = 0;
+	numreceiveddatagrams = 0;
 #if (defined(WIN32) || defined(_WIN32_WCE))
 	timeinit.Dummy();
 #endif // WIN32 || _WIN32_WCE
@@ -331,6 +343,12 @@ int RTPUDPv6Transmitter::Create(size_t maximumpacketsize,const RTPTransmissionPa
 	}
 	
 	maxpacksize = maximumpacketsize;
+#ifdef RTP_SUPPORT_RECVMMSG
+	userecvmmsg = params->GetBatchReceive();
+#else
+	userecvmmsg = false;
+#endif // RTP_SUPPORT_RECVMMSG
+	recvbuffersize = RTPUDPV6TRANS_BATCHRECVSIZE;
 	portbase = params->GetPortbase();
 	multicastTTL = params->GetMulticastTTL();
 	receivemode = RTPTransmitter::AcceptAll;
@@ -370,6 +388,7 @@ void RTPUDPv6Transmitter::Destroy()
 	multicastgroups.Clear();
 #endif // RTP_SUPPORT_IPV6MULTICAST
 	FlushPackets();
+	ClearReceiveBuffers();
 	ClearAcceptIgnoreInfo();
 	localIPs.clear();
 	created = false;
@@ -746,6 +765,53 @@ int RTPUDPv6Transmitter::SendRTPData(const void *data,size_t len)
 	return 0;
 }
 
+int RTPUDPv6Transmitter::SendRTPDataGather(const void *header,size_t headerlen,const void *payload,size_t payloadlen)
+{
+#if (defined(WIN32) || defined(_WIN32_WCE))
+	// Without sendmsg the parts are sent as a copy
+	return RTPTransmitter::SendRTPDataGather(header,headerlen,payload,payloadlen);
+#else
+	struct iovec iovs[2];
+	struct msghdr msg;
+
+	if (!init)
+		return ERR_RTP_UDPV6TRANS_NOTINIT;
+
+	MAINMUTEX_LOCK
+	
+	if (!created)
+	{
+		MAINMUTEX_UNLOCK
+		return ERR_RTP_UDPV6TRANS_NOTCREATED;
+	}
+	if (headerlen+payloadlen > maxpacksize)
+	{
+		MAINMUTEX_UNLOCK
+		return ERR_RTP_UDPV6TRANS_SPECIFIEDSIZETOOBIG;
+	}
+	
+	iovs[0].iov_base = (void *)header;
+	iovs[0].iov_len = headerlen;
+	iovs[1].iov_base = (void *)payload;
+	iovs[1].iov_len = payloadlen;
+	memset(&msg,0,sizeof(struct msghdr));
+	msg.msg_iov = iovs;
+	msg.msg_iovlen = 2;
+	msg.msg_namelen = sizeof(struct sockaddr_in6);
+
+	destinations.GotoFirstElement();
+	while (destinations.HasCurrentElement())
+	{
+		msg.msg_name = (void *)destinations.GetCurrentElement().GetRTPSockAddr();
+		sendmsg(rtpsock,&msg,0);
+		destinations.GotoNextElement();
+	}
+	
+	MAINMUTEX_UNLOCK
+	return 0;
+#endif // WIN32
+}
+
 int RTPUDPv6Transmitter::SendRTCPData(const void *data,size_t len)
 {
 	if (!init)
@@ -1256,7 +1322,7 @@ bool RTPUDPv6Transmitter::SetMulticastTTL(uint8_t ttl)
 
 void RTPUDPv6Transmitter::FlushPackets()
 {
-	std::list<RTPRawPacket*>::const_iterator it;
+	std::list<RTPRawPacket*,RTPSTLAllocator<RTPRawPacket*> >::const_iterator it;
 
 	for (it = rawpacketlist.begin() ; it != rawpacketlist.end() ; ++it)
 		RTPDelete(*it,GetMemoryManager());
@@ -1267,8 +1333,8 @@ int RTPUDPv6Transmitter::PollSocket(bool rtp)
 {
 	//RTPSOCKLENTYPE fromlen;
 	socklen_t fromlen;
-	int recvlen;
-	char packetbuffer[RTPUDPV6TRANS_MAXPACKSIZE];
+	ssize_t recvlen;
+	int status;
 #if (defined(WIN32) || defined(_WIN32_WCE))
 	SOCKET sock;
 	unsigned long len;
@@ -1282,59 +1348,172 @@ int RTPUDPv6Transmitter::PollSocket(bool rtp)
 		sock = rtpsock;
 	else
 		sock = rtcpsock;
+
+#ifdef RTP_SUPPORT_RECVMMSG
+	if (userecvmmsg)
+	{
+		status = ReceiveMessages(rtp,sock);
+		if (userecvmmsg)
+			return status;
+		// recvmmsg is not available, take in the rest one by one
+	}
+#endif // RTP_SUPPORT_RECVMMSG
 	
 	len = 0;
 	RTPIOCTL(sock,FIONREAD,&len);
+	numrecvcalls++;
 	if (len <= 0)
 		return 0;
 
 	while (len > 0)
 	{
 		RTPTime curtime = RTPTime::CurrentTime();
+		uint8_t *data;
+		size_t datalen;
+
+		// The datagram is received right into the buffer the packet keeps. On Linux FIONREAD
+		// tells the size of the next datagram, elsewhere it is the size of all of them.
+		datalen = ((size_t)len < RTPUDPV6TRANS_MAXPACKSIZE)?(size_t)len:RTPUDPV6TRANS_MAXPACKSIZE;
+		data = RTPNew(GetMemoryManager(),(rtp)?RTPMEM_TYPE_BUFFER_RECEIVEDRTPPACKET:RTPMEM_TYPE_BUFFER_RECEIVEDRTCPPACKET) uint8_t[datalen];
+		if (data == 0)
+			return ERR_RTP_OUTOFMEM;
+
 		fromlen = (socklen_t) sizeof(struct sockaddr_in6);
-		recvlen = recvfrom(sock,packetbuffer,RTPUDPV6TRANS_MAXPACKSIZE,0,(struct sockaddr *)&srcaddr,&fromlen);
-		if (recvlen > 0)
+		recvlen = recvfrom(sock,(char *)data,datalen,RTPUDPV6TRANS_RECVFLAGS,(struct sockaddr *)&srcaddr,&fromlen);
+		numrecvcalls++;
+		status = 0;
+		if (recvlen >= 0)
+			numreceiveddatagrams++;
+		if (recvlen > 0 && (size_t)recvlen <= datalen) // truncated datagrams are dropped
+			status = AddReceivedPacket(rtp,data,(size_t)recvlen,srcaddr.sin6_addr,ntohs(srcaddr.sin6_port),curtime);
+		if (status <= 0) // the packet did not take the data
+			RTPDeleteByteArray(data,GetMemoryManager());
+		if (status < 0)
+			return status;
+		len = 0;
+		RTPIOCTL(sock,FIONREAD,&len);
+		numrecvcalls++;
+	}
+	return 0;
+}
+
+#ifdef RTP_SUPPORT_RECVMMSG
+int RTPUDPv6Transmitter::ReceiveMessages(bool rtp,int sock)
+{
+	uint8_t **buffers = recvbuffers[(rtp)?0:1];
+	struct mmsghdr msgs[RTPUDPV6TRANS_MAXRECVMESSAGES];
+	struct iovec iovecs[RTPUDPV6TRANS_MAXRECVMESSAGES];
+	struct sockaddr_in6 srcaddrs[RTPUDPV6TRANS_MAXRECVMESSAGES];
+	int num,i,status;
+
+	do
+	{
+		// Buffers which were not put into a packet last time are still there
+		for (i = 0 ; i < RTPUDPV6TRANS_MAXRECVMESSAGES ; i++)
 		{
-			bool acceptdata;
+			if (buffers[i] == 0)
+			{
+				buffers[i] = RTPNew(GetMemoryManager(),(rtp)?RTPMEM_TYPE_BUFFER_RECEIVEDRTPPACKET:RTPMEM_TYPE_BUFFER_RECEIVEDRTCPPACKET) uint8_t[recvbuffersize];
+				if (buffers[i] == 0)
+					return ERR_RTP_OUTOFMEM;
+			}
+			iovecs[i].iov_base = buffers[i];
+			iovecs[i].iov_len = recvbuffersize;
+			memset(&msgs[i],0,sizeof(struct mmsghdr));
+			msgs[i].msg_hdr.msg_name = &srcaddrs[i];
+			msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in6);
+			msgs[i].msg_hdr.msg_iov = &iovecs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
 
-			// got data, process it
-			if (receivemode == RTPTransmitter::AcceptAll)
-				acceptdata = true;
-			else
-				acceptdata = ShouldAcceptData(srcaddr.sin6_addr,ntohs(srcaddr.sin6_port));
-			
-			if (acceptdata)
+		num = recvmmsg(sock,msgs,RTPUDPV6TRANS_MAXRECVMESSAGES,MSG_DONTWAIT|RTPUDPV6TRANS_RECVFLAGS,0);
+		numrecvcalls++;
+		if (num < 0)
+		{
+			if (errno == ENOSYS) // the kernel is too old
 			{
-				RTPRawPacket *pack;
-				RTPIPv6Address *addr;
-				uint8_t *datacopy;
+				userecvmmsg = false;
+				ClearReceiveBuffers();
+			}
+			return 0; // nothing left, other errors are ignored like with recvfrom
+		}
 
-				addr = RTPNew(GetMemoryManager(),RTPMEM_TYPE_CLASS_RTPADDRESS) RTPIPv6Address(srcaddr.sin6_addr,ntohs(srcaddr.sin6_port));
-				if (addr == 0)
-					return ERR_RTP_OUTOFMEM;
-				datacopy = RTPNew(GetMemoryManager(),(rtp)?RTPMEM_TYPE_BUFFER_RECEIVEDRTPPACKET:RTPMEM_TYPE_BUFFER_RECEIVEDRTCPPACKET) uint8_t[recvlen];
-				if (datacopy == 0)
-				{
-					RTPDelete(addr,GetMemoryManager());
-					return ERR_RTP_OUTOFMEM;
-				}
-				memcpy(datacopy,packetbuffer,recvlen);
-				
-				pack = RTPNew(GetMemoryManager(),RTPMEM_TYPE_CLASS_RTPRAWPACKET) RTPRawPacket(datacopy,recvlen,addr,curtime,rtp,GetMemoryManager());
-				if (pack == 0)
-				{
-					RTPDelete(addr,GetMemoryManager());
-					RTPDeleteByteArray(datacopy,GetMemoryManager());
-					return ERR_RTP_OUTOFMEM;
-				}
-				rawpacketlist.push_back(pack);	
+		// All of them were there when the call returned
+		RTPTime curtime = RTPTime::CurrentTime();
+		size_t largest = 0;
+
+		for (i = 0 ; i < num ; i++)
+		{
+			size_t len = msgs[i].msg_len;
+
+			numreceiveddatagrams++;
+			if ((msgs[i].msg_hdr.msg_flags&MSG_TRUNC) || len > recvbuffersize)
+			{
+				if (len > largest)
+					largest = len;
+				continue;
 			}
+			if (len == 0)
+				continue;
+			status = AddReceivedPacket(rtp,buffers[i],len,srcaddrs[i].sin6_addr,ntohs(srcaddrs[i].sin6_port),curtime);
+			if (status < 0)
+				return status;
+			if (status > 0)
+				buffers[i] = 0; // the packet owns it now
 		}
-		len = 0;
-		RTPIOCTL(sock,FIONREAD,&len);
-	}
+
+		if (largest > recvbuffersize) // make room for the next ones of that size
+		{
+			ClearReceiveBuffers();
+			recvbuffersize = (largest < RTPUDPV6TRANS_MAXPACKSIZE)?largest:RTPUDPV6TRANS_MAXPACKSIZE;
+		}
+	} while (num == RTPUDPV6TRANS_MAXRECVMESSAGES); // there may be more
 	return 0;
 }
+#endif // RTP_SUPPORT_RECVMMSG
+
+// Returns 1 if the packet took over the data, 0 if the datagram is ignored
+int RTPUDPv6Transmitter::AddReceivedPacket(bool rtp,uint8_t *data,size_t len,const in6_addr &srcip,uint16_t srcport,RTPTime &curtime)
+{
+	RTPRawPacket *pack;
+	RTPIPv6Address *addr;
+	bool acceptdata;
+
+	if (receivemode == RTPTransmitter::AcceptAll)
+		acceptdata = true;
+	else
+		acceptdata = ShouldAcceptData(srcip,srcport);
+	if (!acceptdata)
+		return 0;
+
+	addr = RTPNew(GetMemoryManager(),RTPMEM_TYPE_CLASS_RTPADDRESS) RTPIPv6Address(srcip,srcport);
+	if (addr == 0)
+		return ERR_RTP_OUTOFMEM;
+
+	pack = RTPNew(GetMemoryManager(),RTPMEM_TYPE_CLASS_RTPRAWPACKET) RTPRawPacket(data,len,addr,curtime,rtp,GetMemoryManager());
+	if (pack == 0)
+	{
+		RTPDelete(addr,GetMemoryManager());
+		return ERR_RTP_OUTOFMEM;
+	}
+	rawpacketlist.push_back(pack);
+	return 1;
+}
+
+void RTPUDPv6Transmitter::ClearReceiveBuffers()
+{
+	for (int i = 0 ; i < 2 ; i++)
+	{
+		for (int j = 0 ; j < RTPUDPV6TRANS_MAXRECVMESSAGES ; j++)
+		{
+			if (recvbuffers[i][j])
+			{
+				RTPDeleteByteArray(recvbuffers[i][j],GetMemoryManager());
+				recvbuffers[i][j] = 0;
+			}
+		}
+	}
+}
 
 int RTPUDPv6Transmitter::ProcessAddAcceptIgnoreEntry(in6_addr ip,uint16_t port)
 {
@@ -64,6 +64,9 @@
 #define RTPUDPV6TRANS_RTPTRANSMITBUFFER							32768
 #define RTPUDPV6TRANS_RTCPTRANSMITBUFFER						32768
 
+#define RTPUDPV6TRANS_MAXRECVMESSAGES							16
+#define RTPUDPV6TRANS_BATCHRECVSIZE								2048
+
 namespace jrtplib
 {
 
@@ -71,7 +74,7 @@ namespace jrtplib
 class JRTPLIB_IMPORTEXPORT RTPUDPv6TransmissionParams : public RTPTransmissionParams
 {
 public:
-	RTPUDPv6TransmissionParams():RTPTransmissionParams(RTPTransmitter::IPv6UDPProto)	{ portbase = RTPUDPV6TRANS_DEFAULTPORTBASE; for (int i = 0 ; i < 16 ; i++) bindIP.s6_addr[i] = 0; multicastTTL = 1; mcastifidx = 0; rtpsendbuf = RTPUDPV6TRANS_RTPTRANSMITBUFFER; rtprecvbuf= RTPUDPV6TRANS_RTPRECEIVEBUFFER; rtcpsendbuf = RTPUDPV6TRANS_RTCPTRANSMITBUFFER; rtcprecvbuf = RTPUDPV6TRANS_RTCPRECEIVEBUFFER; }
+	RTPUDPv6TransmissionParams():RTPTransmissionParams(RTPTransmitter::IPv6UDPProto)	{ portbase = RTPUDPV6TRANS_DEFAULTPORTBASE; for (int i = 0 ; i < 16 ; i++) bindIP.s6_addr[i] = 0; multicastTTL = 1; mcastifidx = 0; rtpsendbuf = RTPUDPV6TRANS_RTPTRANSMITBUFFER; rtprecvbuf= RTPUDPV6TRANS_RTPRECEIVEBUFFER; rtcpsendbuf = RTPUDPV6TRANS_RTCPTRANSMITBUFFER; rtcprecvbuf = RTPUDPV6TRANS_RTCPRECEIVEBUFFER; batchrecv = true; }
 
 	/** Sets the IP address which is used to bind the sockets to \c ip. */
 	void SetBindIP(in6_addr ip)											{ bindIP = ip; }
@@ -132,6 +135,17 @@ public:
 
 	/** Returns the RTCP socket's receive buffer size. */
 	int GetRTCPReceiveBuffer() const							{ return rtcprecvbuf; }
+
+	/** Sets whether all queued datagrams are taken from a socket at once.
+	 *  If enabled and recvmmsg is available (see RTP_SUPPORT_RECVMMSG), up to RTPUDPV6TRANS_MAXRECVMESSAGES
+	 *  datagrams are received by a single system call, straight into buffers of RTPUDPV6TRANS_BATCHRECVSIZE
+	 *  bytes which the packets keep. Such a batch gets one timestamp. A larger datagram is lost, the buffers
+	 *  grow to its size for the ones after it. Otherwise every datagram is received by a call to recvfrom.
+	 */
+	void SetBatchReceive(bool b)								{ batchrecv = b; }
+
+	/** Returns whether datagrams are received in batches if possible (default is true). */
+	bool GetBatchReceive() const								{ return batchrecv; }
 private:
 	uint16_t portbase;
 	in6_addr bindIP;
@@ -140,6 +154,7 @@ private:
 	uint8_t multicastTTL;
 	int rtpsendbuf, rtprecvbuf;
 	int rtcpsendbuf, rtcprecvbuf;
+	bool batchrecv;
 };
 
 /** Additional information about the UDP over IPv6 transmitter. */
@@ -218,6 +233,7 @@ public:
 	int AbortWait();
 	
 	int SendRTPData(const void *data,size_t len);	
+	int SendRTPDataGather(const void *header,size_t headerlen,const void *payload,size_t payloadlen);
 	int SendRTCPData(const void *data,size_t len);
 
 	int AddDestination(const RTPAddress &addr);
@@ -243,6 +259,12 @@ public:
 #ifdef RTPDEBUG
 	void Dump();
 #endif // RTPDEBUG
+
+	/** Returns the number of receive system calls made so far, including the ones checking for data. */
+	uint32_t GetNumberOfReceiveCalls() const					{ return numrecvcalls; }
+
+	/** Returns the number of datagrams received so far, including the ones which were ignored. */
+	uint32_t GetNumberOfReceivedDatagrams() const				{ return numreceiveddatagrams; }
 private:
 	int CreateLocalIPList();
 	bool GetLocalIPList_Interfaces();
@@ -250,6 +272,11 @@ private:
 	void AddLoopbackAddress();
 	void FlushPackets();
 	int PollSocket(bool rtp);
+#ifdef RTP_SUPPORT_RECVMMSG
+	int ReceiveMessages(bool rtp,int sock);
+#endif // RTP_SUPPORT_RECVMMSG
+	int AddReceivedPacket(bool rtp,uint8_t *data,size_t len,const in6_addr &srcip,uint16_t srcport,RTPTime &curtime);
+	void ClearReceiveBuffers();
 	int ProcessAddAcceptIgnoreEntry(in6_addr ip,uint16_t port);
 	int ProcessDeleteAcceptIgnoreEntry(in6_addr ip,uint16_t port);
 #ifdef RTP_SUPPORT_IPV6MULTICAST
@@ -280,11 +307,16 @@ private:
 #ifdef RTP_SUPPORT_IPV6MULTICAST
 	RTPHashTable<const in6_addr,RTPUDPv6Trans_GetHashIndex_in6_addr,RTPUDPV6TRANS_HASHSIZE> multicastgroups;
 #endif // RTP_SUPPORT_IPV6MULTICAST
-	std::list<RTPRawPacket*> rawpacketlist;
+	std::list<RTPRawPacket*,RTPSTLAllocator<RTPRawPacket*> > rawpacketlist;
 
 	bool supportsmulticasting;
 	size_t maxpacksize;
 
+	bool userecvmmsg;
+	size_t recvbuffersize;
+	uint8_t *recvbuffers[2][RTPUDPV6TRANS_MAXRECVMESSAGES]; // for RTP and RTCP, kept until a datagram is put in
+	uint32_t numrecvcalls, numreceiveddatagrams;
+
 	class PortInfo
 	{
 	public:
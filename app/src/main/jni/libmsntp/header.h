@@ -14,6 +14,7 @@ No changes should be needed for any system that is even remotely like Unix. */
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <netinet/in.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -21,13 +22,7 @@ extern "C" {
 
 #define VERSION         "1.6a"         /* Just the version string */
 #define MAX_SOCKETS        10          /* Maximum number of addresses */
-
-#ifndef LOCKNAME
-    #define LOCKNAME "/etc/msntp.pid"  /* Stores the pid */
-#endif
-#ifndef SAVENAME
-    #define SAVENAME "/etc/msntp.state" /* Stores the recovery state */
-#endif
+#define COUNT_MAX          25          /* Do NOT increase this! */
 
 
 
@@ -35,50 +30,62 @@ extern "C" {
 
 #define op_client           1          /* Behave as a challenge client */
 #define op_server           2          /* Behave as a response server */
-#define op_listen           3          /* Behave as a listening client */
-#define op_broadcast        4          /* Behave as a broadcast server */
 
 extern const char *argv0;
 
-extern int verbose, operation;
-
-extern const char *lockname;
+extern void fatal (msntp_ctx *ctx, int errnum, const char *message,
+    const char *insert);
 
-extern void fatal (int errnum, const char *message, const char *insert);
+extern int run_client (msntp_ctx *ctx, const char *hostnames[], int nhosts,
+    double *server_offset);
 
+extern int run_server (msntp_ctx *ctx, int timeout);
 
 
-/* Defined in unix.c */
 
-extern void do_nothing (int seconds);
+/* Everything a client or server needs, which used to be global.  Contexts
+share nothing, so each can be used by its own thread. */
 
-extern int ftty (FILE *file);
-
-extern void set_lock (int lock);
-
-extern void log_message (const char *message);
+struct msntp_ctx {
+    int operation,                     /* op_client or op_server */
+        port,                          /* In host byte order */
+        verbose,                       /* 0 to 3, like -v, -V and -W */
+        count,                         /* Packets to require */
+        timeout,                       /* Total time for them in millisecs */
+        waiting,                       /* Per packet in millisecs */
+        attempts;                      /* Packets transmitted up to 2*count */
+    double outgoing[2*COUNT_MAX],      /* Transmission timestamps */
+        minerr,                        /* Accuracy to stop at in seconds */
+        dispersion;                    /* The source dispersion in seconds */
+    double started, successes, failures, /* Server statistics */
+        broadcasts, weeble;
+    int descriptors[MAX_SOCKETS];
+    struct sockaddr_in here[MAX_SOCKETS], there[MAX_SOCKETS];
+    int error;                         /* errno or EMSNTP_ constant */
+    const char *message;               /* Describes the EMSNTP_ constant */
+};
 
 
 
 /* Defined in internet.c */
 
-/* extern void find_address (struct in_addr *address, int *port, char *hostname,
-    int timespan); */
+/* extern int find_address (msntp_ctx *ctx, struct in_addr *address,
+    struct in_addr *anywhere, int *port, const char *hostname); */
 
 
 
 /* Defined in socket.c */
 
-extern int open_socket (int which, char *hostnames, int timespan);
+extern int open_socket (msntp_ctx *ctx, int which, const char *hostname);
 
-extern int write_socket (int which, void *packet, int length);
+extern int write_socket (msntp_ctx *ctx, int which, void *packet, int length);
 
-extern int read_socket (int which, void *packet, int length, int waiting,
-                        int *written);
+extern int read_socket (msntp_ctx *ctx, int which, void *packet, int length,
+    int waiting, int *written);
 
-extern int flush_socket (int which, int *count);
+extern int flush_socket (msntp_ctx *ctx, int which, int *count);
 
-extern int msntp_close_socket (int which);
+extern int msntp_close_socket (msntp_ctx *ctx, int which);
 
 
 
@@ -86,10 +93,9 @@ extern int msntp_close_socket (int which);
 
 extern double current_time (double offset);
 
-extern time_t convert_time (double value, int *millisecs);
-
-extern int adjust_time (double difference, int immediate, double ignore);
+extern int adjust_time (msntp_ctx *ctx, double difference, int immediate,
+    double ignore);
 
 #ifdef __cplusplus
 }
-#endif
\ No newline at end of file
+#endif
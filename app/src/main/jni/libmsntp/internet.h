@@ -2,17 +2,13 @@
     Copyright (C) 1996 The University of Cambridge
 
 This includes all of the 'Internet' headers and definitions used across
-modules, including those for handling timeouts.  No changes should be needed
-for any version of Unix with Internet (IP version 5) addressing, but would be
-for other addressing domains.  It needs <sys/socket.h> only because AF_INET is
-needed by gethostbyaddr and is defined there rather than in <netdb.h>, for some
-damn-fool reason. */
+modules.  No changes should be needed for any version of Unix with Internet (IP
+version 5) addressing, but would be for other addressing domains.  It needs
+<sys/socket.h> only because AF_INET is defined there rather than in <netdb.h>,
+for some damn-fool reason. */
 
 
 
-#include <setjmp.h>
-#include <signal.h>
-
 #include <unistd.h>
 #include <sys/types.h>
 #include <netinet/in.h>
@@ -39,8 +35,8 @@ to see whether the universal availability of 64-bit integers arrives first. */
 
 /* Defined in internet.c */
 
-int find_address (struct in_addr *address, struct in_addr *anywhere,
-    struct in_addr *everwhere, int *port, char *hostname, int timespan);
+int find_address (msntp_ctx *ctx, struct in_addr *address,
+    struct in_addr *anywhere, int *port, const char *hostname);
 
 #ifdef __cplusplus
 }
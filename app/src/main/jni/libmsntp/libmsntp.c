@@ -18,121 +18,221 @@
 
 #include <sys/time.h>
 #include <limits.h>
+#include <math.h>
 #include <stdio.h>
 #include <string.h>
-#include <assert.h>
 #include <errno.h>
 
-//extern int errno;
+/* The defaults of msntp */
+#define DEFAULT_COUNT        5
+#define DEFAULT_TIMEOUT_MS   15000
+#define DEFAULT_MINERR       0.1
 
-/* defined in main.c */
-extern int operation, verbose, action, period, count, delay, waiting;
-extern double minerr, maxerr, prompt, dispersion;
-
-extern int run_client(char *hostnames[], int nhosts, double *offset);
-extern int run_server();
-
-/* globals */
-int libmsntp_port;  /* used by internet.c; not assumed to be 16 bits */
-int libmsntp_errno;
-const char *libmsntp_strerror;
+/* used by the functions without a context */
+static msntp_ctx default_ctx;
+static int default_ctx_initialized = 0;
 
 
 /* helper functions */
 
 /**
- * Validates the hostname, stores the port, and initializes a number of msntp
- * settings.
+ * Puts a context into its initial state, with no sockets open.
  */
-void setup(char *hostname, int port) {
-    assert(hostname && strlen(hostname) > 0);
-    libmsntp_port = port;
+static void init_ctx(msntp_ctx *ctx) {
+    int k;
+
+    memset(ctx, 0, sizeof(*ctx));
+    for (k = 0; k < MAX_SOCKETS; ++k)
+        ctx->descriptors[k] = -1;
+    ctx->count = DEFAULT_COUNT;
+    ctx->timeout = DEFAULT_TIMEOUT_MS;
+    ctx->waiting = DEFAULT_TIMEOUT_MS / DEFAULT_COUNT;
+    ctx->minerr = DEFAULT_MINERR;
+    ctx->message = "no error";
+}
+
+static msntp_ctx *get_default_ctx() {
+    if (!default_ctx_initialized) {
+        init_ctx(&default_ctx);
+        default_ctx_initialized = 1;
+    }
+    return &default_ctx;
+}
 
-    action = 0;
-    minerr = 0.1;
-    maxerr = 5.0;
-    count = 5;
-    delay = 15;
-    waiting = delay / count;
-    prompt = (double)INT_MAX;
-    verbose = 0;
+/**
+ * Validates the hostname and port and stores the port. Fails if the context
+ * is a running server.
+ */
+static int setup(msntp_ctx *ctx, const char *hostname, int port) {
+    if (ctx->operation == op_server && ctx->descriptors[0] >= 0) {
+        fatal(ctx, EMSNTP_INVALID_ARGUMENT, "the context is a running server",
+              NULL);
+        return EMSNTP_INVALID_ARGUMENT;
+    }
+    if (hostname == NULL || strlen(hostname) == 0 || port < 0 || port > 65535) {
+        fatal(ctx, EMSNTP_INVALID_ARGUMENT, "invalid hostname or port", NULL);
+        return EMSNTP_INVALID_ARGUMENT;
+    }
+    ctx->port = port;
+    ctx->operation = op_client;
+    return 0;
 }
 
 /**
  * Takes a double parameter representing seconds since the epoch and returns
- * the corresponding timeval. The parameter may have a fractional part.
+ * the corresponding timeval. The parameter may have a fractional part, and may
+ * be negative, tv_usec is always from 0 to 999999.
  */
 struct timeval convert_timeval(double value) {
     struct timeval tv;
-    int millisecs;
+    double secs = floor(value);
+    long usecs = (long) ((value - secs) * 1.0e6 + 0.5);
 
-    tv.tv_sec = convert_time(value, &millisecs);
-    tv.tv_usec = millisecs;
+    if (usecs >= 1000000) {
+        usecs -= 1000000;
+        secs += 1.0;
+    }
+    tv.tv_sec = (time_t) secs;
+    tv.tv_usec = usecs;
     return tv;
 }
 
 
 /* public functions */
-int msntp_set_clock(char *hostname, int port) {
+msntp_ctx *msntp_ctx_new(void) {
+    msntp_ctx *ctx = malloc(sizeof(msntp_ctx));
+
+    if (ctx)
+        init_ctx(ctx);
+    return ctx;
+}
+
+void msntp_ctx_free(msntp_ctx *ctx) {
+    if (!ctx)
+        return;
+    msntp_ctx_stop_server(ctx);
+    free(ctx);
+}
+
+int msntp_ctx_set_client_limits(msntp_ctx *ctx, int count, int timeout_ms,
+                                double minerr) {
+    if (count < 1 || count > COUNT_MAX || timeout_ms < count || minerr <= 0.0) {
+        fatal(ctx, EMSNTP_INVALID_ARGUMENT, "client limits out of range", NULL);
+        return EMSNTP_INVALID_ARGUMENT;
+    }
+    ctx->count = count;
+    ctx->timeout = timeout_ms;
+    ctx->waiting = timeout_ms / count;
+    ctx->minerr = minerr;
+    return 0;
+}
+
+void msntp_ctx_set_verbose(msntp_ctx *ctx, int verbose) {
+    ctx->verbose = verbose;
+}
+
+int msntp_ctx_set_clock(msntp_ctx *ctx, const char *hostname, int port) {
     int ret;
     double offset;
 
-    setup(hostname, port);
-    operation = op_client;
-
-    if (ret = run_client(&hostname, 1, &offset))
+    if ((ret = setup(ctx, hostname, port)))
+        return ret;
+    if ((ret = run_client(ctx, &hostname, 1, &offset)))
         return ret;
-    return adjust_time(offset, 1, 0);
+    return adjust_time(ctx, offset, 1, 0);
 }
 
-int msntp_get_offset(char *hostname, int port, struct timeval *offset) {
+int msntp_ctx_get_offset(msntp_ctx *ctx, const char *hostname, int port,
+                         struct timeval *offset) {
     int ret;
     double offset_d;
 
-    setup(hostname, port);
-    operation = op_client;
-
-    if (ret = run_client(&hostname, 1, &offset_d))
+    if ((ret = setup(ctx, hostname, port)))
+        return ret;
+    if ((ret = run_client(ctx, &hostname, 1, &offset_d)))
         return ret;
     *offset = convert_timeval(offset_d);
     return 0;
 }
 
-int msntp_get_time(char *hostname, int port, struct timeval *server_time) {
+int msntp_ctx_get_time(msntp_ctx *ctx, const char *hostname, int port,
+                       struct timeval *server_time) {
     int ret;
     double offset;
 
-    setup(hostname, port);
-    operation = op_client;
-
-    if (ret = run_client(&hostname, 1, &offset))
+    if ((ret = setup(ctx, hostname, port)))
+        return ret;
+    if ((ret = run_client(ctx, &hostname, 1, &offset)))
         return ret;
     *server_time = convert_timeval(current_time(offset));
     return 0;
 }
 
-int msntp_start_server(int port) {
-    setup("unused", port);
-    operation = op_server;
-    return open_socket(0, NULL, delay);
+int msntp_ctx_start_server(msntp_ctx *ctx, int port) {
+    int ret;
+
+    if ((ret = setup(ctx, "unused", port)))
+        return ret;
+    ctx->operation = op_server;
+    ctx->started = current_time(0.0);
+    ctx->successes = ctx->failures = ctx->broadcasts = 0.0;
+    ctx->weeble = 1.0;
+    if ((ret = open_socket(ctx, 0, NULL)))
+        ctx->operation = 0;
+    return ret;
 }
 
-int msntp_serve() {
-    operation = op_server;
-    return run_server();
+int msntp_ctx_serve(msntp_ctx *ctx, int timeout_ms) {
+    if (ctx->operation != op_server || ctx->descriptors[0] < 0) {
+        fatal(ctx, EMSNTP_INTERNAL, "the server was not started", NULL);
+        return EMSNTP_INTERNAL;
+    }
+    return run_server(ctx, timeout_ms > 0 ? timeout_ms : 0);
 }
 
-int msntp_stop_server (void) {
-    return msntp_close_socket(0);
+int msntp_ctx_server_fd(msntp_ctx *ctx) {
+    return ctx->operation == op_server ? ctx->descriptors[0] : -1;
 }
-    
-const char *msntp_strerror() {
-    if (libmsntp_errno < 0) {
-        return libmsntp_strerror;
+
+int msntp_ctx_stop_server(msntp_ctx *ctx) {
+    if (ctx->operation != op_server)
+        return 0;
+    ctx->operation = 0;
+    return msntp_close_socket(ctx, 0);
+}
+
+const char *msntp_ctx_strerror(msntp_ctx *ctx) {
+    if (ctx->error < 0) {
+        return ctx->message;
     } else {
-        return strerror(libmsntp_errno);
+        return strerror(ctx->error);
     }
 }
 
+int msntp_set_clock(char *hostname, int port) {
+    return msntp_ctx_set_clock(get_default_ctx(), hostname, port);
+}
 
+int msntp_get_offset(char *hostname, int port, struct timeval *offset) {
+    return msntp_ctx_get_offset(get_default_ctx(), hostname, port, offset);
+}
+
+int msntp_get_time(char *hostname, int port, struct timeval *server_time) {
+    return msntp_ctx_get_time(get_default_ctx(), hostname, port, server_time);
+}
 
+int msntp_start_server(int port) {
+    return msntp_ctx_start_server(get_default_ctx(), port);
+}
+
+int msntp_serve() {
+    return msntp_ctx_serve(get_default_ctx(), 0);
+}
+
+int msntp_stop_server (void) {
+    return msntp_ctx_stop_server(get_default_ctx());
+}
+    
+const char *msntp_strerror() {
+    return msntp_ctx_strerror(get_default_ctx());
+}
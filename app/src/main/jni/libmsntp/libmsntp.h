@@ -14,6 +14,13 @@
  * EMSNTP_ constants defined immediately below. The msntp_strerror function
  * returns a human-readable string describing the last error encountered.
  *
+ * Every client or server keeps its state in an msntp_ctx. Separate contexts
+ * can be used by separate threads at the same time, e.g. a server and any
+ * number of clients in one process, but a single context must not be used by
+ * two threads at once. The functions without a context share a default one
+ * and are not thread-safe. No signals are used, timeouts are handled by
+ * waiting on non-blocking sockets.
+ *
  * To use libmsntp in your own programs, include libmsntp.h and link with
  * libmsntp.a. For more information on building libmsntp, see the README file.
  */
@@ -40,6 +47,77 @@ extern "C" {
 #define EMSNTP_NO_GOOD_RESPONSE      -16
 #define EMSNTP_NTP_INCONSISTENCY     -17
 #define EMSNTP_NTP_INSANITY          -18
+#define EMSNTP_INVALID_ARGUMENT      -19
+
+
+/**
+ * The state of one SNTP client or server.
+ */
+typedef struct msntp_ctx msntp_ctx;
+
+/**
+ * Creates a context with the default client limits, see
+ * msntp_ctx_set_client_limits. Returns NULL if out of memory.
+ */
+msntp_ctx *msntp_ctx_new(void);
+
+/**
+ * Stops the server, if it was started, and frees the context.
+ */
+void msntp_ctx_free(msntp_ctx *ctx);
+
+/**
+ * Sets how many requests a client sends, from 1 to 25, and how long it waits
+ * for their responses in total, in milliseconds. Each response is waited for
+ * up to timeout_ms / count. The client stops early once a response is accurate
+ * to within minerr seconds. The defaults are 5 requests in 15 seconds and an
+ * accuracy of 0.1 seconds.
+ */
+int msntp_ctx_set_client_limits(msntp_ctx *ctx, int count, int timeout_ms,
+                                double minerr);
+
+/**
+ * Writes diagnostics to stderr, from 0 (none, the default) to 3 (debugging).
+ */
+void msntp_ctx_set_verbose(msntp_ctx *ctx, int verbose);
+
+/**
+ * Like msntp_set_clock, msntp_get_offset and msntp_get_time, but with the
+ * given context.
+ */
+int msntp_ctx_set_clock(msntp_ctx *ctx, const char *hostname, int port);
+
+int msntp_ctx_get_offset(msntp_ctx *ctx, const char *hostname, int port,
+                         struct timeval *offset);
+
+int msntp_ctx_get_time(msntp_ctx *ctx, const char *hostname, int port,
+                       struct timeval *server_time);
+
+/**
+ * Starts an SNTP server on the port, in host byte order. A context can be a
+ * server or a client, but not both at once.
+ */
+int msntp_ctx_start_server(msntp_ctx *ctx, int port);
+
+/**
+ * Answers all the requests which have arrived, from any number of clients.
+ * Waits up to timeout_ms for the first one if there are none, 0 doesn't wait.
+ * Returns -1 if none arrived in time, 0 once they were answered.
+ */
+int msntp_ctx_serve(msntp_ctx *ctx, int timeout_ms);
+
+/**
+ * The socket of a started server, to wait for requests with poll or epoll
+ * before calling msntp_ctx_serve with a timeout of 0. -1 if not started.
+ */
+int msntp_ctx_server_fd(msntp_ctx *ctx);
+
+int msntp_ctx_stop_server(msntp_ctx *ctx);
+
+/**
+ * Describes the last error encountered with the context.
+ */
+const char *msntp_ctx_strerror(msntp_ctx *ctx);
 
 
 /**
@@ -52,7 +130,7 @@ int msntp_set_clock(char *hostname, int port);
 
 /**
  * Connects to an SNTP server and returns the difference between its clock and
- * the local clock, as a struct timeval. If positive, the server clock is ahead
+ * the local clock, as a struct timeval with tv_usec from 0 to 999999. If positive, the server clock is ahead
  * of the local clock; if negative, the server clock is behind the local clock.
  *
  * The port should be in host byte order.
@@ -75,8 +153,8 @@ int msntp_start_server(int port);
 
 /**
  * Handles incoming conections from SNTP clients. This call is non-blocking; it
- * will either accept and handle a single SNTP request, or time out and return.
- * Should only be called after msntp_start_server.
+ * will either answer the SNTP requests which arrived, or return -1 if there
+ * are none. Should only be called after msntp_start_server.
  */
 int msntp_serve();
 
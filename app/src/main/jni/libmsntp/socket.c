@@ -3,8 +3,8 @@
 
 This includes all of the code needed to handle Berkeley sockets.  It is way
 outside current POSIX, unfortunately.  It should be easy to convert to a system
-that uses another mechanism.  It does not currently use socklen_t, because
-the only system that the author uses that has it is Linux. */
+that uses another mechanism.  In libmsntp the sockets belong to a context and
+are always non-blocking, a read waits for its packet with poll(). */
 
 
 
@@ -12,6 +12,7 @@ the only system that the author uses that has it is Linux. */
 #include "internet.h"
 #include <fcntl.h>
 #include <errno.h>
+#include <poll.h>
 
 #define SOCKET
 #include "kludges.h"
@@ -19,15 +20,6 @@ the only system that the author uses that has it is Linux. */
 
 
 
-/* The code needs to set some variables during the open, for use by later
-functions. */
-
-static int initial = 1,
-    descriptors[MAX_SOCKETS];
-static struct sockaddr_in here[MAX_SOCKETS], there[MAX_SOCKETS];
-
-
-
 void display_in_hex (const void *data, int length) {
     int i;
 
@@ -37,76 +29,73 @@ void display_in_hex (const void *data, int length) {
 
 
 
-int open_socket (int which, char *hostname, int timespan) {
+int open_socket (msntp_ctx *ctx, int which, const char *hostname) {
 
 /* Locate the specified NTP server, set up a couple of addresses and open a
 socket. */
 
-    int port, k;
-    struct in_addr address, anywhere, everywhere;
+    int port, flags, ret;
+    struct in_addr address, anywhere;
 
-/* Initialise and find out the server and port number.  Note that the port
-number is in network format. */
+/* Find out the server and port number.  Note that the port number is in
+network format. */
 
-    if (initial) for (k = 0; k < MAX_SOCKETS; ++k) descriptors[k] = -1;
-    initial = 0;
-    if (which < 0 || which >= MAX_SOCKETS || descriptors[which] >= 0) {
-        fatal(EMSNTP_INTERNAL,"socket index out of range or already open",NULL);
+    if (which < 0 || which >= MAX_SOCKETS || ctx->descriptors[which] >= 0) {
+        fatal(ctx,EMSNTP_INTERNAL,"socket index out of range or already open",
+            NULL);
         return EMSNTP_INTERNAL;
     }
-    if (verbose > 2) fprintf(stderr,"Looking for the socket addresses\n");
-    find_address(&address,&anywhere,&everywhere,&port,hostname,timespan);
-    if (verbose > 2) {
+    if (ctx->verbose > 2) fprintf(stderr,"Looking for the socket addresses\n");
+    if ((ret = find_address(ctx,&address,&anywhere,&port,hostname)))
+        return ret;
+    if (ctx->verbose > 2) {
         fprintf(stderr,"Internet address: address=");
         display_in_hex(&address,sizeof(struct in_addr));
         fprintf(stderr," anywhere=");
         display_in_hex(&anywhere,sizeof(struct in_addr));
-        fprintf(stderr," everywhere=");
-        display_in_hex(&everywhere,sizeof(struct in_addr));
         fputc('\n',stderr);
     }
 
 /* Set up our own and the target addresses.  Note that the target address will
 be reset before use in server mode. */
 
-    memset(&here[which],0,sizeof(struct sockaddr_in));
-    here[which].sin_family = AF_INET;
-    here[which].sin_port =
-        (operation == op_listen || operation == op_server ? port : 0);
-    here[which].sin_addr = anywhere;
-    memset(&there[which],0,sizeof(struct sockaddr_in));
-    there[which].sin_family = AF_INET;
-    there[which].sin_port = port;
-    there[which].sin_addr = (operation == op_broadcast ? everywhere : address);
-    if (verbose > 2) {
+    memset(&ctx->here[which],0,sizeof(struct sockaddr_in));
+    ctx->here[which].sin_family = AF_INET;
+    ctx->here[which].sin_port = (ctx->operation == op_server ? port : 0);
+    ctx->here[which].sin_addr = anywhere;
+    memset(&ctx->there[which],0,sizeof(struct sockaddr_in));
+    ctx->there[which].sin_family = AF_INET;
+    ctx->there[which].sin_port = port;
+    ctx->there[which].sin_addr = address;
+    if (ctx->verbose > 2) {
         fprintf(stderr,"Initial sockets: here=");
-        display_in_hex(&here[which].sin_addr,sizeof(struct in_addr));
+        display_in_hex(&ctx->here[which].sin_addr,sizeof(struct in_addr));
         fputc('/',stderr);
-        display_in_hex(&here[which].sin_port,sizeof(here[which].sin_port));
+        display_in_hex(&ctx->here[which].sin_port,
+            sizeof(ctx->here[which].sin_port));
         fprintf(stderr," there=");
-        display_in_hex(&there[which].sin_addr,sizeof(struct in_addr));
+        display_in_hex(&ctx->there[which].sin_addr,sizeof(struct in_addr));
         fputc('/',stderr);
-        display_in_hex(&there[which].sin_port,sizeof(there[which].sin_port));
+        display_in_hex(&ctx->there[which].sin_port,
+            sizeof(ctx->there[which].sin_port));
         fputc('\n',stderr);
     }
 
-/* Allocate a local UDP socket and configure it. */
+/* Allocate a local UDP socket and configure it.  It is never closed behind our
+back, so don't leak it into child processes either. */
 
     errno = 0;
-    if ((descriptors[which] = socket(AF_INET,SOCK_DGRAM,0)) < 0 ||
-            bind(descriptors[which],(struct sockaddr *)&here[which],
-                    sizeof(here[which]))  < 0) {
-        fatal(errno,"unable to allocate socket for NTP",NULL);
-        return errno;
-    }
-    if (operation == op_broadcast) {
-        errno = 0;
-        k = setsockopt(descriptors[which],SOL_SOCKET,SO_BROADCAST,
-                (void *)&k,sizeof(k));
-        if (k != 0) {
-            fatal(errno,"unable to set permission to broadcast",NULL);
-            return errno;
-        }
+    if ((ctx->descriptors[which] = socket(AF_INET,SOCK_DGRAM,0)) < 0 ||
+            (flags = fcntl(ctx->descriptors[which],F_GETFL,0)) < 0 ||
+            fcntl(ctx->descriptors[which],F_SETFL,flags|O_NONBLOCK) == -1 ||
+            fcntl(ctx->descriptors[which],F_SETFD,FD_CLOEXEC) == -1 ||
+            bind(ctx->descriptors[which],(struct sockaddr *)&ctx->here[which],
+                    sizeof(ctx->here[which]))  < 0) {
+        ret = errno;
+        fatal(ctx,ret,"unable to allocate socket for NTP",NULL);
+        if (ctx->descriptors[which] >= 0) close(ctx->descriptors[which]);
+        ctx->descriptors[which] = -1;
+        return ret;
     }
 
     return 0;
@@ -114,22 +103,23 @@ be reset before use in server mode. */
 
 
 
-extern int write_socket (int which, void *packet, int length) {
+extern int write_socket (msntp_ctx *ctx, int which, void *packet,
+                         int length) {
 
 /* Any errors in doing this are fatal - including blocking.  Yes, this leaves a
 server vulnerable to a denial of service attack. */
 
     int k;
 
-    if (which < 0 || which >= MAX_SOCKETS || descriptors[which] < 0) {
-        fatal(EMSNTP_INTERNAL,"socket index out of range or not open",NULL);
+    if (which < 0 || which >= MAX_SOCKETS || ctx->descriptors[which] < 0) {
+        fatal(ctx,EMSNTP_INTERNAL,"socket index out of range or not open",NULL);
         return EMSNTP_INTERNAL;
     }
     errno = 0;
-    k = sendto(descriptors[which],packet,(size_t)length,0,
-            (struct sockaddr *)&there[which],sizeof(there[which]));
+    k = sendto(ctx->descriptors[which],packet,(size_t)length,0,
+            (struct sockaddr *)&ctx->there[which],sizeof(ctx->there[which]));
     if (k != length) {
-        fatal(errno,"unable to send NTP packet",NULL);
+        fatal(ctx,errno,"unable to send NTP packet",NULL);
         return errno;
     }
 
@@ -138,71 +128,79 @@ server vulnerable to a denial of service attack. */
 
 
 
-extern int read_socket (int which, void *packet, int length, int waiting,
-                        int *written) {
+extern int read_socket (msntp_ctx *ctx, int which, void *packet, int length,
+                        int waiting, int *written) {
 
 /* Read a packet and returns (in a parameter) the number of bytes written. Only
 incorrect length and timeout are not fatal. Note that in msntp, this used
-SIGALRM to handle timeouts, but in libmsntp, it uses select(). Also, a timeout
-is only set in client mode; in server mode, read_socket is non-blocking. */
+SIGALRM to handle timeouts, but in libmsntp, it waits up to 'waiting'
+milliseconds with poll(); 0 doesn't wait at all. */
 
     struct sockaddr_in scratch, *ptr;
-    int n;
+    socklen_t n;
     int k;
     int ret;
-    struct timeval timeout = { 0, 0 };
-    fd_set fd;
+    struct pollfd fd;
 
     *written = 0;
-    if (operation == op_client) {
-      timeout.tv_sec = waiting;
-    }
-
-/* Under normal circumstances, select on the socket for the given timeout. */
-
-    if (which < 0 || which >= MAX_SOCKETS || descriptors[which] < 0) {
-        fatal(EMSNTP_INTERNAL,"socket index out of range or not open",NULL);
+    if (which < 0 || which >= MAX_SOCKETS || ctx->descriptors[which] < 0) {
+        fatal(ctx,EMSNTP_INTERNAL,"socket index out of range or not open",NULL);
         return EMSNTP_INTERNAL;
     }
 
-    FD_ZERO(&fd);
-    FD_SET(descriptors[which], &fd);
+/* Try the non-blocking read first, the packet is often there already. In
+server mode, the address of the client replaces the target. */
 
-    ret = select(descriptors[which] + 1, &fd, NULL, NULL, &timeout);
-
-    if (ret == 0) {
-        if (verbose > 2)
-          fprintf(stderr,"Receive timed out\n");
-        else if (verbose > 1)
-          fprintf(stderr,"%s: receive timed out after %d seconds\n",
-                  argv0,waiting);
+    while (1) {
+        if (ctx->operation == op_server)
+            memcpy(ptr = &ctx->there[which],&ctx->here[which],
+                sizeof(struct sockaddr_in));
+        else
+            memcpy(ptr = &scratch,&ctx->there[which],
+                sizeof(struct sockaddr_in));
+        n = sizeof(struct sockaddr_in);
         errno = 0;
-        return -1;
-    } else if (ret < 0) {
-        if (verbose > 1)
-          fprintf(stderr,"select returned error: %s", strerror(errno));
-        return -1;
-    }
+        k = recvfrom(ctx->descriptors[which],packet,(size_t)length,0,
+            (struct sockaddr *)ptr,&n);
+        if (k >= 0) break;
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            fatal(ctx,errno,"unable to receive NTP packet from server",NULL);
+            return errno;
+        }
 
-/* select returned 1, so we have a packet waiting. get the packet and clear the
-   timeout, if any.  */
+/* Nothing there yet, so wait for the given timeout.  A signal restarts the
+wait, which may then take a little longer. */
 
-    if (operation == op_server)
-        memcpy(ptr = &there[which],&here[which],sizeof(struct sockaddr_in));
-    else
-        memcpy(ptr = &scratch,&there[which],sizeof(struct sockaddr_in));
-    n = sizeof(struct sockaddr_in);
-    errno = 0;
-    k = recvfrom(descriptors[which],packet,(size_t)length,0,
-        (struct sockaddr *)ptr,&n);
+        if (waiting <= 0) {
+            errno = 0;
+            return -1;
+        }
+        fd.fd = ctx->descriptors[which];
+        fd.events = POLLIN;
+        fd.revents = 0;
+        ret = poll(&fd,1,waiting);
+        if (ret == 0) {
+            if (ctx->verbose > 2)
+              fprintf(stderr,"Receive timed out\n");
+            else if (ctx->verbose > 1)
+              fprintf(stderr,"%s: receive timed out after %d millisecs\n",
+                      argv0,waiting);
+            errno = 0;
+            return -1;
+        } else if (ret < 0) {
+            if (errno == EINTR) continue;
+            if (ctx->verbose > 1)
+              fprintf(stderr,"poll returned error: %s\n",strerror(errno));
+            return -1;
+        }
+        waiting = 0;    /* The packet is there */
+    }
 
-/* Now issue some low-level diagnostics. */
+/* Now issue some low-level diagnostics.  An empty packet is just one of
+incorrect length, anyone can send it to a server. */
 
-    if (k <= 0) {
-        fatal(errno,"unable to receive NTP packet from server",NULL);
-        return errno;
-    }
-    if (verbose > 2) {
+    if (ctx->verbose > 2) {
         fprintf(stderr,"Packet of length %d received from ",k);
         display_in_hex(&ptr->sin_addr,sizeof(struct in_addr));
         fputc('/',stderr);
@@ -216,74 +214,67 @@ is only set in client mode; in server mode, read_socket is non-blocking. */
 
 
 
-extern int flush_socket (int which, int *count) {
+extern int flush_socket (msntp_ctx *ctx, int which, int *count) {
 
 /* Get rid of any outstanding input, because it may have been hanging around
 for a while.  Ignore packet length oddities and return the number of packets
 skipped. */
 
     struct sockaddr_in scratch;
-    int n;
+    socklen_t n;
     char buffer[256];
-    int flags, total = 0, k;
+    int total = 0, k;
 
     *count = 0;
 
-/* The code is the obvious. */
+/* The code is the obvious, the socket is non-blocking anyway. */
 
-    if (which < 0 || which >= MAX_SOCKETS || descriptors[which] < 0) {
-        fatal(EMSNTP_INTERNAL,"socket index out of range or not open",NULL);
+    if (which < 0 || which >= MAX_SOCKETS || ctx->descriptors[which] < 0) {
+        fatal(ctx,EMSNTP_INTERNAL,"socket index out of range or not open",NULL);
         return EMSNTP_INTERNAL;
     }
-    if (verbose > 2) fprintf(stderr,"Flushing outstanding packets\n");
-    errno = 0;
-    if ((flags = fcntl(descriptors[which],F_GETFL,0)) < 0 ||
-        fcntl(descriptors[which],F_SETFL,flags|O_NONBLOCK) == -1) {
-        fatal(errno,"unable to set non-blocking mode",NULL);
-        return errno;
-    }
+    if (ctx->verbose > 2) fprintf(stderr,"Flushing outstanding packets\n");
     while (1) {
         n = sizeof(struct sockaddr_in);
         errno = 0;
-        k = recvfrom(descriptors[which],buffer,256,0,
+        k = recvfrom(ctx->descriptors[which],buffer,256,0,
             (struct sockaddr *)&scratch,&n);
         if (k < 0) {
             if (errno == EAGAIN || errno == EWOULDBLOCK) break;
-            fatal(errno,"unable to flush socket",NULL);
+            if (errno == EINTR) continue;
+            fatal(ctx,errno,"unable to flush socket",NULL);
             return errno;
         }
         ++*count;
         total += k;
     }
-    errno = 0;
-    if (fcntl(descriptors[which],F_SETFL,flags) == -1) {
-        fatal(errno,"unable to restore blocking mode",NULL);
-        return errno;
-    }
-    if (verbose > 2)
+    if (ctx->verbose > 2)
         fprintf(stderr,"Flushed %d packets totalling %d bytes\n",*count,total);
     return 0;
 }
 
 
 
-extern int msntp_close_socket (int which) {
+extern int msntp_close_socket (msntp_ctx *ctx, int which) {
 
 /* There is little point in shielding this with a timeout, because any hangs
 are unlikely to be interruptible.  It can get called when the sockets haven't
 been opened, so ignore that case. */
 
+    int ret;
+
     if (which < 0 || which >= MAX_SOCKETS) {
-        fatal(EMSNTP_INTERNAL,"socket index out of range",NULL);
+        fatal(ctx,EMSNTP_INTERNAL,"socket index out of range",NULL);
         return EMSNTP_INTERNAL;
     }
-    if (descriptors[which] < 0) return;
+    if (ctx->descriptors[which] < 0) return 0;
     errno = 0;
-    if (close(descriptors[which])) {
-        fatal(errno,"unable to close NTP socket",NULL);
+    ret = close(ctx->descriptors[which]);
+    ctx->descriptors[which] = -1;
+    if (ret) {
+        fatal(ctx,errno,"unable to close NTP socket",NULL);
         return errno;
     }
-    descriptors[which] = -1;
 
     return 0;
 }
@@ -26,6 +26,8 @@ more than is defined by POSIX, unfortunately.  Systems that do not have the
 #include <android/log.h>
 int adjtime(const struct timeval *delta, struct timeval *olddelta) {
     //__android_log_print(ANDROID_LOG_DEBUG, "libsmntp", "You can't use adjtime on android");
+    errno = ENOSYS;
+    return -1;
 }
 #endif
 
@@ -33,36 +35,21 @@ int adjtime(const struct timeval *delta, struct timeval *olddelta) {
 double current_time (double offset) {
 
 /* Get the current UTC time in seconds since the Epoch plus an offset (usually
-the time from the beginning of the century to the Epoch!) */
+the time from the beginning of the century to the Epoch!)  This cannot fail
+with a valid argument. */
 
     struct timeval current;
 
     errno = 0;
-    if (gettimeofday(&current,NULL)) {
-        fatal(errno,"unable to read current machine/system time",NULL);
+    if (gettimeofday(&current,NULL))
         exit(errno);
-    }
     return offset+current.tv_sec+1.0e-6*current.tv_usec;
 }
 
 
 
-time_t convert_time (double value, int *millisecs) {
-
-/* Convert the time to the ANSI C form. */
-
-    time_t result = (time_t)value;
-
-    if ((*millisecs = (int)(1000.0*(value-result))) >= 1000) {
-        *millisecs = 0;
-        ++result;
-    }
-    return result;
-}
-
-
-
-int adjust_time (double difference, int immediate, double ignore) {
+int adjust_time (msntp_ctx *ctx, double difference, int immediate,
+    double ignore) {
 
 /* Adjust the current UTC time.  This is portable, even if struct timeval uses
 an unsigned long for tv_sec. */
@@ -79,7 +66,7 @@ negative, unsigned values. */
     adjust.tv_usec = (long)(MILLION_D*(difference-n));
     errno = 0;
     if (gettimeofday(&old,NULL)) {
-        fatal(errno,"unable to read machine/system time",NULL);
+        fatal(ctx,errno,"unable to read machine/system time",NULL);
         return errno;
     }
     new.tv_sec = old.tv_sec+adjust.tv_sec;
@@ -94,7 +81,7 @@ negative, unsigned values. */
 
 /* Now diagnose the situation if necessary, and perform the dirty deed. */
 
-    if (verbose > 2)
+    if (ctx->verbose > 2)
         fprintf(stderr,
             "Times: old=(%ld,%.6ld) new=(%ld,%.6ld) adjust=(%ld,%.6ld)\n",
             (long)old.tv_sec,(long)old.tv_usec,
@@ -103,25 +90,28 @@ negative, unsigned values. */
     if (immediate) {
         errno = 0;
         if (settimeofday(&new,NULL)) {
-            fatal(errno,"unable to reset current system time",NULL);
+            fatal(ctx,errno,"unable to reset current system time",NULL);
             return errno;
         }
     } else {
         errno = 0;
         if (adjtime(&adjust,&previous)) {
-            fatal(errno,"unable to adjust current system time",NULL);
+            fatal(ctx,errno,"unable to adjust current system time",NULL);
             return errno;
         }
         if (previous.tv_sec != 0 || previous.tv_usec != 0) {
             sprintf(text,"(%ld,%.6ld)",
                 (long)previous.tv_sec,(long)previous.tv_usec);
             if (previous.tv_sec+1.0e-6*previous.tv_usec > ignore) {
-                fatal(EMSNTP_INTERNAL,"outstanding time adjustment %s",text);
+                fatal(ctx,EMSNTP_INTERNAL,"outstanding time adjustment %s",
+                    text);
                 return EMSNTP_INTERNAL;
             }
-            else if (verbose)
+            else if (ctx->verbose)
                 fprintf(stderr,"%s: outstanding time adjustment %s\n",
                     argv0,text);
         }
     }
+
+    return 0;
 }
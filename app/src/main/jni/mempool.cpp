@@ -0,0 +1,149 @@
+/*
+ * mempool.cpp: Pools the memory of the jrtplib objects and packet buffers for reuse
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#include "mempool.h"
+
+#include <new>
+
+static const size_t _bufferSizes[AUDIOSYNC_POOL_CLASSES] = {
+        32, 64, 128, 256, 512, AUDIOSYNC_POOL_PACKET_SIZE
+};
+static const size_t _capacities[AUDIOSYNC_POOL_CLASSES] = {
+        AUDIOSYNC_POOL_OBJECTS, AUDIOSYNC_POOL_OBJECTS, AUDIOSYNC_POOL_OBJECTS,
+        AUDIOSYNC_POOL_LARGE_OBJECTS, AUDIOSYNC_POOL_LARGE_OBJECTS, AUDIOSYNC_POOL_PACKETS
+};
+
+PoolMemoryManager::PoolMemoryManager() : oversized(0) {
+    slabSize = 0;
+    for (size_t i = 0; i < AUDIOSYNC_POOL_CLASSES; i++) {
+        slabSize += _bufferSizes[i] * _capacities[i];
+    }
+    // Every buffer size is a multiple of the alignment new guarantees
+    slab = new uint8_t[slabSize];
+
+    uint8_t *first = slab;
+    for (size_t i = 0; i < AUDIOSYNC_POOL_CLASSES; i++) {
+        SizeClass &c = classes[i];
+        c.bufferSize = _bufferSizes[i];
+        c.capacity = _capacities[i];
+        c.first = first;
+        first += c.bufferSize * c.capacity;
+        c.next = new std::atomic<uint32_t>[c.capacity];
+        for (size_t j = 0; j < c.capacity; j++) {
+            c.next[j].store(j + 1 < c.capacity ? (uint32_t) (j + 2) : 0);
+        }
+        c.head.store(1);
+        c.live.store(0);
+        c.highWater.store(0);
+        c.fallbacks.store(0);
+    }
+}
+
+PoolMemoryManager::~PoolMemoryManager() {
+    for (size_t i = 0; i < AUDIOSYNC_POOL_CLASSES; i++) delete[] classes[i].next;
+    delete[] slab;
+}
+
+void *PoolMemoryManager::Pop(SizeClass &c) {
+    uint64_t head = c.head.load(std::memory_order_acquire);
+    while (true) {
+        uint32_t top = (uint32_t) head;
+        if (top == 0) return NULL;
+        // Might be stale if another thread took the buffer meanwhile, then the counter changed
+        uint32_t next = c.next[top - 1].load(std::memory_order_relaxed);
+        uint64_t newHead = (((head >> 32) + 1) << 32) | next;
+        if (c.head.compare_exchange_weak(head, newHead, std::memory_order_acquire,
+                                         std::memory_order_acquire)) {
+            return c.first + (size_t) (top - 1) * c.bufferSize;
+        }
+    }
+}
+
+void PoolMemoryManager::Push(SizeClass &c, uint32_t index) {
+    uint64_t head = c.head.load(std::memory_order_relaxed);
+    uint64_t newHead;
+    do {
+        c.next[index].store((uint32_t) head, std::memory_order_relaxed);
+        newHead = (((head >> 32) + 1) << 32) | (index + 1);
+    } while (!c.head.compare_exchange_weak(head, newHead, std::memory_order_release,
+                                           std::memory_order_relaxed));
+}
+
+void *PoolMemoryManager::AllocateBuffer(size_t numbytes, int memtype) {
+    size_t i = 0;
+    if (memtype == RTPMEM_TYPE_BUFFER_RECEIVEDRTPPACKET
+        || memtype == RTPMEM_TYPE_BUFFER_RECEIVEDRTCPPACKET) {
+        i = AUDIOSYNC_POOL_CLASSES - 1;
+    } else {
+        while (i < AUDIOSYNC_POOL_CLASSES - 1 && numbytes > classes[i].bufferSize) i++;
+    }
+
+    SizeClass &c = classes[i];
+    if (numbytes > c.bufferSize) {
+        oversized.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        void *buffer = Pop(c);
+        if (buffer != NULL) {
+            int64_t live = c.live.fetch_add(1, std::memory_order_relaxed) + 1;
+            int64_t highWater = c.highWater.load(std::memory_order_relaxed);
+            while (live > highWater
+                   && !c.highWater.compare_exchange_weak(highWater, live,
+                                                         std::memory_order_relaxed));
+            return buffer;
+        }
+        c.fallbacks.fetch_add(1, std::memory_order_relaxed);
+    }
+    return ::operator new(numbytes, std::nothrow);
+}
+
+void PoolMemoryManager::FreeBuffer(void *buffer) {
+    uint8_t *p = (uint8_t *) buffer;
+    if (p >= slab && p < slab + slabSize) {
+        for (size_t i = 0; i < AUDIOSYNC_POOL_CLASSES; i++) {
+            SizeClass &c = classes[i];
+            if (p < c.first + c.bufferSize * c.capacity) {
+                c.live.fetch_sub(1, std::memory_order_relaxed);
+                Push(c, (uint32_t) ((p - c.first) / c.bufferSize));
+                return;
+            }
+        }
+    }
+    ::operator delete(buffer);
+}
+
+PoolStats PoolMemoryManager::Stats(size_t sizeClass) const {
+    const SizeClass &c = classes[sizeClass];
+    PoolStats stats;
+    stats.bufferSize = c.bufferSize;
+    stats.capacity = c.capacity;
+    stats.live = c.live.load(std::memory_order_relaxed);
+    stats.highWater = c.highWater.load(std::memory_order_relaxed);
+    stats.fallbacks = c.fallbacks.load(std::memory_order_relaxed);
+    return stats;
+}
+
+PoolStats PoolMemoryManager::TotalStats() const {
+    PoolStats total = {0, 0, 0, 0, oversized.load(std::memory_order_relaxed)};
+    for (size_t i = 0; i < AUDIOSYNC_POOL_CLASSES; i++) {
+        PoolStats stats = Stats(i);
+        total.capacity += stats.capacity;
+        total.live += stats.live;
+        total.highWater += stats.highWater;
+        total.fallbacks += stats.fallbacks;
+    }
+    return total;
+}
+
+PoolMemoryManager *PoolMemoryManager::Shared() {
+    static PoolMemoryManager manager;
+    return &manager;
+}
@@ -0,0 +1,104 @@
+/*
+ * mempool.h: Pools the memory of the jrtplib objects and packet buffers for reuse
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#ifndef AUDIOSYNC_MEMPOOL_H
+#define AUDIOSYNC_MEMPOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+#include "jrtplib/rtpmemorymanager.h"
+
+// Received datagrams up to this size come from the pool, ours stay below the MTU
+#define AUDIOSYNC_POOL_PACKET_SIZE 2048
+// Enough for a full jitter buffer, the decoder queue and the receive batches of a few receivers
+#define AUDIOSYNC_POOL_PACKETS 2048
+// Below the packets, classes of 32 to 512 bytes. Each packet on its way through a session
+// comes with an address, a raw packet, the parsed packet and a list node, all of them small.
+#define AUDIOSYNC_POOL_CLASSES 6
+#define AUDIOSYNC_POOL_OBJECTS 4096
+#define AUDIOSYNC_POOL_LARGE_OBJECTS 256
+
+struct PoolStats {
+    size_t bufferSize;// 0 for the total over all classes
+    size_t capacity;
+    int64_t live;// Handed out right now
+    int64_t highWater;// Most ever live at the same time
+    uint64_t fallbacks;// Allocations which went to the heap because the class was full
+};
+
+/*
+ * Memory manager of the jrtplib sessions, every allocation they make in the steady state comes
+ * from one of a few size classes and goes back there. Allocations go to the class with the
+ * smallest buffers they fit in, the size is fixed for every object type, while received
+ * datagrams always get a buffer of the largest class. The transmitters receive each datagram
+ * straight into it, the RTPPacket parsed from it keeps using it, and deleting the packet puts
+ * it back. Anything larger, and allocations from a class which ran out, go to the heap.
+ *
+ * All buffers are allocated up front in one slab. Allocating and freeing is lock free, every
+ * class keeps its free buffers in a stack of indices tagged with a counter against ABA.
+ * A transmitter has to use the same manager as its session, the buffers change hands.
+ */
+class PoolMemoryManager : public jrtplib::RTPMemoryManager {
+public:
+    PoolMemoryManager();
+
+    ~PoolMemoryManager();
+
+    void *AllocateBuffer(size_t numbytes, int memtype);
+
+    void FreeBuffer(void *buffer);
+
+    size_t NumClasses() const {
+        return AUDIOSYNC_POOL_CLASSES;
+    }
+
+    /**
+     * @param sizeClass  from 0 to NumClasses() - 1, the buffers grow with the index
+     */
+    PoolStats Stats(size_t sizeClass) const;
+
+    /**
+     * Summed up over all classes, the high-water mark is the sum of theirs. Fallbacks include
+     * allocations larger than any buffer.
+     */
+    PoolStats TotalStats() const;
+
+    /**
+     * The manager all sessions share
+     */
+    static PoolMemoryManager *Shared();
+
+private:
+    struct SizeClass {
+        size_t bufferSize, capacity;
+        uint8_t *first;// Within the slab
+        // The next free buffer after each one, as index + 1 like the head
+        std::atomic<uint32_t> *next;
+        // Counter in the upper 32 bit, index + 1 of the first free buffer in the lower, 0 if none
+        std::atomic<uint64_t> head;
+        std::atomic<int64_t> live, highWater;
+        std::atomic<uint64_t> fallbacks;
+    };
+
+    SizeClass classes[AUDIOSYNC_POOL_CLASSES];
+    uint8_t *slab;
+    size_t slabSize;
+    std::atomic<uint64_t> oversized;
+
+    void *Pop(SizeClass &c);
+
+    void Push(SizeClass &c, uint32_t index);
+};
+
+#endif //AUDIOSYNC_MEMPOOL_H
@@ -0,0 +1,105 @@
+/*
+ * nack.cpp: Requests the retransmission of lost RTP packets
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#include "nack.h"
+
+#include <arpa/inet.h>
+
+static inline int16_t _seqDiff(uint16_t a, uint16_t b) {
+    return (int16_t) (a - b);
+}
+
+void NackTracker::Received(uint16_t seqNum, int64_t nowUs) {
+    if (!started) {
+        started = true;
+        highestSeqNum = seqNum;
+        return;
+    }
+
+    int16_t diff = _seqDiff(seqNum, highestSeqNum);
+    if (diff > 0) {
+        // Only the end of a very large gap is still useful
+        uint16_t first = (uint16_t) (highestSeqNum + 1);
+        if (diff - 1 > AUDIOSYNC_NACK_MAX_MISSING) {
+            first = (uint16_t) (seqNum - AUDIOSYNC_NACK_MAX_MISSING);
+        }
+        for (uint16_t s = first; s != seqNum; s++) {
+            Missing m = {s, nowUs, 0};
+            missing.push_back(m);
+        }
+        while (missing.size() > AUDIOSYNC_NACK_MAX_MISSING) missing.pop_front();
+        highestSeqNum = seqNum;
+        return;
+    }
+
+    // Late, reordered or the retransmission we asked for
+    for (MissingList::iterator it = missing.begin(); it != missing.end(); ++it) {
+        if (it->seqNum == seqNum) {
+            if (it->retries > 0) repaired++;
+            missing.erase(it);
+            return;
+        }
+    }
+}
+
+void NackTracker::Passed(uint16_t seqNum) {
+    while (!missing.empty() && _seqDiff(missing.front().seqNum, seqNum) <= 0) {
+        missing.pop_front();
+    }
+}
+
+size_t NackTracker::Collect(int64_t nowUs, int64_t delayUs, int64_t retryUs,
+                            audiostream_nack *entries, size_t capacity) {
+    size_t count = 0;
+    MissingList::iterator it = missing.begin();
+    while (it != missing.end()) {
+        if (nowUs - it->sinceUs < (it->retries == 0 ? delayUs : retryUs)) {
+            ++it;
+            continue;
+        }
+        if (it->retries >= AUDIOSYNC_NACK_RETRIES) {// The last request had its chance
+            it = missing.erase(it);
+            continue;
+        }
+
+        // Packets close to the one before share its entry
+        int16_t diff = count > 0 ? _seqDiff(it->seqNum, entries[count - 1].seqNum) : 0;
+        if (count > 0 && diff > 0 && diff <= 16) {
+            entries[count - 1].bitmask |= (uint16_t) (1 << (diff - 1));
+        } else if (count < capacity) {
+            entries[count].seqNum = it->seqNum;
+            entries[count].bitmask = 0;
+            count++;
+        } else {
+            break;
+        }
+        it->retries++;
+        it->sinceUs = nowUs;
+        requested++;
+        ++it;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        entries[i].seqNum = htons(entries[i].seqNum);
+        entries[i].bitmask = htons(entries[i].bitmask);
+    }
+    return count;
+}
+
+int64_t NackTracker::NextDueUs(int64_t delayUs, int64_t retryUs) {
+    int64_t dueUs = -1;
+    for (Missing &m : missing) {
+        int64_t us = m.sinceUs + (m.retries == 0 ? delayUs : retryUs);
+        if (dueUs < 0 || us < dueUs) dueUs = us;
+    }
+    return dueUs;
+}
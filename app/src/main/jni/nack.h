@@ -0,0 +1,105 @@
+/*
+ * nack.h: Requests the retransmission of lost RTP packets
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#ifndef AUDIOSYNC_NACK_H
+#define AUDIOSYNC_NACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+
+#include "apppacket.h"
+#include "jrtplib/rtpmemorymanager.h"
+
+// Sent packets the sender keeps for retransmission, about 10s of AAC
+#define AUDIOSYNC_NACK_HISTORY 512
+// Reordered packets may still come, don't ask for a packet before it is missing this long,
+// or a few times the interarrival jitter if that is longer
+#define AUDIOSYNC_NACK_DELAY_US 10000
+#define AUDIOSYNC_NACK_JITTER_FACTOR 3
+// A packet is requested this often, one round trip apart, before it is given up
+#define AUDIOSYNC_NACK_RETRIES 3
+#define AUDIOSYNC_NACK_MIN_RETRY_US 20000
+#define AUDIOSYNC_NACK_DEFAULT_RETRY_US 100000
+// Longest time a packet after a gap is held back for the retransmission to arrive
+#define AUDIOSYNC_NACK_MAX_HOLD_US 500000
+// Gaps larger than this are most likely a restart of the stream, not worth asking for
+#define AUDIOSYNC_NACK_MAX_MISSING 256
+// Entries per APP packet, well below the smallest MTU
+#define AUDIOSYNC_NACK_MAX_ENTRIES 64
+
+/*
+ * Tracks the sequence numbers which are missing from the media stream, in arrival order of
+ * the other packets, and decides which of them to request from the sender.
+ */
+class NackTracker {
+public:
+    /**
+     * @param mgr  holds the list of missing packets
+     */
+    NackTracker(jrtplib::RTPMemoryManager *mgr = NULL)
+            : missing(jrtplib::RTPSTLAllocator<Missing>(mgr, RTPMEM_TYPE_CLASS_LISTNODE)) {}
+
+    /**
+     * A packet arrived, packets skipped by it are missing from now on
+     */
+    void Received(uint16_t seqNum, int64_t nowUs);
+
+    /**
+     * The packets up to seqNum were passed on, lost or not. It's too late to ask for them.
+     */
+    void Passed(uint16_t seqNum);
+
+    /**
+     * Fills entries with the packets which are due to be requested, in network byte order.
+     * A packet is first requested once it is missing for delayUs, then again after every
+     * retryUs until AUDIOSYNC_NACK_RETRIES is reached.
+     * @return the number of entries used, at most capacity
+     */
+    size_t Collect(int64_t nowUs, int64_t delayUs, int64_t retryUs, audiostream_nack *entries,
+                   size_t capacity);
+
+    /**
+     * When Collect has something to do next, with the same delays
+     * @return -1 if no packet is missing
+     */
+    int64_t NextDueUs(int64_t delayUs, int64_t retryUs);
+
+    /**
+     * Packets asked for, every retry counts
+     */
+    uint64_t Requested() {
+        return requested;
+    }
+
+    /**
+     * Requested packets which arrived after all
+     */
+    uint64_t Repaired() {
+        return repaired;
+    }
+
+private:
+    struct Missing {
+        uint16_t seqNum;
+        int64_t sinceUs;// Missing since, or last requested at once retries > 0
+        int retries;
+    };
+    typedef std::deque<Missing, jrtplib::RTPSTLAllocator<Missing> > MissingList;
+
+    MissingList missing;// Sorted by sequence number
+    bool started = false;
+    uint16_t highestSeqNum = 0;
+    uint64_t requested = 0, repaired = 0;
+};
+
+#endif //AUDIOSYNC_NACK_H
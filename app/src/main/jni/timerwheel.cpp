@@ -0,0 +1,91 @@
+/*
+ * timerwheel.cpp: Deadlines of the network loop
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#include "timerwheel.h"
+
+TimerWheel::TimerWheel(size_t timers) : slots(AUDIOSYNC_TIMER_SLOTS), dueTicks(timers, -1) {
+    // Every timer could end up in the same slot, scheduling never allocates
+    for (std::vector<size_t> &slot : slots) slot.reserve(timers);
+}
+
+void TimerWheel::Remove(size_t id) {
+    std::vector<size_t> &slot = slots[dueTicks[id] % AUDIOSYNC_TIMER_SLOTS];
+    for (size_t i = 0; i < slot.size(); i++) {
+        if (slot[i] == id) {
+            slot[i] = slot.back();
+            slot.pop_back();
+            break;
+        }
+    }
+    dueTicks[id] = -1;
+}
+
+void TimerWheel::Schedule(size_t id, int64_t dueUs) {
+    if (dueTicks[id] >= 0) Remove(id);
+    int64_t tick = (dueUs + AUDIOSYNC_TIMER_TICK_US - 1) / AUDIOSYNC_TIMER_TICK_US;
+    // Overdue timers go into the next slot to be expired
+    if (cursorTick >= 0 && tick < cursorTick) tick = cursorTick;
+    dueTicks[id] = tick;
+    slots[tick % AUDIOSYNC_TIMER_SLOTS].push_back(id);
+}
+
+void TimerWheel::Cancel(size_t id) {
+    if (dueTicks[id] >= 0) Remove(id);
+}
+
+int64_t TimerWheel::NextDueUs() {
+    if (cursorTick >= 0) {
+        for (int64_t tick = cursorTick; tick < cursorTick + AUDIOSYNC_TIMER_SLOTS; tick++) {
+            int64_t due = -1;
+            for (size_t id : slots[tick % AUDIOSYNC_TIMER_SLOTS]) {
+                // The others are a round or more later
+                if (dueTicks[id] <= tick && (due < 0 || dueTicks[id] < due)) due = dueTicks[id];
+            }
+            if (due >= 0) return due * AUDIOSYNC_TIMER_TICK_US;
+        }
+    }
+
+    // Nothing within one revolution
+    int64_t due = -1;
+    for (int64_t tick : dueTicks) {
+        if (tick >= 0 && (due < 0 || tick < due)) due = tick;
+    }
+    return due < 0 ? -1 : due * AUDIOSYNC_TIMER_TICK_US;
+}
+
+int TimerWheel::Expire(int64_t nowUs) {
+    int64_t nowTick = nowUs / AUDIOSYNC_TIMER_TICK_US;
+    if (cursorTick < 0) {
+        cursorTick = nowTick;
+        for (int64_t tick : dueTicks) {
+            if (tick >= 0 && tick < cursorTick) cursorTick = tick;
+        }
+    }
+    // One revolution visits every slot
+    if (nowTick - cursorTick >= AUDIOSYNC_TIMER_SLOTS) {
+        cursorTick = nowTick - AUDIOSYNC_TIMER_SLOTS + 1;
+    }
+
+    for (; cursorTick <= nowTick; cursorTick++) {
+        std::vector<size_t> &slot = slots[cursorTick % AUDIOSYNC_TIMER_SLOTS];
+        for (size_t i = 0; i < slot.size(); i++) {
+            size_t id = slot[i];
+            if (dueTicks[id] <= nowTick) {
+                slot[i] = slot.back();
+                slot.pop_back();
+                dueTicks[id] = -1;
+                return (int) id;
+            }
+        }
+    }
+    return -1;
+}
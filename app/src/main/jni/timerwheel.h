@@ -0,0 +1,66 @@
+/*
+ * timerwheel.h: Deadlines of the network loop
+ *
+ * (C) Copyright 2015 Simon Grätzer
+ * Email: simon@graetzer.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#ifndef AUDIOSYNC_TIMERWHEEL_H
+#define AUDIOSYNC_TIMERWHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Deadlines are rounded up to full ticks, one revolution of the wheel spans about half a second
+#define AUDIOSYNC_TIMER_TICK_US 1000
+#define AUDIOSYNC_TIMER_SLOTS 512
+
+/*
+ * Hashed timer wheel. Every timer is identified by a small number, scheduling it again moves
+ * its deadline. Timers further away than one revolution stay in their slot for more rounds.
+ */
+class TimerWheel {
+public:
+    /**
+     * @param timers  number of timers, ids go from 0 to timers - 1
+     */
+    TimerWheel(size_t timers);
+
+    /**
+     * Sets the deadline of the timer, in monotonic microseconds
+     */
+    void Schedule(size_t id, int64_t dueUs);
+
+    void Cancel(size_t id);
+
+    bool IsScheduled(size_t id) {
+        return dueTicks[id] >= 0;
+    }
+
+    /**
+     * Time to wake up for the earliest timer, the deadline rounded up to its tick.
+     * @return -1 if no timer is scheduled
+     */
+    int64_t NextDueUs();
+
+    /**
+     * Removes one timer whose deadline passed, call it until it returns -1
+     * @return the id of the timer or -1
+     */
+    int Expire(int64_t nowUs);
+
+private:
+    std::vector<std::vector<size_t> > slots;// Ids of the timers in there
+    std::vector<int64_t> dueTicks;// Per timer, -1 if not scheduled
+    int64_t cursorTick = -1;// Slots before it were expired
+
+    void Remove(size_t id);
+};
+
+#endif //AUDIOSYNC_TIMERWHEEL_H